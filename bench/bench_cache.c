@@ -0,0 +1,68 @@
+// Compressed chunk cache against a player going back and forth between two
+// places further apart than the loaded area: every trip unloads one side and
+// loads the other. Without a cache both are generated again each time, with
+// one big enough they come back from memory. Per cache budget: time per trip,
+// chunks generated, hit rate and what the cache takes next to the world.
+//
+//   cache-bench [view_distance] [trips]
+
+#include "chunk_cache.h"
+#include "job.h"
+#include "log.h"
+#include "streamer.h"
+#include "timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SEED 1234
+
+static void run(int view_distance, int trips, uint64_t budget) {
+    struct World *world = world_create();
+    struct StreamerConfig config = streamer_default_config(view_distance, SEED);
+    config.wait_generation = true;
+    config.cache_budget = budget;
+    struct Streamer *streamer = streamer_create(world, &config);
+    if (streamer == NULL) exit(1);
+
+    // the two loaded areas do not overlap, every chunk loaded is either generated or cached.
+    // Both are generated once before the timing
+    float distance = (float) ((2 * view_distance + 4) * SECTION_SIZE);
+    streamer_update(streamer, 0.0f, 0.0f);
+    streamer_update(streamer, distance, 0.0f);
+
+    struct StreamerStats stats;
+    uint32_t generated = 0;
+    double start = timer_now();
+    for (int i=0; i<trips; i++) {
+        streamer_update(streamer, i % 2 ? distance : 0.0f, 0.0f);
+        streamer_stats(streamer, &stats);
+        generated += stats.chunks_loaded - stats.chunks_cached;
+    }
+    double elapsed = timer_now() - start;
+
+    struct ChunkCacheStats cache;
+    chunk_cache_stats(streamer_cache(streamer), &cache);
+    printf("%6.2f MB %9.1f ms %9u %7.0f%% %9.1f %9.1f %7.1fx\n", budget / (1024.0 * 1024.0),
+           elapsed * 1000.0 / trips, generated / trips, chunk_cache_hit_rate(&cache) * 100.0,
+           cache.bytes / (1024.0 * 1024.0), world_memory_usage(world) / (1024.0 * 1024.0), chunk_cache_compression(&cache));
+
+    streamer_destroy(streamer);
+    world_destroy(world);
+}
+
+int main(int argc, char **argv) {
+    int view_distance = argc > 1 ? atoi(argv[1]) : 8;
+    int trips         = argc > 2 ? atoi(argv[2]) : 6;
+
+    set_log_level(WARNING);
+    job_system_init(0);
+    printf("view distance: %d chunks, %d trips, workers: %d\n", view_distance, trips, job_worker_count());
+    printf("%9s %12s %9s %8s %9s %9s %8s\n", "budget", "per trip", "generated", "hits", "cache MB", "world MB", "ratio");
+
+    static const uint64_t budgets[] = {0, 64ull << 10, 256ull << 10, CHUNK_CACHE_BUDGET};
+    for (size_t i=0; i<sizeof(budgets) / sizeof(budgets[0]); i++) run(view_distance, trips, budgets[i]);
+
+    job_system_shutdown();
+    return 0;
+}
@@ -0,0 +1,68 @@
+// ECS benchmark: movement + gravity systems over 100k entities
+//
+//   ecs-bench [entities] [ticks] [workers]
+
+#include "ecs.h"
+#include "entity.h"
+#include "job.h"
+#include "log.h"
+#include "timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+    uint32_t entities = argc > 1 ? (uint32_t) atoi(argv[1]) : 100000;
+    uint32_t ticks    = argc > 2 ? (uint32_t) atoi(argv[2]) : 1000;
+    int workers       = argc > 3 ? atoi(argv[3]) : 0;
+
+    set_log_level(WARNING);
+    job_system_init(workers);
+
+    struct Ecs *ecs = ecs_create();
+    entity_register_components(ecs);
+
+    // a mix of archetypes like a real world: mobs and drops fall, projectiles
+    // have their own gravity, some things only move
+    ecs_mask_t moving = ECS_BIT(COMPONENT_POSITION) | ECS_BIT(COMPONENT_VELOCITY);
+    ecs_mask_t falling = moving | ECS_BIT(COMPONENT_GRAVITY);
+    srand(1);
+    for (uint32_t i=0; i<entities; i++) {
+        entity_t entity = ecs_create_entity(ecs, (i % 4 == 0) ? moving : falling);
+        struct EntityPosition *position = ecs_get(ecs, entity, COMPONENT_POSITION);
+        struct EntityVelocity *velocity = ecs_get(ecs, entity, COMPONENT_VELOCITY);
+        position->x = (float) (rand() % 1024);
+        position->y = (float) (rand() % 256);
+        position->z = (float) (rand() % 1024);
+        velocity->x = (float) (rand() % 100) / 10.0f - 5.0f;
+        velocity->z = (float) (rand() % 100) / 10.0f - 5.0f;
+
+        struct EntityGravity *gravity = ecs_get(ecs, entity, COMPONENT_GRAVITY);
+        if (gravity) gravity->scale = (i % 4 == 1) ? 0.25f : 1.0f;
+    }
+
+    const float dt = 1.0f / 20.0f;
+    // warm up the caches and the workers
+    for (int i=0; i<10; i++) {
+        system_gravity(ecs, dt);
+        system_movement(ecs, dt);
+    }
+
+    double start = timer_now();
+    for (uint32_t i=0; i<ticks; i++) {
+        system_gravity(ecs, dt);
+        system_movement(ecs, dt);
+    }
+    double elapsed = timer_now() - start;
+
+    double per_tick = elapsed / ticks;
+    printf("entities:         %u\n", ecs_entity_count(ecs));
+    printf("workers:          %d\n", job_worker_count());
+    printf("ticks:            %u\n", ticks);
+    printf("time per tick:    %.3f ms\n", per_tick * 1000.0);
+    printf("entity updates/s: %.1f M\n", (double) entities / per_tick / 1e6);
+
+    ecs_destroy(ecs);
+    job_system_shutdown();
+    return 0;
+}
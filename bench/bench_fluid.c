@@ -0,0 +1,154 @@
+// Fluid flow: a flood over terraced ground, then the drain once the sources go.
+// Sources every 12 blocks flood the whole area, a few lava ones meet the water.
+// Reports the updates and the time of the ticks against what a scan of every
+// loaded block would visit. Once drained not a drop of water must be left.
+//
+//   fluid-bench [chunks] [max ticks]
+
+#include "fluid.h"
+#include "log.h"
+#include "timer.h"
+#include "world.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define GROUND      32
+#define SPACING     12      // between two sources
+#define LAVA_EVERY  7       // one source in that many is lava
+
+struct Phase {
+    uint32_t ticks;
+    uint64_t updates, changes;
+    uint32_t max_updates;
+    double time, max_time;
+};
+
+// one terrace per chunk, 0 to 3 blocks over the ground: the water falls from one to the next
+static int32_t floor_height(int32_t x, int32_t z) {
+    return GROUND + ((x / SECTION_SIZE) * 3 + (z / SECTION_SIZE)) % 4;
+}
+
+static struct World *build_world(int chunks) {
+    struct World *world = world_create();
+    if (world == NULL) return NULL;
+    for (int cz=0; cz<chunks; cz++) {
+        for (int cx=0; cx<chunks; cx++) {
+            struct Chunk *chunk = world_create_chunk(world, cx, cz);
+            if (chunk == NULL) return NULL;
+            for (int s=0; s<GROUND / SECTION_SIZE; s++) section_fill(&chunk->sections[s], BLOCK_STONE);
+            for (int z=0; z<SECTION_SIZE; z++) {
+                for (int x=0; x<SECTION_SIZE; x++) {
+                    int32_t wx = cx * SECTION_SIZE + x, wz = cz * SECTION_SIZE + z;
+                    for (int32_t y=GROUND; y<floor_height(wx, wz); y++) world_set_block(world, wx, y, wz, BLOCK_STONE);
+                }
+            }
+        }
+    }
+    return world;
+}
+
+// sources on the ground every SPACING blocks, away from the edges of the world
+static uint32_t set_sources(struct World *world, struct Fluids *fluids, int chunks, bool place) {
+    uint32_t count = 0, i = 0;
+    int32_t extent = chunks * SECTION_SIZE;
+    for (int32_t z=SPACING / 2; z<extent; z+=SPACING) {
+        for (int32_t x=SPACING / 2; x<extent; x+=SPACING) {
+            int32_t y = floor_height(x, z);
+            block_t block = place ? (i++ % LAVA_EVERY == 0 ? BLOCK_LAVA : BLOCK_WATER) : BLOCK_AIR;
+            world_set_block(world, x, y, z, block);
+            fluid_wake(fluids, world, x, y, z);
+            count++;
+        }
+    }
+    return count;
+}
+
+struct Flood {
+    struct World *world;
+    struct Fluids *fluids;
+};
+
+// what simulation_set_block() does for the fluids, nothing else lives here
+static void set_block(void *user, int32_t x, int32_t y, int32_t z, block_t block) {
+    struct Flood *flood = user;
+    world_set_block(flood->world, x, y, z, block);
+    fluid_wake(flood->fluids, flood->world, x, y, z);
+}
+
+static void run(struct World *world, struct Fluids *fluids, uint32_t max_ticks, struct Phase *phase) {
+    struct Flood flood = {world, fluids};
+    struct FluidStats stats;
+    fluid_stats(fluids, &stats);
+    while (stats.active > 0 && phase->ticks < max_ticks) {
+        fluid_tick(fluids, world, set_block, &flood);
+        fluid_stats(fluids, &stats);
+        phase->ticks++;
+        phase->updates += stats.updates;
+        phase->changes += stats.changes;
+        phase->time += stats.tick_time;
+        if (stats.updates > phase->max_updates) phase->max_updates = stats.updates;
+        if (stats.tick_time > phase->max_time) phase->max_time = stats.tick_time;
+    }
+}
+
+static void print_phase(const char *name, const struct Phase *phase) {
+    uint32_t ticks = phase->ticks ? phase->ticks : 1;
+    printf("%-6s %6u %10llu %10llu %10.0f %8u %10.3f %8.3f %10.0f\n", name, phase->ticks,
+           (unsigned long long) phase->updates, (unsigned long long) phase->changes,
+           (double) phase->updates / ticks, phase->max_updates, phase->time * 1e3 / ticks, phase->max_time * 1e3,
+           phase->time > 0.0 ? phase->updates / phase->time : 0.0);
+}
+
+// whatever their state, or only those with one: BLOCK_AIR counts the flowing fluid
+static uint32_t count_blocks(struct World *world, int chunks, block_t block) {
+    uint32_t count = 0;
+    int32_t extent = chunks * SECTION_SIZE;
+    for (int32_t z=0; z<extent; z++) {
+        for (int32_t x=0; x<extent; x++) {
+            for (int32_t y=GROUND; y<GROUND + 8; y++) {
+                block_t found = world_get_block(world, x, y, z);
+                count += block == BLOCK_AIR ? block_has(found, BLOCK_FLAG_LIQUID) && block_state(found) != 0 : block_id(found) == block;
+            }
+        }
+    }
+    return count;
+}
+
+int main(int argc, char **argv) {
+    int chunks = argc > 1 ? atoi(argv[1]) : 16;
+    uint32_t max_ticks = argc > 2 ? (uint32_t) atoi(argv[2]) : 4000;
+    if (chunks < 1) chunks = 1;
+
+    set_log_level(WARNING);
+    struct World *world = build_world(chunks);
+    struct Fluids *fluids = fluid_create();
+    if (world == NULL || fluids == NULL) return EXIT_FAILURE;
+
+    uint64_t scan = (uint64_t) chunks * chunks * SECTION_SIZE * SECTION_SIZE * WORLD_HEIGHT;
+    uint32_t stone = count_blocks(world, chunks, BLOCK_STONE);
+    uint32_t sources = set_sources(world, fluids, chunks, true);
+    printf("%d x %d chunks, %u sources, a scan of the loaded blocks visits %llu per tick\n",
+           chunks, chunks, sources, (unsigned long long) scan);
+    printf("phase   ticks    updates    changes  upd/tick  max upd   ms/tick   max ms    upd/s\n");
+
+    struct Phase flood = {0};
+    run(world, fluids, max_ticks, &flood);
+    print_phase("flood", &flood);
+    printf("  flooded: %u water, %u lava, %u stone where they met, %u flowing cells\n",
+           count_blocks(world, chunks, BLOCK_WATER), count_blocks(world, chunks, BLOCK_LAVA),
+           count_blocks(world, chunks, BLOCK_STONE) - stone, count_blocks(world, chunks, BLOCK_AIR));
+
+    struct Phase drain = {0};
+    set_sources(world, fluids, chunks, false);
+    run(world, fluids, max_ticks, &drain);
+    print_phase("drain", &drain);
+    struct FluidStats stats;
+    fluid_stats(fluids, &stats);
+    uint32_t left = count_blocks(world, chunks, BLOCK_WATER) + count_blocks(world, chunks, BLOCK_LAVA);
+    printf("  left after the drain: %u fluid blocks, %u active\n", left, stats.active);
+
+    fluid_destroy(fluids);
+    world_destroy(world);
+    return left == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
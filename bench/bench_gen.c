@@ -0,0 +1,109 @@
+// Staged world generation: throughput and latency of each generator stage,
+// then the same square filled by worldgen_fill_chunk(), which works the
+// neighbors' trees out again for every chunk. Both must give the same blocks.
+//
+//   gen-bench [radius] [workers]
+
+#include "generator.h"
+#include "job.h"
+#include "log.h"
+#include "timer.h"
+#include "worldgen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SEED 1234
+
+static struct Chunk **chunks;
+
+static void fill_job(void *ctx, uint32_t begin, uint32_t end) {
+    (void) ctx;
+    for (uint32_t i=begin; i<end; i++) worldgen_fill_chunk(chunks[i], SEED);
+}
+
+static bool same_blocks(const struct Chunk *a, const struct Chunk *b) {
+    for (int s=0; s<CHUNK_SECTIONS; s++) {
+        for (int y=0; y<SECTION_SIZE; y++) {
+            for (int z=0; z<SECTION_SIZE; z++) {
+                for (int x=0; x<SECTION_SIZE; x++) {
+                    if (section_get(&a->sections[s], x, y, z) != section_get(&b->sections[s], x, y, z)) return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int radius  = argc > 1 ? atoi(argv[1]) : 16;
+    int workers = argc > 2 ? atoi(argv[2]) : 0;
+    if (radius < 0) radius = 0;
+
+    set_log_level(WARNING);
+    job_system_init(workers);
+    uint32_t side = (uint32_t) (2 * radius + 1);
+    uint32_t count = side * side;
+    printf("%u chunks (radius %d), workers: %d\n", count, radius, job_worker_count());
+
+    // staged, nearest chunks first
+    struct World *staged = world_create();
+    struct Generator *generator = generator_create(SEED);
+    if (staged == NULL || generator == NULL) return EXIT_FAILURE;
+    double start = timer_now();
+    for (int32_t z=-radius; z<=radius; z++) {
+        for (int32_t x=-radius; x<=radius; x++) {
+            generator_request(generator, x, z, (uint32_t) (x * x + z * z));
+        }
+    }
+    generator_flush(generator);
+    for (int32_t z=-radius; z<=radius; z++) {
+        for (int32_t x=-radius; x<=radius; x++) {
+            struct Chunk *chunk = generator_take(generator, x, z);
+            if (chunk != NULL) world_insert_chunk(staged, chunk);
+        }
+    }
+    double staged_time = timer_now() - start;
+
+    struct GeneratorStats stats;
+    generator_stats(generator, &stats);
+    printf("staged          %7.1f ms, %6.0f chunks/s\n", staged_time * 1e3, count / staged_time);
+    printf("  stage       chunks   us/chunk  chunks/s/worker  latency mean   max\n");
+    for (int s=GEN_STAGE_NOISE; s<GEN_STAGE_COUNT; s++) {
+        const struct GenStageStats *stage = &stats.stages[s];
+        if (stage->chunks == 0) continue;
+        printf("  %-9s %8llu %10.1f %16.0f %10.2f ms %5.1f ms\n", gen_stage_name((enum gen_stage) s),
+               (unsigned long long) stage->chunks, stage->run_time * 1e6 / stage->chunks, stage->chunks / stage->run_time,
+               stage->latency * 1e3 / stage->chunks, stage->max_latency * 1e3);
+    }
+    // the cached stages go once no requested chunk needs them
+    generator_update(generator);
+    generator_stats(generator, &stats);
+    printf("  cached after taking every chunk: %u\n", stats.cached);
+    generator_destroy(generator);
+
+    // one function per chunk
+    struct World *whole = world_create();
+    chunks = malloc(count * sizeof(*chunks));
+    if (whole == NULL || chunks == NULL) return EXIT_FAILURE;
+    for (uint32_t i=0; i<count; i++) {
+        chunks[i] = world_create_chunk(whole, (int32_t) (i % side) - radius, (int32_t) (i / side) - radius);
+    }
+    start = timer_now();
+    job_parallel_for(count, 4, fill_job, NULL);
+    double whole_time = timer_now() - start;
+    printf("per chunk       %7.1f ms, %6.0f chunks/s\n", whole_time * 1e3, count / whole_time);
+
+    uint32_t different = 0;
+    for (uint32_t i=0; i<count; i++) {
+        const struct Chunk *a = world_get_chunk(staged, chunks[i]->x, chunks[i]->z);
+        if (a == NULL || !same_blocks(a, chunks[i])) different++;
+    }
+    printf("different chunks: %u\n", different);
+
+    free(chunks);
+    world_destroy(whole);
+    world_destroy(staged);
+    job_system_shutdown();
+    return different == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,81 @@
+// Mesh size at a long view distance, everything at full detail versus LOD
+//
+//   lod-bench [view_distance] [workers]
+
+#include "job.h"
+#include "log.h"
+#include "streamer.h"
+#include "timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SEED 1234
+#define WALK 16     // chunks walked after the first load
+
+static void run(int view_distance, bool lod) {
+    struct World *world = world_create();
+    struct StreamerConfig config = streamer_default_config(view_distance, SEED);
+    config.lod = lod;
+    config.wait_generation = true;
+    struct Streamer *streamer = streamer_create(world, &config);
+    if (streamer == NULL) exit(1);
+
+    double start = timer_now();
+    streamer_update(streamer, 0.0f, 0.0f);
+    double load = timer_now() - start;
+
+    struct StreamerStats stats;
+    streamer_stats(streamer, &stats);
+    uint64_t vertices = 0;
+    for (int i=0; i<LOD_COUNT; i++) vertices += stats.vertices[i];
+
+    printf("%s\n", lod ? "LOD" : "full detail");
+    printf("  chunks loaded     %u\n", stats.chunks_loaded);
+    for (int i=0; i<LOD_COUNT; i++) {
+        if (stats.chunks_drawn[i] == 0) continue;
+        printf("  LOD %d             %5u chunks %10llu vertices\n", i, stats.chunks_drawn[i], (unsigned long long) stats.vertices[i]);
+    }
+    printf("  vertices          %llu\n", (unsigned long long) vertices);
+    printf("  vertex memory     %.1f MB\n", stats.vertex_bytes / (1024.0 * 1024.0));
+    printf("  first load        %.0f ms\n", load * 1000.0);
+
+    // walking in a straight line: the ring shifts and the LOD bands move with the player
+    uint32_t remeshed = 0;
+    start = timer_now();
+    for (int i=1; i<=WALK; i++) {
+        streamer_update(streamer, (float) (i * SECTION_SIZE), 0.0f);
+        streamer_stats(streamer, &stats);
+        remeshed += stats.chunks_meshed;
+    }
+    double walk = timer_now() - start;
+    printf("  per chunk walked  %.1f ms, %u chunks meshed\n", walk * 1000.0 / WALK, remeshed / WALK);
+
+    // what the GPU memory budget callback does to the meshes
+    for (int pressure=MEMORY_PRESSURE_HIGH; pressure<=MEMORY_PRESSURE_CRITICAL; pressure++) {
+        streamer_memory_pressure(streamer, pressure);
+        streamer_update(streamer, (float) (WALK * SECTION_SIZE), 0.0f);
+        streamer_stats(streamer, &stats);
+        printf("  %-8s pressure  %.1f MB of vertices, %u chunks meshed\n", pressure == MEMORY_PRESSURE_HIGH ? "high" : "critical",
+               stats.vertex_bytes / (1024.0 * 1024.0), stats.chunks_meshed);
+    }
+
+    streamer_destroy(streamer);
+    world_destroy(world);
+}
+
+int main(int argc, char **argv) {
+    int view_distance = argc > 1 ? atoi(argv[1]) : 32;
+    int workers       = argc > 2 ? atoi(argv[2]) : 0;
+
+    set_log_level(WARNING);
+    job_system_init(workers);
+    printf("view distance: %d chunks, workers: %d, vertex size %u bytes\n",
+           view_distance, job_worker_count(), (unsigned) sizeof(struct BlockVertex));
+
+    run(view_distance, false);
+    run(view_distance, true);
+
+    job_system_shutdown();
+    return 0;
+}
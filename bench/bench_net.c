@@ -0,0 +1,210 @@
+// Loopback test of the client/server protocol: a server and a client in one
+// process talking over TCP on 127.0.0.1. Measures the join, the entity
+// updates while standing among the entities, then a fast flight across fresh
+// terrain, and checks the client ends up with the same blocks as the server.
+// While idle blocks change around the spawn, the client gets the sections again.
+//
+//   net-bench [view_distance] [entities] [speed blocks/s]
+
+#include "entity.h"
+#include "job.h"
+#include "log.h"
+#include "net.h"
+#include "net_client.h"
+#include "net_server.h"
+#include "simulation.h"
+#include "timer.h"
+#include "worldgen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SEED 1234
+#define JOIN_TIMEOUT 2000       // ticks
+#define IDLE_TICKS 100          // standing among the entities
+#define FLIGHT_TICKS 400        // 20 s of game time
+#define SPAWN_RADIUS 3          // chunks kept around the entities
+#define EDITS_PER_TICK 20       // blocks changed around the spawn while idle
+
+static void spawn_entities(struct Simulation *simulation, uint32_t count) {
+    ecs_mask_t mask = ECS_BIT(COMPONENT_POSITION) | ECS_BIT(COMPONENT_VELOCITY) |
+                      ECS_BIT(COMPONENT_GRAVITY) | ECS_BIT(COMPONENT_COLLIDER);
+    srand(SEED);
+    for (uint32_t i=0; i<count; i++) {
+        entity_t entity = ecs_create_entity(simulation->ecs, mask);
+        struct EntityPosition *position = ecs_get(simulation->ecs, entity, COMPONENT_POSITION);
+        struct EntityVelocity *velocity = ecs_get(simulation->ecs, entity, COMPONENT_VELOCITY);
+        struct EntityGravity *gravity = ecs_get(simulation->ecs, entity, COMPONENT_GRAVITY);
+        struct EntityCollider *collider = ecs_get(simulation->ecs, entity, COMPONENT_COLLIDER);
+        position->x = (float) rand() / RAND_MAX * 96.0f - 48.0f;
+        position->z = (float) rand() / RAND_MAX * 96.0f - 48.0f;
+        position->y = (float) worldgen_height((int32_t) position->x, (int32_t) position->z, SEED) + 1.0f;
+        // a quarter of them walk around, the rest stand still
+        if (i % 4 == 0) {
+            velocity->x = (float) rand() / RAND_MAX * 4.0f - 2.0f;
+            velocity->z = (float) rand() / RAND_MAX * 4.0f - 2.0f;
+        }
+        gravity->scale = 1.0f;
+        collider->half_width = 0.3f;
+        collider->height = 1.8f;
+    }
+}
+
+static uint32_t compare_worlds(struct World *server, struct World *client) {
+    uint32_t mismatches = 0, cursor = 0;
+    struct Chunk *chunk;
+    while ((chunk = world_next_chunk(client, &cursor)) != NULL) {
+        struct Chunk *reference = world_get_chunk(server, chunk->x, chunk->z);
+        if (reference == NULL) {
+            mismatches++;
+            continue;
+        }
+        bool same = true;
+        for (int s=0; s<CHUNK_SECTIONS && same; s++) {
+            for (int i=0; i<SECTION_VOLUME && same; i++) {
+                int x = i & SECTION_MASK, z = (i >> SECTION_SHIFT) & SECTION_MASK, y = i >> (2 * SECTION_SHIFT);
+                same = section_get(&chunk->sections[s], x, y, z) == section_get(&reference->sections[s], x, y, z);
+            }
+        }
+        if (!same) mismatches++;
+    }
+    return mismatches;
+}
+
+// one game tick on both ends
+static bool step(struct Simulation *simulation, struct NetServer *server, struct NetClient *client, float x, float y, float z) {
+    simulation_tick(simulation);
+    net_server_tick(server);
+    if (simulation->tick % TICKS_PER_SECOND == 0) net_server_unload_chunks(server, SPAWN_RADIUS);
+    return net_client_update(client, x, y, z);
+}
+
+int main(int argc, char **argv) {
+    int view_distance = argc > 1 ? atoi(argv[1]) : 12;
+    uint32_t entities = argc > 2 ? (uint32_t) atoi(argv[2]) : 2000;
+    float speed       = argc > 3 ? (float) atof(argv[3]) : 40.0f;
+
+    set_log_level(WARNING);
+    if (!net_init()) return 1;
+    job_system_init(0);
+
+    struct Simulation *simulation = simulation_create(SEED);
+    spawn_entities(simulation, entities);
+    struct NetServerConfig config = net_server_default_config();
+    config.port = 0;
+    config.max_view_distance = view_distance;
+    struct NetServer *server = net_server_create(simulation, &config);
+    if (server == NULL) return 1;
+
+    struct World *client_world = world_create();
+    struct NetClient *client = net_client_connect("127.0.0.1", net_server_port(server), client_world, view_distance);
+    if (client == NULL) return 1;
+
+    uint32_t expected = 0;
+    for (int dz=-view_distance; dz<=view_distance; dz++) {
+        for (int dx=-view_distance; dx<=view_distance; dx++) {
+            if (dx * dx + dz * dz <= view_distance * view_distance) expected++;
+        }
+    }
+    printf("view distance %d (%u chunks), %u entities, budget %u KB/tick\n",
+           view_distance, expected, entities, config.chunk_bytes_per_tick / 1024);
+
+    // join: everything in view arrives
+    float x = 0.5f, y = 100.0f, z = 0.5f;
+    struct NetClientStats client_stats;
+    struct NetServerStats server_stats;
+    double start = timer_now();
+    double worst = 0.0;
+    int ticks = 0;
+    do {
+        double tick_start = timer_now();
+        if (!step(simulation, server, client, x, y, z)) {
+            printf("disconnected\n");
+            return 1;
+        }
+        if (timer_now() - tick_start > worst) worst = timer_now() - tick_start;
+        net_client_stats(client, &client_stats);
+        ticks++;
+    } while (client_stats.chunks_received < expected && ticks < JOIN_TIMEOUT);
+    double elapsed = timer_now() - start;
+    net_server_stats(server, &server_stats);
+
+    printf("join\n");
+    printf("  %d ticks (%.2f s of game time), %.0f ms wall, %.1f ms the longest tick\n", ticks,
+           (double) ticks / TICKS_PER_SECOND, elapsed * 1000.0, worst * 1000.0);
+    printf("  %llu chunks, %.2f KB per chunk on the wire\n", (unsigned long long) server_stats.chunks_sent,
+           server_stats.chunk_bytes / 1024.0 / (double) server_stats.chunks_sent);
+    printf("  %.2f MB sent, %.1f MB/s wall\n", server_stats.bytes_sent / 1048576.0, server_stats.bytes_sent / 1048576.0 / elapsed);
+
+    // standing at spawn: the entities move and blocks change here and there
+    struct NetServerStats before = server_stats;
+    srand(SEED);
+    for (int i=0; i<IDLE_TICKS; i++) {
+        for (int e=0; e<EDITS_PER_TICK; e++) {
+            int32_t bx = rand() % (2 * view_distance * SECTION_SIZE) - view_distance * SECTION_SIZE;
+            int32_t bz = rand() % (2 * view_distance * SECTION_SIZE) - view_distance * SECTION_SIZE;
+            simulation_set_block(simulation, bx, worldgen_height(bx, bz, SEED) + 1, bz, e % 2 ? BLOCK_GLASS : BLOCK_LOG);
+        }
+        step(simulation, server, client, x, y, z);
+    }
+    // the last changes land, the random ticks may still change a few blocks meanwhile
+    for (int i=0; i<4; i++) {
+        net_server_tick(server);
+        net_client_update(client, x, y, z);
+    }
+    uint32_t edited = compare_worlds(simulation->world, client_world);
+    net_server_stats(server, &server_stats);
+
+    // what a full snapshot of the same entities would cost
+    const struct Snapshot *snapshot = net_client_entities(client);
+    struct Buffer full = {0};
+    if (snapshot != NULL) protocol_write_entities(&full, snapshot, NULL);
+    printf("idle at spawn\n");
+    printf("  %u entities in view, %.2f KB per tick, %.2f KB per tick without the deltas\n",
+           snapshot ? snapshot->count : 0,
+           (server_stats.entity_bytes - before.entity_bytes) / 1024.0 / IDLE_TICKS, full.size / 1024.0);
+    printf("  %d block changes per tick: %.1f sections, %.2f KB per tick\n", EDITS_PER_TICK,
+           (double) (server_stats.sections_sent - before.sections_sent) / IDLE_TICKS,
+           (server_stats.section_bytes - before.section_bytes) / 1024.0 / IDLE_TICKS);
+    printf("  check: %u chunks mismatching after the changes\n", edited);
+    buffer_free(&full);
+
+    // fast flight over new terrain
+    before = server_stats;
+    net_client_stats(client, &client_stats);
+    uint64_t chunks_before = client_stats.chunks_received;
+    start = timer_now();
+    for (int i=0; i<FLIGHT_TICKS; i++) {
+        x += speed * TICK_DT;
+        step(simulation, server, client, x, y, z);
+    }
+    elapsed = timer_now() - start;
+    // let the last packets land
+    for (int i=0; i<4; i++) {
+        net_server_tick(server);
+        net_client_update(client, x, y, z);
+    }
+    net_server_stats(server, &server_stats);
+    net_client_stats(client, &client_stats);
+
+    double game_seconds = (double) FLIGHT_TICKS / TICKS_PER_SECOND;
+    uint64_t sent = server_stats.bytes_sent - before.bytes_sent;
+    printf("flight at %.0f blocks/s\n", speed);
+    printf("  %.1f chunks/s, %.1f KB/s of game time, %.1f MB/s wall\n",
+           (client_stats.chunks_received - chunks_before) / game_seconds,
+           sent / 1024.0 / game_seconds, sent / 1048576.0 / elapsed);
+
+    printf("  server: %u chunks loaded, %llu unloaded, %u still generating\n", world_chunk_count(simulation->world),
+           (unsigned long long) server_stats.chunks_unloaded, server_stats.generating);
+
+    uint32_t mismatches = compare_worlds(simulation->world, client_world);
+    printf("check: %u chunks on the client, %u mismatching\n", world_chunk_count(client_world), mismatches);
+
+    net_client_destroy(client);
+    net_server_destroy(server);
+    world_destroy(client_world);
+    simulation_destroy(simulation);
+    job_system_shutdown();
+    net_shutdown();
+    return mismatches == 0 && edited == 0 ? 0 : 1;
+}
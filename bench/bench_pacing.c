@@ -0,0 +1,84 @@
+// Frame pacing against a simulated GPU: the loop of window.c with the
+// simulation as busy CPU time and draw_frame() waiting for the previous frame,
+// one frame in flight like the renderer. Frame time and latency (input sampled
+// to the GPU done) of each pacing setting:
+//  - GPU bound, normal then low latency: the input should be sampled later
+//    for the same frame rate
+//  - CPU bound with jittery frames, uncapped then capped below the average:
+//    the frame times should even out
+//
+//   pacing-bench [frames]
+
+#include "log.h"
+#include "pacing.h"
+#include "timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct Scenario {
+    const char *name;
+    double cpu, cpu_jitter;     // seconds
+    double gpu, gpu_jitter;
+    enum latency_mode latency_mode;
+    double fps_cap;
+};
+
+static double jitter(double value, double amount) {
+    return value + amount * (2.0 * rand() / RAND_MAX - 1.0);
+}
+
+static void busy(double seconds) {
+    double end = timer_now() + seconds;
+    while (timer_now() < end) {}
+}
+
+static void run(const struct Scenario *scenario, uint32_t frames) {
+    struct FramePacer pacer;
+    pacer_init(&pacer, PRESENT_MODE_MAILBOX, scenario->latency_mode, scenario->fps_cap);
+    double gpu_done = 0.0;      // of the frame on the GPU
+    double waited = 0.0, delay = 0.0;
+    srand(7);
+    for (uint32_t f=0; f<frames; f++) {
+        pacer_begin_frame(&pacer);
+        busy(jitter(scenario->cpu, scenario->cpu_jitter));
+
+        // draw_frame(): the fence of the previous frame, then the submit
+        double wait_start = timer_now();
+        if (gpu_done > wait_start) {
+            if (gpu_done - wait_start > PACING_SPIN) timer_sleep(gpu_done - wait_start - PACING_SPIN);
+            while (timer_now() < gpu_done) {}
+        }
+        double now = timer_now();
+        double wait = now - wait_start;
+        // the renderer estimates when the GPU was done, here it is known
+        pacer_end_frame(&pacer, wait, f > 0 && gpu_done < now ? gpu_done : now);
+        gpu_done = now + jitter(scenario->gpu, scenario->gpu_jitter);
+        waited += wait;
+        delay += pacer.delay;
+    }
+
+    const struct PacingStats *times = &pacer.frame_times[PRESENT_MODE_MAILBOX][scenario->latency_mode];
+    const struct PacingStats *latency = &pacer.latencies[PRESENT_MODE_MAILBOX][scenario->latency_mode];
+    printf("%-22s %7.2f %7.2f %7.2f %9.2f %7.2f %7.2f %7.2f\n", scenario->name,
+           times->mean * 1e3, pacing_stats_deviation(times) * 1e3, times->max * 1e3,
+           latency->mean * 1e3, pacing_stats_deviation(latency) * 1e3,
+           waited * 1e3 / frames, delay * 1e3 / frames);
+}
+
+int main(int argc, char **argv) {
+    uint32_t frames = argc > 1 ? (uint32_t) atoi(argv[1]) : 300;
+    if (frames < 2) frames = 2;
+    set_log_level(WARNING);
+
+    static const struct Scenario scenarios[] = {
+        {"gpu bound",              0.003, 0.0005, 0.012, 0.001, LATENCY_MODE_NORMAL, 0.0},
+        {"gpu bound, low latency", 0.003, 0.0005, 0.012, 0.001, LATENCY_MODE_LOW,    0.0},
+        {"cpu bound",              0.007, 0.006,  0.002, 0.0,   LATENCY_MODE_NORMAL, 0.0},
+        {"cpu bound, 60 fps cap",  0.007, 0.006,  0.002, 0.0,   LATENCY_MODE_NORMAL, 60.0},
+    };
+    printf("%u frames each                 frame ms                latency ms   wait ms delay ms\n", frames);
+    printf("%-22s %7s %7s %7s %9s %7s\n", "", "avg", "dev", "max", "avg", "dev");
+    for (size_t i=0; i<sizeof(scenarios) / sizeof(scenarios[0]); i++) run(&scenarios[i], frames);
+    return EXIT_SUCCESS;
+}
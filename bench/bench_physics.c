@@ -0,0 +1,103 @@
+// Physics benchmark: terrain sweep + entity broadphase, 10k and 100k entities
+//
+//   physics-bench [ticks] [workers]
+
+#include "ecs.h"
+#include "entity.h"
+#include "job.h"
+#include "log.h"
+#include "physics.h"
+#include "timer.h"
+#include "world.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WORLD_CHUNKS 32     // 512x512 blocks
+#define GROUND_LEVEL 64
+
+// flat ground with a few pillars and steps to collide with
+static struct World *build_world() {
+    struct World *world = world_create();
+    srand(7);
+    for (int cx=0; cx<WORLD_CHUNKS; cx++) {
+        for (int cz=0; cz<WORLD_CHUNKS; cz++) {
+            struct Chunk *chunk = world_create_chunk(world, cx, cz);
+            for (int s=0; s<GROUND_LEVEL / SECTION_SIZE; s++) {
+                section_fill(&chunk->sections[s], BLOCK_STONE);
+            }
+            for (int i=0; i<24; i++) {
+                int x = cx * SECTION_SIZE + rand() % SECTION_SIZE;
+                int z = cz * SECTION_SIZE + rand() % SECTION_SIZE;
+                int h = 1 + rand() % 4;
+                for (int y=0; y<h; y++) {
+                    world_set_block(world, x, GROUND_LEVEL + y, z, BLOCK_DIRT);
+                }
+            }
+        }
+    }
+    return world;
+}
+
+static void run(struct World *world, uint32_t entities, uint32_t ticks) {
+    struct Ecs *ecs = ecs_create();
+    entity_register_components(ecs);
+    struct Physics *physics = physics_create();
+
+    ecs_mask_t mask = ECS_BIT(COMPONENT_POSITION) | ECS_BIT(COMPONENT_VELOCITY) |
+                      ECS_BIT(COMPONENT_GRAVITY) | ECS_BIT(COMPONENT_COLLIDER);
+    float extent = WORLD_CHUNKS * SECTION_SIZE;
+    for (uint32_t i=0; i<entities; i++) {
+        entity_t entity = ecs_create_entity(ecs, mask);
+        struct EntityPosition *position = ecs_get(ecs, entity, COMPONENT_POSITION);
+        struct EntityVelocity *velocity = ecs_get(ecs, entity, COMPONENT_VELOCITY);
+        struct EntityGravity *gravity = ecs_get(ecs, entity, COMPONENT_GRAVITY);
+        struct EntityCollider *collider = ecs_get(ecs, entity, COMPONENT_COLLIDER);
+        position->x = (float) rand() / RAND_MAX * extent;
+        position->y = GROUND_LEVEL + 5 + (float) rand() / RAND_MAX * 40.0f;
+        position->z = (float) rand() / RAND_MAX * extent;
+        velocity->x = (float) rand() / RAND_MAX * 8.0f - 4.0f;
+        velocity->z = (float) rand() / RAND_MAX * 8.0f - 4.0f;
+        gravity->scale = 1.0f;
+        collider->half_width = 0.3f;
+        collider->height = 1.8f;
+    }
+
+    const float dt = 1.0f / 20.0f;
+    for (int i=0; i<20; i++) {
+        system_gravity(ecs, dt);
+        physics_step(physics, ecs, world, dt);
+    }
+
+    uint64_t pairs = 0;
+    double start = timer_now();
+    for (uint32_t i=0; i<ticks; i++) {
+        system_gravity(ecs, dt);
+        physics_step(physics, ecs, world, dt);
+        pairs += physics_last_pairs_count(physics);
+    }
+    double elapsed = timer_now() - start;
+
+    printf("entities: %6u  time per tick: %8.3f ms  ticks/s: %8.1f  pairs/tick: %.0f\n",
+        entities, elapsed / ticks * 1000.0, ticks / elapsed, (double) pairs / ticks);
+
+    physics_destroy(physics);
+    ecs_destroy(ecs);
+}
+
+int main(int argc, char **argv) {
+    uint32_t ticks = argc > 1 ? (uint32_t) atoi(argv[1]) : 200;
+    int workers    = argc > 2 ? atoi(argv[2]) : 0;
+
+    set_log_level(WARNING);
+    job_system_init(workers);
+    printf("workers: %d\n", job_worker_count());
+
+    struct World *world = build_world();
+    run(world, 10000, ticks);
+    run(world, 100000, ticks);
+
+    world_destroy(world);
+    job_system_shutdown();
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Raycast benchmark on generated terrain
+//
+//   raycast-bench [rays] [workers]
+
+#include "job.h"
+#include "log.h"
+#include "raycast.h"
+#include "timer.h"
+#include "worldgen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define RADIUS 8    // chunks around the origin
+#define SEED 1234
+
+static float random_unit() {
+    return (float) rand() / RAND_MAX * 2.0f - 1.0f;
+}
+
+static void report(const char *name, uint32_t count, double elapsed, const struct RayHit *hits) {
+    uint32_t hit_count = 0;
+    for (uint32_t i=0; i<count; i++) hit_count += hits[i].hit;
+    printf("%-28s %9.2f M rays/s  (%5.1f%% hit)\n", name, count / elapsed / 1e6, 100.0 * hit_count / count);
+}
+
+int main(int argc, char **argv) {
+    uint32_t count = argc > 1 ? (uint32_t) atoi(argv[1]) : 1000000;
+    int workers    = argc > 2 ? atoi(argv[2]) : 0;
+
+    set_log_level(WARNING);
+    job_system_init(workers);
+    printf("workers: %d\n", job_worker_count());
+
+    struct World *world = world_create();
+    for (int x=-RADIUS; x<RADIUS; x++) {
+        for (int z=-RADIUS; z<RADIUS; z++) {
+            worldgen_generate_chunk(world, x, z, SEED);
+        }
+    }
+
+    struct Ray *rays = malloc(count * sizeof(*rays));
+    struct RayHit *hits = malloc(count * sizeof(*hits));
+    float extent = RADIUS * SECTION_SIZE - 16.0f;
+    srand(42);
+
+    // block picking / line of sight: from eye height in any direction
+    for (uint32_t i=0; i<count; i++) {
+        float x = random_unit() * extent, z = random_unit() * extent;
+        rays[i].origin[0] = x;
+        rays[i].origin[1] = worldgen_height((int32_t) x, (int32_t) z, SEED) + 1.6f;
+        rays[i].origin[2] = z;
+        rays[i].direction[0] = random_unit();
+        rays[i].direction[1] = random_unit();
+        rays[i].direction[2] = random_unit();
+        rays[i].max_distance = 64.0f;
+    }
+
+    double start = timer_now();
+    for (uint32_t i=0; i<count; i++) {
+        raycast(world, &rays[i], NULL, &hits[i]);
+    }
+    report("line of sight, one by one", count, timer_now() - start, hits);
+
+    start = timer_now();
+    raycast_batch(world, rays, hits, count, NULL);
+    report("line of sight, batched", count, timer_now() - start, hits);
+
+    // from the sky: most of the path crosses empty sections
+    for (uint32_t i=0; i<count; i++) {
+        rays[i].origin[0] = random_unit() * extent;
+        rays[i].origin[1] = WORLD_HEIGHT - 1;
+        rays[i].origin[2] = random_unit() * extent;
+        rays[i].direction[0] = random_unit() * 0.3f;
+        rays[i].direction[1] = -1.0f;
+        rays[i].direction[2] = random_unit() * 0.3f;
+        rays[i].max_distance = 512.0f;
+    }
+    start = timer_now();
+    raycast_batch(world, rays, hits, count, NULL);
+    report("from the sky, batched", count, timer_now() - start, hits);
+
+    // explosions: a sphere of rays from a few centers underground
+    for (uint32_t i=0; i<count; i++) {
+        uint32_t center = i / 4096;
+        srand(center);
+        float x = random_unit() * extent, z = random_unit() * extent;
+        srand(i);
+        rays[i].origin[0] = x;
+        rays[i].origin[1] = worldgen_height((int32_t) x, (int32_t) z, SEED) - 2.0f;
+        rays[i].origin[2] = z;
+        rays[i].direction[0] = random_unit();
+        rays[i].direction[1] = random_unit();
+        rays[i].direction[2] = random_unit();
+        rays[i].max_distance = 8.0f;
+    }
+    start = timer_now();
+    raycast_batch(world, rays, hits, count, NULL);
+    report("explosion, batched", count, timer_now() - start, hits);
+
+    free(rays);
+    free(hits);
+    world_destroy(world);
+    job_system_shutdown();
+    return 0;
+}
@@ -0,0 +1,119 @@
+// Headless replay of an input recording: the simulation and the chunk streamer
+// follow the recorded player tick by tick, the time of every tick is the frame
+// time. The same recording gives the same run on every build, compare the summaries.
+//
+//   replay-bench record file [ticks] [seed]     write a scripted flythrough
+//   replay-bench play file [view distance] [frames.csv]
+
+#include "input.h"
+#include "job.h"
+#include "log.h"
+#include "player.h"
+#include "simulation.h"
+#include "stats.h"
+#include "streamer.h"
+#include "timer.h"
+#include "worldgen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the flythrough goes through the same Input as the window callbacks, recording included
+static int record(const char *path, uint32_t ticks, uint32_t seed) {
+    struct Input *input = input_create();
+    if (input == NULL || !input_record(input, path, seed)) return EXIT_FAILURE;
+
+    struct InputState state = {0};
+    double cursor_x = 640.0, cursor_y = 480.0;
+    input_push(input, &(struct InputEvent) {.type = INPUT_EVENT_CURSOR, .x = cursor_x, .y = cursor_y});
+    input_push(input, &(struct InputEvent) {.type = INPUT_EVENT_KEY, .code = INPUT_KEY_W, .action = INPUT_PRESS});
+    for (uint32_t tick=0; tick<ticks; tick++) {
+        uint32_t phase = tick % 200;
+        // sprint for a while, climb a bit, then look around while flying on
+        if (phase == 20)  input_push(input, &(struct InputEvent) {.type = INPUT_EVENT_KEY, .code = INPUT_KEY_LEFT_CONTROL, .action = INPUT_PRESS});
+        if (phase == 120) input_push(input, &(struct InputEvent) {.type = INPUT_EVENT_KEY, .code = INPUT_KEY_LEFT_CONTROL, .action = INPUT_RELEASE});
+        if (phase == 60)  input_push(input, &(struct InputEvent) {.type = INPUT_EVENT_KEY, .code = INPUT_KEY_SPACE, .action = INPUT_PRESS});
+        if (phase == 70)  input_push(input, &(struct InputEvent) {.type = INPUT_EVENT_KEY, .code = INPUT_KEY_SPACE, .action = INPUT_RELEASE});
+        if (phase >= 140 && phase < 180) {
+            cursor_x += 6.0;
+            cursor_y += phase < 160 ? 1.0 : -1.0;
+            input_push(input, &(struct InputEvent) {.type = INPUT_EVENT_CURSOR, .x = cursor_x, .y = cursor_y});
+        }
+        input_tick(input, tick, &state);
+    }
+    input_destroy(input);
+    printf("recorded %u ticks of flythrough to %s\n", ticks, path);
+    return EXIT_SUCCESS;
+}
+
+static int play(const char *path, int view_distance, const char *frames_path) {
+    uint32_t seed;
+    struct Input *input = input_create();
+    if (input == NULL || !input_replay(input, path, &seed)) return EXIT_FAILURE;
+
+    struct Simulation *simulation = simulation_create(seed);
+    struct StreamerConfig config = streamer_default_config(view_distance, seed);
+    // what gets meshed in a frame must not depend on how fast the workers are
+    config.wait_generation = true;
+    struct Streamer *streamer = simulation ? streamer_create(simulation->world, &config) : NULL;
+    struct FrameLog frames;
+    if (streamer == NULL || !frame_log_open(&frames, frames_path)) return EXIT_FAILURE;
+
+    struct InputState state = {0};
+    struct Player player;
+    player_init(&player, 0.5f, (float) worldgen_height(0, 0, seed) + 10.0f, 0.5f);
+
+    // the first load is not part of the flythrough
+    streamer_update(streamer, player.x, player.z);
+
+    uint64_t meshed = 0;
+    double start = timer_now();
+    while (!input_replay_done(input)) {
+        double frame_start = timer_now();
+        input_tick(input, (uint32_t) simulation->tick, &state);
+        player_update(&player, &state, TICK_DT);
+        simulation_tick(simulation);
+        streamer_update(streamer, player.x, player.z);
+        frame_log_add(&frames, simulation->tick, timer_now() - frame_start);
+
+        struct StreamerStats stats;
+        streamer_stats(streamer, &stats);
+        meshed += stats.chunks_meshed;
+    }
+    double elapsed = timer_now() - start;
+
+    printf("replayed %llu ticks in %.2f s, %llu chunks meshed\n",
+           (unsigned long long) simulation->tick, elapsed, (unsigned long long) meshed);
+    // identical on every build and machine, or the replay is not deterministic
+    printf("final player position %.4f %.4f %.4f, yaw %.4f, pitch %.4f\n", player.x, player.y, player.z, player.yaw, player.pitch);
+    set_log_level(INFO);
+    frame_log_close(&frames);
+
+    streamer_destroy(streamer);
+    simulation_destroy(simulation);
+    input_destroy(input);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3 || (strcmp(argv[1], "record") != 0 && strcmp(argv[1], "play") != 0)) {
+        fprintf(stderr, "usage: replay-bench record file [ticks] [seed]\n"
+                        "       replay-bench play file [view distance] [frames.csv]\n");
+        return EXIT_FAILURE;
+    }
+    set_log_level(WARNING);
+
+    if (strcmp(argv[1], "record") == 0) {
+        uint32_t ticks = argc > 3 ? (uint32_t) atoi(argv[3]) : 600;
+        uint32_t seed  = argc > 4 ? (uint32_t) strtoul(argv[4], NULL, 10) : 1234;
+        return record(argv[2], ticks, seed);
+    }
+
+    int view_distance = argc > 3 ? atoi(argv[3]) : 12;
+    const char *frames = argc > 4 ? argv[4] : NULL;
+    job_system_init(0);
+    int result = play(argv[2], view_distance, frames);
+    job_system_shutdown();
+    return result;
+}
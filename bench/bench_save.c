@@ -0,0 +1,190 @@
+// Save benchmark: tick time around a world save, blocking on the tick thread
+// versus a copy on write snapshot written by the save thread.
+// Blocks are edited at random every tick, the first save writes every chunk,
+// the next ones only the chunks edited since. Ticks are paced at 20 TPS like
+// the server, the save thread gets the idle part of each tick.
+//
+//   save-bench [directory] [ticks] [save every n ticks] [edits per tick] [radius]
+
+#include "entity.h"
+#include "job.h"
+#include "log.h"
+#include "save.h"
+#include "simulation.h"
+#include "timer.h"
+#include "worldgen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ENTITIES 2000
+
+struct Options {
+    const char *directory;
+    uint32_t ticks;
+    uint32_t save_every;
+    uint32_t edits;
+    int radius;
+};
+
+static void spawn_entities(struct Simulation *simulation, int radius) {
+    ecs_mask_t mask = ECS_BIT(COMPONENT_POSITION) | ECS_BIT(COMPONENT_VELOCITY) |
+                      ECS_BIT(COMPONENT_GRAVITY) | ECS_BIT(COMPONENT_COLLIDER);
+    float extent = (float) (radius * SECTION_SIZE);
+    for (uint32_t i=0; i<ENTITIES; i++) {
+        entity_t entity = ecs_create_entity(simulation->ecs, mask);
+        struct EntityPosition *position = ecs_get(simulation->ecs, entity, COMPONENT_POSITION);
+        struct EntityVelocity *velocity = ecs_get(simulation->ecs, entity, COMPONENT_VELOCITY);
+        struct EntityGravity *gravity = ecs_get(simulation->ecs, entity, COMPONENT_GRAVITY);
+        struct EntityCollider *collider = ecs_get(simulation->ecs, entity, COMPONENT_COLLIDER);
+        position->x = ((float) rand() / RAND_MAX * 2.0f - 1.0f) * extent;
+        position->z = ((float) rand() / RAND_MAX * 2.0f - 1.0f) * extent;
+        position->y = (float) worldgen_height((int32_t) position->x, (int32_t) position->z, simulation->seed) + 2.0f;
+        velocity->x = (float) rand() / RAND_MAX * 4.0f - 2.0f;
+        velocity->y = 0.0f;
+        velocity->z = (float) rand() / RAND_MAX * 4.0f - 2.0f;
+        gravity->scale = 1.0f;
+        collider->half_width = 0.3f;
+        collider->height = 1.8f;
+        collider->on_ground = 0;
+    }
+}
+
+static void edit_blocks(struct World *world, uint32_t count, int radius) {
+    int32_t extent = (2 * radius + 1) * SECTION_SIZE;
+    int32_t origin = -radius * SECTION_SIZE;
+    for (uint32_t i=0; i<count; i++) {
+        int32_t x = origin + rand() % extent;
+        int32_t z = origin + rand() % extent;
+        int32_t y = 32 + rand() % 64;
+        world_set_block(world, x, y, z, (block_t) (rand() % BLOCK_COUNT));
+    }
+}
+
+// every chunk read back from the region files must match the world
+static uint32_t verify(struct RegionStorage *storage, struct World *world) {
+    struct World *loaded = world_create();
+    uint32_t mismatches = 0;
+    uint32_t cursor = 0;
+    struct Chunk *chunk;
+    while ((chunk = world_next_chunk(world, &cursor)) != NULL) {
+        if (!world_load_chunk(storage, loaded, chunk->x, chunk->z)) {
+            mismatches++;
+            continue;
+        }
+        struct Chunk *copy = world_get_chunk(loaded, chunk->x, chunk->z);
+        for (int s=0; s<CHUNK_SECTIONS; s++) {
+            for (int i=0; i<SECTION_VOLUME; i++) {
+                int x = i & SECTION_MASK, z = (i >> SECTION_SHIFT) & SECTION_MASK, y = i >> (2 * SECTION_SHIFT);
+                if (section_get(&chunk->sections[s], x, y, z) != section_get(&copy->sections[s], x, y, z)) {
+                    mismatches++;
+                    s = CHUNK_SECTIONS;
+                    break;
+                }
+            }
+        }
+    }
+    world_destroy(loaded);
+    return mismatches;
+}
+
+static void run(const struct Options *options, bool background) {
+    char directory[512];
+    snprintf(directory, sizeof(directory), "%s/%s", options->directory, background ? "snapshot" : "blocking");
+
+    srand(42);
+    struct Simulation *simulation = simulation_create(1234);
+    if (simulation == NULL || !simulation_open_storage(simulation, directory)) exit(EXIT_FAILURE);
+    simulation_load_area(simulation, 0, 0, options->radius);
+    // nothing is read back during the run, every chunk is written by the first save
+    spawn_entities(simulation, options->radius);
+    struct WorldSaver *saver = background ? world_saver_create(simulation->storage) : NULL;
+    if (background && saver == NULL) exit(EXIT_FAILURE);
+
+    double tick_total = 0.0, tick_max = 0.0;
+    double first_save = 0.0, save_total = 0.0;
+    uint32_t ticks = 0, saves = 0;
+    uint64_t chunks = 0;
+    double next_tick = timer_now();
+    for (uint32_t t=0; t<options->ticks; t++) {
+        double start = timer_now();
+        edit_blocks(simulation->world, options->edits, options->radius);
+        simulation_tick(simulation);
+
+        bool save = t % options->save_every == 0;
+        struct SaveStats stats = {0};
+        if (save && background) {
+            if (world_saver_begin(saver, simulation->world)) {
+                world_saver_last_stats(saver, &stats);
+            } else {
+                save = false;
+            }
+        } else if (save) {
+            world_save_blocking(simulation->storage, simulation->world, &stats);
+        }
+        double elapsed = timer_now() - start;
+
+        if (save) {
+            if (saves == 0) first_save = elapsed;
+            else save_total += elapsed;
+            saves++;
+            chunks += stats.chunks;
+        } else {
+            tick_total += elapsed;
+            if (elapsed > tick_max) tick_max = elapsed;
+            ticks++;
+        }
+
+        next_tick += TICK_DT;
+        double now = timer_now();
+        if (now < next_tick) timer_sleep(next_tick - now);
+        else next_tick = now;
+    }
+
+    double write_seconds = 0.0;
+    if (background) {
+        world_saver_wait(saver);
+        world_saver_begin(saver, simulation->world);
+        world_saver_wait(saver);
+        struct SaveStats stats;
+        world_saver_last_stats(saver, &stats);
+        write_seconds = stats.write_seconds;
+        world_saver_destroy(saver);
+    } else {
+        struct SaveStats stats;
+        world_save_blocking(simulation->storage, simulation->world, &stats);
+        write_seconds = stats.write_seconds;
+    }
+
+    printf("%-9s first save tick %8.2f ms  later save ticks %7.2f ms  other ticks %5.2f ms avg %6.2f ms max\n",
+           background ? "snapshot" : "blocking", first_save * 1000.0,
+           saves > 1 ? save_total / (saves - 1) * 1000.0 : 0.0,
+           ticks ? tick_total / ticks * 1000.0 : 0.0, tick_max * 1000.0);
+    printf("          %u saves, %llu chunks, last save written in %.1f ms, verify: %u mismatches\n",
+           saves, (unsigned long long) chunks, write_seconds * 1000.0, verify(simulation->storage, simulation->world));
+
+    simulation_destroy(simulation);
+}
+
+int main(int argc, char **argv) {
+    struct Options options = {
+        .directory  = argc > 1 ? argv[1] : "save-bench-world",
+        .ticks      = argc > 2 ? (uint32_t) atoi(argv[2]) : 120,
+        .save_every = argc > 3 ? (uint32_t) atoi(argv[3]) : 30,
+        .edits      = argc > 4 ? (uint32_t) atoi(argv[4]) : 20,
+        .radius     = argc > 5 ? atoi(argv[5]) : 12,
+    };
+    if (options.save_every == 0) options.save_every = 1;
+
+    set_log_level(WARNING);
+    job_system_init(0);
+    printf("workers: %d, %d chunks, %u edits per tick, save every %u ticks\n", job_worker_count(),
+           (2 * options.radius + 1) * (2 * options.radius + 1), options.edits, options.save_every);
+
+    run(&options, false);
+    run(&options, true);
+
+    job_system_shutdown();
+    return 0;
+}
@@ -0,0 +1,224 @@
+// Entity range queries: the spatial index against a scan of every entity, on
+// entities spread over a square of terrain. Also the cost of keeping the index
+// up to date, moving the entities one by one and rebuilding it after a bulk move.
+// Both sides must find the same entities.
+//
+//   spatial-bench [entities] [queries] [workers]
+
+#include "job.h"
+#include "log.h"
+#include "spatial.h"
+#include "timer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define EXTENT      1024.0f     // blocks per side of the square
+#define RANGE       16.0f       // item pickup, AI targeting
+#define BOX         24.0f       // side of the box queries
+#define NEAREST     8
+#define MAX_DISTANCE 64.0f
+#define MOVE        0.5f        // blocks per step, a tick of walking
+
+static float random_float(float min, float max) {
+    return min + (float) rand() / RAND_MAX * (max - min);
+}
+
+// -- linear scans, the baseline
+
+static uint32_t scan_range(const struct SpatialEntity *entities, uint32_t count, float x, float y, float z, float range,
+                           uint32_t *ids, uint32_t capacity) {
+    uint32_t found = 0;
+    for (uint32_t i=0; i<count; i++) {
+        float dx = entities[i].x - x, dy = entities[i].y - y, dz = entities[i].z - z;
+        float reach = range + entities[i].radius;
+        if (dx * dx + dy * dy + dz * dz > reach * reach) continue;
+        if (found < capacity) ids[found] = i;
+        found++;
+    }
+    return found;
+}
+
+static uint32_t scan_box(const struct SpatialEntity *entities, uint32_t count, const struct Aabb *box,
+                         uint32_t *ids, uint32_t capacity) {
+    uint32_t found = 0;
+    for (uint32_t i=0; i<count; i++) {
+        const struct SpatialEntity *e = &entities[i];
+        if (e->x + e->radius < box->min_x || e->x - e->radius > box->max_x ||
+            e->y + e->radius < box->min_y || e->y - e->radius > box->max_y ||
+            e->z + e->radius < box->min_z || e->z - e->radius > box->max_z) {
+            continue;
+        }
+        if (found < capacity) ids[found] = i;
+        found++;
+    }
+    return found;
+}
+
+static uint32_t scan_nearest(const struct SpatialEntity *entities, uint32_t count, float x, float y, float z,
+                             float max_distance, uint32_t k, uint32_t *ids, float *distances) {
+    uint32_t found = 0;
+    float limit = max_distance * max_distance;
+    for (uint32_t i=0; i<count; i++) {
+        float dx = entities[i].x - x, dy = entities[i].y - y, dz = entities[i].z - z;
+        float d = dx * dx + dy * dy + dz * dz;
+        if (d > limit) continue;
+        uint32_t n = found < k ? found++ : k - 1;
+        while (n > 0 && distances[n - 1] > d) {
+            distances[n] = distances[n - 1];
+            ids[n] = ids[n - 1];
+            n--;
+        }
+        distances[n] = d;
+        ids[n] = i;
+        if (found == k) limit = distances[k - 1];
+    }
+    for (uint32_t i=0; i<found; i++) distances[i] = sqrtf(distances[i]);
+    return found;
+}
+
+// a sample of the range queries against the scan
+static bool check(const struct SpatialIndex *index, const struct SpatialEntity *entities, uint32_t count,
+                  float (*points)[3], uint32_t queries, uint32_t *ids) {
+    uint64_t found = 0, expected = 0;
+    for (uint32_t q=0; q<queries; q+=10) {
+        found += spatial_query_range(index, points[q][0], points[q][1], points[q][2], RANGE, ids, count);
+        expected += scan_range(entities, count, points[q][0], points[q][1], points[q][2], RANGE, ids, count);
+    }
+    return found == expected;
+}
+
+struct Result {
+    double seconds;
+    uint64_t found;
+    double distances;   // sum over the nearest queries
+};
+
+static void print_result(const char *name, uint32_t queries, const struct Result *index, const struct Result *scan) {
+    printf("%-8s %12.0f q/s %12.0f q/s %8.1fx %10.1f found/q\n", name, queries / index->seconds, queries / scan->seconds,
+           scan->seconds / index->seconds, (double) index->found / queries);
+}
+
+int main(int argc, char **argv) {
+    uint32_t count   = argc > 1 ? (uint32_t) atoi(argv[1]) : 50000;
+    uint32_t queries = argc > 2 ? (uint32_t) atoi(argv[2]) : 20000;
+    int workers      = argc > 3 ? atoi(argv[3]) : 0;
+    if (count < 1) count = 1;
+    if (queries < 1) queries = 1;
+
+    set_log_level(WARNING);
+    job_system_init(workers);
+
+    srand(42);
+    struct SpatialEntity *entities = malloc(count * sizeof(*entities));
+    float (*points)[3] = malloc(queries * sizeof(*points));
+    uint32_t *ids = malloc(count * sizeof(*ids));
+    uint32_t nearest_ids[NEAREST];
+    float nearest_distances[NEAREST];
+    for (uint32_t i=0; i<count; i++) {
+        entities[i] = (struct SpatialEntity) {
+            random_float(0.0f, EXTENT), random_float(60.0f, 80.0f), random_float(0.0f, EXTENT), random_float(0.25f, 1.0f)};
+    }
+    for (uint32_t q=0; q<queries; q++) {
+        points[q][0] = random_float(0.0f, EXTENT);
+        points[q][1] = random_float(60.0f, 80.0f);
+        points[q][2] = random_float(0.0f, EXTENT);
+    }
+
+    struct SpatialIndex *index = spatial_create();
+    double start = timer_now();
+    for (uint32_t i=0; i<count; i++) spatial_insert(index, i, &entities[i]);
+    double inserted = timer_now() - start;
+    printf("%u entities over %.0f x %.0f blocks, %d workers\n", count, EXTENT, EXTENT, job_worker_count());
+    printf("insert   %8.3f ms, %.1f M/s\n", inserted * 1e3, count / inserted / 1e6);
+
+    // queries, the index and the scan
+    printf("query         index          scan  speedup\n");
+    struct Result index_range = {0}, scan_range_result = {0};
+    start = timer_now();
+    for (uint32_t q=0; q<queries; q++) {
+        index_range.found += spatial_query_range(index, points[q][0], points[q][1], points[q][2], RANGE, ids, count);
+    }
+    index_range.seconds = timer_now() - start;
+    start = timer_now();
+    for (uint32_t q=0; q<queries; q++) {
+        scan_range_result.found += scan_range(entities, count, points[q][0], points[q][1], points[q][2], RANGE, ids, count);
+    }
+    scan_range_result.seconds = timer_now() - start;
+    print_result("range", queries, &index_range, &scan_range_result);
+
+    struct Result index_box = {0}, scan_box_result = {0};
+    start = timer_now();
+    for (uint32_t q=0; q<queries; q++) {
+        struct Aabb box = {points[q][0], points[q][1] - BOX / 2, points[q][2],
+                           points[q][0] + BOX, points[q][1] + BOX / 2, points[q][2] + BOX};
+        index_box.found += spatial_query_box(index, &box, ids, count);
+    }
+    index_box.seconds = timer_now() - start;
+    start = timer_now();
+    for (uint32_t q=0; q<queries; q++) {
+        struct Aabb box = {points[q][0], points[q][1] - BOX / 2, points[q][2],
+                           points[q][0] + BOX, points[q][1] + BOX / 2, points[q][2] + BOX};
+        scan_box_result.found += scan_box(entities, count, &box, ids, count);
+    }
+    scan_box_result.seconds = timer_now() - start;
+    print_result("box", queries, &index_box, &scan_box_result);
+
+    struct Result index_nearest = {0}, scan_nearest_result = {0};
+    start = timer_now();
+    for (uint32_t q=0; q<queries; q++) {
+        uint32_t n = spatial_query_nearest(index, points[q][0], points[q][1], points[q][2], MAX_DISTANCE, NEAREST,
+                                           nearest_ids, nearest_distances);
+        index_nearest.found += n;
+        for (uint32_t i=0; i<n; i++) index_nearest.distances += nearest_distances[i];
+    }
+    index_nearest.seconds = timer_now() - start;
+    start = timer_now();
+    for (uint32_t q=0; q<queries; q++) {
+        uint32_t n = scan_nearest(entities, count, points[q][0], points[q][1], points[q][2], MAX_DISTANCE, NEAREST,
+                                  nearest_ids, nearest_distances);
+        scan_nearest_result.found += n;
+        for (uint32_t i=0; i<n; i++) scan_nearest_result.distances += nearest_distances[i];
+    }
+    scan_nearest_result.seconds = timer_now() - start;
+    print_result("nearest", queries, &index_nearest, &scan_nearest_result);
+
+    bool same = index_range.found == scan_range_result.found && index_box.found == scan_box_result.found &&
+                index_nearest.found == scan_nearest_result.found &&
+                fabs(index_nearest.distances - scan_nearest_result.distances) < 1e-3 * scan_nearest_result.distances;
+    if (!same) printf("the index and the scan found different entities\n");
+
+    // keeping it up to date: every entity walks a step
+    for (uint32_t i=0; i<count; i++) {
+        entities[i].x += random_float(-MOVE, MOVE);
+        entities[i].z += random_float(-MOVE, MOVE);
+    }
+    start = timer_now();
+    for (uint32_t i=0; i<count; i++) spatial_move(index, i, entities[i].x, entities[i].y, entities[i].z);
+    double moved = timer_now() - start;
+    printf("move     %8.3f ms for all, %.1f M/s\n", moved * 1e3, count / moved / 1e6);
+    if (!check(index, entities, count, points, queries, ids)) {
+        printf("the moved index and the scan found different entities\n");
+        same = false;
+    }
+
+    spatial_rebuild(index, entities, count);    // the scratch arrays
+    start = timer_now();
+    const int rebuilds = 20;
+    for (int r=0; r<rebuilds; r++) spatial_rebuild(index, entities, count);
+    double rebuilt = (timer_now() - start) / rebuilds;
+    printf("rebuild  %8.3f ms for all, %.1f M/s\n", rebuilt * 1e3, count / rebuilt / 1e6);
+
+    if (!check(index, entities, count, points, queries, ids)) {
+        printf("the rebuilt index and the scan found different entities\n");
+        same = false;
+    }
+
+    spatial_destroy(index);
+    free(entities);
+    free(points);
+    free(ids);
+    job_system_shutdown();
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
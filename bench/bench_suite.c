@@ -0,0 +1,590 @@
+// Microbenchmarks of the CPU hot paths, no window nor GPU needed.
+// Every benchmark runs a few warmup repetitions, then timed repetitions of a
+// fixed number of operations. The results can be saved as JSON and a later run
+// compared against them: a median slower than the baseline by more than the
+// threshold is a regression and the exit code is 1, so is a benchmark of the
+// baseline that did not run (renamed or removed) unless --filter left it out.
+//
+//   minecraft-bench [--filter text] [--repetitions n] [--warmup n]
+//                   [--json file] [--compare baseline.json] [--threshold percent]
+//                   [--dir directory]
+
+#include "compress.h"
+#include "log.h"
+#include "memory.h"
+#include "mesher.h"
+#include "noise.h"
+#include "protocol.h"
+#include "region.h"
+#include "timer.h"
+#include "translucent.h"
+#include "world.h"
+#include "worldgen.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SEED            1234
+#define WORLD_CHUNKS    8           // side of the generated test world
+#define MAX_BENCHMARKS  32
+#define MAX_REPETITIONS 1000
+
+#if defined(_WIN32)
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+struct Options {
+    const char *filter;
+    int repetitions;
+    int warmup;
+    const char *json;
+    const char *compare;
+    double threshold;       // percent
+    const char *directory;  // scratch files of the I/O benchmarks
+    bool help;
+};
+
+struct Benchmark {
+    const char *name;
+    uint64_t operations;                    // per repetition
+    void (*run)(void *state, uint64_t operations);
+};
+
+struct Result {
+    const char *name;
+    uint64_t operations;
+    double warmup_ns;       // mean per operation
+    double min_ns, median_ns, mean_ns, stddev_ns, max_ns;
+};
+
+// shared by the benchmarks, built once. The edits go to their own world so
+// every other benchmark sees the same blocks whatever ran before
+static struct World *world;
+static struct World *edit_world;
+static struct RegionStorage *storage;
+static struct FrameArena *arena;
+static uint8_t *record;
+static size_t record_size;
+static volatile uint64_t sink;      // keeps the compiler from dropping the work
+// the section of the test world with the most water and glass faces
+static int16_t (*translucent_quads)[3];
+static uint32_t translucent_count;
+static uint32_t *translucent_indices;
+
+static uint32_t rng = 1;
+
+static uint32_t next_random() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+
+static void bench_world_get_block(void *state, uint64_t operations) {
+    (void) state;
+    uint64_t sum = 0;
+    for (uint64_t i=0; i<operations; i++) {
+        uint32_t r = next_random();
+        int32_t x = r % (WORLD_CHUNKS * SECTION_SIZE), z = (r >> 8) % (WORLD_CHUNKS * SECTION_SIZE);
+        sum += world_get_block(world, x, (r >> 16) % WORLD_HEIGHT, z);
+    }
+    sink += sum;
+}
+
+static void bench_world_set_block(void *state, uint64_t operations) {
+    (void) state;
+    for (uint64_t i=0; i<operations; i++) {
+        uint32_t r = next_random();
+        int32_t x = r % (WORLD_CHUNKS * SECTION_SIZE), z = (r >> 8) % (WORLD_CHUNKS * SECTION_SIZE);
+        world_set_block(edit_world, x, 40 + (r >> 16) % 40, z, (block_t) (r >> 24) % BLOCK_COUNT);
+    }
+}
+
+// the access pattern of the mesher and the physics: neighbors of a walking point
+static void bench_block_access(void *state, uint64_t operations) {
+    (void) state;
+    struct BlockAccess access;
+    block_access_init(&access, world);
+    uint64_t sum = 0;
+    int32_t extent = WORLD_CHUNKS * SECTION_SIZE;
+    for (uint64_t i=0; i<operations; i++) {
+        int32_t x = (int32_t) (i % extent), z = (int32_t) ((i / extent) % extent);
+        sum += block_access_get(&access, x, 64, z);
+    }
+    sink += sum;
+}
+
+static void bench_section_get(void *state, uint64_t operations) {
+    (void) state;
+    const struct Section *section = &world_get_chunk(world, 1, 1)->sections[3];
+    uint64_t sum = 0;
+    for (uint64_t i=0; i<operations; i++) {
+        uint32_t index = (uint32_t) i & (SECTION_VOLUME - 1);
+        sum += section_get(section, index & SECTION_MASK, index >> (2 * SECTION_SHIFT), (index >> SECTION_SHIFT) & SECTION_MASK);
+    }
+    sink += sum;
+}
+
+// the property lookups of the mesher and the physics, on the blocks of a surface section
+static void bench_block_flags(void *state, uint64_t operations) {
+    (void) state;
+    const struct Section *section = &world_get_chunk(world, 1, 1)->sections[SEA_LEVEL / SECTION_SIZE];
+    uint64_t sum = 0;
+    for (uint64_t i=0; i<operations; i++) {
+        block_t block = section->blocks ? section->blocks[i & (SECTION_VOLUME - 1)] : section->single;
+        sum += block_is_opaque(block) + block_is_solid(block) + block_mesh_layer(block);
+    }
+    sink += sum;
+}
+
+static void mesh_sections(uint64_t operations, int lod) {
+    block_t grid[(SECTION_SIZE + 2) * (SECTION_SIZE + 2) * (SECTION_SIZE + 2)];
+    struct SectionMesh mesh = {0};
+    uint64_t vertices = 0;
+    for (uint64_t i=0; i<operations; i++) {
+        // the sections around the surface, the ones that have faces
+        int32_t cx = 1 + (int32_t) (i % (WORLD_CHUNKS - 2)), cz = 1 + (int32_t) ((i / (WORLD_CHUNKS - 2)) % (WORLD_CHUNKS - 2));
+        struct Chunk *chunk = world_get_chunk(world, cx, cz);
+        mesher_mesh_section(world, chunk, 3 + (int) (i % 2), lod, NULL, grid, &mesh);
+        vertices += section_mesh_vertices(&mesh);
+    }
+    section_mesh_free(&mesh);
+    sink += vertices;
+}
+
+static void bench_mesh_section(void *state, uint64_t operations) {
+    (void) state;
+    mesh_sections(operations, 0);
+}
+
+static void bench_mesh_section_lod2(void *state, uint64_t operations) {
+    (void) state;
+    mesh_sections(operations, 2);
+}
+
+static void bench_noise2(void *state, uint64_t operations) {
+    (void) state;
+    float sum = 0.0f;
+    for (uint64_t i=0; i<operations; i++) {
+        sum += noise2((float) i * 0.37f, (float) i * 0.11f, SEED);
+    }
+    sink += (uint64_t) (sum != 0.0f);
+}
+
+static void bench_fbm3(void *state, uint64_t operations) {
+    (void) state;
+    float sum = 0.0f;
+    for (uint64_t i=0; i<operations; i++) {
+        sum += fbm3((float) i * 0.37f, (float) i * 0.05f, (float) i * 0.11f, 4, SEED);
+    }
+    sink += (uint64_t) (sum != 0.0f);
+}
+
+static void bench_worldgen_chunk(void *state, uint64_t operations) {
+    (void) state;
+    struct Chunk chunk = {0};
+    for (uint64_t i=0; i<operations; i++) {
+        chunk.x = 100 + (int32_t) i;
+        chunk.z = -7;
+        worldgen_fill_chunk(&chunk, SEED);
+        sink += chunk.sections[4].single;
+        for (int s=0; s<CHUNK_SECTIONS; s++) section_fill(&chunk.sections[s], BLOCK_AIR);
+    }
+}
+
+static void bench_column_compress(void *state, uint64_t operations) {
+    (void) state;
+    struct Buffer column = {0};
+    uint8_t *out = NULL;
+    size_t capacity = 0;
+    for (uint64_t i=0; i<operations; i++) {
+        struct Chunk *chunk = world_get_chunk(world, (int32_t) (i % WORLD_CHUNKS), 2);
+        column.size = 0;
+        protocol_write_column(&column, chunk->sections);
+        if (compress_bound(column.size) > capacity) {
+            capacity = compress_bound(column.size);
+            memory_free(out);
+            out = memory_alloc(capacity, MEMORY_TAG_IO);
+        }
+        sink += compress_block(column.data, column.size, out, capacity);
+    }
+    memory_free(out);
+    buffer_free(&column);
+}
+
+static void bench_region_write(void *state, uint64_t operations) {
+    (void) state;
+    for (uint64_t i=0; i<operations; i++) {
+        int32_t x = (int32_t) (i % REGION_SIZE), z = (int32_t) ((i / REGION_SIZE) % REGION_SIZE);
+        if (!region_storage_write(storage, x, z, record, record_size)) exit(EXIT_FAILURE);
+    }
+}
+
+static void bench_region_read(void *state, uint64_t operations) {
+    (void) state;
+    struct Buffer out = {0};
+    for (uint64_t i=0; i<operations; i++) {
+        int32_t x = (int32_t) (i % REGION_SIZE), z = (int32_t) ((i / REGION_SIZE) % REGION_SIZE);
+        out.size = 0;
+        if (!region_storage_read(storage, x, z, &out)) exit(EXIT_FAILURE);
+        sink += out.size;
+    }
+    buffer_free(&out);
+}
+
+// a message under the log level, what every TRACE in a hot loop costs
+static void bench_log_filtered(void *state, uint64_t operations) {
+    (void) state;
+    for (uint64_t i=0; i<operations; i++) {
+        TRACE("bench %llu %f", (unsigned long long) i, 1.5);
+    }
+}
+
+static void bench_log_written(void *state, uint64_t operations) {
+    FILE *null = state;
+    set_log_file(null);
+    set_log_level(INFO);
+    for (uint64_t i=0; i<operations; i++) {
+        INFO("bench %llu %f", (unsigned long long) i, 1.5);
+    }
+    set_log_level(WARNING);
+    set_log_file(NULL);
+}
+
+static void bench_malloc(void *state, uint64_t operations) {
+    (void) state;
+    for (uint64_t i=0; i<operations; i++) {
+        void *p = malloc(16 + (i & 255));
+        sink += (uintptr_t) p & 1;
+        free(p);
+    }
+}
+
+static void bench_memory_alloc(void *state, uint64_t operations) {
+    (void) state;
+    for (uint64_t i=0; i<operations; i++) {
+        void *p = memory_alloc(16 + (i & 255), MEMORY_TAG_WORLD);
+        sink += (uintptr_t) p & 1;
+        memory_free(p);
+    }
+}
+
+static void bench_frame_arena(void *state, uint64_t operations) {
+    (void) state;
+    for (uint64_t i=0; i<operations; i++) {
+        // a frame every 1024 allocations
+        if ((i & 1023) == 0) frame_arena_begin_frame(arena);
+        void *p = frame_arena_alloc(arena, 16 + (i & 255));
+        sink += (uintptr_t) p & 1;
+    }
+}
+
+static void bench_translucent_sort(void *state, uint64_t operations) {
+    (void) state;
+    uint32_t *scratch = memory_alloc(translucent_count * 2 * sizeof(uint32_t), MEMORY_TAG_RENDERER);
+    for (uint64_t i=0; i<operations; i++) {
+        // the camera walks around the section
+        float camera[3] = {(float) (i % 24) - 4.0f, 8.0f + (float) (i % 5), (float) ((i / 24) % 24) - 4.0f};
+        translucent_sort((const int16_t (*)[3]) translucent_quads, translucent_count, camera, translucent_indices, scratch);
+        sink += translucent_indices[0];
+    }
+    memory_free(scratch);
+}
+
+static const struct Benchmark benchmarks[] = {
+    {"world_get_block",     1000000, bench_world_get_block},
+    {"world_set_block",     1000000, bench_world_set_block},
+    {"block_access_get",    1000000, bench_block_access},
+    {"section_get",         4000000, bench_section_get},
+    {"block_flags",         4000000, bench_block_flags},
+    {"mesh_section",            200, bench_mesh_section},
+    {"mesh_section_lod2",      1000, bench_mesh_section_lod2},
+    {"noise2",              1000000, bench_noise2},
+    {"fbm3_4_octaves",       200000, bench_fbm3},
+    {"worldgen_chunk",           20, bench_worldgen_chunk},
+    {"column_compress",         200, bench_column_compress},
+    {"region_write",            256, bench_region_write},
+    {"region_read",            1024, bench_region_read},
+    {"log_filtered",        1000000, bench_log_filtered},
+    {"log_written",           20000, bench_log_written},
+    {"malloc_free",         1000000, bench_malloc},
+    {"memory_alloc_free",   1000000, bench_memory_alloc},
+    {"frame_arena_alloc",   1000000, bench_frame_arena},
+    {"translucent_sort",       1000, bench_translucent_sort},
+};
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static bool setup(const struct Options *options) {
+    world = world_create();
+    edit_world = world_create();
+    for (int32_t z=0; z<WORLD_CHUNKS; z++) {
+        for (int32_t x=0; x<WORLD_CHUNKS; x++) {
+            worldgen_generate_chunk(world, x, z, SEED);
+            worldgen_generate_chunk(edit_world, x, z, SEED);
+        }
+    }
+
+    storage = region_storage_open(options->directory);
+    arena = frame_arena_create(256 * 1024, MEMORY_TAG_RENDERER);
+    if (storage == NULL || arena == NULL) return false;
+
+    // a typical saved chunk: compressed column of a generated chunk
+    struct Buffer column = {0};
+    protocol_write_column(&column, world_get_chunk(world, 1, 1)->sections);
+    record = memory_alloc(compress_bound(column.size), MEMORY_TAG_IO);
+    record_size = compress_block(column.data, column.size, record, compress_bound(column.size));
+    buffer_free(&column);
+    // region_read needs them stored
+    for (int32_t i=0; i<REGION_CHUNKS; i++) {
+        if (!region_storage_write(storage, i % REGION_SIZE, i / REGION_SIZE, record, record_size)) return false;
+    }
+
+    block_t grid[(SECTION_SIZE + 2) * (SECTION_SIZE + 2) * (SECTION_SIZE + 2)];
+    struct SectionMesh mesh = {0};
+    for (int32_t i=0; i<(WORLD_CHUNKS - 2) * (WORLD_CHUNKS - 2) * CHUNK_SECTIONS; i++) {
+        struct Chunk *chunk = world_get_chunk(world, 1 + i % (WORLD_CHUNKS - 2), 1 + (i / (WORLD_CHUNKS - 2)) % (WORLD_CHUNKS - 2));
+        mesher_mesh_section(world, chunk, i / ((WORLD_CHUNKS - 2) * (WORLD_CHUNKS - 2)), 0, NULL, grid, &mesh);
+        const struct Mesh *layer = &mesh.layers[MESH_LAYER_TRANSLUCENT];
+        if (layer->count / 4 <= translucent_count) continue;
+        translucent_count = layer->count / 4;
+        memory_free(translucent_quads);
+        translucent_quads = memory_alloc(translucent_count * sizeof(*translucent_quads), MEMORY_TAG_RENDERER);
+        translucent_centers(layer->vertices, translucent_count, translucent_quads);
+    }
+    section_mesh_free(&mesh);
+    translucent_indices = memory_alloc((translucent_count + 1) * 6 * sizeof(uint32_t), MEMORY_TAG_RENDERER);
+    return true;
+}
+
+static void teardown() {
+    memory_free(translucent_indices);
+    memory_free(translucent_quads);
+    memory_free(record);
+    frame_arena_destroy(arena);
+    region_storage_close(storage);
+    world_destroy(edit_world);
+    world_destroy(world);
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void run(const struct Benchmark *benchmark, const struct Options *options, void *state, struct Result *result) {
+    static double samples[MAX_REPETITIONS];
+    *result = (struct Result) {.name = benchmark->name, .operations = benchmark->operations};
+    rng = 1;
+
+    double warmup = 0.0;
+    for (int i=0; i<options->warmup; i++) {
+        double start = timer_now();
+        benchmark->run(state, benchmark->operations);
+        warmup += timer_now() - start;
+    }
+    if (options->warmup > 0) result->warmup_ns = warmup / options->warmup / benchmark->operations * 1e9;
+
+    double sum = 0.0;
+    for (int i=0; i<options->repetitions; i++) {
+        double start = timer_now();
+        benchmark->run(state, benchmark->operations);
+        samples[i] = (timer_now() - start) / benchmark->operations * 1e9;
+        sum += samples[i];
+    }
+    int n = options->repetitions;
+    qsort(samples, n, sizeof(double), compare_double);
+    result->min_ns = samples[0];
+    result->max_ns = samples[n - 1];
+    result->median_ns = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2.0;
+    result->mean_ns = sum / n;
+    double variance = 0.0;
+    for (int i=0; i<n; i++) {
+        variance += (samples[i] - result->mean_ns) * (samples[i] - result->mean_ns);
+    }
+    result->stddev_ns = n > 1 ? sqrt(variance / (n - 1)) : 0.0;
+}
+
+static bool write_json(const char *path, const struct Options *options, const struct Result *results, int count) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        ERROR("BENCH failed to write %s", path);
+        return false;
+    }
+    fprintf(file, "{\n  \"suite\": \"minecraft-bench\",\n  \"repetitions\": %d,\n  \"warmup\": %d,\n  \"benchmarks\": [\n",
+            options->repetitions, options->warmup);
+    for (int i=0; i<count; i++) {
+        const struct Result *r = &results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"operations\": %llu, \"warmup_ns\": %.3f, \"min_ns\": %.3f, "
+                      "\"median_ns\": %.3f, \"mean_ns\": %.3f, \"stddev_ns\": %.3f, \"max_ns\": %.3f}%s\n",
+                r->name, (unsigned long long) r->operations, r->warmup_ns, r->min_ns,
+                r->median_ns, r->mean_ns, r->stddev_ns, r->max_ns, i + 1 < count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+// only reads back what write_json() writes: the name and median of each benchmark
+static char *read_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = size >= 0 ? malloc((size_t) size + 1) : NULL;
+    if (text != NULL) {
+        size_t read = fread(text, 1, (size_t) size, file);
+        text[read] = '\0';
+    }
+    fclose(file);
+    return text;
+}
+
+static bool baseline_median(const char *json, const char *name, double *median) {
+    char key[128];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+    const char *entry = strstr(json, key);
+    if (entry == NULL) return false;
+    const char *end = strchr(entry, '}');
+    const char *value = strstr(entry, "\"median_ns\":");
+    if (value == NULL || (end != NULL && value > end)) return false;
+    *median = strtod(value + strlen("\"median_ns\":"), NULL);
+    return *median > 0.0;
+}
+
+static int compare(const char *path, double threshold, const char *filter, const struct Result *results, int count) {
+    char *json = read_file(path);
+    if (json == NULL) {
+        ERROR("BENCH failed to read the baseline %s", path);
+        return -1;
+    }
+
+    int regressions = 0;
+    printf("\n%-22s %12s %12s %9s\n", "compared to baseline", "baseline ns", "now ns", "change");
+    for (int i=0; i<count; i++) {
+        double baseline;
+        if (!baseline_median(json, results[i].name, &baseline)) {
+            printf("%-22s %12s %12.2f %9s\n", results[i].name, "-", results[i].median_ns, "new");
+            continue;
+        }
+        double change = (results[i].median_ns / baseline - 1.0) * 100.0;
+        bool regression = change > threshold;
+        regressions += regression;
+        printf("%-22s %12.2f %12.2f %+8.1f%%%s\n", results[i].name, baseline, results[i].median_ns, change,
+               regression ? "  REGRESSION" : change < -threshold ? "  faster" : "");
+    }
+
+    // a benchmark that stopped running would hide its regression
+    int missing = 0;
+    const char *key = "\"name\": \"";
+    for (const char *entry = strstr(json, key); entry != NULL; entry = strstr(entry, key)) {
+        entry += strlen(key);
+        const char *end = strchr(entry, '"');
+        if (end == NULL) break;
+        char name[128];
+        snprintf(name, sizeof(name), "%.*s", (int) (end - entry), entry);
+        if (filter != NULL && strstr(name, filter) == NULL) continue;
+        bool ran = false;
+        for (int i=0; i<count && !ran; i++) ran = strcmp(results[i].name, name) == 0;
+        if (!ran) {
+            printf("%-22s %12s %12s %9s  MISSING\n", name, "", "-", "");
+            missing++;
+        }
+    }
+    free(json);
+    printf("%d regressions over %.1f%%, %d benchmarks of the baseline missing\n", regressions, threshold, missing);
+    if (missing != 0) ERROR("BENCH %d benchmarks of the baseline did not run, renamed or removed?", missing);
+    return regressions + missing;
+}
+
+static void usage() {
+    printf("minecraft-bench [--filter text] [--repetitions n] [--warmup n]\n"
+           "                [--json file] [--compare baseline.json] [--threshold percent]\n"
+           "                [--dir directory]\n");
+}
+
+static bool parse_args(int argc, char **argv, struct Options *options) {
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            options->help = true;
+            return true;
+        }
+        if (strncmp(argv[i], "--", 2) != 0) {
+            ERROR("BENCH unexpected argument %s", argv[i]);
+            usage();
+            return false;
+        }
+        if (i + 1 >= argc) {
+            ERROR("BENCH missing value for %s", argv[i]);
+            usage();
+            return false;
+        }
+        const char *value = argv[++i];
+        if      (strcmp(argv[i - 1], "--filter") == 0)      options->filter = value;
+        else if (strcmp(argv[i - 1], "--repetitions") == 0) options->repetitions = atoi(value);
+        else if (strcmp(argv[i - 1], "--warmup") == 0)      options->warmup = atoi(value);
+        else if (strcmp(argv[i - 1], "--json") == 0)        options->json = value;
+        else if (strcmp(argv[i - 1], "--compare") == 0)     options->compare = value;
+        else if (strcmp(argv[i - 1], "--threshold") == 0)   options->threshold = atof(value);
+        else if (strcmp(argv[i - 1], "--dir") == 0)         options->directory = value;
+        else {
+            ERROR("BENCH unknown option %s", argv[i - 1]);
+            usage();
+            return false;
+        }
+    }
+    if (options->repetitions < 1 || options->repetitions > MAX_REPETITIONS || options->warmup < 0 || options->threshold < 0) {
+        ERROR("BENCH repetitions must be 1..%d, warmup and threshold positive", MAX_REPETITIONS);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    struct Options options = {
+        .filter = NULL,
+        .repetitions = 10,
+        .warmup = 2,
+        .json = NULL,
+        .compare = NULL,
+        .threshold = 10.0,
+        .directory = "minecraft-bench-data",
+    };
+    set_log_level(WARNING);
+    if (!parse_args(argc, argv, &options)) return EXIT_FAILURE;
+    if (options.help) {
+        usage();
+        return EXIT_SUCCESS;
+    }
+
+    FILE *null = fopen(NULL_DEVICE, "w");
+    if (null == NULL || !setup(&options)) {
+        ERROR("BENCH setup failed");
+        return EXIT_FAILURE;
+    }
+
+    static struct Result results[MAX_BENCHMARKS];
+    int count = 0;
+    printf("%-22s %10s %10s %10s %10s %10s %10s\n", "benchmark", "ops", "warmup ns", "min ns", "median ns", "mean ns", "stddev");
+    for (size_t i=0; i<BENCHMARK_COUNT; i++) {
+        if (options.filter != NULL && strstr(benchmarks[i].name, options.filter) == NULL) continue;
+        struct Result *r = &results[count++];
+        run(&benchmarks[i], &options, null, r);
+        printf("%-22s %10llu %10.2f %10.2f %10.2f %10.2f %9.1f%%\n", r->name, (unsigned long long) r->operations,
+               r->warmup_ns, r->min_ns, r->median_ns, r->mean_ns, r->mean_ns > 0 ? r->stddev_ns / r->mean_ns * 100.0 : 0.0);
+        fflush(stdout);
+    }
+    teardown();
+    fclose(null);
+
+    if (options.json != NULL && !write_json(options.json, &options, results, count)) return EXIT_FAILURE;
+    if (options.compare != NULL) {
+        int regressions = compare(options.compare, options.threshold, options.filter, results, count);
+        if (regressions != 0) return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,229 @@
+// Block ticks: a timing wheel holding a million scheduled updates, each one
+// scheduled again when it runs so the count stays the same, against a binary
+// heap ordered by due tick doing the same work. Then the random ticks of
+// generated terrain against picking blocks in every section.
+//
+//   tick-bench [updates] [ticks]
+
+#include "blocktick.h"
+#include "log.h"
+#include "timer.h"
+#include "worldgen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_DELAY   12000       // 10 minutes of ticks
+#define EXTENT      1024        // blocks on x and z the positions spread over
+#define RADIUS      8           // chunks of terrain around the origin
+#define SEED        1234
+#define PASSES      200
+
+struct Run {
+    uint64_t ticked;
+    uint64_t checksum;          // of the positions ticked, the same whatever the order in a tick
+    double max_tick;
+};
+
+// of the position and the tick, so the wheel and the heap draw the same whatever their order
+static uint32_t random_delay(int32_t x, int32_t y, int32_t z, uint64_t now) {
+    uint64_t h = ((uint64_t) (uint32_t) x << 32 | (uint32_t) z) ^ ((uint64_t) y << 56) ^ (now * 0x9E3779B97F4A7C15ULL);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    // mostly short, like fluids and falling blocks, some long like crops
+    return (h & 3) == 0 ? 1 + (uint32_t) (h >> 8) % MAX_DELAY : 1 + (uint32_t) (h >> 8) % 40;
+}
+
+static void add_checksum(struct Run *run, int32_t x, int32_t y, int32_t z) {
+    run->ticked++;
+    run->checksum += ((uint64_t) (uint32_t) x * 2654435761u) ^ ((uint64_t) (uint32_t) y << 40) ^ (uint64_t) (uint32_t) z;
+}
+
+// -- timing wheel
+
+struct WheelRun {
+    struct Run run;
+    struct BlockTicks *ticks;
+    uint64_t now;
+};
+
+static void wheel_tick(void *user, int32_t x, int32_t y, int32_t z) {
+    struct WheelRun *wheel = user;
+    add_checksum(&wheel->run, x, y, z);
+    block_ticks_schedule(wheel->ticks, x, y, z, random_delay(x, y, z, wheel->now));
+}
+
+// -- binary heap of due ticks, one entry per position scheduled
+
+struct Entry {
+    uint64_t due;
+    int32_t x, y, z;
+};
+
+struct Heap {
+    struct Entry *entries;
+    uint32_t count;
+    uint64_t now;
+};
+
+static void heap_push(struct Heap *heap, struct Entry entry) {
+    uint32_t i = heap->count++;
+    while (i > 0 && heap->entries[(i - 1) / 2].due > entry.due) {
+        heap->entries[i] = heap->entries[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap->entries[i] = entry;
+}
+
+static struct Entry heap_pop(struct Heap *heap) {
+    struct Entry top = heap->entries[0];
+    struct Entry last = heap->entries[--heap->count];
+    uint32_t i = 0;
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= heap->count) break;
+        if (child + 1 < heap->count && heap->entries[child + 1].due < heap->entries[child].due) child++;
+        if (heap->entries[child].due >= last.due) break;
+        heap->entries[i] = heap->entries[child];
+        i = child;
+    }
+    heap->entries[i] = last;
+    return top;
+}
+
+static void heap_advance(struct Heap *heap, struct Run *run) {
+    while (heap->count > 0 && heap->entries[0].due <= heap->now) {
+        struct Entry entry = heap_pop(heap);
+        add_checksum(run, entry.x, entry.y, entry.z);
+        entry.due = heap->now + random_delay(entry.x, entry.y, entry.z, heap->now);
+        heap_push(heap, entry);
+    }
+    heap->now++;
+}
+
+static void position(uint32_t i, int32_t *x, int32_t *y, int32_t *z) {
+    *x = (int32_t) (i % EXTENT) - EXTENT / 2;
+    *z = (int32_t) (i / EXTENT % EXTENT) - EXTENT / 2;
+    *y = (int32_t) (i / (EXTENT * EXTENT));
+}
+
+static void print_run(const char *name, const struct Run *run, uint32_t ticks, double elapsed) {
+    printf("%-14s %10.0f ticks/s %8.3f ms/tick %8.3f max ms %8.2f M updates/s  checksum %016llx\n", name,
+           ticks / elapsed, elapsed * 1e3 / ticks, run->max_tick * 1e3, run->ticked / elapsed / 1e6,
+           (unsigned long long) run->checksum);
+}
+
+// -- random ticks
+
+static uint64_t random_hits;
+
+static void count_hit(void *user, int32_t x, int32_t y, int32_t z) {
+    (void) user; (void) x; (void) y; (void) z;
+    random_hits++;
+}
+
+// the same picks in every loaded section, no skipping
+static uint32_t every_section(struct World *world, uint32_t *seed) {
+    uint32_t sampled = 0, cursor = 0;
+    struct Chunk *chunk;
+    while ((chunk = world_next_chunk(world, &cursor)) != NULL) {
+        for (int s=0; s<CHUNK_SECTIONS; s++) {
+            const struct Section *section = &chunk->sections[s];
+            sampled++;
+            for (int n=0; n<RANDOM_TICKS_PER_SECTION; n++) {
+                *seed = *seed * 1664525u + 1013904223u;
+                uint32_t i = *seed >> 20;
+                block_t block = section->blocks ? section->blocks[i] : section->single;
+                if (block_has(block, BLOCK_FLAG_RANDOM_TICK)) count_hit(NULL, 0, 0, 0);
+            }
+        }
+    }
+    return sampled;
+}
+
+int main(int argc, char **argv) {
+    uint32_t count = argc > 1 ? (uint32_t) atoi(argv[1]) : 1000000;
+    uint32_t ticks = argc > 2 ? (uint32_t) atoi(argv[2]) : 4200;     // past a level 2 slot
+    if (ticks < 1) ticks = 1;
+    set_log_level(WARNING);
+
+    struct WheelRun wheel = {{0, 0, 0.0}, block_ticks_create(), 0};
+    double start = timer_now();
+    block_ticks_reserve(wheel.ticks, count);
+    for (uint32_t i=0; i<count; i++) {
+        int32_t x, y, z;
+        position(i, &x, &y, &z);
+        block_ticks_schedule(wheel.ticks, x, y, z, random_delay(x, y, z, 0));
+    }
+    double scheduled = timer_now() - start;
+    uint32_t again = 0;
+    for (uint32_t i=0; i<count; i+=16) {
+        int32_t x, y, z;
+        position(i, &x, &y, &z);
+        again += block_ticks_schedule(wheel.ticks, x, y, z, 1);
+    }
+    printf("%u updates scheduled in %.1f ms, %u of %u scheduled twice kept\n",
+           block_ticks_count(wheel.ticks), scheduled * 1e3, again, (count + 15) / 16);
+
+    struct Run heap_run = {0, 0, 0.0};
+    struct Heap heap = {malloc(count * sizeof(struct Entry)), 0, 0};
+    start = timer_now();
+    for (uint32_t i=0; i<count; i++) {
+        struct Entry entry;
+        position(i, &entry.x, &entry.y, &entry.z);
+        entry.due = random_delay(entry.x, entry.y, entry.z, 0);
+        heap_push(&heap, entry);
+    }
+    double heap_scheduled = timer_now() - start;
+    printf("heap filled in %.1f ms\n", heap_scheduled * 1e3);
+
+    start = timer_now();
+    for (uint32_t t=0; t<ticks; t++) {
+        double tick_start = timer_now();
+        block_ticks_advance(wheel.ticks, UINT32_MAX, wheel_tick, &wheel);
+        wheel.now++;
+        double elapsed = timer_now() - tick_start;
+        if (elapsed > wheel.run.max_tick) wheel.run.max_tick = elapsed;
+    }
+    print_run("timing wheel", &wheel.run, ticks, timer_now() - start);
+
+    start = timer_now();
+    for (uint32_t t=0; t<ticks; t++) {
+        double tick_start = timer_now();
+        heap_advance(&heap, &heap_run);
+        double elapsed = timer_now() - tick_start;
+        if (elapsed > heap_run.max_tick) heap_run.max_tick = elapsed;
+    }
+    print_run("binary heap", &heap_run, ticks, timer_now() - start);
+    printf("%llu updates over %u ticks, %u still scheduled\n",
+           (unsigned long long) wheel.run.ticked, ticks, block_ticks_count(wheel.ticks));
+    bool same = wheel.run.ticked == heap_run.ticked && wheel.run.checksum == heap_run.checksum;
+    if (!same) printf("the wheel and the heap ticked different positions\n");
+    block_ticks_destroy(wheel.ticks);
+    free(heap.entries);
+
+    // random ticks over generated terrain: grass is the only block with them
+    struct World *world = world_create();
+    for (int x=-RADIUS; x<RADIUS; x++) {
+        for (int z=-RADIUS; z<RADIUS; z++) worldgen_generate_chunk(world, x, z, SEED);
+    }
+    uint32_t seed = 1, sampled = 0;
+    block_random_ticks(world, RANDOM_TICKS_PER_SECTION, &seed, count_hit, NULL);    // counts the sections
+    random_hits = 0;
+    start = timer_now();
+    for (int p=0; p<PASSES; p++) sampled = block_random_ticks(world, RANDOM_TICKS_PER_SECTION, &seed, count_hit, NULL);
+    double skipping = timer_now() - start;
+    uint64_t skipping_hits = random_hits;
+
+    uint32_t all = 0;
+    random_hits = 0;
+    start = timer_now();
+    for (int p=0; p<PASSES; p++) all = every_section(world, &seed);
+    double every = timer_now() - start;
+    printf("random ticks   %u of %u sections sampled\n", sampled, all);
+    printf("  skipping     %8.3f ms/pass  %6.1f blocks ticked/pass\n", skipping * 1e3 / PASSES, (double) skipping_hits / PASSES);
+    printf("  every one    %8.3f ms/pass  %6.1f blocks ticked/pass\n", every * 1e3 / PASSES, (double) random_hits / PASSES);
+    world_destroy(world);
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
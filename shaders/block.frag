@@ -0,0 +1,26 @@
+#version 450
+
+// set per pipeline variant through VkSpecializationInfo (see pipeline.c)
+layout (constant_id = 0) const int PASS = 0; // 0 opaque, 1 cutout, 2 translucent, 3 wireframe
+layout (constant_id = 1) const float ALPHA_CUTOFF = 0.0;
+
+layout (location = 0) in vec4 frag_color;
+
+layout (location = 0) out vec4 out_color;
+
+void main(){
+    vec4 color = frag_color;
+
+    // PASS is a constant, the compiler removes the branches that do not apply
+    if (PASS == 0) {
+        color.a = 1.0;
+    }
+    if (PASS == 1 && color.a < ALPHA_CUTOFF) {
+        discard;
+    }
+    if (PASS == 3) {
+        color = vec4(1.0);
+    }
+
+    out_color = color;
+}
@@ -0,0 +1,28 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// block ids and BLOCK_COLORS, generated from data/blocks.txt
+#include "blocks.glsl"
+
+// one struct BlockVertex (mesher.h) per vertex
+layout (location = 0) in ivec4 position;   // x y z relative to the section origin, block
+layout (location = 1) in uvec2 face_size;  // enum block_face, cell size
+
+layout (push_constant) uniform Push {
+    mat4 view_proj;
+    vec4 origin;    // section origin minus the camera position
+} push;
+
+layout (location = 0) out vec4 frag_color;
+
+// the depth pre-pass and the opaque pass must land on the exact same depth
+invariant gl_Position;
+
+// by enum block_face: -x +x -y +y -z +z
+const float shade[6] = float[](0.8, 0.8, 0.5, 1.0, 0.65, 0.65);
+
+void main() {
+    gl_Position = push.view_proj * vec4(push.origin.xyz + vec3(position.xyz), 1.0);
+    vec4 color = BLOCK_COLORS[clamp(position.w, 0, BLOCK_COUNT - 1)];
+    frag_color = vec4(color.rgb * shade[min(face_size.x, 5u)], color.a);
+}
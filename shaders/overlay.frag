@@ -0,0 +1,13 @@
+#version 450
+
+// the font, one channel: 1 inside the glyphs, the solid glyph for the plain quads
+layout (binding = 0) uniform sampler2D font;
+
+layout (location = 0) in vec2 frag_uv;
+layout (location = 1) in vec4 frag_color;
+
+layout (location = 0) out vec4 out_color;
+
+void main() {
+    out_color = vec4(frag_color.rgb, frag_color.a * texture(font, frag_uv).r);
+}
@@ -0,0 +1,19 @@
+#version 450
+
+// positions are in pixels from the top left corner of the window
+layout (push_constant) uniform Screen {
+    vec2 size;
+} screen;
+
+layout (location = 0) in vec2 in_position;
+layout (location = 1) in vec2 in_uv;
+layout (location = 2) in vec4 in_color;
+
+layout (location = 0) out vec2 frag_uv;
+layout (location = 1) out vec4 frag_color;
+
+void main() {
+    gl_Position = vec4(in_position / screen.size * 2.0 - 1.0, 0.0, 1.0);
+    frag_uv = in_uv;
+    frag_color = in_color;
+}
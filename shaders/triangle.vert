@@ -1,22 +0,0 @@
-#version 450
-
-layout (location = 0) out vec3 frag_color;
-
-vec2 position[3] = vec2[](
-    vec2(0.0, -5.0),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
-
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
-
-
-void main() {
-    gl_Position = vec4(position[gl_VertexIndex], 0.0, 0.1);
-    frag_color = colors[gl_VertexIndex];
-}
- 
\ No newline at end of file
@@ -0,0 +1,40 @@
+#include "block.h"
+#include "log.h"
+
+#include <string.h>
+
+block_t block_register(const struct BlockDef *def) {
+    if (def->name == NULL || block_find(def->name) != BLOCK_NONE) {
+        ERROR("BLOCK %s is already registered", def->name ? def->name : "(null)");
+        return BLOCK_NONE;
+    }
+    if ((def->flags & BLOCK_LAYER_FLAGS) == BLOCK_LAYER_FLAGS) {
+        ERROR("BLOCK %s is either cutout or translucent, not both", def->name);
+        return BLOCK_NONE;
+    }
+    if (block_tables.count >= BLOCK_MAX) {
+        ERROR("BLOCK no id left for %s, %d at most", def->name, BLOCK_MAX);
+        return BLOCK_NONE;
+    }
+
+    block_t id = (block_t) block_tables.count++;
+    for (int f=0; f<BLOCK_FLAG_COUNT; f++) {
+        if (def->flags & (1u << f)) block_tables.flags[f][id >> 6] |= 1ull << (id & 63);
+    }
+    block_tables.light[id] = def->light < BLOCK_MAX_LIGHT ? def->light : BLOCK_MAX_LIGHT;
+    memcpy(block_tables.faces[id], def->faces, sizeof(block_tables.faces[id]));
+    block_tables.names[id] = def->name;
+    INFO("BLOCK %s registered as %u", def->name, id);
+    return id;
+}
+
+block_t block_find(const char *name) {
+    for (uint32_t i=0; i<block_tables.count; i++) {
+        if (strcmp(block_tables.names[i], name) == 0) return (block_t) i;
+    }
+    return BLOCK_NONE;
+}
+
+const char *block_name(block_t block) {
+    return block_id(block) < block_tables.count ? block_tables.names[block_id(block)] : "?";
+}
@@ -0,0 +1,134 @@
+// Block registry.
+// The properties of every block id live in flat tables: one bitset per flag and
+// one array per value, so the hot loops (mesher, physics, raycasts) read them with
+// a load, a shift and a mask instead of a switch over the ids. The built in blocks
+// come from data/blocks.txt, turned into block_table.c by tools/blockgen.c at
+// build time. Mods add theirs with block_register() at start, before any world
+// exists: the tables are read without locks.
+// A block_t is an id in its low BLOCK_ID_BITS and a state above them (the level
+// of a flowing fluid). The state goes wherever the block goes, saves and network
+// included, and the tables only look at the id. State 0 is the plain block.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BLOCK_ID_BITS   8
+#define BLOCK_MAX       (1 << BLOCK_ID_BITS)    // ids the tables have room for, built in and registered
+#define BLOCK_WORDS     (BLOCK_MAX / 64)
+#define BLOCK_NONE      BLOCK_MAX
+#define BLOCK_MAX_LIGHT 15
+
+#if defined(_MSC_VER)
+#define CACHE_ALIGNED __declspec(align(64))
+#else
+#define CACHE_ALIGNED __attribute__((aligned(64)))
+#endif
+
+typedef uint16_t block_t;
+
+// the order of data/blocks.txt
+enum block_id {
+    BLOCK_AIR = 0,
+    BLOCK_STONE,
+    BLOCK_DIRT,
+    BLOCK_GRASS,
+    BLOCK_SAND,
+    BLOCK_WATER,
+    BLOCK_GLASS,
+    BLOCK_LEAVES,
+    BLOCK_LOG,
+    BLOCK_BEDROCK,
+    BLOCK_LAVA,
+    BLOCK_COUNT     // built in, the registered ones follow
+};
+
+// faces of a block, also the side a ray enters it from
+enum block_face {
+    FACE_NEG_X = 0,
+    FACE_POS_X,
+    FACE_NEG_Y,
+    FACE_POS_Y,
+    FACE_NEG_Z,
+    FACE_POS_Z,
+    FACE_COUNT,
+    FACE_NONE = FACE_COUNT
+};
+
+enum block_flag {
+    BLOCK_FLAG_SOLID = 0,       // entities collide with it, rays stop on it
+    BLOCK_FLAG_OPAQUE,          // hides the faces of its neighbors
+    BLOCK_FLAG_CUTOUT,          // drawn with alpha test, MESH_LAYER_CUTOUT
+    BLOCK_FLAG_TRANSLUCENT,     // drawn blended, MESH_LAYER_TRANSLUCENT
+    BLOCK_FLAG_LIQUID,
+    BLOCK_FLAG_FALLS,           // falls when nothing holds it
+    BLOCK_FLAG_RANDOM_TICK,     // changes by itself, see block_random_ticks()
+    BLOCK_FLAG_COUNT
+};
+
+// a block is in one mesh layer, at most one of these
+#define BLOCK_LAYER_FLAGS ((1u << BLOCK_FLAG_CUTOUT) | (1u << BLOCK_FLAG_TRANSLUCENT))
+
+// what a mod gives for a new block
+struct BlockDef {
+    const char *name;
+    uint32_t flags;                 // 1 << enum block_flag
+    uint8_t light;                  // emitted, up to BLOCK_MAX_LIGHT
+    uint8_t faces[FACE_COUNT];      // texture layer of each face
+};
+
+// indexed by block id, each table starts on its own cache line
+struct BlockTables {
+    CACHE_ALIGNED uint64_t flags[BLOCK_FLAG_COUNT][BLOCK_WORDS];
+    CACHE_ALIGNED uint8_t light[BLOCK_MAX];
+    CACHE_ALIGNED uint8_t faces[BLOCK_MAX][FACE_COUNT];
+    const char *names[BLOCK_MAX];
+    uint32_t count;                 // ids in use
+};
+
+// block_table.c, generated
+extern struct BlockTables block_tables;
+
+static inline block_t block_id(block_t block) {
+    return (block_t) (block & (BLOCK_MAX - 1));
+}
+
+static inline uint32_t block_state(block_t block) {
+    return (uint32_t) block >> BLOCK_ID_BITS;
+}
+
+// the id of block with state instead of its own
+static inline block_t block_with_state(block_t block, uint32_t state) {
+    return (block_t) (block_id(block) | state << BLOCK_ID_BITS);
+}
+
+// ids past the registered ones read as air
+static inline bool block_has(block_t block, enum block_flag flag) {
+    uint32_t id = block_id(block);
+    return (block_tables.flags[flag][id >> 6] >> (id & 63)) & 1;
+}
+
+static inline bool block_is_solid(block_t block) {
+    return block_has(block, BLOCK_FLAG_SOLID);
+}
+
+// hides the faces of its neighbors
+static inline bool block_is_opaque(block_t block) {
+    return block_has(block, BLOCK_FLAG_OPAQUE);
+}
+
+static inline uint8_t block_light(block_t block) {
+    return block_tables.light[block_id(block)];
+}
+
+static inline uint8_t block_face_layer(block_t block, enum block_face face) {
+    return block_tables.faces[block_id(block)][face];
+}
+
+// a new id after the built in ones, BLOCK_NONE when the tables are full, the name is taken
+// or the flags hold both BLOCK_LAYER_FLAGS
+block_t block_register(const struct BlockDef *def);
+// BLOCK_NONE when no block has that name
+block_t block_find(const char *name);
+const char *block_name(block_t block);
@@ -0,0 +1,321 @@
+#include "blocktick.h"
+#include "log.h"
+#include "memory.h"
+
+#define EMPTY_KEY   UINT64_MAX
+#define SLOT_BITS   6
+#define SLOT_MASK   (BLOCK_TICK_SLOTS - 1)
+#define WHEEL_BITS  (SLOT_BITS * BLOCK_TICK_LEVELS)
+#define MIN_CAPACITY 1024
+
+struct Tick {
+    uint64_t key;       // packed position
+    uint64_t due;
+};
+
+struct TickList {
+    struct Tick *ticks;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+struct BlockTicks {
+    struct TickList wheel[BLOCK_TICK_LEVELS][BLOCK_TICK_SLOTS];
+    struct TickList overflow;   // due past the top level, see insert()
+    // the slots coming due at the next multiple of 64 already moved down, placed
+    // as if now were there. See drain()
+    struct TickList next[BLOCK_TICK_LEVELS - 1][BLOCK_TICK_SLOTS];
+    // open addressing on the position, the schedule that stands. A tick in
+    // the wheel whose due does not match the one here was cancelled
+    struct Tick *table;
+    uint32_t capacity;          // power of 2
+    uint32_t count;
+    uint64_t now;               // the next tick to run
+};
+
+// 26 bits for x and z, 8 for y: never EMPTY_KEY
+static uint64_t pack(int32_t x, int32_t y, int32_t z) {
+    return ((uint64_t) (x & 0x3FFFFFF) << 34) | ((uint64_t) (z & 0x3FFFFFF) << 8) | (uint64_t) (y & 0xFF);
+}
+
+static void unpack(uint64_t key, int32_t *x, int32_t *y, int32_t *z) {
+    *x = (int32_t) ((uint32_t) (key >> 34) << 6) >> 6;
+    *z = (int32_t) ((uint32_t) (key >> 8) << 6) >> 6;
+    *y = (int32_t) (key & 0xFF);
+}
+
+static uint32_t hash_key(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    return (uint32_t) key;
+}
+
+static uint32_t find_slot(const struct Tick *table, uint32_t capacity, uint64_t key) {
+    uint32_t mask = capacity - 1;
+    uint32_t slot = hash_key(key) & mask;
+    while (table[slot].key != EMPTY_KEY && table[slot].key != key) slot = (slot + 1) & mask;
+    return slot;
+}
+
+static bool alloc_table(struct BlockTicks *ticks, uint32_t capacity) {
+    struct Tick *table = memory_alloc(capacity * sizeof(*table), MEMORY_TAG_SIMULATION);
+    if (table == NULL) return false;
+    for (uint32_t i=0; i<capacity; i++) table[i].key = EMPTY_KEY;
+
+    for (uint32_t i=0; i<ticks->capacity; i++) {
+        if (ticks->table[i].key != EMPTY_KEY) table[find_slot(table, capacity, ticks->table[i].key)] = ticks->table[i];
+    }
+    memory_free(ticks->table);
+    ticks->table = table;
+    ticks->capacity = capacity;
+    return true;
+}
+
+static void table_remove(struct BlockTicks *ticks, uint32_t slot) {
+    uint32_t mask = ticks->capacity - 1;
+    ticks->table[slot].key = EMPTY_KEY;
+    ticks->count--;
+
+    // backward shift the entries after the hole so the probe chains stay intact
+    uint32_t hole = slot;
+    uint32_t next = (slot + 1) & mask;
+    while (ticks->table[next].key != EMPTY_KEY) {
+        uint32_t home = hash_key(ticks->table[next].key) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            ticks->table[hole] = ticks->table[next];
+            ticks->table[next].key = EMPTY_KEY;
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+static bool list_push(struct TickList *list, struct Tick tick) {
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 64;
+        struct Tick *grown = memory_realloc(list->ticks, capacity * sizeof(*grown), MEMORY_TAG_SIMULATION);
+        if (grown == NULL) {
+            FATAL("BLOCKTICK out of memory scheduling %u ticks in a slot", capacity);
+            return false;
+        }
+        list->ticks = grown;
+        list->capacity = capacity;
+    }
+    list->ticks[list->count++] = tick;
+    return true;
+}
+
+// the level is the highest group of 6 bits where due and now differ: the tick moves
+// down when now gets there. Past the top level it waits in the overflow until now
+// reaches the next multiple of 64^4, the delay cut to BLOCK_TICK_MAX_DELAY keeps
+// it within the wheel from there
+static bool insert_at(struct TickList wheel[][BLOCK_TICK_SLOTS], struct TickList *overflow, uint64_t now, struct Tick tick) {
+    uint64_t diff = tick.due ^ now;
+    for (int level=0; level<BLOCK_TICK_LEVELS; level++) {
+        if (diff >> (SLOT_BITS * (level + 1)) == 0) {
+            return list_push(&wheel[level][(tick.due >> (SLOT_BITS * level)) & SLOT_MASK], tick);
+        }
+    }
+    return list_push(overflow, tick);
+}
+
+static bool insert(struct BlockTicks *ticks, struct Tick tick) {
+    return insert_at(ticks->wheel, &ticks->overflow, ticks->now, tick);
+}
+
+// every tick of the list again, at a lower level now
+static void cascade(struct BlockTicks *ticks, struct TickList *list) {
+    uint32_t count = list->count;
+    list->count = 0;
+    for (uint32_t i=0; i<count; i++) insert(ticks, list->ticks[i]);
+}
+
+// A slot of a higher level holds every tick due in its range, cascading it all at
+// once makes that one tick much longer than the others. So the slots due at the
+// next multiple of 64 move down a share per tick over the 64 before it, into next
+// where they are placed as if now were already there. None of them is due before.
+// What fn schedules into those slots meanwhile is left to cascade()
+static void drain(struct BlockTicks *ticks) {
+    uint64_t at = (ticks->now | SLOT_MASK) + 1;
+    uint64_t left = at - ticks->now;                    // ticks, this one included
+    for (int level=1; level<BLOCK_TICK_LEVELS; level++) {
+        if ((at & ((1ull << (SLOT_BITS * level)) - 1)) != 0) break;
+        struct TickList *list = &ticks->wheel[level][(at >> (SLOT_BITS * level)) & SLOT_MASK];
+        uint32_t moves = (uint32_t) ((list->count + left - 1) / left);
+        // the last ones first, the list only shrinks. Due below the level, they never overflow
+        for (uint32_t i=0; i<moves; i++) insert_at(ticks->next, NULL, at, list->ticks[--list->count]);
+    }
+}
+
+// at the multiple of 64 drain() was working towards, its slots are empty below
+// the levels it moved ticks to, but for those over the budget at level 0
+static void merge_next(struct BlockTicks *ticks) {
+    for (int level=0; level<BLOCK_TICK_LEVELS - 1; level++) {
+        for (int s=0; s<BLOCK_TICK_SLOTS; s++) {
+            struct TickList *next = &ticks->next[level][s];
+            struct TickList *list = &ticks->wheel[level][s];
+            if (next->count == 0) continue;
+            if (list->count == 0) {
+                struct TickList swap = *list;
+                *list = *next;
+                *next = swap;
+                continue;
+            }
+            for (uint32_t i=0; i<next->count; i++) list_push(list, next->ticks[i]);
+            next->count = 0;
+        }
+    }
+}
+
+struct BlockTicks *block_ticks_create() {
+    struct BlockTicks *ticks = memory_calloc(1, sizeof(*ticks), MEMORY_TAG_SIMULATION);
+    if (ticks == NULL || !alloc_table(ticks, MIN_CAPACITY)) {
+        FATAL("BLOCKTICK failed to allocate");
+        memory_free(ticks);
+        return NULL;
+    }
+    return ticks;
+}
+
+void block_ticks_destroy(struct BlockTicks *ticks) {
+    if (ticks == NULL) return;
+    for (int level=0; level<BLOCK_TICK_LEVELS; level++) {
+        for (int s=0; s<BLOCK_TICK_SLOTS; s++) memory_free(ticks->wheel[level][s].ticks);
+    }
+    for (int level=0; level<BLOCK_TICK_LEVELS - 1; level++) {
+        for (int s=0; s<BLOCK_TICK_SLOTS; s++) memory_free(ticks->next[level][s].ticks);
+    }
+    memory_free(ticks->overflow.ticks);
+    memory_free(ticks->table);
+    memory_free(ticks);
+}
+
+bool block_ticks_reserve(struct BlockTicks *ticks, uint32_t count) {
+    if (count > UINT32_MAX / 4) return false;
+    uint32_t capacity = ticks->capacity;
+    while (capacity < count * 2) capacity *= 2;
+    if (capacity == ticks->capacity) return true;
+    if (!alloc_table(ticks, capacity)) {
+        ERROR("BLOCKTICK out of memory reserving %u positions", count);
+        return false;
+    }
+    return true;
+}
+
+bool block_ticks_schedule(struct BlockTicks *ticks, int32_t x, int32_t y, int32_t z, uint32_t delay) {
+    uint64_t key = pack(x, y, z);
+    uint32_t slot = find_slot(ticks->table, ticks->capacity, key);
+    if (ticks->table[slot].key != EMPTY_KEY) return false;
+
+    if ((ticks->count + 1) * 2 > ticks->capacity) {
+        if (!alloc_table(ticks, ticks->capacity * 2)) {
+            FATAL("BLOCKTICK out of memory growing the table to %u", ticks->capacity * 2);
+            return false;
+        }
+        slot = find_slot(ticks->table, ticks->capacity, key);
+    }
+    if (delay < 1) delay = 1;
+    if (delay > BLOCK_TICK_MAX_DELAY) delay = BLOCK_TICK_MAX_DELAY;
+    struct Tick tick = {key, ticks->now + delay};
+    if (!insert(ticks, tick)) return false;
+    ticks->table[slot] = tick;
+    ticks->count++;
+    return true;
+}
+
+bool block_ticks_pending(const struct BlockTicks *ticks, int32_t x, int32_t y, int32_t z) {
+    return ticks->table[find_slot(ticks->table, ticks->capacity, pack(x, y, z))].key != EMPTY_KEY;
+}
+
+// the tick stays in its slot and is dropped when due
+void block_ticks_cancel(struct BlockTicks *ticks, int32_t x, int32_t y, int32_t z) {
+    uint32_t slot = find_slot(ticks->table, ticks->capacity, pack(x, y, z));
+    if (ticks->table[slot].key != EMPTY_KEY) table_remove(ticks, slot);
+}
+
+uint32_t block_ticks_advance(struct BlockTicks *ticks, uint32_t budget, block_tick_fn fn, void *user) {
+    uint64_t now = ticks->now;
+    // the slots of now at the higher levels move down, the top first so that
+    // its ticks due now go on down to level 0. Most of them were already by drain()
+    if ((now & SLOT_MASK) == 0) merge_next(ticks);
+    if ((now & ((1ull << WHEEL_BITS) - 1)) == 0) cascade(ticks, &ticks->overflow);
+    for (int level=BLOCK_TICK_LEVELS - 1; level>0; level--) {
+        if ((now & ((1ull << (SLOT_BITS * level)) - 1)) != 0) continue;
+        cascade(ticks, &ticks->wheel[level][(now >> (SLOT_BITS * level)) & SLOT_MASK]);
+    }
+    drain(ticks);
+
+    // fn schedules at least one tick ahead, never in this slot
+    struct TickList *due = &ticks->wheel[0][now & SLOT_MASK];
+    uint32_t ticked = 0, i = 0;
+    for (; i<due->count && ticked<budget; i++) {
+        struct Tick tick = due->ticks[i];
+        uint32_t slot = find_slot(ticks->table, ticks->capacity, tick.key);
+        if (ticks->table[slot].key == EMPTY_KEY || ticks->table[slot].due != tick.due) continue;     // cancelled
+        table_remove(ticks, slot);
+        int32_t x, y, z;
+        unpack(tick.key, &x, &y, &z);
+        fn(user, x, y, z);
+        ticked++;
+    }
+
+    // over budget, the rest is due the next tick and stays scheduled
+    ticks->now++;
+    for (; i<due->count; i++) {
+        struct Tick tick = due->ticks[i];
+        uint32_t slot = find_slot(ticks->table, ticks->capacity, tick.key);
+        if (ticks->table[slot].key == EMPTY_KEY || ticks->table[slot].due != tick.due) continue;
+        tick.due = ticks->now;
+        ticks->table[slot].due = tick.due;
+        insert(ticks, tick);
+    }
+    due->count = 0;
+    return ticked;
+}
+
+uint32_t block_ticks_count(const struct BlockTicks *ticks) {
+    return ticks->count;
+}
+
+// whether a section holds random tick blocks, counted again when it changed
+static bool section_ticking(struct Chunk *chunk, int s) {
+    uint32_t bit = 1u << s;
+    if (chunk->recount & bit) {
+        const struct Section *section = &chunk->sections[s];
+        bool ticking = block_has(section->single, BLOCK_FLAG_RANDOM_TICK);
+        if (section->blocks != NULL) {
+            ticking = false;
+            for (uint32_t i=0; i<SECTION_VOLUME && !ticking; i++) {
+                ticking = block_has(section->blocks[i], BLOCK_FLAG_RANDOM_TICK);
+            }
+        }
+        chunk->ticking = ticking ? chunk->ticking | bit : chunk->ticking & ~bit;
+        chunk->recount &= ~bit;
+    }
+    return (chunk->ticking & bit) != 0;
+}
+
+uint32_t block_random_ticks(struct World *world, uint32_t per_section, uint32_t *seed, block_tick_fn fn, void *user) {
+    uint32_t sampled = 0, cursor = 0;
+    struct Chunk *chunk;
+    while ((chunk = world_next_chunk(world, &cursor)) != NULL) {
+        if (chunk->recount == 0 && chunk->ticking == 0) continue;
+        for (int s=0; s<CHUNK_SECTIONS; s++) {
+            if (!section_ticking(chunk, s)) continue;
+            sampled++;
+            for (uint32_t n=0; n<per_section; n++) {
+                // read again every time, fn may draw from it too
+                *seed = *seed * 1664525u + 1013904223u;
+                uint32_t i = *seed >> 20;                   // 12 bits, y z x
+                const struct Section *section = &chunk->sections[s];
+                block_t block = section->blocks ? section->blocks[i] : section->single;
+                if (!block_has(block, BLOCK_FLAG_RANDOM_TICK)) continue;
+                fn(user, chunk->x * SECTION_SIZE + (int32_t) (i & SECTION_MASK),
+                   s * SECTION_SIZE + (int32_t) (i >> (2 * SECTION_SHIFT)),
+                   chunk->z * SECTION_SIZE + (int32_t) ((i >> SECTION_SHIFT) & SECTION_MASK));
+            }
+        }
+    }
+    return sampled;
+}
@@ -0,0 +1,48 @@
+// Block ticks: the updates a block asks for some ticks ahead (falling sand,
+// flowing fluids, delays), and the random ticks of the blocks that change by
+// themselves (grass).
+// Scheduled ticks wait in a hierarchical timing wheel: 4 levels of 64 slots,
+// level k holds the ticks due within 64^(k+1) ticks. Scheduling appends to a
+// slot, a slot of a higher level moves down a level each time the tick counter
+// reaches it, so every update is touched at most 4 times whatever the number
+// pending. Those moves are spread over the 64 ticks before the slot is due.
+// A position is scheduled once, the first schedule stands.
+// Random ticks pick a few blocks in every section holding blocks with
+// BLOCK_FLAG_RANDOM_TICK, the sections with none of them are skipped.
+
+#pragma once
+
+#include "world.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BLOCK_TICK_LEVELS       4
+#define BLOCK_TICK_SLOTS        64
+#define BLOCK_TICK_MAX_DELAY    ((1u << 24) - 1)    // 64^4 - 1, longer delays are cut to it
+#define RANDOM_TICKS_PER_SECTION 3
+
+typedef void (*block_tick_fn)(void *user, int32_t x, int32_t y, int32_t z);
+
+struct BlockTicks;
+
+struct BlockTicks *block_ticks_create();
+void block_ticks_destroy(struct BlockTicks *ticks);
+
+// room for count positions without growing the table while scheduling them
+bool block_ticks_reserve(struct BlockTicks *ticks, uint32_t count);
+// x,y,z is due delay ticks from now, at least 1. False when it already is scheduled
+// (the first one stands) or out of memory
+bool block_ticks_schedule(struct BlockTicks *ticks, int32_t x, int32_t y, int32_t z, uint32_t delay);
+bool block_ticks_pending(const struct BlockTicks *ticks, int32_t x, int32_t y, int32_t z);
+void block_ticks_cancel(struct BlockTicks *ticks, int32_t x, int32_t y, int32_t z);
+// moves one tick ahead and calls fn on the positions due, at most budget of them:
+// the rest is due the next tick. fn may schedule. Returns the positions ticked
+uint32_t block_ticks_advance(struct BlockTicks *ticks, uint32_t budget, block_tick_fn fn, void *user);
+// positions scheduled
+uint32_t block_ticks_count(const struct BlockTicks *ticks);
+
+// calls fn on per_section random blocks of every loaded section holding blocks with
+// BLOCK_FLAG_RANDOM_TICK, those picked without the flag are skipped. *seed is the
+// state of the random numbers (an LCG), fn may draw from it. Returns the sections sampled
+uint32_t block_random_ticks(struct World *world, uint32_t per_section, uint32_t *seed, block_tick_fn fn, void *user);
@@ -0,0 +1,123 @@
+#include "capture.h"
+
+#include "image.h"
+#include "log.h"
+#include "readback.h"
+
+#include <stdio.h>
+
+#if defined(_WIN32)
+#include <direct.h>
+#define make_directory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define make_directory(path) mkdir(path, 0755)
+#endif
+
+#define PATH_LENGTH 512
+
+static struct CaptureConfig config;
+// counted by the jobs
+static uint32_t written;        // captures, or golden images that were missing
+static uint32_t matched;
+static uint32_t failed;         // differing, without a golden image or not written
+static uint32_t dropped;        // no readback buffer free, no readback at all or no memory for the image
+
+
+bool capture_init(const struct CaptureConfig *_config) {
+    config = *_config;
+    written = matched = failed = dropped = 0;
+    if (config.directory == NULL) return true;
+    if (config.every == 0) config.every = CAPTURE_EVERY;
+    // fails harmlessly when it exists
+    make_directory(config.directory);
+    INFO("CAPTURE %s %s every %u ticks", !config.golden ? "writing to" : config.update ? "updating" : "comparing with",
+         config.directory, config.every);
+    return true;
+}
+
+bool capture_enabled() {
+    return config.directory != NULL;
+}
+
+static void count(uint32_t *counter) {
+    __atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+}
+
+// on a worker
+static void capture_frame(void *user, uint64_t tick, const struct Image *image) {
+    (void) user;
+    if (image == NULL) {
+        WARNING("CAPTURE tick %llu dropped, no memory for the image", (unsigned long long) tick);
+        count(&dropped);
+        return;
+    }
+    char path[PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/tick_%06llu.ppm", config.directory, (unsigned long long) tick);
+
+    struct Image golden;
+    if (!config.golden) {
+        count(image_write_ppm(image, path) ? &written : &failed);
+        return;
+    }
+    if (!image_read_ppm(&golden, path)) {
+        if (config.update) {
+            WARNING("CAPTURE no golden image for tick %llu, writing it", (unsigned long long) tick);
+            count(image_write_ppm(image, path) ? &written : &failed);
+            return;
+        }
+        // a wrong directory or a damaged baseline compares nothing, it must not pass
+        ERROR("CAPTURE no readable golden image %s, --update-golden writes the missing ones", path);
+        snprintf(path, sizeof(path), "%s/tick_%06llu.actual.ppm", config.directory, (unsigned long long) tick);
+        image_write_ppm(image, path);
+        count(&failed);
+        return;
+    }
+
+    struct ImageDiff diff;
+    bool same_size = image_compare(image, &golden, config.tolerance, &diff);
+    image_destroy(&golden);
+    if (same_size && diff.differing <= (uint64_t) (diff.pixels * CAPTURE_MAX_DIFFERING)) {
+        INFO("CAPTURE tick %llu matches, %llu pixels differ, by %d at most", (unsigned long long) tick,
+             (unsigned long long) diff.differing, diff.max_difference);
+        count(&matched);
+        // left by an earlier run that failed
+        snprintf(path, sizeof(path), "%s/tick_%06llu.actual.ppm", config.directory, (unsigned long long) tick);
+        remove(path);
+        return;
+    }
+
+    // next to the golden image, to look at both
+    if (same_size) {
+        ERROR("CAPTURE tick %llu differs: %llu of %llu pixels beyond %d, by %d at most", (unsigned long long) tick,
+              (unsigned long long) diff.differing, (unsigned long long) diff.pixels, config.tolerance, diff.max_difference);
+    } else {
+        ERROR("CAPTURE tick %llu is %ux%u, the golden image is %ux%u", (unsigned long long) tick,
+              image->width, image->height, golden.width, golden.height);
+    }
+    snprintf(path, sizeof(path), "%s/tick_%06llu.actual.ppm", config.directory, (unsigned long long) tick);
+    image_write_ppm(image, path);
+    count(&failed);
+}
+
+void capture_tick(uint64_t tick) {
+    if (config.directory == NULL || tick == 0 || tick % config.every != 0) return;
+    if (!readback_request(tick, capture_frame, NULL)) {
+        WARNING("CAPTURE tick %llu dropped, no readback buffer", (unsigned long long) tick);
+        count(&dropped);
+    }
+}
+
+bool capture_finish() {
+    if (config.directory == NULL) return true;
+    if (config.golden) {
+        INFO("CAPTURE %u frames match, %u differ or have no golden image, %u new golden images, %u dropped", matched, failed, written, dropped);
+    } else {
+        INFO("CAPTURE %u frames written, %u failed, %u dropped", written, failed, dropped);
+    }
+    if (matched + written + failed + dropped == 0) {
+        ERROR("CAPTURE no frame captured, the run is shorter than %u ticks", config.every);
+        return false;
+    }
+    return failed == 0 && dropped == 0;
+}
@@ -0,0 +1,35 @@
+// Frame captures for checking renderer changes without looking at the window.
+// Every few ticks the frame is read back (readback.h) and written as a PPM, or
+// compared with the golden image an earlier run wrote. The comparison runs on
+// the workers, the frames keep their pace. A golden image that is missing or
+// unreadable fails the run like a differing one, only --update-golden writes it.
+// While capturing, the loop runs one tick per frame and the streamer waits for
+// the generation, so with a replay the same tick shows the same picture on every
+// run. Keep the overlay off in the recording, it prints the frame times.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CAPTURE_EVERY           200     // ticks between two captures
+#define CAPTURE_TOLERANCE       8       // per channel, covers the rounding of different drivers
+#define CAPTURE_MAX_DIFFERING   0.001   // fraction of the pixels that may be beyond the tolerance
+
+struct CaptureConfig {
+    const char *directory;      // NULL captures nothing
+    bool golden;                // compare with the images in directory instead of writing them
+    bool update;                // golden: write the golden images that are missing instead of failing
+    uint32_t every;             // ticks
+    int tolerance;
+};
+
+// before the first tick, creates the directory
+bool capture_init(const struct CaptureConfig *config);
+bool capture_enabled();
+// after a tick, requests the next frame when a capture is due
+void capture_tick(uint64_t tick);
+// after the renderer is destroyed, every capture is done then. Logs the
+// results, false when a frame was dropped, could not be written, differs
+// from its golden image or has none to compare with
+bool capture_finish();
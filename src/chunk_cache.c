@@ -0,0 +1,254 @@
+#include "chunk_cache.h"
+#include "compress.h"
+#include "log.h"
+#include "memory.h"
+#include "protocol.h"
+
+#include <string.h>
+
+#define MIN_CAPACITY 256
+
+// a cached column, allocated to the size of its compressed data
+struct CacheEntry {
+    int32_t x, z;
+    uint32_t unsaved;               // of the chunk, the next save still writes it
+    uint32_t version;
+    uint32_t raw_size;              // of the encoded column
+    uint32_t size;                  // compressed
+    uint64_t world_bytes;
+    struct CacheEntry *newer, *older;
+    uint8_t data[];
+};
+
+// open addressing table of entries, linear probing, like the world's.
+// The entries are also in a list from the most to the least recently stored
+struct ChunkCache {
+    struct CacheEntry **slots;
+    uint32_t capacity;              // power of two
+    struct CacheEntry *newest, *oldest;
+
+    struct Buffer column;           // scratch: encoded then compressed
+    struct Buffer compressed;
+    struct ChunkCacheStats stats;
+};
+
+static uint32_t hash_chunk(int32_t x, int32_t z) {
+    uint32_t h = (uint32_t) x * 0x9E3779B1u ^ (uint32_t) z * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+static uint64_t entry_bytes(const struct CacheEntry *entry) {
+    return sizeof(*entry) + entry->size;
+}
+
+struct ChunkCache *chunk_cache_create(uint64_t budget) {
+    struct ChunkCache *cache = memory_calloc(1, sizeof(*cache), MEMORY_TAG_WORLD);
+    if (cache == NULL) {
+        FATAL("CACHE failed to allocate the chunk cache");
+        return NULL;
+    }
+    cache->capacity = MIN_CAPACITY;
+    cache->slots = memory_calloc(cache->capacity, sizeof(*cache->slots), MEMORY_TAG_WORLD);
+    if (cache->slots == NULL) {
+        FATAL("CACHE failed to allocate the chunk table");
+        memory_free(cache);
+        return NULL;
+    }
+    cache->stats.budget = budget;
+    return cache;
+}
+
+void chunk_cache_destroy(struct ChunkCache *cache) {
+    if (cache == NULL) return;
+    for (uint32_t i=0; i<cache->capacity; i++) {
+        memory_free(cache->slots[i]);
+    }
+    memory_free(cache->slots);
+    buffer_free(&cache->column);
+    buffer_free(&cache->compressed);
+    memory_free(cache);
+}
+
+static uint32_t find_slot(const struct ChunkCache *cache, int32_t x, int32_t z) {
+    uint32_t mask = cache->capacity - 1;
+    uint32_t slot = hash_chunk(x, z) & mask;
+    while (cache->slots[slot] != NULL) {
+        if (cache->slots[slot]->x == x && cache->slots[slot]->z == z) break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static bool grow(struct ChunkCache *cache) {
+    uint32_t old_capacity = cache->capacity;
+    struct CacheEntry **old_slots = cache->slots;
+
+    struct CacheEntry **slots = memory_calloc(old_capacity * 2, sizeof(*slots), MEMORY_TAG_WORLD);
+    if (slots == NULL) return false;
+    cache->slots = slots;
+    cache->capacity = old_capacity * 2;
+
+    for (uint32_t i=0; i<old_capacity; i++) {
+        if (old_slots[i] != NULL) {
+            cache->slots[find_slot(cache, old_slots[i]->x, old_slots[i]->z)] = old_slots[i];
+        }
+    }
+    memory_free(old_slots);
+    return true;
+}
+
+// out of the table and the list, the caller frees it
+static void unlink_entry(struct ChunkCache *cache, uint32_t slot) {
+    struct CacheEntry *entry = cache->slots[slot];
+    if (entry->newer != NULL) entry->newer->older = entry->older;
+    else cache->newest = entry->older;
+    if (entry->older != NULL) entry->older->newer = entry->newer;
+    else cache->oldest = entry->newer;
+    cache->stats.chunks--;
+    cache->stats.bytes -= entry_bytes(entry);
+    cache->stats.world_bytes -= entry->world_bytes;
+
+    // backward shift the entries after the hole so the probe chains stay intact
+    uint32_t mask = cache->capacity - 1;
+    cache->slots[slot] = NULL;
+    uint32_t hole = slot;
+    uint32_t next = (slot + 1) & mask;
+    while (cache->slots[next] != NULL) {
+        uint32_t home = hash_chunk(cache->slots[next]->x, cache->slots[next]->z) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            cache->slots[hole] = cache->slots[next];
+            cache->slots[next] = NULL;
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+// the oldest first. Entries with unsaved edits stay, nothing else has them
+static void evict(struct ChunkCache *cache, uint64_t budget) {
+    struct CacheEntry *entry = cache->oldest;
+    while (entry != NULL && cache->stats.bytes > budget) {
+        struct CacheEntry *newer = entry->newer;
+        if (entry->unsaved == 0) {
+            unlink_entry(cache, find_slot(cache, entry->x, entry->z));
+            memory_free(entry);
+            cache->stats.evicted++;
+        }
+        entry = newer;
+    }
+}
+
+void chunk_cache_set_budget(struct ChunkCache *cache, uint64_t budget) {
+    cache->stats.budget = budget;
+    evict(cache, budget);
+}
+
+bool chunk_cache_put(struct ChunkCache *cache, const struct Chunk *chunk) {
+    uint32_t slot = find_slot(cache, chunk->x, chunk->z);
+    if (cache->slots[slot] != NULL) {
+        struct CacheEntry *stale = cache->slots[slot];
+        unlink_entry(cache, slot);
+        memory_free(stale);
+    }
+
+    cache->column.size = 0;
+    protocol_write_column(&cache->column, chunk->sections);
+    size_t bound = compress_bound(cache->column.size);
+    if (!buffer_reserve(&cache->compressed, bound)) return false;
+    size_t size = compress_block(cache->column.data, cache->column.size, cache->compressed.data, bound);
+    if (sizeof(struct CacheEntry) + size > cache->stats.budget) return false;
+
+    struct CacheEntry *entry = memory_alloc(sizeof(*entry) + size, MEMORY_TAG_WORLD);
+    if (entry == NULL) return false;
+    if ((cache->stats.chunks + 1) * 2 > cache->capacity && !grow(cache)) {
+        memory_free(entry);
+        return false;
+    }
+    entry->x = chunk->x;
+    entry->z = chunk->z;
+    entry->unsaved = chunk->unsaved;
+    entry->version = chunk->version;
+    entry->raw_size = (uint32_t) cache->column.size;
+    entry->size = (uint32_t) size;
+    entry->world_bytes = sizeof(*chunk);
+    for (int s=0; s<CHUNK_SECTIONS; s++) {
+        if (chunk->sections[s].blocks != NULL) entry->world_bytes += SECTION_VOLUME * sizeof(block_t);
+    }
+    memcpy(entry->data, cache->compressed.data, size);
+
+    // make room first, the new entry is not the one to go
+    evict(cache, cache->stats.budget - entry_bytes(entry));
+    if (cache->stats.bytes + entry_bytes(entry) > cache->stats.budget) {
+        memory_free(entry);
+        return false;
+    }
+    cache->slots[find_slot(cache, entry->x, entry->z)] = entry;
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest != NULL) cache->newest->newer = entry;
+    else cache->oldest = entry;
+    cache->newest = entry;
+    cache->stats.chunks++;
+    cache->stats.bytes += entry_bytes(entry);
+    cache->stats.world_bytes += entry->world_bytes;
+    cache->stats.stored++;
+    return true;
+}
+
+struct Chunk *chunk_cache_take(struct ChunkCache *cache, int32_t chunk_x, int32_t chunk_z) {
+    uint32_t slot = find_slot(cache, chunk_x, chunk_z);
+    struct CacheEntry *entry = cache->slots[slot];
+    if (entry == NULL) {
+        cache->stats.misses++;
+        return NULL;
+    }
+    unlink_entry(cache, slot);
+
+    struct Chunk *chunk = NULL;
+    cache->column.size = 0;
+    if (buffer_reserve(&cache->column, entry->raw_size) &&
+        decompress_block(entry->data, entry->size, cache->column.data, entry->raw_size)) {
+        chunk = chunk_create(chunk_x, chunk_z);
+    }
+    struct Reader reader = {cache->column.data, entry->raw_size, 0, false};
+    if (chunk != NULL && !protocol_read_column(&reader, chunk->sections)) {
+        ERROR("CACHE chunk %d,%d is corrupt, it will be generated again", chunk_x, chunk_z);
+        chunk_free(chunk);
+        chunk = NULL;
+    }
+    if (chunk == NULL) {
+        cache->stats.misses++;
+    } else {
+        chunk->unsaved = entry->unsaved;
+        chunk->version = entry->version;
+        // which sections changed is not kept, a client with an older copy gets them all
+        for (int s=0; s<CHUNK_SECTIONS; s++) chunk->changed[s] = entry->version;
+        cache->stats.hits++;
+    }
+    memory_free(entry);
+    return chunk;
+}
+
+void chunk_cache_stats(const struct ChunkCache *cache, struct ChunkCacheStats *stats) {
+    *stats = cache->stats;
+}
+
+double chunk_cache_hit_rate(const struct ChunkCacheStats *stats) {
+    uint64_t takes = stats->hits + stats->misses;
+    return takes > 0 ? (double) stats->hits / takes : 0.0;
+}
+
+double chunk_cache_compression(const struct ChunkCacheStats *stats) {
+    return stats->bytes > 0 ? (double) stats->world_bytes / stats->bytes : 0.0;
+}
+
+void chunk_cache_report(const struct ChunkCache *cache) {
+    const struct ChunkCacheStats *stats = &cache->stats;
+    INFO("CACHE %u chunks in %.1f of %.1f MB, %.1fx smaller than in the world. %llu hits %llu misses (%.0f%%), %llu stored, %llu evicted",
+         stats->chunks, stats->bytes / (1024.0 * 1024.0), stats->budget / (1024.0 * 1024.0), chunk_cache_compression(stats),
+         (unsigned long long) stats->hits, (unsigned long long) stats->misses, chunk_cache_hit_rate(stats) * 100.0,
+         (unsigned long long) stats->stored, (unsigned long long) stats->evicted);
+}
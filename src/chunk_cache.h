@@ -0,0 +1,50 @@
+// Compressed chunk cache, between the world and the generator.
+// A chunk column leaving the streamer's range is encoded like in the region
+// files (protocol_write_column) and compressed (compress.h) instead of being
+// dropped. Coming back in range takes it from here: no disk, no generation,
+// the edits made to it are still there. The cache holds at most a byte budget,
+// the least recently stored chunks are evicted first, except those with unsaved
+// sections: they are the only copy of their edits and stay until taken back.
+// Not thread safe, the streamer calls it from its update.
+
+#pragma once
+
+#include "world.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CHUNK_CACHE_BUDGET (64ull << 20)   // bytes, a few thousand columns of ordinary terrain
+
+struct ChunkCacheStats {
+    uint64_t hits;
+    uint64_t misses;                // taken while not in the cache
+    uint64_t stored;
+    uint64_t evicted;               // pushed out by newer chunks before being taken back
+    uint32_t chunks;                // in the cache now
+    uint64_t bytes;                 // they take, compressed with their bookkeeping
+    uint64_t world_bytes;           // they took in the world, block arrays included
+    uint64_t budget;
+};
+
+struct ChunkCache;
+
+// budget 0 keeps nothing, every take misses
+struct ChunkCache *chunk_cache_create(uint64_t budget);
+void chunk_cache_destroy(struct ChunkCache *cache);
+// evicts down to the new budget, or as far as the unsaved chunks let it
+void chunk_cache_set_budget(struct ChunkCache *cache, uint64_t budget);
+
+// compresses a copy of the chunk, the caller still owns it. Replaces what was
+// cached at its coordinates. False when it does not fit the budget, the unsaved
+// chunks already taking the room, or out of memory
+bool chunk_cache_put(struct ChunkCache *cache, const struct Chunk *chunk);
+// the cached chunk as a new chunk_create() one, gone from the cache. NULL on a miss
+struct Chunk *chunk_cache_take(struct ChunkCache *cache, int32_t chunk_x, int32_t chunk_z);
+
+void chunk_cache_stats(const struct ChunkCache *cache, struct ChunkCacheStats *stats);
+// 0..1, 0 before any take
+double chunk_cache_hit_rate(const struct ChunkCacheStats *stats);
+// world bytes over cached bytes, what the compression saves
+double chunk_cache_compression(const struct ChunkCacheStats *stats);
+void chunk_cache_report(const struct ChunkCache *cache);
@@ -0,0 +1,131 @@
+#include "compress.h"
+
+#include <string.h>
+
+// Sequence layout:
+//   token          literal count in the high nibble, match length - 4 in the low one,
+//                  15 means more bytes follow (each 255 means keep reading)
+//   literals
+//   offset         2 bytes little endian, absent in the last sequence
+//   match length   extra bytes
+#define MIN_MATCH     4
+#define LAST_LITERALS 5         // the tail is always sent as literals
+#define MAX_OFFSET    65535
+#define HASH_BITS     13
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+size_t compress_bound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+static uint8_t *write_length(uint8_t *op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t) length;
+    return op;
+}
+
+static uint8_t *write_sequence(uint8_t *op, const uint8_t *literals, size_t literal_count,
+                               size_t offset, size_t match_length) {
+    uint8_t *token = op++;
+    *token = (uint8_t) ((literal_count >= 15 ? 15 : literal_count) << 4);
+    if (literal_count >= 15) op = write_length(op, literal_count - 15);
+    memcpy(op, literals, literal_count);
+    op += literal_count;
+
+    if (match_length == 0) return op;   // last sequence
+
+    *op++ = (uint8_t) offset;
+    *op++ = (uint8_t) (offset >> 8);
+    size_t extra = match_length - MIN_MATCH;
+    *token |= (uint8_t) (extra >= 15 ? 15 : extra);
+    if (extra >= 15) op = write_length(op, extra - 15);
+    return op;
+}
+
+size_t compress_block(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity) {
+    if (capacity < compress_bound(size)) return 0;
+
+    int32_t table[1 << HASH_BITS];
+    memset(table, 0xFF, sizeof(table));
+
+    uint8_t *op = dst;
+    size_t anchor = 0;
+    size_t ip = 0;
+    size_t match_limit = size > LAST_LITERALS ? size - LAST_LITERALS : 0;
+
+    while (ip + MIN_MATCH <= match_limit) {
+        uint32_t sequence = read32(src + ip);
+        uint32_t h = hash4(sequence);
+        int32_t ref = table[h];
+        table[h] = (int32_t) ip;
+
+        if (ref < 0 || ip - (size_t) ref > MAX_OFFSET || read32(src + ref) != sequence) {
+            ip++;
+            continue;
+        }
+
+        size_t length = MIN_MATCH;
+        while (ip + length < match_limit && src[ref + length] == src[ip + length]) length++;
+
+        op = write_sequence(op, src + anchor, ip - anchor, ip - (size_t) ref, length);
+        ip += length;
+        anchor = ip;
+    }
+
+    op = write_sequence(op, src + anchor, size - anchor, 0, 0);
+    return (size_t) (op - dst);
+}
+
+static bool read_length(const uint8_t *src, size_t src_size, size_t *ip, size_t *length) {
+    uint8_t byte;
+    do {
+        if (*ip >= src_size) return false;
+        byte = src[(*ip)++];
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool decompress_block(const uint8_t *src, size_t src_size, uint8_t *dst, size_t size) {
+    size_t ip = 0, op = 0;
+    while (ip < src_size) {
+        uint8_t token = src[ip++];
+
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 && !read_length(src, src_size, &ip, &literal_count)) return false;
+        if (literal_count > src_size - ip || literal_count > size - op) return false;
+        memcpy(dst + op, src + ip, literal_count);
+        ip += literal_count;
+        op += literal_count;
+
+        if (ip == src_size) break;      // the last sequence has no match
+
+        if (src_size - ip < 2) return false;
+        size_t offset = src[ip] | (size_t) src[ip + 1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > op) return false;
+
+        size_t length = (token & 15);
+        if (length == 15 && !read_length(src, src_size, &ip, &length)) return false;
+        length += MIN_MATCH;
+        if (length > size - op) return false;
+
+        // byte by byte, the match can overlap what it writes
+        const uint8_t *from = dst + op - offset;
+        for (size_t i=0; i<length; i++) dst[op + i] = from[i];
+        op += length;
+    }
+    return op == size;
+}
@@ -0,0 +1,18 @@
+// Small LZ77 block codec in the spirit of LZ4: byte aligned sequences of
+// literals and back references, no entropy coding. Fast to decode and good
+// enough on block data, which is made of long runs and repeated layers.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// worst case compressed size of size bytes
+size_t compress_bound(size_t size);
+
+// returns the compressed size, 0 if dst is too small
+size_t compress_block(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity);
+
+// decompresses exactly size bytes, false on corrupt input
+bool decompress_block(const uint8_t *src, size_t src_size, uint8_t *dst, size_t size);
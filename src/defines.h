@@ -2,6 +2,11 @@
 
 #include <stdbool.h>
 
+#include "input.h"
+#include "pacing.h"
+#include "player.h"
+#include "stats.h"
+
 #define OK 0;
 #define FAIL 1;
 
@@ -12,7 +17,14 @@
 struct Game {
     struct Window *window;
     // renderer
-    // World
+    struct Streamer *streamer;      // the chunks around the player, generated and meshed
+    struct Simulation *simulation;  // world, entities and physics, same as the server runs
+    struct Input *input;            // live, recorded or replayed
+    struct InputState input_state;  // as of the last tick
+    struct Player player;
+    struct FrameLog frames;
+    struct FramePacer pacer;        // when the frames start
+    double start;                   // timer_now() at launch, for the time to the first frame
 };
 
 extern struct Game game;
\ No newline at end of file
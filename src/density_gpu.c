@@ -0,0 +1,436 @@
+#include "density_gpu.h"
+
+#include "job.h"
+#include "log.h"
+#include "memory.h"
+#include "pipeline.h"
+#include "timer.h"
+#include "vulkan_if.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define COLUMNS     (SECTION_SIZE * SECTION_SIZE)
+#define CHUNK_WORDS (WORLD_HEIGHT * COLUMNS / 2)    // 2 blocks per word
+#define AUTO_RADIUS 2                               // chunks timed by DENSITY_MODE_AUTO
+
+enum { BUFFER_COORDS = 0, BUFFER_HEIGHTS, BUFFER_BLOCKS, BUFFER_COUNT };
+
+struct DensityPush {
+    uint32_t seed;
+    uint32_t count;
+};
+
+static const char *DENSITY_MODE_NAMES[DENSITY_MODE_COUNT] = {
+    [DENSITY_MODE_CPU]  = "cpu",
+    [DENSITY_MODE_GPU]  = "gpu",
+    [DENSITY_MODE_AUTO] = "auto",
+};
+
+static const VkDeviceSize BUFFER_SIZES[BUFFER_COUNT] = {
+    [BUFFER_COORDS]  = DENSITY_GPU_BATCH * 2 * sizeof(int32_t),
+    [BUFFER_HEIGHTS] = DENSITY_GPU_BATCH * COLUMNS * sizeof(int32_t),
+    [BUFFER_BLOCKS]  = DENSITY_GPU_BATCH * CHUNK_WORDS * sizeof(uint32_t),
+};
+
+static enum density_mode mode = DENSITY_MODE_CPU;
+static struct Generator *attached;  // the generator running its batches here
+
+static VkQueue queue;
+static VkDescriptorSetLayout set_layout;
+static VkDescriptorPool descriptor_pool;
+static VkDescriptorSet descriptor_set;
+static VkPipelineLayout density_layout;
+static VkPipeline density_pipeline;
+static VkCommandPool cmd_pool;
+static VkCommandBuffer cmd_buffer;
+static VkFence fence;
+
+static VkBuffer buffers[BUFFER_COUNT];
+static VkDeviceMemory memories[BUFFER_COUNT];
+static void *mapped[BUFFER_COUNT];  // for the lifetime of the backend
+
+static const struct DensityBatch *batch;    // in flight, NULL when idle
+static bool unpacking;
+static struct JobCounter unpack_jobs;
+
+static bool submit(void *ctx, const struct DensityBatch *batch);
+static bool poll(void *ctx);
+
+static const struct DensityBackend backend = {
+    .name = "gpu",
+    .max_batch = DENSITY_GPU_BATCH,
+    .ctx = NULL,
+    .submit = submit,
+    .poll = poll,
+};
+
+
+const char *density_mode_name(enum density_mode mode) {
+    return mode < DENSITY_MODE_COUNT ? DENSITY_MODE_NAMES[mode] : "?";
+}
+
+enum density_mode density_mode_from_name(const char *name) {
+    for (int i=0; i<DENSITY_MODE_COUNT; i++) {
+        if (strcmp(name, DENSITY_MODE_NAMES[i]) == 0) return i;
+    }
+    return DENSITY_MODE_COUNT;
+}
+
+void density_gpu_set_mode(enum density_mode _mode) {
+    if (_mode < DENSITY_MODE_COUNT) mode = _mode;
+}
+
+const struct DensityBackend *density_gpu_backend() {
+    return &backend;
+}
+
+// copies the blocks of one chunk of the batch, uniform sections get no array
+static void unpack_job(void *arg) {
+    uint32_t i = (uint32_t) (uintptr_t) arg;
+    const int32_t *heights = (const int32_t *) mapped[BUFFER_HEIGHTS] + i * COLUMNS;
+    struct WorldgenColumns *columns = batch->columns[i];
+    columns->min_height = WORLD_HEIGHT;
+    columns->max_height = 0;
+    for (int z=0; z<SECTION_SIZE; z++) {
+        for (int x=0; x<SECTION_SIZE; x++) {
+            int32_t h = heights[z * SECTION_SIZE + x];
+            columns->heights[z][x] = (int16_t) h;
+            if (h < columns->min_height) columns->min_height = h;
+            if (h > columns->max_height) columns->max_height = h;
+        }
+    }
+
+    // 16 bit blocks packed little end first, the layout of a section
+    const block_t *blocks = (const block_t *) ((const uint32_t *) mapped[BUFFER_BLOCKS] + (size_t) i * CHUNK_WORDS);
+    struct Chunk *chunk = batch->chunks[i];
+    for (int s=0; s<CHUNK_SECTIONS; s++) {
+        const block_t *src = blocks + s * SECTION_VOLUME;
+        int j = 1;
+        while (j < SECTION_VOLUME && src[j] == src[0]) j++;
+        if (j == SECTION_VOLUME) {
+            section_fill(&chunk->sections[s], src[0]);
+            continue;
+        }
+        block_t *dst = section_write_blocks(&chunk->sections[s]);
+        if (dst == NULL) return;
+        memcpy(dst, src, SECTION_VOLUME * sizeof(block_t));
+    }
+}
+
+static bool submit(void *ctx, const struct DensityBatch *_batch) {
+    (void) ctx;
+    int32_t *coords = mapped[BUFFER_COORDS];
+    for (uint32_t i=0; i<_batch->count; i++) {
+        coords[2 * i] = _batch->x[i];
+        coords[2 * i + 1] = _batch->z[i];
+    }
+
+    vkResetCommandBuffer(cmd_buffer, 0);
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(cmd_buffer, &begin_info) != VK_SUCCESS) return false;
+
+    struct DensityPush push = {.seed = _batch->seed, .count = _batch->count};
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, density_pipeline);
+    vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, density_layout, 0, 1, &descriptor_set, 0, NULL);
+    vkCmdPushConstants(cmd_buffer, density_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+    vkCmdDispatch(cmd_buffer, _batch->count, 1, 1);
+
+    // the host reads the results once the fence signals
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                         1, &barrier, 0, NULL, 0, NULL);
+    if (vkEndCommandBuffer(cmd_buffer) != VK_SUCCESS) return false;
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &cmd_buffer;
+    vkResetFences(logical_device, 1, &fence);
+    if (vkQueueSubmit(queue, 1, &submit_info, fence) != VK_SUCCESS) {
+        ERROR("DENSITY failed to submit a batch");
+        return false;
+    }
+    batch = _batch;
+    return true;
+}
+
+static bool poll(void *ctx) {
+    (void) ctx;
+    if (batch == NULL) return true;
+    if (!unpacking) {
+        VkResult status = vkGetFenceStatus(logical_device, fence);
+        if (status == VK_NOT_READY) return false;
+        // a lost device leaves the blocks undefined, the renderer fails on it anyway
+        if (status != VK_SUCCESS) ERROR("DENSITY lost the device during a batch");
+        for (uint32_t i=0; i<batch->count; i++) job_submit(unpack_job, (void *) (uintptr_t) i, &unpack_jobs);
+        unpacking = true;
+    }
+    if (!job_done(&unpack_jobs)) return false;
+    unpacking = false;
+    batch = NULL;
+    return true;
+}
+
+static bool create_descriptors() {
+    VkDescriptorSetLayoutBinding bindings[BUFFER_COUNT] = {};
+    for (int i=0; i<BUFFER_COUNT; i++) {
+        bindings[i].binding = (uint32_t) i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = BUFFER_COUNT;
+    layout_info.pBindings = bindings;
+    if (vkCreateDescriptorSetLayout(logical_device, &layout_info, NULL, &set_layout) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkDescriptorPoolSize pool_size = {};
+    pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_size.descriptorCount = BUFFER_COUNT;
+
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    pool_info.maxSets = 1;
+    if (vkCreateDescriptorPool(logical_device, &pool_info, NULL, &descriptor_pool) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = descriptor_pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &set_layout;
+    if (vkAllocateDescriptorSets(logical_device, &alloc_info, &descriptor_set) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkDescriptorBufferInfo buffer_infos[BUFFER_COUNT] = {};
+    VkWriteDescriptorSet writes[BUFFER_COUNT] = {};
+    for (int i=0; i<BUFFER_COUNT; i++) {
+        buffer_infos[i].buffer = buffers[i];
+        buffer_infos[i].range = VK_WHOLE_SIZE;
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = descriptor_set;
+        writes[i].dstBinding = (uint32_t) i;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].descriptorCount = 1;
+        writes[i].pBufferInfo = &buffer_infos[i];
+    }
+    vkUpdateDescriptorSets(logical_device, BUFFER_COUNT, writes, 0, NULL);
+    return true;
+}
+
+static bool create_density_pipeline() {
+    size_t code_size = 0;
+    unsigned char *code = load_shader("density.comp.spv", &code_size);
+    VkShaderModule module = code ? create_shader_module(code, code_size) : NULL;
+    memory_free(code);
+    if (module == NULL) return false;
+
+    VkPushConstantRange push_range = {};
+    push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_range.size = sizeof(struct DensityPush);
+
+    VkPipelineLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &set_layout;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_range;
+    if (vkCreatePipelineLayout(logical_device, &layout_info, NULL, &density_layout) != VK_SUCCESS) {
+        vkDestroyShaderModule(logical_device, module, NULL);
+        return false;
+    }
+
+    VkComputePipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = density_layout;
+    VkResult result = vkCreateComputePipelines(logical_device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &density_pipeline);
+    vkDestroyShaderModule(logical_device, module, NULL);
+    return result == VK_SUCCESS;
+}
+
+static bool create_buffers() {
+    // the CPU reads everything back, cached memory when there is some
+    VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    if (find_memory_type(UINT32_MAX, properties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != UINT32_MAX) {
+        properties |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    }
+    for (int i=0; i<BUFFER_COUNT; i++) {
+        if (!create_buffer(BUFFER_SIZES[i], VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, properties, &buffers[i], &memories[i])) {
+            return false;
+        }
+        if (vkMapMemory(logical_device, memories[i], 0, BUFFER_SIZES[i], 0, &mapped[i]) != VK_SUCCESS) return false;
+    }
+    return true;
+}
+
+static bool create_commands(uint32_t queue_family) {
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = queue_family;
+    if (vkCreateCommandPool(logical_device, &pool_info, NULL, &cmd_pool) != VK_SUCCESS) return false;
+
+    VkCommandBufferAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = cmd_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(logical_device, &alloc_info, &cmd_buffer) != VK_SUCCESS) return false;
+
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    return vkCreateFence(logical_device, &fence_info, NULL, &fence) == VK_SUCCESS;
+}
+
+// the square of chunks around 0,0 into a new world, returns the seconds it took
+static double generate(struct World *world, int radius, uint32_t seed, bool gpu) {
+    struct Generator *generator = generator_create(seed);
+    if (generator == NULL) return -1.0;
+    if (gpu) generator_set_density_backend(generator, &backend);
+    double start = timer_now();
+    for (int32_t z=-radius; z<=radius; z++) {
+        for (int32_t x=-radius; x<=radius; x++) {
+            generator_request(generator, x, z, (uint32_t) (x * x + z * z));
+        }
+    }
+    generator_flush(generator);
+    for (int32_t z=-radius; z<=radius; z++) {
+        for (int32_t x=-radius; x<=radius; x++) {
+            struct Chunk *chunk = generator_take(generator, x, z);
+            if (chunk != NULL && !world_insert_chunk(world, chunk)) chunk_free(chunk);
+        }
+    }
+    double seconds = timer_now() - start;
+    generator_report(generator);
+    generator_destroy(generator);
+    return seconds;
+}
+
+static bool same_blocks(const struct Chunk *a, const struct Chunk *b) {
+    for (int s=0; s<CHUNK_SECTIONS; s++) {
+        for (int y=0; y<SECTION_SIZE; y++) {
+            for (int z=0; z<SECTION_SIZE; z++) {
+                for (int x=0; x<SECTION_SIZE; x++) {
+                    if (section_get(&a->sections[s], x, y, z) != section_get(&b->sections[s], x, y, z)) return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// both backends on the same square: the seconds each took and the chunks that differ
+static uint32_t compare(int radius, uint32_t seed, double *cpu_seconds, double *gpu_seconds) {
+    struct World *cpu_world = world_create();
+    struct World *gpu_world = world_create();
+    uint32_t different = 0;
+    if (cpu_world != NULL && gpu_world != NULL) {
+        *cpu_seconds = generate(cpu_world, radius, seed, false);
+        *gpu_seconds = generate(gpu_world, radius, seed, true);
+        for (int32_t z=-radius; z<=radius; z++) {
+            for (int32_t x=-radius; x<=radius; x++) {
+                const struct Chunk *a = world_get_chunk(cpu_world, x, z);
+                const struct Chunk *b = world_get_chunk(gpu_world, x, z);
+                if (a == NULL || b == NULL || !same_blocks(a, b)) different++;
+            }
+        }
+    } else {
+        different = 1;
+    }
+    if (cpu_world != NULL) world_destroy(cpu_world);
+    if (gpu_world != NULL) world_destroy(gpu_world);
+    return different;
+}
+
+bool density_gpu_benchmark(int radius, uint32_t seed) {
+    if (density_pipeline == VK_NULL_HANDLE) {
+        ERROR("DENSITY no GPU backend to benchmark");
+        return false;
+    }
+    uint32_t count = (uint32_t) ((2 * radius + 1) * (2 * radius + 1));
+    double cpu = 0.0, gpu = 0.0;
+    uint32_t different = compare(radius, seed, &cpu, &gpu);
+    INFO("DENSITY %u chunks, workers (%d) %.1f ms, %.0f chunks/s, gpu %.1f ms, %.0f chunks/s: %s is faster",
+         count, job_worker_count(), cpu * 1e3, count / cpu, gpu * 1e3, count / gpu, cpu <= gpu ? "cpu" : "gpu");
+    if (different > 0) {
+        ERROR("DENSITY %u chunks differ between the workers and the GPU", different);
+        return false;
+    }
+    INFO("DENSITY same blocks on both");
+    return true;
+}
+
+bool density_gpu_create(VkQueue _queue, uint32_t queue_family, struct Generator *generator) {
+    queue = _queue;
+    if (!create_buffers() || !create_descriptors() || !create_density_pipeline() || !create_commands(queue_family)) {
+        WARNING("DENSITY failed to create the compute pipeline, the workers generate the terrain");
+        density_gpu_destroy();
+        return false;
+    }
+
+    bool use = mode == DENSITY_MODE_GPU;
+    if (mode == DENSITY_MODE_AUTO) {
+        // any seed takes about as long
+        double cpu = 0.0, gpu = 0.0;
+        uint32_t different = compare(AUTO_RADIUS, 1, &cpu, &gpu);
+        // never a backend that disagrees with the workers
+        use = different == 0 && gpu < cpu;
+        INFO("DENSITY auto: workers %.1f ms, gpu %.1f ms, %u chunks differ", cpu * 1e3, gpu * 1e3, different);
+    }
+    if (use) {
+        attached = generator;
+        generator_set_density_backend(generator, &backend);
+    }
+    INFO("DENSITY mode %s, the terrain density runs on the %s", density_mode_name(mode), use ? "GPU" : "workers");
+    return true;
+}
+
+void density_gpu_destroy() {
+    if (attached != NULL) generator_set_density_backend(attached, NULL);
+    attached = NULL;
+    // only a batch of the benchmark could still be in flight
+    if (batch != NULL) {
+        vkWaitForFences(logical_device, 1, &fence, VK_TRUE, UINT64_MAX);
+        job_wait(&unpack_jobs);
+        batch = NULL;
+        unpacking = false;
+    }
+    if (fence != VK_NULL_HANDLE) vkDestroyFence(logical_device, fence, NULL);
+    if (cmd_pool != VK_NULL_HANDLE) vkDestroyCommandPool(logical_device, cmd_pool, NULL);
+    if (density_pipeline != VK_NULL_HANDLE) vkDestroyPipeline(logical_device, density_pipeline, NULL);
+    if (density_layout != VK_NULL_HANDLE) vkDestroyPipelineLayout(logical_device, density_layout, NULL);
+    if (descriptor_pool != VK_NULL_HANDLE) vkDestroyDescriptorPool(logical_device, descriptor_pool, NULL);
+    if (set_layout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(logical_device, set_layout, NULL);
+    for (int i=0; i<BUFFER_COUNT; i++) {
+        if (buffers[i] == VK_NULL_HANDLE) continue;
+        if (mapped[i] != NULL) vkUnmapMemory(logical_device, memories[i]);
+        vkDestroyBuffer(logical_device, buffers[i], NULL);
+        vkFreeMemory(logical_device, memories[i], NULL);
+        buffers[i] = VK_NULL_HANDLE;
+        mapped[i] = NULL;
+    }
+    fence = VK_NULL_HANDLE;
+    cmd_pool = VK_NULL_HANDLE;
+    density_pipeline = VK_NULL_HANDLE;
+    density_layout = VK_NULL_HANDLE;
+    descriptor_pool = VK_NULL_HANDLE;
+    set_layout = VK_NULL_HANDLE;
+}
@@ -0,0 +1,41 @@
+// Terrain density on the GPU: the noise and caves stages of a batch of chunks in
+// one compute dispatch (shaders/density.comp), behind the generator's DensityBackend.
+// The blocks land in host visible memory and are copied into the chunks by jobs
+// once the fence signals, the main thread never waits for the GPU. The blocks are
+// the same as the workers make.
+// --gen-backend picks cpu, gpu or auto, which times both on a few chunks at start.
+
+#pragma once
+
+#include "generator.h"
+
+#include <stdbool.h>
+#include <vulkan/vulkan.h>
+
+#define DENSITY_GPU_BATCH   32      // chunks per dispatch, 4 MB of blocks read back
+
+enum density_mode {
+    DENSITY_MODE_CPU = 0,
+    DENSITY_MODE_GPU,
+    DENSITY_MODE_AUTO,      // the faster of the two on this machine
+    DENSITY_MODE_COUNT
+};
+
+const char *density_mode_name(enum density_mode mode);
+// DENSITY_MODE_COUNT for an unknown name
+enum density_mode density_mode_from_name(const char *name);
+// before density_gpu_create()
+void density_gpu_set_mode(enum density_mode mode);
+
+// after the logical device, the queue family must support compute. Gives the
+// generator the GPU backend when the mode picks it. False when the GPU can not
+// be used, the workers keep generating
+bool density_gpu_create(VkQueue queue, uint32_t queue_family, struct Generator *generator);
+// takes the backend back from the generator first
+void density_gpu_destroy();
+
+const struct DensityBackend *density_gpu_backend();
+
+// generates the square of chunks around 0,0 on the workers then on the GPU, logs
+// both times and the chunks that differ. Blocks. False when they differ
+bool density_gpu_benchmark(int radius, uint32_t seed);
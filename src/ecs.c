@@ -0,0 +1,345 @@
+#include "ecs.h"
+#include "log.h"
+#include "job.h"
+#include "memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ECS_INVALID UINT32_MAX
+
+struct Archetype {
+    ecs_mask_t mask;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *entities;                     // entity index of each row
+    void *columns[ECS_MAX_COMPONENTS];      // NULL for components not in the mask
+};
+
+struct EntityRecord {
+    uint32_t archetype;     // ECS_INVALID when the slot is free
+    uint32_t row;           // next free slot when the slot is free
+    uint32_t generation;
+};
+
+struct Ecs {
+    uint32_t component_size[ECS_MAX_COMPONENTS];
+    const char *component_name[ECS_MAX_COMPONENTS];
+    uint32_t component_count;
+
+    struct Archetype archetypes[ECS_MAX_ARCHETYPES];
+    uint32_t archetype_count;
+
+    struct EntityRecord *records;
+    uint32_t records_count;
+    uint32_t records_capacity;
+    uint32_t free_head;
+    uint32_t alive_count;
+
+    // ecs_query_parallel() chunks, kept between calls
+    struct EcsView *views;
+    uint32_t views_capacity;
+};
+
+
+struct Ecs *ecs_create() {
+    struct Ecs *ecs = memory_calloc(1, sizeof(*ecs), MEMORY_TAG_SIMULATION);
+    if (ecs == NULL) {
+        FATAL("ECS failed to allocate the world");
+        return NULL;
+    }
+    ecs->free_head = ECS_INVALID;
+    return ecs;
+}
+
+void ecs_destroy(struct Ecs *ecs) {
+    if (ecs == NULL) return;
+    for (uint32_t i=0; i<ecs->archetype_count; i++) {
+        struct Archetype *archetype = &ecs->archetypes[i];
+        for (int c=0; c<ECS_MAX_COMPONENTS; c++) {
+            memory_free(archetype->columns[c]);
+        }
+        memory_free(archetype->entities);
+    }
+    memory_free(ecs->records);
+    memory_free(ecs->views);
+    memory_free(ecs);
+}
+
+ecs_component_t ecs_register_component(struct Ecs *ecs, const char *name, uint32_t size) {
+    if (ecs->component_count == ECS_MAX_COMPONENTS) {
+        FATAL("ECS too many components, can't register %s", name);
+        return ECS_INVALID;
+    }
+    ecs_component_t component = ecs->component_count++;
+    ecs->component_size[component] = size;
+    ecs->component_name[component] = name;
+    return component;
+}
+
+static uint32_t find_archetype(struct Ecs *ecs, ecs_mask_t mask) {
+    for (uint32_t i=0; i<ecs->archetype_count; i++) {
+        if (ecs->archetypes[i].mask == mask) return i;
+    }
+
+    if (ecs->archetype_count == ECS_MAX_ARCHETYPES) {
+        FATAL("ECS too many archetypes");
+        return ECS_INVALID;
+    }
+    uint32_t index = ecs->archetype_count++;
+    memset(&ecs->archetypes[index], 0, sizeof(struct Archetype));
+    ecs->archetypes[index].mask = mask;
+    return index;
+}
+
+static bool archetype_reserve(struct Ecs *ecs, struct Archetype *archetype, uint32_t capacity) {
+    if (capacity <= archetype->capacity) return true;
+
+    uint32_t new_capacity = archetype->capacity ? archetype->capacity : 64;
+    while (new_capacity < capacity) new_capacity *= 2;
+
+    uint32_t *entities = memory_realloc(archetype->entities, new_capacity * sizeof(*entities), MEMORY_TAG_SIMULATION);
+    if (entities == NULL) return false;
+    archetype->entities = entities;
+
+    for (uint32_t c=0; c<ecs->component_count; c++) {
+        if (!(archetype->mask & ECS_BIT(c))) continue;
+        void *column = memory_realloc(archetype->columns[c], (size_t) new_capacity * ecs->component_size[c], MEMORY_TAG_SIMULATION);
+        if (column == NULL) return false;
+        archetype->columns[c] = column;
+    }
+    archetype->capacity = new_capacity;
+    return true;
+}
+
+// append a zeroed row, returns its index
+static uint32_t archetype_push(struct Ecs *ecs, struct Archetype *archetype, uint32_t entity_index) {
+    if (!archetype_reserve(ecs, archetype, archetype->count + 1)) {
+        FATAL("ECS out of memory");
+        return ECS_INVALID;
+    }
+    uint32_t row = archetype->count++;
+    archetype->entities[row] = entity_index;
+    for (uint32_t c=0; c<ecs->component_count; c++) {
+        if (archetype->mask & ECS_BIT(c)) {
+            uint32_t size = ecs->component_size[c];
+            memset((char *) archetype->columns[c] + (size_t) row * size, 0, size);
+        }
+    }
+    return row;
+}
+
+// swap the last row into the hole to keep the columns packed
+static void archetype_remove_row(struct Ecs *ecs, struct Archetype *archetype, uint32_t row) {
+    uint32_t last = archetype->count - 1;
+    if (row != last) {
+        for (uint32_t c=0; c<ecs->component_count; c++) {
+            if (archetype->mask & ECS_BIT(c)) {
+                uint32_t size = ecs->component_size[c];
+                char *column = archetype->columns[c];
+                memcpy(column + (size_t) row * size, column + (size_t) last * size, size);
+            }
+        }
+        uint32_t moved = archetype->entities[last];
+        archetype->entities[row] = moved;
+        ecs->records[moved].row = row;
+    }
+    archetype->count--;
+}
+
+static struct EntityRecord *get_record(struct Ecs *ecs, entity_t entity) {
+    if (entity.index >= ecs->records_count) return NULL;
+    struct EntityRecord *record = &ecs->records[entity.index];
+    if (record->archetype == ECS_INVALID || record->generation != entity.generation) return NULL;
+    return record;
+}
+
+entity_t ecs_create_entity(struct Ecs *ecs, ecs_mask_t components) {
+    entity_t entity = {ECS_INVALID, 0};
+
+    uint32_t archetype_index = find_archetype(ecs, components);
+    if (archetype_index == ECS_INVALID) return entity;
+
+    uint32_t index;
+    if (ecs->free_head != ECS_INVALID) {
+        index = ecs->free_head;
+        ecs->free_head = ecs->records[index].row;
+    } else {
+        if (ecs->records_count == ecs->records_capacity) {
+            uint32_t capacity = ecs->records_capacity ? ecs->records_capacity * 2 : 1024;
+            struct EntityRecord *records = memory_realloc(ecs->records, capacity * sizeof(*records), MEMORY_TAG_SIMULATION);
+            if (records == NULL) {
+                FATAL("ECS out of memory");
+                return entity;
+            }
+            ecs->records = records;
+            ecs->records_capacity = capacity;
+        }
+        index = ecs->records_count++;
+        ecs->records[index].generation = 0;
+    }
+
+    struct EntityRecord *record = &ecs->records[index];
+    uint32_t row = archetype_push(ecs, &ecs->archetypes[archetype_index], index);
+    if (row == ECS_INVALID) {
+        // the record goes back to the free list unused
+        record->archetype = ECS_INVALID;
+        record->row = ecs->free_head;
+        ecs->free_head = index;
+        return entity;
+    }
+    record->archetype = archetype_index;
+    record->row = row;
+    ecs->alive_count++;
+
+    entity.index = index;
+    entity.generation = record->generation;
+    return entity;
+}
+
+void ecs_destroy_entity(struct Ecs *ecs, entity_t entity) {
+    struct EntityRecord *record = get_record(ecs, entity);
+    if (record == NULL) return;
+
+    archetype_remove_row(ecs, &ecs->archetypes[record->archetype], record->row);
+    record->archetype = ECS_INVALID;
+    record->generation++;
+    record->row = ecs->free_head;
+    ecs->free_head = entity.index;
+    ecs->alive_count--;
+}
+
+bool ecs_alive(struct Ecs *ecs, entity_t entity) {
+    return get_record(ecs, entity) != NULL;
+}
+
+uint32_t ecs_entity_count(struct Ecs *ecs) {
+    return ecs->alive_count;
+}
+
+void *ecs_get(struct Ecs *ecs, entity_t entity, ecs_component_t component) {
+    struct EntityRecord *record = get_record(ecs, entity);
+    if (record == NULL) return NULL;
+
+    struct Archetype *archetype = &ecs->archetypes[record->archetype];
+    if (!(archetype->mask & ECS_BIT(component))) return NULL;
+    return (char *) archetype->columns[component] + (size_t) record->row * ecs->component_size[component];
+}
+
+// move the entity to the archetype of new_mask, keeping the components both have
+static void change_archetype(struct Ecs *ecs, struct EntityRecord *record, uint32_t entity_index, ecs_mask_t new_mask) {
+    uint32_t dst_index = find_archetype(ecs, new_mask);
+    if (dst_index == ECS_INVALID) return;
+
+    struct Archetype *src = &ecs->archetypes[record->archetype];
+    struct Archetype *dst = &ecs->archetypes[dst_index];
+    uint32_t src_row = record->row;
+    uint32_t dst_row = archetype_push(ecs, dst, entity_index);
+    if (dst_row == ECS_INVALID) return;
+
+    ecs_mask_t shared = src->mask & dst->mask;
+    for (uint32_t c=0; c<ecs->component_count; c++) {
+        if (shared & ECS_BIT(c)) {
+            uint32_t size = ecs->component_size[c];
+            memcpy((char *) dst->columns[c] + (size_t) dst_row * size,
+                   (char *) src->columns[c] + (size_t) src_row * size, size);
+        }
+    }
+
+    archetype_remove_row(ecs, src, src_row);
+    record->archetype = dst_index;
+    record->row = dst_row;
+}
+
+void ecs_add(struct Ecs *ecs, entity_t entity, ecs_component_t component) {
+    struct EntityRecord *record = get_record(ecs, entity);
+    if (record == NULL) return;
+
+    ecs_mask_t mask = ecs->archetypes[record->archetype].mask;
+    if (mask & ECS_BIT(component)) return;
+    change_archetype(ecs, record, entity.index, mask | ECS_BIT(component));
+}
+
+void ecs_remove(struct Ecs *ecs, entity_t entity, ecs_component_t component) {
+    struct EntityRecord *record = get_record(ecs, entity);
+    if (record == NULL) return;
+
+    ecs_mask_t mask = ecs->archetypes[record->archetype].mask;
+    if (!(mask & ECS_BIT(component))) return;
+    change_archetype(ecs, record, entity.index, mask & ~ECS_BIT(component));
+}
+
+void *ecs_column(struct EcsView *view, ecs_component_t component) {
+    return view->ecs->archetypes[view->archetype].columns[component];
+}
+
+entity_t ecs_view_entity(struct EcsView *view, uint32_t row) {
+    uint32_t index = view->ecs->archetypes[view->archetype].entities[row];
+    entity_t entity = {index, view->ecs->records[index].generation};
+    return entity;
+}
+
+static bool query_match(struct EcsQuery *query, ecs_mask_t mask) {
+    return (mask & query->all) == query->all && (mask & query->none) == 0;
+}
+
+void ecs_query_each(struct Ecs *ecs, struct EcsQuery query, ecs_system_fn fn, void *ctx) {
+    for (uint32_t i=0; i<ecs->archetype_count; i++) {
+        struct Archetype *archetype = &ecs->archetypes[i];
+        if (archetype->count == 0 || !query_match(&query, archetype->mask)) continue;
+
+        struct EcsView view = {ecs, i, 0, archetype->count};
+        fn(&view, ctx);
+    }
+}
+
+
+struct ParallelQuery {
+    struct EcsView *views;
+    ecs_system_fn fn;
+    void *ctx;
+};
+
+static void run_views(void *arg, uint32_t begin, uint32_t end) {
+    struct ParallelQuery *query = arg;
+    for (uint32_t i=begin; i<end; i++) {
+        query->fn(&query->views[i], query->ctx);
+    }
+}
+
+void ecs_query_parallel(struct Ecs *ecs, struct EcsQuery query, uint32_t chunk_size, ecs_system_fn fn, void *ctx) {
+    if (chunk_size == 0) chunk_size = 1024;
+
+    // cut every matching archetype in chunks, they become independent jobs
+    uint32_t views_count = 0;
+    for (uint32_t i=0; i<ecs->archetype_count; i++) {
+        struct Archetype *archetype = &ecs->archetypes[i];
+        if (archetype->count == 0 || !query_match(&query, archetype->mask)) continue;
+        views_count += (archetype->count + chunk_size - 1) / chunk_size;
+    }
+    if (views_count == 0) return;
+
+    if (views_count > ecs->views_capacity) {
+        struct EcsView *views = memory_realloc(ecs->views, views_count * sizeof(*views), MEMORY_TAG_SIMULATION);
+        if (views == NULL) {
+            ecs_query_each(ecs, query, fn, ctx);
+            return;
+        }
+        ecs->views = views;
+        ecs->views_capacity = views_count;
+    }
+    struct EcsView *views = ecs->views;
+
+    uint32_t n = 0;
+    for (uint32_t i=0; i<ecs->archetype_count; i++) {
+        struct Archetype *archetype = &ecs->archetypes[i];
+        if (archetype->count == 0 || !query_match(&query, archetype->mask)) continue;
+        for (uint32_t begin=0; begin<archetype->count; begin+=chunk_size) {
+            uint32_t end = begin + chunk_size < archetype->count ? begin + chunk_size : archetype->count;
+            views[n++] = (struct EcsView){ecs, i, begin, end};
+        }
+    }
+
+    struct ParallelQuery parallel = {views, fn, ctx};
+    job_parallel_for(views_count, 1, run_views, &parallel);
+}
@@ -0,0 +1,69 @@
+// Archetype based entity component system.
+// Entities with the same set of components live in the same archetype table,
+// every component is a tightly packed column (structure of arrays), so a system
+// walks plain arrays instead of chasing pointers.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ECS_MAX_COMPONENTS 64
+#define ECS_MAX_ARCHETYPES 256
+
+typedef uint32_t ecs_component_t;   // index of a registered component
+typedef uint64_t ecs_mask_t;        // one bit per component
+
+#define ECS_BIT(component) ((ecs_mask_t) 1 << (component))
+
+// stable handle: the generation changes when the slot is reused,
+// so a stale handle never points to a new entity
+typedef struct entity {
+    uint32_t index;
+    uint32_t generation;
+} entity_t;
+
+struct Ecs;
+
+// a contiguous run of rows in one archetype, handed to the systems
+struct EcsView {
+    struct Ecs *ecs;
+    uint32_t archetype;
+    uint32_t begin;
+    uint32_t end;
+};
+
+struct EcsQuery {
+    ecs_mask_t all;     // the archetype must have all of these
+    ecs_mask_t none;    // and none of these
+};
+
+typedef void (*ecs_system_fn)(struct EcsView *view, void *ctx);
+
+struct Ecs *ecs_create();
+void ecs_destroy(struct Ecs *ecs);
+
+ecs_component_t ecs_register_component(struct Ecs *ecs, const char *name, uint32_t size);
+
+// the components are zero initialized
+entity_t ecs_create_entity(struct Ecs *ecs, ecs_mask_t components);
+void ecs_destroy_entity(struct Ecs *ecs, entity_t entity);
+bool ecs_alive(struct Ecs *ecs, entity_t entity);
+uint32_t ecs_entity_count(struct Ecs *ecs);
+
+// NULL if the entity is dead or does not have the component.
+// The pointer is valid until the next structural change (create/destroy/add/remove)
+void *ecs_get(struct Ecs *ecs, entity_t entity, ecs_component_t component);
+void ecs_add(struct Ecs *ecs, entity_t entity, ecs_component_t component);
+void ecs_remove(struct Ecs *ecs, entity_t entity, ecs_component_t component);
+
+// base pointer of a component column for the rows of the view, index it with [view->begin .. view->end)
+void *ecs_column(struct EcsView *view, ecs_component_t component);
+entity_t ecs_view_entity(struct EcsView *view, uint32_t row);
+
+// Run fn on every archetype matching the query, in archetype order.
+// No structural changes are allowed while a query runs.
+void ecs_query_each(struct Ecs *ecs, struct EcsQuery query, ecs_system_fn fn, void *ctx);
+// Same but the rows are split in chunks of chunk_size run on the worker threads.
+// fn must only touch the rows of its view and must not start another parallel query.
+void ecs_query_parallel(struct Ecs *ecs, struct EcsQuery query, uint32_t chunk_size, ecs_system_fn fn, void *ctx);
@@ -0,0 +1,49 @@
+#include "entity.h"
+
+ecs_component_t COMPONENT_POSITION;
+ecs_component_t COMPONENT_VELOCITY;
+ecs_component_t COMPONENT_GRAVITY;
+ecs_component_t COMPONENT_COLLIDER;
+
+// rows per job, big enough to amortize the scheduling
+#define SYSTEM_CHUNK_SIZE 4096
+
+void entity_register_components(struct Ecs *ecs) {
+    COMPONENT_POSITION = ecs_register_component(ecs, "position", sizeof(struct EntityPosition));
+    COMPONENT_VELOCITY = ecs_register_component(ecs, "velocity", sizeof(struct EntityVelocity));
+    COMPONENT_GRAVITY  = ecs_register_component(ecs, "gravity",  sizeof(struct EntityGravity));
+    COMPONENT_COLLIDER = ecs_register_component(ecs, "collider", sizeof(struct EntityCollider));
+}
+
+static void update_movement(struct EcsView *view, void *ctx) {
+    float dt = *(float *) ctx;
+    struct EntityPosition *position = ecs_column(view, COMPONENT_POSITION);
+    struct EntityVelocity *velocity = ecs_column(view, COMPONENT_VELOCITY);
+
+    for (uint32_t i=view->begin; i<view->end; i++) {
+        position[i].x += velocity[i].x * dt;
+        position[i].y += velocity[i].y * dt;
+        position[i].z += velocity[i].z * dt;
+    }
+}
+
+static void update_gravity(struct EcsView *view, void *ctx) {
+    float dt = *(float *) ctx;
+    struct EntityVelocity *velocity = ecs_column(view, COMPONENT_VELOCITY);
+    struct EntityGravity *gravity = ecs_column(view, COMPONENT_GRAVITY);
+
+    for (uint32_t i=view->begin; i<view->end; i++) {
+        float vy = velocity[i].y - GRAVITY_ACCELERATION * gravity[i].scale * dt;
+        velocity[i].y = vy < -TERMINAL_VELOCITY ? -TERMINAL_VELOCITY : vy;
+    }
+}
+
+void system_movement(struct Ecs *ecs, float dt) {
+    struct EcsQuery query = {ECS_BIT(COMPONENT_POSITION) | ECS_BIT(COMPONENT_VELOCITY), ECS_BIT(COMPONENT_COLLIDER)};
+    ecs_query_parallel(ecs, query, SYSTEM_CHUNK_SIZE, update_movement, &dt);
+}
+
+void system_gravity(struct Ecs *ecs, float dt) {
+    struct EcsQuery query = {ECS_BIT(COMPONENT_VELOCITY) | ECS_BIT(COMPONENT_GRAVITY), 0};
+    ecs_query_parallel(ecs, query, SYSTEM_CHUNK_SIZE, update_gravity, &dt);
+}
@@ -0,0 +1,41 @@
+// common entity components and the systems that update them
+
+#pragma once
+
+#include "ecs.h"
+
+struct EntityPosition {
+    float x, y, z;
+};
+
+struct EntityVelocity {
+    float x, y, z;
+};
+
+// scale of the world gravity, 0 for things that float
+struct EntityGravity {
+    float scale;
+};
+
+// box centered on the position horizontally, going up from the feet.
+// Entities with a collider are moved by physics_step() instead of system_movement()
+struct EntityCollider {
+    float half_width;
+    float height;
+    uint32_t on_ground;
+};
+
+extern ecs_component_t COMPONENT_POSITION;
+extern ecs_component_t COMPONENT_VELOCITY;
+extern ecs_component_t COMPONENT_GRAVITY;
+extern ecs_component_t COMPONENT_COLLIDER;
+
+#define GRAVITY_ACCELERATION 32.0f  // blocks/s^2
+#define TERMINAL_VELOCITY    78.4f  // blocks/s
+
+void entity_register_components(struct Ecs *ecs);
+
+// position += velocity * dt, for the entities without collider
+void system_movement(struct Ecs *ecs, float dt);
+// velocity.y -= gravity * dt, clamped to the terminal velocity
+void system_gravity(struct Ecs *ecs, float dt);
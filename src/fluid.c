@@ -0,0 +1,180 @@
+#include "fluid.h"
+#include "blocktick.h"
+#include "log.h"
+#include "memory.h"
+#include "timer.h"
+
+struct FluidKind {
+    block_t block;
+    int drop;               // levels lost per block sideways
+    uint32_t delay;         // ticks between two updates of a cell
+};
+
+static const struct FluidKind KINDS[] = {
+    {BLOCK_WATER, 1, 5},
+    {BLOCK_LAVA,  2, 30},
+};
+
+struct Fluids {
+    struct BlockTicks *ticks;   // the active cells
+    fluid_set_fn set;           // during a tick
+    void *user;
+    struct BlockAccess access;
+    struct FluidStats stats;
+};
+
+struct Fluids *fluid_create() {
+    struct Fluids *fluids = memory_calloc(1, sizeof(*fluids), MEMORY_TAG_SIMULATION);
+    if (fluids == NULL) {
+        FATAL("FLUID failed to allocate");
+        return NULL;
+    }
+    fluids->ticks = block_ticks_create();
+    if (fluids->ticks == NULL) {
+        FATAL("FLUID failed to allocate the active cells");
+        fluid_destroy(fluids);
+        return NULL;
+    }
+    return fluids;
+}
+
+void fluid_destroy(struct Fluids *fluids) {
+    if (fluids == NULL) return;
+    block_ticks_destroy(fluids->ticks);
+    memory_free(fluids);
+}
+
+static const struct FluidKind *fluid_kind(block_t block) {
+    for (uint32_t i=0; i<sizeof(KINDS) / sizeof(KINDS[0]); i++) {
+        if (KINDS[i].block == block_id(block)) return &KINDS[i];
+    }
+    return NULL;
+}
+
+// the state of a fluid block is how far below a source it is
+static int block_level(block_t block) {
+    return FLUID_SOURCE - (int) block_state(block);
+}
+
+static block_t with_level(block_t fluid, int level) {
+    return block_with_state(fluid, (uint32_t) (FLUID_SOURCE - level));
+}
+
+// false when the chunk is not loaded or y is out of the world, nothing flows there
+static bool get(struct Fluids *fluids, int32_t x, int32_t y, int32_t z, block_t *block) {
+    if (y < 0 || y >= WORLD_HEIGHT) return false;
+    *block = block_access_get(&fluids->access, x, y, z);
+    return fluids->access.chunk != NULL;
+}
+
+static void schedule(struct Fluids *fluids, int32_t x, int32_t y, int32_t z, block_t block) {
+    const struct FluidKind *kind = fluid_kind(block);
+    if (kind != NULL) block_ticks_schedule(fluids->ticks, x, y, z, kind->delay);
+}
+
+// the fluid at x,y,z and next to it
+static void wake_around(struct Fluids *fluids, int32_t x, int32_t y, int32_t z) {
+    static const int8_t AROUND[7][3] = {{0,0,0}, {-1,0,0}, {1,0,0}, {0,-1,0}, {0,1,0}, {0,0,-1}, {0,0,1}};
+    for (int i=0; i<7; i++) {
+        int32_t nx = x + AROUND[i][0], ny = y + AROUND[i][1], nz = z + AROUND[i][2];
+        block_t block;
+        if (get(fluids, nx, ny, nz, &block) && block_has(block, BLOCK_FLAG_LIQUID)) schedule(fluids, nx, ny, nz, block);
+    }
+}
+
+// set wakes the cells around, through fluid_wake()
+static void set_cell(struct Fluids *fluids, int32_t x, int32_t y, int32_t z, block_t block) {
+    fluids->stats.changes++;
+    fluids->set(fluids->user, x, y, z, block);
+}
+
+// moves fluid into a neighbor at level, water and lava meeting make stone
+static void flow_into(struct Fluids *fluids, int32_t x, int32_t y, int32_t z, block_t target, block_t fluid, int level) {
+    if (block_has(target, BLOCK_FLAG_LIQUID)) {
+        if (block_id(target) != fluid) {
+            set_cell(fluids, x, y, z, BLOCK_STONE);
+        } else if (block_level(target) < level) {
+            set_cell(fluids, x, y, z, with_level(fluid, level));
+        }
+    } else if (!block_is_solid(target)) {
+        set_cell(fluids, x, y, z, with_level(fluid, level));
+    }
+}
+
+static void update_cell(void *user, int32_t x, int32_t y, int32_t z) {
+    static const int8_t SIDES[4][2] = {{-1,0}, {1,0}, {0,-1}, {0,1}};
+    struct Fluids *fluids = user;
+    block_t block, other;
+    if (!get(fluids, x, y, z, &block)) return;
+    const struct FluidKind *kind = fluid_kind(block);
+    if (kind == NULL) return;       // replaced since it was scheduled
+    block_t fluid = kind->block;
+
+    int level = block_level(block);
+    if (level < FLUID_SOURCE) {
+        // a flowing cell is as high as what feeds it
+        int fed = 0;
+        if (get(fluids, x, y + 1, z, &other) && block_id(other) == fluid) fed = FLUID_SOURCE - 1;
+        for (int i=0; i<4; i++) {
+            int32_t nx = x + SIDES[i][0], nz = z + SIDES[i][1];
+            if (!get(fluids, nx, y, nz, &other) || block_id(other) != fluid) continue;
+            int from = block_level(other) - kind->drop;
+            if (from > fed) fed = from;
+        }
+        if (fed <= 0) {
+            set_cell(fluids, x, y, z, BLOCK_AIR);
+            return;
+        }
+        if (fed != level) {
+            set_cell(fluids, x, y, z, with_level(fluid, fed));
+            level = fed;
+        }
+    }
+
+    // down first, sideways only on a floor
+    if (!get(fluids, x, y - 1, z, &other)) return;
+    if (block_id(other) == fluid) return;
+    if (!block_is_solid(other)) {
+        flow_into(fluids, x, y - 1, z, other, fluid, FLUID_SOURCE - 1);
+        return;
+    }
+    int spread = level - kind->drop;
+    if (spread <= 0) return;
+    for (int i=0; i<4; i++) {
+        int32_t nx = x + SIDES[i][0], nz = z + SIDES[i][1];
+        if (get(fluids, nx, y, nz, &other)) flow_into(fluids, nx, y, nz, other, fluid, spread);
+    }
+}
+
+void fluid_wake(struct Fluids *fluids, struct World *world, int32_t x, int32_t y, int32_t z) {
+    block_access_init(&fluids->access, world);
+    wake_around(fluids, x, y, z);
+}
+
+void fluid_tick(struct Fluids *fluids, struct World *world, fluid_set_fn set, void *user) {
+    double start = timer_now();
+    // chunks come and go between ticks, never keep one across
+    block_access_init(&fluids->access, world);
+    fluids->stats.changes = 0;
+    fluids->set = set;
+    fluids->user = user;
+    // over budget, the rest waits for the next tick
+    uint32_t updates = block_ticks_advance(fluids->ticks, FLUID_TICK_BUDGET, update_cell, fluids);
+    fluids->set = NULL;
+
+    fluids->stats.updates = updates;
+    fluids->stats.total_updates += updates;
+    fluids->stats.tick_time = timer_now() - start;
+}
+
+int fluid_level(struct Fluids *fluids, struct World *world, int32_t x, int32_t y, int32_t z) {
+    block_access_init(&fluids->access, world);
+    block_t block;
+    if (!get(fluids, x, y, z, &block) || !block_has(block, BLOCK_FLAG_LIQUID)) return 0;
+    return block_level(block);
+}
+
+void fluid_stats(const struct Fluids *fluids, struct FluidStats *stats) {
+    *stats = fluids->stats;
+    stats->active = block_ticks_count(fluids->ticks);
+}
@@ -0,0 +1,48 @@
+// Fluid flow: water and lava spread from their sources by levels.
+// Only the cells that may change are visited: a cell is active while it is
+// scheduled, it is updated at its tick, and a change of its level wakes its
+// neighbors. A still lake costs nothing.
+//  - a source is level FLUID_SOURCE. The level is the state of the block (block.h),
+//    kept with it in saves, the chunk cache and the network. A plain fluid block is
+//    a source (the seas of the generator)
+//  - fluid falls first, a falling column is FLUID_SOURCE - 1 all the way down
+//  - on a floor it spreads sideways, losing 1 level per block (water) or 2 (lava)
+//  - a flowing cell no longer fed drains, level by level
+//  - water and lava flowing into each other turn to stone
+// The changes go through the set function of fluid_tick(), the game's own
+// simulation_set_block() so that what they touch reacts (sand falls).
+
+#pragma once
+
+#include "world.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FLUID_SOURCE        8
+#define FLUID_TICK_BUDGET   65536   // updates per tick, the rest waits for the next tick
+
+struct FluidStats {
+    uint32_t updates;       // during the last tick
+    uint32_t changes;       // blocks set during the last tick
+    double tick_time;       // seconds of the last tick
+    uint32_t active;        // cells scheduled
+    uint64_t total_updates;
+};
+
+// changes the block at x,y,z and calls fluid_wake() there
+typedef void (*fluid_set_fn)(void *user, int32_t x, int32_t y, int32_t z, block_t block);
+
+struct Fluids;
+
+struct Fluids *fluid_create();
+void fluid_destroy(struct Fluids *fluids);
+
+// a block changed at x,y,z: schedules it and the fluid around it
+void fluid_wake(struct Fluids *fluids, struct World *world, int32_t x, int32_t y, int32_t z);
+// updates the cells due this tick, the blocks they change go through set
+void fluid_tick(struct Fluids *fluids, struct World *world, fluid_set_fn set, void *user);
+// level of a fluid block, 0 when it is not one
+int fluid_level(struct Fluids *fluids, struct World *world, int32_t x, int32_t y, int32_t z);
+
+void fluid_stats(const struct Fluids *fluids, struct FluidStats *stats);
@@ -0,0 +1,18 @@
+// 8x8 bitmap font for the debug text, printable ASCII (32..126) plus a solid
+// block at 127 that the overlay uses for its plain quads.
+// One byte per row from the top, bit 0 is the leftmost pixel (font8x8, public domain).
+
+#pragma once
+
+#include <stdint.h>
+
+#define FONT_FIRST_CHAR     32
+#define FONT_GLYPH_COUNT    96
+#define FONT_GLYPH_SIZE     8
+#define FONT_SOLID_CHAR     127
+
+extern const uint8_t font_8x8[FONT_GLYPH_COUNT][FONT_GLYPH_SIZE];
+
+// one byte per pixel (0 or 255), glyphs in a grid of columns x rows,
+// pixels must hold columns * rows * 64 bytes
+void font_rasterize(uint8_t *pixels, uint32_t columns, uint32_t rows);
@@ -0,0 +1,521 @@
+#include "generator.h"
+#include "worldgen.h"
+#include "job.h"
+#include "log.h"
+#include "memory.h"
+#include "timer.h"
+
+#include <stdlib.h>
+
+// how far around its chunk a stage reads, the chunks there need the stage before
+static const struct {
+    const char *name;
+    int radius;
+} STAGES[GEN_STAGE_COUNT] = {
+    [GEN_STAGE_NONE]     = {"none",     0},
+    [GEN_STAGE_NOISE]    = {"noise",    0},
+    [GEN_STAGE_CAVES]    = {"caves",    0},
+    [GEN_STAGE_BIOMES]   = {"biomes",   0},
+    [GEN_STAGE_SURFACE]  = {"surface",  0},
+    [GEN_STAGE_TREES]    = {"trees",    0},
+    [GEN_STAGE_DECORATE] = {"decorate", 1},
+};
+
+#define USER_RADIUS 1   // the widest stage radius
+
+struct GenChunk {
+    int32_t x, z;
+    struct Generator *generator;
+    uint8_t stage;                  // last stage run
+    uint32_t cached;                // bit per stage whose results are kept
+    bool requested;
+    bool running;
+    bool waiting;                   // ready for the next stage since ready_time
+    bool cancelled;                 // while running: the neighbors are released once the job is done
+    bool on_backend;                // running in the density batch
+    uint16_t users;                 // requested chunks in the 3x3 around, itself included
+    uint32_t priority;
+    double ready_time;
+    double run_time;                // of the last job, written by the worker
+    struct JobCounter counter;
+    struct Chunk *chunk;            // NULL for a chunk only needed for its trees, and once taken
+    struct GenChunk *around[9];     // the 3x3 chunks for decorate
+    struct WorldgenColumns columns;
+    struct Tree trees[WORLDGEN_MAX_TREES];
+    uint32_t tree_count;
+};
+
+// open addressing table of the chunks, linear probing, grows when more than half full
+struct Generator {
+    uint32_t seed;
+    struct GenChunk **slots;
+    uint32_t capacity;              // power of two
+    uint32_t count;
+    struct GenChunk **scratch;      // capacity entries
+    uint32_t running;
+    double last_update;
+    struct GeneratorStats stats;
+
+    const struct DensityBackend *backend;
+    const char *density_name;       // of the last backend, for the report
+    struct DensityBatch batch;      // count 0 when none is in flight
+    struct GenChunk *batch_chunks[DENSITY_MAX_BATCH];
+    double batch_start;
+};
+
+const char *gen_stage_name(enum gen_stage stage) {
+    return stage < GEN_STAGE_COUNT ? STAGES[stage].name : "unknown";
+}
+
+static uint32_t hash_chunk(int32_t x, int32_t z) {
+    uint32_t h = (uint32_t) x * 0x9E3779B1u ^ (uint32_t) z * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+static uint32_t find_slot(struct Generator *generator, int32_t x, int32_t z) {
+    uint32_t mask = generator->capacity - 1;
+    uint32_t slot = hash_chunk(x, z) & mask;
+    while (generator->slots[slot] != NULL) {
+        if (generator->slots[slot]->x == x && generator->slots[slot]->z == z) break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static bool grow(struct Generator *generator) {
+    uint32_t old_capacity = generator->capacity;
+    struct GenChunk **old_slots = generator->slots;
+
+    struct GenChunk **slots = memory_calloc(old_capacity * 2, sizeof(*slots), MEMORY_TAG_WORLD);
+    struct GenChunk **scratch = memory_alloc(old_capacity * 2 * sizeof(*scratch), MEMORY_TAG_WORLD);
+    if (slots == NULL || scratch == NULL) {
+        memory_free(slots);
+        memory_free(scratch);
+        return false;
+    }
+    memory_free(generator->scratch);
+    generator->scratch = scratch;
+    generator->slots = slots;
+    generator->capacity = old_capacity * 2;
+
+    for (uint32_t i=0; i<old_capacity; i++) {
+        if (old_slots[i] != NULL) {
+            generator->slots[find_slot(generator, old_slots[i]->x, old_slots[i]->z)] = old_slots[i];
+        }
+    }
+    memory_free(old_slots);
+    return true;
+}
+
+static struct GenChunk *lookup(struct Generator *generator, int32_t x, int32_t z) {
+    return generator->slots[find_slot(generator, x, z)];
+}
+
+static struct GenChunk *get_or_create(struct Generator *generator, int32_t x, int32_t z, uint32_t priority) {
+    uint32_t slot = find_slot(generator, x, z);
+    struct GenChunk *gen = generator->slots[slot];
+    if (gen != NULL) {
+        if (priority < gen->priority) gen->priority = priority;
+        return gen;
+    }
+
+    if ((generator->count + 1) * 2 > generator->capacity) {
+        if (!grow(generator)) {
+            FATAL("GENERATOR out of memory growing the chunk table");
+            return NULL;
+        }
+        slot = find_slot(generator, x, z);
+    }
+    gen = memory_calloc(1, sizeof(*gen), MEMORY_TAG_WORLD);
+    if (gen == NULL) {
+        FATAL("GENERATOR out of memory allocating chunk %d,%d", x, z);
+        return NULL;
+    }
+    gen->x = x;
+    gen->z = z;
+    gen->generator = generator;
+    gen->priority = priority;
+    generator->slots[slot] = gen;
+    generator->count++;
+    return gen;
+}
+
+static void remove_chunk(struct Generator *generator, int32_t x, int32_t z) {
+    uint32_t mask = generator->capacity - 1;
+    uint32_t slot = find_slot(generator, x, z);
+    struct GenChunk *gen = generator->slots[slot];
+    if (gen == NULL) return;
+
+    chunk_free(gen->chunk);
+    memory_free(gen);
+    generator->slots[slot] = NULL;
+    generator->count--;
+
+    // backward shift the entries after the hole so the probe chains stay intact
+    uint32_t hole = slot;
+    uint32_t next = (slot + 1) & mask;
+    while (generator->slots[next] != NULL) {
+        uint32_t home = hash_chunk(generator->slots[next]->x, generator->slots[next]->z) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            generator->slots[hole] = generator->slots[next];
+            generator->slots[next] = NULL;
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+struct Generator *generator_create(uint32_t seed) {
+    struct Generator *generator = memory_calloc(1, sizeof(*generator), MEMORY_TAG_WORLD);
+    if (generator == NULL) {
+        FATAL("GENERATOR failed to allocate the generator");
+        return NULL;
+    }
+    generator->seed = seed;
+    generator->capacity = 1024;
+    generator->slots = memory_calloc(generator->capacity, sizeof(*generator->slots), MEMORY_TAG_WORLD);
+    generator->scratch = memory_alloc(generator->capacity * sizeof(*generator->scratch), MEMORY_TAG_WORLD);
+    if (generator->slots == NULL || generator->scratch == NULL) {
+        FATAL("GENERATOR failed to allocate the chunk table");
+        generator_destroy(generator);
+        return NULL;
+    }
+    generator->last_update = timer_now();
+    return generator;
+}
+
+void generator_destroy(struct Generator *generator) {
+    if (generator == NULL) return;
+    if (generator->slots != NULL) {
+        generator_set_density_backend(generator, NULL);
+        // a decorate job reads its neighbors, every job is done before anything is freed
+        for (uint32_t i=0; i<generator->capacity; i++) {
+            struct GenChunk *gen = generator->slots[i];
+            if (gen != NULL && gen->running) job_wait(&gen->counter);
+        }
+        for (uint32_t i=0; i<generator->capacity; i++) {
+            struct GenChunk *gen = generator->slots[i];
+            if (gen == NULL) continue;
+            chunk_free(gen->chunk);
+            memory_free(gen);
+        }
+    }
+    memory_free(generator->slots);
+    memory_free(generator->scratch);
+    memory_free(generator);
+}
+
+static void stage_job(void *arg) {
+    struct GenChunk *gen = arg;
+    uint32_t seed = gen->generator->seed;
+    double start = timer_now();
+
+    // the chunks only needed for their trees have no blocks to carve
+    switch (gen->stage + 1) {
+    case GEN_STAGE_NOISE:
+        worldgen_stage_noise(gen->chunk, gen->x, gen->z, &gen->columns, seed);
+        break;
+    case GEN_STAGE_CAVES:
+        if (gen->chunk != NULL) worldgen_stage_caves(gen->chunk, &gen->columns, seed);
+        break;
+    case GEN_STAGE_BIOMES:
+        worldgen_stage_biomes(gen->x, gen->z, &gen->columns, seed);
+        break;
+    case GEN_STAGE_SURFACE:
+        if (gen->chunk != NULL) worldgen_stage_surface(gen->chunk, &gen->columns);
+        break;
+    case GEN_STAGE_TREES:
+        gen->tree_count = worldgen_stage_trees(gen->x, gen->z, &gen->columns, seed, gen->trees);
+        break;
+    case GEN_STAGE_DECORATE: {
+        // the neighbors' trees are only read, their own decorate writes their own blocks
+        const struct Tree *trees[9];
+        uint32_t counts[9];
+        for (int n=0; n<9; n++) {
+            trees[n] = gen->around[n]->trees;
+            counts[n] = gen->around[n]->tree_count;
+        }
+        worldgen_stage_decorate(gen->chunk, trees, counts);
+        gen->chunk->dirty = (1u << CHUNK_SECTIONS) - 1;
+        gen->chunk->unsaved = (1u << CHUNK_SECTIONS) - 1;
+        break;
+    }
+    default:
+        break;
+    }
+    gen->run_time = timer_now() - start;
+}
+
+void generator_request(struct Generator *generator, int32_t chunk_x, int32_t chunk_z, uint32_t priority) {
+    struct GenChunk *gen = get_or_create(generator, chunk_x, chunk_z, priority);
+    if (gen == NULL) return;
+    if (gen->requested) {
+        gen->cancelled = false;
+        return;
+    }
+    gen->requested = true;
+    for (int32_t dz=-USER_RADIUS; dz<=USER_RADIUS; dz++) {
+        for (int32_t dx=-USER_RADIUS; dx<=USER_RADIUS; dx++) {
+            struct GenChunk *around = get_or_create(generator, chunk_x + dx, chunk_z + dz, priority);
+            if (around != NULL) around->users++;
+        }
+    }
+}
+
+static void release_users(struct Generator *generator, struct GenChunk *gen) {
+    gen->requested = false;
+    for (int32_t dz=-USER_RADIUS; dz<=USER_RADIUS; dz++) {
+        for (int32_t dx=-USER_RADIUS; dx<=USER_RADIUS; dx++) {
+            struct GenChunk *around = lookup(generator, gen->x + dx, gen->z + dz);
+            if (around != NULL) around->users--;
+        }
+    }
+}
+
+void generator_cancel(struct Generator *generator, int32_t chunk_x, int32_t chunk_z) {
+    struct GenChunk *gen = lookup(generator, chunk_x, chunk_z);
+    if (gen == NULL || !gen->requested) return;
+    // a running decorate still reads the neighbors' trees
+    if (gen->running) gen->cancelled = true;
+    else release_users(generator, gen);
+}
+
+struct Chunk *generator_take(struct Generator *generator, int32_t chunk_x, int32_t chunk_z) {
+    struct GenChunk *gen = lookup(generator, chunk_x, chunk_z);
+    if (gen == NULL || !gen->requested || gen->running || gen->stage < GEN_STAGE_DECORATE || gen->chunk == NULL) return NULL;
+    struct Chunk *chunk = gen->chunk;
+    gen->chunk = NULL;
+    release_users(generator, gen);
+    return chunk;
+}
+
+static void finish_stage(struct Generator *generator, struct GenChunk *gen, double now) {
+    gen->running = false;
+    gen->waiting = false;
+    generator->running--;
+    gen->stage++;
+    gen->cached |= 1u << gen->stage;
+
+    struct GenStageStats *stats = &generator->stats.stages[gen->stage];
+    double latency = now - gen->ready_time;
+    stats->chunks++;
+    stats->run_time += gen->run_time;
+    stats->latency += latency;
+    if (latency > stats->max_latency) stats->max_latency = latency;
+    if (gen->stage == GEN_STAGE_DECORATE) generator->stats.chunks_done++;
+}
+
+static bool dependencies_met(struct Generator *generator, struct GenChunk *gen, int stage) {
+    int radius = STAGES[stage].radius;
+    for (int32_t dz=-radius; dz<=radius; dz++) {
+        for (int32_t dx=-radius; dx<=radius; dx++) {
+            if (dx == 0 && dz == 0) continue;
+            struct GenChunk *around = lookup(generator, gen->x + dx, gen->z + dz);
+            if (around == NULL || !(around->cached & 1u << (stage - 1))) return false;
+        }
+    }
+    return true;
+}
+
+static int compare_priority(const void *a, const void *b) {
+    const struct GenChunk *ga = *(const struct GenChunk *const *) a;
+    const struct GenChunk *gb = *(const struct GenChunk *const *) b;
+    if (ga->priority != gb->priority) return ga->priority < gb->priority ? -1 : 1;
+    return ga->ready_time < gb->ready_time ? -1 : ga->ready_time > gb->ready_time;
+}
+
+// both density stages at once, the batch time is shared by its chunks
+static void finish_batch(struct Generator *generator, double now) {
+    struct DensityBatch *batch = &generator->batch;
+    double elapsed = now - generator->batch_start;
+    struct GenStageStats *stats = &generator->stats.stages[GEN_STAGE_NOISE];
+    for (uint32_t i=0; i<batch->count; i++) {
+        struct GenChunk *gen = generator->batch_chunks[i];
+        gen->running = false;
+        gen->on_backend = false;
+        gen->waiting = false;
+        gen->stage = GEN_STAGE_CAVES;
+        gen->cached |= 1u << GEN_STAGE_NOISE | 1u << GEN_STAGE_CAVES;
+
+        double latency = now - gen->ready_time;
+        stats->chunks++;
+        stats->run_time += elapsed / batch->count;
+        stats->latency += latency;
+        if (latency > stats->max_latency) stats->max_latency = latency;
+        if (gen->cancelled) {
+            gen->cancelled = false;
+            release_users(generator, gen);
+        }
+    }
+    generator->stats.density_batches++;
+    generator->stats.density_time += elapsed;
+    batch->count = 0;
+}
+
+void generator_set_density_backend(struct Generator *generator, const struct DensityBackend *backend) {
+    if (generator->batch.count > 0) {
+        while (!generator->backend->poll(generator->backend->ctx)) timer_sleep(0.0005);
+        finish_batch(generator, timer_now());
+    }
+    generator->backend = backend;
+    if (backend != NULL) {
+        generator->density_name = backend->name;
+        INFO("GENERATOR density stages on %s, %u chunks per batch", backend->name, backend->max_batch);
+    }
+}
+
+void generator_update(struct Generator *generator) {
+    double now = timer_now();
+    if (generator->running > 0 || generator->batch.count > 0) generator->stats.busy_time += now - generator->last_update;
+    generator->last_update = now;
+    if (generator->batch.count > 0 && generator->backend->poll(generator->backend->ctx)) finish_batch(generator, now);
+
+    // finished jobs, then what is not needed any more
+    uint32_t evict_count = 0;
+    for (uint32_t i=0; i<generator->capacity; i++) {
+        struct GenChunk *gen = generator->slots[i];
+        if (gen == NULL || gen->on_backend) continue;
+        if (gen->running) {
+            if (!job_done(&gen->counter)) continue;
+            finish_stage(generator, gen, now);
+            if (gen->cancelled) {
+                gen->cancelled = false;
+                release_users(generator, gen);
+            }
+        }
+        if (gen->users == 0) {
+            generator->scratch[evict_count++] = gen;
+            continue;
+        }
+        if (!gen->requested && gen->chunk != NULL) {
+            // a neighbor only needs the trees
+            chunk_free(gen->chunk);
+            gen->chunk = NULL;
+        }
+        if (gen->requested && gen->chunk == NULL) {
+            // asked for again after being taken, or a neighbor that is now wanted whole:
+            // the blocks start over, the trees are kept
+            gen->chunk = chunk_create(gen->x, gen->z);
+            gen->stage = GEN_STAGE_NONE;
+            gen->cached &= 1u << GEN_STAGE_TREES;
+            gen->waiting = false;
+        }
+    }
+    for (uint32_t i=0; i<evict_count; i++) {
+        remove_chunk(generator, generator->scratch[i]->x, generator->scratch[i]->z);
+    }
+
+    // the chunks ready for their next stage
+    uint32_t ready_count = 0;
+    for (uint32_t i=0; i<generator->capacity; i++) {
+        struct GenChunk *gen = generator->slots[i];
+        if (gen == NULL || gen->running) continue;
+        if (gen->requested && gen->chunk == NULL) continue;     // out of memory
+
+        enum gen_stage target = gen->requested ? GEN_STAGE_DECORATE : GEN_STAGE_TREES;
+        // the trees of a chunk starting over are still there
+        if (gen->stage + 1 == GEN_STAGE_TREES && (gen->cached & 1u << GEN_STAGE_TREES)) gen->stage = GEN_STAGE_TREES;
+        if (gen->stage >= target || !dependencies_met(generator, gen, gen->stage + 1)) {
+            gen->waiting = false;
+            continue;
+        }
+        if (!gen->waiting) {
+            gen->waiting = true;
+            gen->ready_time = now;
+        }
+        generator->scratch[ready_count++] = gen;
+    }
+    qsort(generator->scratch, ready_count, sizeof(*generator->scratch), compare_priority);
+
+    // the density of the requested chunks goes to the backend, nearest first
+    const struct DensityBackend *backend = generator->backend;
+    if (backend != NULL && generator->batch.count == 0) {
+        struct DensityBatch *batch = &generator->batch;
+        batch->seed = generator->seed;
+        for (uint32_t i=0; i<ready_count && batch->count < backend->max_batch; i++) {
+            struct GenChunk *gen = generator->scratch[i];
+            if (gen->stage != GEN_STAGE_NONE || gen->chunk == NULL) continue;
+            batch->x[batch->count] = gen->x;
+            batch->z[batch->count] = gen->z;
+            batch->chunks[batch->count] = gen->chunk;
+            batch->columns[batch->count] = &gen->columns;
+            generator->batch_chunks[batch->count++] = gen;
+        }
+        generator->batch_start = now;
+        if (batch->count > 0 && backend->submit(backend->ctx, batch)) {
+            for (uint32_t i=0; i<batch->count; i++) {
+                generator->batch_chunks[i]->running = true;
+                generator->batch_chunks[i]->on_backend = true;
+            }
+        } else if (batch->count > 0) {
+            WARNING("GENERATOR %s failed, density back on the workers", backend->name);
+            batch->count = 0;
+            generator->backend = backend = NULL;
+        }
+    }
+
+    for (uint32_t i=0; i<ready_count && generator->running < GENERATOR_MAX_JOBS; i++) {
+        struct GenChunk *gen = generator->scratch[i];
+        if (gen->running) continue;
+        // waits for the next batch
+        if (backend != NULL && gen->stage == GEN_STAGE_NONE && gen->chunk != NULL) continue;
+        if (gen->stage + 1 == GEN_STAGE_DECORATE) {
+            for (int n=0; n<9; n++) gen->around[n] = lookup(generator, gen->x + n % 3 - 1, gen->z + n / 3 - 1);
+        }
+        gen->running = true;
+        generator->running++;
+        job_submit(stage_job, gen, &gen->counter);
+    }
+}
+
+void generator_flush(struct Generator *generator) {
+    for (;;) {
+        generator_update(generator);
+
+        bool pending = false;
+        struct GenChunk *running = NULL;
+        for (uint32_t i=0; i<generator->capacity; i++) {
+            struct GenChunk *gen = generator->slots[i];
+            if (gen == NULL) continue;
+            if (gen->requested && (gen->running || gen->stage < GEN_STAGE_DECORATE || gen->chunk == NULL)) pending = true;
+            if (gen->running && running == NULL) running = gen;
+        }
+        if (!pending) return;
+        if (running == NULL) {
+            ERROR("GENERATOR requested chunks can not be generated");
+            return;
+        }
+        if (running->on_backend) timer_sleep(0.0005);
+        else job_wait(&running->counter);
+    }
+}
+
+void generator_stats(struct Generator *generator, struct GeneratorStats *stats) {
+    *stats = generator->stats;
+    stats->cached = generator->count;
+    stats->running = generator->running;
+}
+
+void generator_report(struct Generator *generator) {
+    const struct GeneratorStats *stats = &generator->stats;
+    if (stats->chunks_done == 0) return;
+    INFO("GENERATOR %llu chunks, %.2f s with jobs in flight, %.0f chunks/s",
+         (unsigned long long) stats->chunks_done, stats->busy_time,
+         stats->busy_time > 0.0 ? stats->chunks_done / stats->busy_time : 0.0);
+    if (stats->density_batches > 0) {
+        INFO("GENERATOR density on %s: %llu batches, %.2f ms per batch",
+             generator->density_name,
+             (unsigned long long) stats->density_batches, stats->density_time * 1e3 / stats->density_batches);
+    }
+    for (int s=GEN_STAGE_NOISE; s<GEN_STAGE_COUNT; s++) {
+        const struct GenStageStats *stage = &stats->stages[s];
+        if (stage->chunks == 0) continue;
+        INFO("GENERATOR %-8s %7llu chunks %8.1f us/chunk %8.0f chunks/s per worker, latency %.2f ms mean %.2f ms max",
+             STAGES[s].name, (unsigned long long) stage->chunks, stage->run_time * 1e6 / stage->chunks,
+             stage->run_time > 0.0 ? stage->chunks / stage->run_time : 0.0,
+             stage->latency * 1e3 / stage->chunks, stage->max_latency * 1e3);
+    }
+}
@@ -0,0 +1,93 @@
+// Staged world generation across chunks.
+// A chunk runs the worldgen.h stages one at a time as jobs, its status is the
+// last stage it finished. A stage that reads the chunks around it only starts
+// once they all finished the stage before it: decorate needs the trees of the
+// 8 neighbors. The neighbors pulled in that way stop at the trees stage and
+// never allocate blocks. Stage results (columns, trees) stay cached as long as a
+// requested chunk around them is not taken.
+// Each stage counts the chunks through it, the time its jobs ran and the latency
+// from the moment the chunk was ready for it to the moment it finished.
+
+#pragma once
+
+#include "worldgen.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define GENERATOR_MAX_JOBS 64   // stage jobs in flight
+#define DENSITY_MAX_BATCH  64   // chunks per density batch
+
+enum gen_stage {
+    GEN_STAGE_NONE = 0,
+    GEN_STAGE_NOISE,
+    GEN_STAGE_CAVES,
+    GEN_STAGE_BIOMES,
+    GEN_STAGE_SURFACE,
+    GEN_STAGE_TREES,
+    GEN_STAGE_DECORATE,     // the chunk is done
+    GEN_STAGE_COUNT
+};
+
+struct GenStageStats {
+    uint64_t chunks;        // through the stage
+    double run_time;        // seconds, summed over the jobs
+    double latency;         // seconds from ready to finished, summed
+    double max_latency;
+};
+
+// a batch for the density backend, the chunks are all air and the columns empty
+struct DensityBatch {
+    uint32_t seed;
+    uint32_t count;
+    int32_t x[DENSITY_MAX_BATCH], z[DENSITY_MAX_BATCH];
+    struct Chunk *chunks[DENSITY_MAX_BATCH];
+    struct WorldgenColumns *columns[DENSITY_MAX_BATCH];
+};
+
+struct DensityBackend {
+    const char *name;
+    uint32_t max_batch;     // up to DENSITY_MAX_BATCH
+    void *ctx;
+    // starts the noise and caves stages of a batch, one at a time. The batch stays
+    // untouched until poll() returns true. False when it failed, the workers take over
+    bool (*submit)(void *ctx, const struct DensityBatch *batch);
+    // main thread, does not block: true once the batch is written to its chunks and columns
+    bool (*poll)(void *ctx);
+};
+
+struct GeneratorStats {
+    struct GenStageStats stages[GEN_STAGE_COUNT];
+    uint64_t chunks_done;       // requested chunks that went through every stage
+    double busy_time;           // wall seconds with jobs in flight
+    uint64_t density_batches;   // run on the backend, their chunks count in the noise stage
+    double density_time;        // seconds from submit to done, summed
+    uint32_t cached;            // chunks held, requested or kept for their neighbors
+    uint32_t running;           // jobs in flight
+};
+
+struct Generator;
+
+const char *gen_stage_name(enum gen_stage stage);
+
+struct Generator *generator_create(uint32_t seed);
+// waits for the jobs in flight, the chunks not taken are freed
+void generator_destroy(struct Generator *generator);
+
+// ask for a chunk, the lowest priority goes first. Nothing happens if it is already requested
+void generator_request(struct Generator *generator, int32_t chunk_x, int32_t chunk_z, uint32_t priority);
+// not needed any more, its cached stages may be dropped
+void generator_cancel(struct Generator *generator, int32_t chunk_x, int32_t chunk_z);
+// main thread: picks up the finished stages and queues the ones now ready, does not block
+void generator_update(struct Generator *generator);
+// blocks, helping with the jobs, until every requested chunk is done
+void generator_flush(struct Generator *generator);
+// the requested chunk once done, NULL before. The caller owns it (world_insert_chunk(), chunk_free())
+struct Chunk *generator_take(struct Generator *generator, int32_t chunk_x, int32_t chunk_z);
+
+// NULL runs everything on the workers, waits for the batch in flight
+void generator_set_density_backend(struct Generator *generator, const struct DensityBackend *backend);
+
+void generator_stats(struct Generator *generator, struct GeneratorStats *stats);
+// logs the stats of every stage
+void generator_report(struct Generator *generator);
@@ -0,0 +1,132 @@
+#include "gpu_memory.h"
+#include "log.h"
+#include "timer.h"
+
+#include <string.h>
+
+// the level only drops back once the load is this far under its threshold
+#define HYSTERESIS 0.05f
+
+struct Callback {
+    memory_pressure_fn fn;
+    void *ctx;
+};
+
+static VkPhysicalDevice physical_device;
+static PFN_vkGetPhysicalDeviceMemoryProperties2KHR get_memory_properties2;
+static struct GpuMemoryStats stats;
+static struct Callback callbacks[GPU_MEMORY_MAX_CALLBACKS];
+static uint32_t callbacks_count;
+static double last_query;
+
+static const char *pressure_names[] = {"none", "high", "critical"};
+
+static enum memory_pressure pressure_for_load(float load, enum memory_pressure current) {
+    float critical = GPU_MEMORY_CRITICAL - (current >= MEMORY_PRESSURE_CRITICAL ? HYSTERESIS : 0.0f);
+    float high = GPU_MEMORY_HIGH - (current >= MEMORY_PRESSURE_HIGH ? HYSTERESIS : 0.0f);
+    if (load >= critical) return MEMORY_PRESSURE_CRITICAL;
+    if (load >= high) return MEMORY_PRESSURE_HIGH;
+    return MEMORY_PRESSURE_NONE;
+}
+
+static void query() {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+    budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties.pNext = &budget;
+    get_memory_properties2(physical_device, &properties);
+
+    float load = 0.0f;
+    for (uint32_t i=0; i<stats.heap_count; i++) {
+        struct GpuHeap *heap = &stats.heaps[i];
+        heap->budget = budget.heapBudget[i];
+        heap->usage = budget.heapUsage[i];
+        TRACE("GPU MEMORY heap %u: %.1f / %.1f MB", i, heap->usage / (1024.0 * 1024.0), heap->budget / (1024.0 * 1024.0));
+        if (heap->device_local && heap->budget > 0) {
+            float heap_load = (float) heap->usage / (float) heap->budget;
+            if (heap_load > load) load = heap_load;
+        }
+    }
+    stats.load = load;
+    stats.queries++;
+
+    enum memory_pressure pressure = pressure_for_load(load, stats.pressure);
+    if (pressure == stats.pressure) return;
+    if (pressure > stats.pressure) {
+        WARNING("GPU MEMORY at %.0f%% of the budget, pressure %s", load * 100.0f, pressure_names[pressure]);
+    } else {
+        INFO("GPU MEMORY back to %.0f%% of the budget, pressure %s", load * 100.0f, pressure_names[pressure]);
+    }
+    stats.pressure = pressure;
+    for (uint32_t i=0; i<callbacks_count; i++) {
+        callbacks[i].fn(callbacks[i].ctx, pressure);
+    }
+}
+
+void gpu_memory_init(VkInstance instance, VkPhysicalDevice device, bool budget_extension) {
+    physical_device = device;
+    memset(&stats, 0, sizeof(stats));
+
+    VkPhysicalDeviceMemoryProperties properties;
+    vkGetPhysicalDeviceMemoryProperties(device, &properties);
+    stats.heap_count = properties.memoryHeapCount;
+    for (uint32_t i=0; i<stats.heap_count; i++) {
+        stats.heaps[i].size = properties.memoryHeaps[i].size;
+        stats.heaps[i].budget = properties.memoryHeaps[i].size;
+        stats.heaps[i].device_local = (properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    }
+
+    get_memory_properties2 = NULL;
+    if (budget_extension) {
+        get_memory_properties2 = (PFN_vkGetPhysicalDeviceMemoryProperties2KHR)
+            vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR");
+    }
+    stats.budget_supported = get_memory_properties2 != NULL;
+    INFO("GPU MEMORY %u heaps, budget tracking %s", stats.heap_count, stats.budget_supported ? "on" : "not supported");
+
+    if (stats.budget_supported) {
+        query();
+        last_query = timer_now();
+    }
+}
+
+void gpu_memory_update() {
+    if (!stats.budget_supported) return;
+    double now = timer_now();
+    if (now - last_query < GPU_MEMORY_QUERY_INTERVAL) return;
+    last_query = now;
+    query();
+}
+
+void gpu_memory_stats(struct GpuMemoryStats *out) {
+    *out = stats;
+}
+
+bool gpu_memory_add_callback(memory_pressure_fn fn, void *ctx) {
+    if (callbacks_count == GPU_MEMORY_MAX_CALLBACKS) {
+        ERROR("GPU MEMORY too many pressure callbacks");
+        return false;
+    }
+    callbacks[callbacks_count++] = (struct Callback) {fn, ctx};
+    // a late subscriber still hears about the pressure already there
+    if (stats.pressure != MEMORY_PRESSURE_NONE) fn(ctx, stats.pressure);
+    return true;
+}
+
+void gpu_memory_remove_callback(memory_pressure_fn fn, void *ctx) {
+    for (uint32_t i=0; i<callbacks_count; i++) {
+        if (callbacks[i].fn == fn && callbacks[i].ctx == ctx) {
+            callbacks[i] = callbacks[--callbacks_count];
+            return;
+        }
+    }
+}
+
+void gpu_memory_report() {
+    for (uint32_t i=0; i<stats.heap_count; i++) {
+        const struct GpuHeap *heap = &stats.heaps[i];
+        INFO("GPU MEMORY heap %u%s: %8.1f MB, budget %8.1f MB, used %8.1f MB", i, heap->device_local ? " (device)" : "",
+             heap->size / (1024.0 * 1024.0), heap->budget / (1024.0 * 1024.0), heap->usage / (1024.0 * 1024.0));
+    }
+}
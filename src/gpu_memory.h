@@ -0,0 +1,48 @@
+// GPU memory budget.
+// With VK_EXT_memory_budget the driver reports for each heap how much this
+// process may use (the budget, it shrinks when other applications take VRAM)
+// and how much it uses. Going over the budget makes the driver page memory
+// over the bus, which shows as long stutters, so the subsystems holding GPU
+// memory register a callback and shrink when the usage gets close.
+// Without the extension only the heap sizes are known and no callback fires.
+
+#pragma once
+
+#include "memory.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#define GPU_MEMORY_HIGH             0.80f   // usage / budget asking the subsystems to shrink
+#define GPU_MEMORY_CRITICAL         0.95f
+#define GPU_MEMORY_QUERY_INTERVAL   0.5     // seconds between two queries of the driver
+#define GPU_MEMORY_MAX_CALLBACKS    8
+
+struct GpuHeap {
+    VkDeviceSize size;
+    VkDeviceSize budget;        // the heap size without the extension
+    VkDeviceSize usage;         // 0 without the extension
+    bool device_local;
+};
+
+struct GpuMemoryStats {
+    bool budget_supported;
+    uint32_t heap_count;
+    struct GpuHeap heaps[VK_MAX_MEMORY_HEAPS];
+    float load;                 // highest usage / budget of the device local heaps
+    enum memory_pressure pressure;
+    uint64_t queries;
+};
+
+// budget_extension: VK_EXT_memory_budget is enabled on the device
+void gpu_memory_init(VkInstance instance, VkPhysicalDevice device, bool budget_extension);
+// once per frame, the driver is only asked every GPU_MEMORY_QUERY_INTERVAL
+void gpu_memory_update();
+void gpu_memory_stats(struct GpuMemoryStats *stats);
+
+// fn runs on the render thread each time the pressure level changes, NONE included
+bool gpu_memory_add_callback(memory_pressure_fn fn, void *ctx);
+void gpu_memory_remove_callback(memory_pressure_fn fn, void *ctx);
+
+void gpu_memory_report();
@@ -0,0 +1,101 @@
+#include "image.h"
+#include "log.h"
+#include "memory.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_SIDE 16384
+
+bool image_create(struct Image *image, uint32_t width, uint32_t height) {
+    image->width = width;
+    image->height = height;
+    image->pixels = memory_alloc((size_t) width * height * 3, MEMORY_TAG_RENDERER);
+    if (image->pixels == NULL) {
+        ERROR("IMAGE failed to allocate %ux%u pixels", width, height);
+        return false;
+    }
+    return true;
+}
+
+void image_destroy(struct Image *image) {
+    memory_free(image->pixels);
+    image->pixels = NULL;
+}
+
+bool image_write_ppm(const struct Image *image, const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        ERROR("IMAGE failed to create %s", path);
+        return false;
+    }
+    size_t size = (size_t) image->width * image->height * 3;
+    bool ok = fprintf(file, "P6\n%u %u\n255\n", image->width, image->height) > 0 &&
+              fwrite(image->pixels, 1, size, file) == size;
+    if (fclose(file) != 0) ok = false;
+    if (!ok) ERROR("IMAGE failed to write %s", path);
+    return ok;
+}
+
+// a number of the header, after white space and comments
+static bool read_number(FILE *file, uint32_t *value) {
+    int c = fgetc(file);
+    for (;;) {
+        while (c != EOF && isspace(c)) c = fgetc(file);
+        if (c != '#') break;
+        while (c != EOF && c != '\n') c = fgetc(file);
+    }
+    if (c == EOF || !isdigit(c)) return false;
+    uint32_t n = 0;
+    while (c != EOF && isdigit(c)) {
+        if (n > MAX_SIDE) return false;
+        n = n * 10 + (uint32_t) (c - '0');
+        c = fgetc(file);
+    }
+    // the single white space before the pixels
+    if (c == EOF || !isspace(c)) return false;
+    *value = n;
+    return true;
+}
+
+bool image_read_ppm(struct Image *image, const char *path) {
+    image->pixels = NULL;
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return false;
+
+    uint32_t width, height, max;
+    bool ok = fgetc(file) == 'P' && fgetc(file) == '6' &&
+              read_number(file, &width) && read_number(file, &height) && read_number(file, &max) &&
+              width > 0 && height > 0 && width <= MAX_SIDE && height <= MAX_SIDE && max == 255;
+    if (!ok) {
+        ERROR("IMAGE %s is not an 8 bit binary PPM", path);
+    } else if (!image_create(image, width, height)) {
+        ok = false;
+    } else if (fread(image->pixels, 1, (size_t) width * height * 3, file) != (size_t) width * height * 3) {
+        ERROR("IMAGE %s is truncated", path);
+        image_destroy(image);
+        ok = false;
+    }
+    fclose(file);
+    return ok;
+}
+
+bool image_compare(const struct Image *a, const struct Image *b, int tolerance, struct ImageDiff *diff) {
+    diff->differing = 0;
+    diff->pixels = (uint64_t) a->width * a->height;
+    diff->max_difference = 0;
+    if (a->width != b->width || a->height != b->height) return false;
+
+    for (uint64_t i=0; i<diff->pixels; i++) {
+        const uint8_t *pa = &a->pixels[i * 3], *pb = &b->pixels[i * 3];
+        int worst = 0;
+        for (int c=0; c<3; c++) {
+            int d = abs((int) pa[c] - (int) pb[c]);
+            if (d > worst) worst = d;
+        }
+        if (worst > tolerance) diff->differing++;
+        if (worst > diff->max_difference) diff->max_difference = worst;
+    }
+    return true;
+}
@@ -0,0 +1,29 @@
+// 8 bit RGB images: binary PPM files (P6) and the comparison of two images.
+// PPM needs no library and every image viewer opens it.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct Image {
+    uint32_t width, height;
+    uint8_t *pixels;            // rows top to bottom, 3 bytes per pixel
+};
+
+struct ImageDiff {
+    uint64_t differing;         // pixels with a channel beyond the tolerance
+    uint64_t pixels;
+    int max_difference;         // largest channel difference, 0..255
+};
+
+// pixels uninitialized, false out of memory
+bool image_create(struct Image *image, uint32_t width, uint32_t height);
+void image_destroy(struct Image *image);
+
+bool image_write_ppm(const struct Image *image, const char *path);
+// allocates the pixels, false when the file is missing or not a 8 bit P6
+bool image_read_ppm(struct Image *image, const char *path);
+
+// a channel differing by tolerance or less is the same. False when the sizes differ
+bool image_compare(const struct Image *a, const struct Image *b, int tolerance, struct ImageDiff *diff);
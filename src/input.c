@@ -0,0 +1,212 @@
+#include "input.h"
+#include "log.h"
+#include "memory.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define FILE_MAGIC      0x5243494du     // "MICR"
+#define FILE_VERSION    1
+#define RECORD_SIZE     29              // tick 4, type 1, code 4, action 4, x 8, y 8
+#define QUEUE_SIZE      1024            // live events between two ticks
+
+struct Input {
+    struct InputEvent queue[QUEUE_SIZE];
+    uint32_t queue_count;
+    uint32_t dropped;
+
+    FILE *record;
+    uint32_t last_tick;
+
+    FILE *replay;
+    struct InputEvent next;     // read ahead from the replay file
+    bool has_next;
+    bool replay_done;
+    uint32_t replay_length;
+};
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    for (int i=0; i<4; i++) p[i] = (uint8_t) (v >> (8 * i));
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static void put_f64(uint8_t *p, double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    put_u32(p, (uint32_t) bits);
+    put_u32(p + 4, (uint32_t) (bits >> 32));
+}
+
+static double get_f64(const uint8_t *p) {
+    uint64_t bits = get_u32(p) | (uint64_t) get_u32(p + 4) << 32;
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+static bool write_event(FILE *file, const struct InputEvent *event) {
+    uint8_t record[RECORD_SIZE];
+    put_u32(record, event->tick);
+    record[4] = event->type;
+    put_u32(record + 5, (uint32_t) event->code);
+    put_u32(record + 9, (uint32_t) event->action);
+    put_f64(record + 13, event->x);
+    put_f64(record + 21, event->y);
+    return fwrite(record, RECORD_SIZE, 1, file) == 1;
+}
+
+static bool read_event(FILE *file, struct InputEvent *event) {
+    uint8_t record[RECORD_SIZE];
+    if (fread(record, RECORD_SIZE, 1, file) != 1) return false;
+    event->tick = get_u32(record);
+    event->type = record[4];
+    event->code = (int32_t) get_u32(record + 5);
+    event->action = (int32_t) get_u32(record + 9);
+    event->x = get_f64(record + 13);
+    event->y = get_f64(record + 21);
+    return true;
+}
+
+struct Input *input_create() {
+    struct Input *input = memory_calloc(1, sizeof(*input), MEMORY_TAG_SIMULATION);
+    if (input == NULL) FATAL("INPUT failed to allocate");
+    return input;
+}
+
+void input_destroy(struct Input *input) {
+    if (input == NULL) return;
+    if (input->record != NULL) {
+        struct InputEvent end = {.tick = input->last_tick + 1, .type = INPUT_EVENT_END};
+        write_event(input->record, &end);
+        fclose(input->record);
+        INFO("INPUT recorded %u ticks", end.tick);
+    }
+    if (input->replay != NULL) fclose(input->replay);
+    if (input->dropped > 0) WARNING("INPUT dropped %u events, too many in one tick", input->dropped);
+    memory_free(input);
+}
+
+bool input_record(struct Input *input, const char *path, uint32_t seed) {
+    input->record = fopen(path, "wb");
+    uint8_t header[12];
+    put_u32(header, FILE_MAGIC);
+    put_u32(header + 4, FILE_VERSION);
+    put_u32(header + 8, seed);
+    if (input->record == NULL || fwrite(header, sizeof(header), 1, input->record) != 1) {
+        ERROR("INPUT failed to create the recording %s", path);
+        if (input->record != NULL) fclose(input->record);
+        input->record = NULL;
+        return false;
+    }
+    INFO("INPUT recording to %s", path);
+    return true;
+}
+
+bool input_replay(struct Input *input, const char *path, uint32_t *seed) {
+    FILE *file = fopen(path, "rb");
+    uint8_t header[12];
+    if (file == NULL || fread(header, sizeof(header), 1, file) != 1 ||
+        get_u32(header) != FILE_MAGIC || get_u32(header + 4) != FILE_VERSION) {
+        ERROR("INPUT %s is not an input recording", path);
+        if (file != NULL) fclose(file);
+        return false;
+    }
+    *seed = get_u32(header + 8);
+
+    // the length is in the end record
+    struct InputEvent event;
+    long start = ftell(file);
+    input->replay_length = 0;
+    while (read_event(file, &event)) input->replay_length = event.tick;
+    fseek(file, start, SEEK_SET);
+
+    input->replay = file;
+    input->has_next = read_event(file, &input->next);
+    input->replay_done = false;
+    input->queue_count = 0;
+    INFO("INPUT replaying %s, %u ticks", path, input->replay_length);
+    return true;
+}
+
+bool input_replaying(const struct Input *input) {
+    return input->replay != NULL;
+}
+
+bool input_replay_done(const struct Input *input) {
+    return input->replay_done;
+}
+
+uint32_t input_replay_length(const struct Input *input) {
+    return input->replay_length;
+}
+
+void input_push(struct Input *input, const struct InputEvent *event) {
+    if (input->replay != NULL) return;
+    if (input->queue_count == QUEUE_SIZE) {
+        input->dropped++;
+        return;
+    }
+    input->queue[input->queue_count++] = *event;
+}
+
+static void apply(struct InputState *state, const struct InputEvent *event) {
+    switch (event->type) {
+    case INPUT_EVENT_KEY:
+        if (event->code >= 0 && event->code < INPUT_MAX_KEYS) state->keys[event->code] = event->action != INPUT_RELEASE;
+        break;
+    case INPUT_EVENT_MOUSE_BUTTON:
+        if (event->code >= 0 && event->code < INPUT_MAX_BUTTONS) state->buttons[event->code] = event->action != INPUT_RELEASE;
+        break;
+    case INPUT_EVENT_CURSOR:
+        if (state->cursor_known) {
+            state->cursor_dx += event->x - state->cursor_x;
+            state->cursor_dy += event->y - state->cursor_y;
+        }
+        state->cursor_known = true;
+        state->cursor_x = event->x;
+        state->cursor_y = event->y;
+        break;
+    case INPUT_EVENT_SCROLL:
+        state->scroll_x += event->x;
+        state->scroll_y += event->y;
+        break;
+    case INPUT_EVENT_CURSOR_ENTER:
+        state->inside = event->action != 0;
+        break;
+    }
+}
+
+void input_tick(struct Input *input, uint32_t tick, struct InputState *state) {
+    state->cursor_dx = state->cursor_dy = 0.0;
+    state->scroll_x = state->scroll_y = 0.0;
+
+    if (input->replay != NULL) {
+        while (input->has_next && input->next.tick <= tick) {
+            if (input->next.type == INPUT_EVENT_END) {
+                input->replay_done = true;
+                input->has_next = false;
+                break;
+            }
+            apply(state, &input->next);
+            input->has_next = read_event(input->replay, &input->next);
+        }
+        if (!input->has_next) input->replay_done = true;
+        return;
+    }
+
+    for (uint32_t i=0; i<input->queue_count; i++) {
+        struct InputEvent *event = &input->queue[i];
+        event->tick = tick;
+        apply(state, event);
+        if (input->record != NULL && !write_event(input->record, event)) {
+            ERROR("INPUT failed to write the recording, stopped recording");
+            fclose(input->record);
+            input->record = NULL;
+        }
+    }
+    input->queue_count = 0;
+    input->last_tick = tick;
+}
@@ -0,0 +1,76 @@
+// Input events, live or replayed.
+// The window callbacks push events, they are applied at the next tick boundary
+// in arrival order. A recording stores every event with the tick it was applied
+// on, replaying it applies the same events on the same ticks whatever the frame
+// rate, so a flythrough runs the same way on every build, with or without a window.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define INPUT_MAX_KEYS      512
+#define INPUT_MAX_BUTTONS   8
+
+// key and button codes are the GLFW ones, headless code uses these
+#define INPUT_KEY_SPACE         32
+#define INPUT_KEY_A             65
+#define INPUT_KEY_D             68
+#define INPUT_KEY_S             83
+#define INPUT_KEY_W             87
+#define INPUT_KEY_ESCAPE        256
+#define INPUT_KEY_LEFT_SHIFT    340
+#define INPUT_KEY_LEFT_CONTROL  341
+#define INPUT_RELEASE           0
+#define INPUT_PRESS             1
+#define INPUT_REPEAT            2
+
+enum input_event_type {
+    INPUT_EVENT_KEY = 0,        // code: key, action: INPUT_PRESS/RELEASE/REPEAT
+    INPUT_EVENT_MOUSE_BUTTON,   // code: button, action
+    INPUT_EVENT_CURSOR,         // x, y: cursor position
+    INPUT_EVENT_SCROLL,         // x, y: offsets
+    INPUT_EVENT_CURSOR_ENTER,   // action: 1 entered, 0 left
+    INPUT_EVENT_END,            // last record of a file, tick: length of the recording
+};
+
+struct InputEvent {
+    uint32_t tick;              // set when the event is applied
+    uint8_t type;
+    int32_t code;
+    int32_t action;
+    double x, y;
+};
+
+// what the simulation reads, changes only in input_tick()
+struct InputState {
+    bool keys[INPUT_MAX_KEYS];
+    bool buttons[INPUT_MAX_BUTTONS];
+    double cursor_x, cursor_y;
+    bool cursor_known;              // the first position is not a movement
+    double cursor_dx, cursor_dy;    // movement during the last tick
+    double scroll_x, scroll_y;      // during the last tick
+    bool inside;
+};
+
+struct Input;
+
+struct Input *input_create();
+// closes the recording
+void input_destroy(struct Input *input);
+
+// from now on every applied event is also written to the file
+bool input_record(struct Input *input, const char *path, uint32_t seed);
+// apply the events of the file instead of the live ones. seed gets the seed the
+// recording was made with, the world must be the same for the replay to match
+bool input_replay(struct Input *input, const char *path, uint32_t *seed);
+bool input_replaying(const struct Input *input);
+// a replay went past its last recorded tick
+bool input_replay_done(const struct Input *input);
+// ticks in the replay file
+uint32_t input_replay_length(const struct Input *input);
+
+// live events, dropped while replaying
+void input_push(struct Input *input, const struct InputEvent *event);
+// apply what arrived since the last tick (or what the file has for this tick)
+void input_tick(struct Input *input, uint32_t tick, struct InputState *state);
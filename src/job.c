@@ -0,0 +1,212 @@
+#include "job.h"
+#include "log.h"
+#include "memory.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define JOB_QUEUE_SIZE 4096 // power of two
+#define JOB_MAX_WORKERS 32
+#define JOB_LOCAL_RANGES 64 // job_parallel_for batches kept on the stack
+
+struct Job {
+    job_fn fn;
+    void *arg;
+    struct JobCounter *counter;
+};
+
+static struct Job queue[JOB_QUEUE_SIZE];
+static uint32_t queue_head; // next job to run
+static uint32_t queue_tail; // next free slot
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t workers[JOB_MAX_WORKERS];
+static int workers_count = 0;
+static bool running = false;
+
+
+static int cpu_count() {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int) info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int) n : 1;
+#endif
+}
+
+static void run_job(struct Job *job) {
+    job->fn(job->arg);
+    if (job->counter) {
+        __atomic_sub_fetch(&job->counter->pending, 1, __ATOMIC_ACQ_REL);
+    }
+}
+
+// caller must hold queue_mutex
+static bool pop_job(struct Job *job) {
+    if (queue_head == queue_tail) return false;
+    *job = queue[queue_head & (JOB_QUEUE_SIZE - 1)];
+    queue_head++;
+    return true;
+}
+
+static void *worker_main(void *arg) {
+    (void) arg;
+    struct Job job;
+    pthread_mutex_lock(&queue_mutex);
+    while (running) {
+        if (pop_job(&job)) {
+            pthread_mutex_unlock(&queue_mutex);
+            run_job(&job);
+            pthread_mutex_lock(&queue_mutex);
+        } else {
+            pthread_cond_wait(&queue_cond, &queue_mutex);
+        }
+    }
+    pthread_mutex_unlock(&queue_mutex);
+    return NULL;
+}
+
+bool job_system_init(int worker_count) {
+    if (running) return true;
+
+    if (worker_count <= 0) worker_count = cpu_count() - 1;
+    if (worker_count > JOB_MAX_WORKERS) worker_count = JOB_MAX_WORKERS;
+
+    queue_head = queue_tail = 0;
+    running = true;
+    for (int i=0; i<worker_count; i++) {
+        if (pthread_create(&workers[i], NULL, worker_main, NULL) != 0) {
+            ERROR("JOB failed to create worker thread %d", i);
+            break;
+        }
+        workers_count++;
+    }
+
+    INFO("JOB system started with %d worker(s)", workers_count);
+    return true;
+}
+
+void job_system_shutdown() {
+    if (!running) return;
+
+    // drain what is left so nobody waits forever on a counter
+    struct Job job;
+    pthread_mutex_lock(&queue_mutex);
+    while (pop_job(&job)) {
+        pthread_mutex_unlock(&queue_mutex);
+        run_job(&job);
+        pthread_mutex_lock(&queue_mutex);
+    }
+    running = false;
+    pthread_cond_broadcast(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+
+    for (int i=0; i<workers_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    workers_count = 0;
+    INFO("JOB system stopped");
+}
+
+int job_worker_count() {
+    return workers_count;
+}
+
+void job_submit(job_fn fn, void *arg, struct JobCounter *counter) {
+    struct Job job = {fn, arg, counter};
+    if (counter) {
+        __atomic_add_fetch(&counter->pending, 1, __ATOMIC_ACQ_REL);
+    }
+
+    if (workers_count == 0) {
+        run_job(&job);
+        return;
+    }
+
+    pthread_mutex_lock(&queue_mutex);
+    if (queue_tail - queue_head >= JOB_QUEUE_SIZE) {
+        pthread_mutex_unlock(&queue_mutex);
+        run_job(&job);
+        return;
+    }
+    queue[queue_tail & (JOB_QUEUE_SIZE - 1)] = job;
+    queue_tail++;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+}
+
+bool job_done(struct JobCounter *counter) {
+    return __atomic_load_n(&counter->pending, __ATOMIC_ACQUIRE) == 0;
+}
+
+void job_wait(struct JobCounter *counter) {
+    struct Job job;
+    while (!job_done(counter)) {
+        pthread_mutex_lock(&queue_mutex);
+        bool got_job = pop_job(&job);
+        pthread_mutex_unlock(&queue_mutex);
+
+        if (got_job) {
+            run_job(&job);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+
+struct RangeJob {
+    job_range_fn fn;
+    void *ctx;
+    uint32_t begin;
+    uint32_t end;
+};
+
+static void run_range_job(void *arg) {
+    struct RangeJob *range = arg;
+    range->fn(range->ctx, range->begin, range->end);
+}
+
+void job_parallel_for(uint32_t count, uint32_t batch_size, job_range_fn fn, void *ctx) {
+    if (count == 0) return;
+    if (batch_size == 0) batch_size = 1;
+
+    uint32_t batches = (count + batch_size - 1) / batch_size;
+    if (workers_count == 0 || batches == 1) {
+        fn(ctx, 0, count);
+        return;
+    }
+
+    // the usual batch counts fit on the stack, no heap call per parallel loop
+    struct RangeJob local[JOB_LOCAL_RANGES];
+    struct RangeJob *ranges = batches <= JOB_LOCAL_RANGES ? local : memory_alloc(batches * sizeof *ranges, MEMORY_TAG_JOB);
+    if (ranges == NULL) {
+        fn(ctx, 0, count);
+        return;
+    }
+
+    struct JobCounter counter = {0};
+    for (uint32_t i=0; i<batches; i++) {
+        ranges[i].fn = fn;
+        ranges[i].ctx = ctx;
+        ranges[i].begin = i * batch_size;
+        ranges[i].end = (i + 1) * batch_size < count ? (i + 1) * batch_size : count;
+        // keep the last batch for this thread
+        if (i + 1 < batches) {
+            job_submit(run_range_job, &ranges[i], &counter);
+        }
+    }
+    run_range_job(&ranges[batches - 1]);
+    job_wait(&counter);
+    if (ranges != local) memory_free(ranges);
+}
@@ -0,0 +1,30 @@
+// small worker thread pool used to move work (pipeline compilation, meshing, ...)
+// off the frame's critical path
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef void (*job_fn)(void *arg);
+typedef void (*job_range_fn)(void *ctx, uint32_t begin, uint32_t end);
+
+// counts the jobs still in flight for a group of submissions.
+// zero initialize it before the first job_submit()
+struct JobCounter {
+    int pending;
+};
+
+// worker_count 0 means one worker per core minus the main thread
+bool job_system_init(int worker_count);
+void job_system_shutdown();
+int  job_worker_count();
+
+// if the system is not running (or the queue is full) the job runs inline
+void job_submit(job_fn fn, void *arg, struct JobCounter *counter);
+// the calling thread helps running queued jobs while it waits
+void job_wait(struct JobCounter *counter);
+bool job_done(struct JobCounter *counter);
+
+// split [0, count) in batches of batch_size and run them on the workers, blocking until done
+void job_parallel_for(uint32_t count, uint32_t batch_size, job_range_fn fn, void *ctx);
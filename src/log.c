@@ -11,6 +11,8 @@
   static log_level_t log_level = TRACE;
 #endif
 
+static FILE *log_file = NULL;
+
 static char *level_string[6] = {
   "[TRACE] ",
   "[DEBUG] ",
@@ -31,7 +33,7 @@ void console_write(const char *message, char color){
         "\x1b[33m",
         "\x1b[31m",
         "\x1b[37;41m"};
-    printf("%s%s\x1b[0m",message_color[color], message);
+    fprintf(log_file ? log_file : stdout, "%s%s\x1b[0m",message_color[color], message);
 }
 
 static int _string_format(char* dest, const char *fmt, void *va_list) {
@@ -59,6 +61,10 @@ void set_log_level(log_level_t level) {
   }
 }
 
+void set_log_file(FILE *file) {
+  log_file = file;
+}
+
 void log_output(log_level_t level, const char *fmt, ...){
   // calculate time stamp
   if (level < log_level) {
@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <stdio.h>
+
 typedef enum log_level
 {
     TRACE   = 0,
@@ -22,6 +24,8 @@ typedef enum log_level
 void log_output(log_level_t level, const char *fmt, ...);
 
 void set_log_level(log_level_t level);
+// where the messages go, NULL is stdout
+void set_log_file(FILE *file);
 
 
 
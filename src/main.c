@@ -1,32 +1,203 @@
+//   minecraft [--record file] [--replay file] [--frames file] [--view-distance chunks] [--chunk-cache MB]
+//             [--depth-mode unsorted|sorted|prepass] [--gen-backend cpu|gpu|auto] [--gen-bench radius]
+//             [--capture dir | --golden dir | --update-golden dir] [--capture-every ticks] [--golden-tolerance n]
+//             [--present-mode fifo|fifo_relaxed|mailbox|immediate] [--fps-cap fps] [--latency normal|low]
+//
+// --record writes the input of the session, --replay plays one back instead of
+// the live input and quits at its end, --frames writes the time of every frame as CSV.
+// --chunk-cache is the memory kept for the compressed chunks that left the view
+// distance (chunk_cache.h), 0 generates them again every time.
+// --depth-mode picks how the opaque blocks are drawn (F4 cycles through the modes),
+// replaying the same recording in each mode compares the fragments they shade.
+// --gen-backend runs the terrain noise and caves on the workers, in a compute
+// shader or on whichever was faster at start. --gen-bench generates the chunks
+// within radius both ways, logs the times and quits.
+// --capture writes a frame every --capture-every ticks as dir/tick_<tick>.ppm,
+// --golden compares them with the ones of an earlier run instead and fails when
+// one differs beyond the tolerance or is missing (capture.h), with --replay:
+//   minecraft --replay walk.rec --capture golden/walk       once, then after a change
+//   minecraft --replay walk.rec --golden golden/walk
+// --update-golden compares the same way and writes the golden images that are missing
+// --present-mode picks how the frames reach the screen (F5 cycles through them),
+// --fps-cap sleeps between the frames, --latency low samples the input as late
+// as the GPU allows (F6 toggles it, pacing.h). The frame time variance and the
+// latency of each mode are logged at exit
+
 #include "log.h"
 #include "window.h"
 #include "defines.h"
+#include "capture.h"
+#include "density_gpu.h"
+#include "job.h"
+#include "simulation.h"
+#include "streamer.h"
+#include "terrain.h"
+#include "vulkan_if.h"
+#include "timer.h"
+#include "worldgen.h"
+
+#include <stdlib.h>
+#include <string.h>
 
 
 static int width = 1280;
 static int height = 960;
 static const char *title = "Minecraft";
 
+struct Options {
+    const char *record;
+    const char *replay;
+    const char *frames;
+    int view_distance;
+    int chunk_cache;        // MB, -1 the default
+    enum depth_mode depth_mode;
+    enum density_mode density_mode;
+    int gen_bench;          // radius, 0 plays
+    struct CaptureConfig capture;
+    enum present_mode present_mode;
+    double fps_cap;         // 0 uncapped
+    enum latency_mode latency_mode;
+};
+
 
 
 struct Game game;
 
 
-void init(){
+static bool parse_args(int argc, char **argv, struct Options *options) {
+    for (int i=1; i<argc; i++) {
+        if (i + 1 >= argc) {
+            ERROR("Missing value for %s", argv[i]);
+            return false;
+        }
+        const char *value = argv[++i];
+        if      (strcmp(argv[i - 1], "--record") == 0) options->record = value;
+        else if (strcmp(argv[i - 1], "--replay") == 0) options->replay = value;
+        else if (strcmp(argv[i - 1], "--frames") == 0) options->frames = value;
+        else if (strcmp(argv[i - 1], "--view-distance") == 0) options->view_distance = atoi(value);
+        else if (strcmp(argv[i - 1], "--chunk-cache") == 0) options->chunk_cache = atoi(value);
+        else if (strcmp(argv[i - 1], "--depth-mode") == 0) {
+            options->depth_mode = depth_mode_from_name(value);
+            if (options->depth_mode == DEPTH_MODE_COUNT) {
+                ERROR("Unknown depth mode %s", value);
+                return false;
+            }
+        }
+        else if (strcmp(argv[i - 1], "--gen-backend") == 0) {
+            options->density_mode = density_mode_from_name(value);
+            if (options->density_mode == DENSITY_MODE_COUNT) {
+                ERROR("Unknown generation backend %s", value);
+                return false;
+            }
+        }
+        else if (strcmp(argv[i - 1], "--gen-bench") == 0) options->gen_bench = atoi(value);
+        else if (strcmp(argv[i - 1], "--capture") == 0 || strcmp(argv[i - 1], "--golden") == 0 ||
+                 strcmp(argv[i - 1], "--update-golden") == 0) {
+            if (options->capture.directory != NULL) {
+                ERROR("Only one of --capture, --golden and --update-golden");
+                return false;
+            }
+            options->capture.directory = value;
+            options->capture.update = strcmp(argv[i - 1], "--update-golden") == 0;
+            options->capture.golden = options->capture.update || strcmp(argv[i - 1], "--golden") == 0;
+        }
+        else if (strcmp(argv[i - 1], "--capture-every") == 0) options->capture.every = (uint32_t) atoi(value);
+        else if (strcmp(argv[i - 1], "--golden-tolerance") == 0) options->capture.tolerance = atoi(value);
+        else if (strcmp(argv[i - 1], "--present-mode") == 0) {
+            options->present_mode = present_mode_from_name(value);
+            if (options->present_mode == PRESENT_MODE_COUNT) {
+                ERROR("Unknown present mode %s", value);
+                return false;
+            }
+        }
+        else if (strcmp(argv[i - 1], "--fps-cap") == 0) options->fps_cap = atof(value);
+        else if (strcmp(argv[i - 1], "--latency") == 0) {
+            options->latency_mode = latency_mode_from_name(value);
+            if (options->latency_mode == LATENCY_MODE_COUNT) {
+                ERROR("Unknown latency mode %s", value);
+                return false;
+            }
+        }
+        else {
+            ERROR("Unknown option %s", argv[i - 1]);
+            return false;
+        }
+    }
+    if (options->capture.golden && options->replay == NULL) {
+        ERROR("--golden and --update-golden need a --replay to show the same frames");
+        return false;
+    }
+    return true;
+}
+
+bool init(const struct Options *options){
+    uint32_t seed = 1234;
     game.window = &window;
-    
+    game.input = input_create();
+    if (game.input == NULL) return false;
+    // a replay needs the world it was recorded in
+    if (options->replay != NULL && !input_replay(game.input, options->replay, &seed)) return false;
+    if (options->record != NULL && !input_record(game.input, options->record, seed)) return false;
+    if (!frame_log_open(&game.frames, options->frames)) return false;
+
+    game.simulation = simulation_create(seed);
+    if (game.simulation == NULL) return false;
+    player_init(&game.player, 0.5f, (float) worldgen_height(0, 0, seed) + 10.0f, 0.5f);
+
+    if (!capture_init(&options->capture)) return false;
+    struct StreamerConfig config = streamer_default_config(options->view_distance, seed);
+    // the chunks in view are there when a frame is captured
+    config.wait_generation = capture_enabled();
+    if (options->chunk_cache >= 0) config.cache_budget = (uint64_t) options->chunk_cache << 20;
+    game.streamer = streamer_create(game.simulation->world, &config);
+    if (game.streamer == NULL) return false;
+    terrain_set_depth_mode(options->depth_mode);
+    terrain_set_wait_sorts(capture_enabled());
+    pacer_init(&game.pacer, options->present_mode, options->latency_mode, options->fps_cap);
+    set_present_mode(options->present_mode);
+    density_gpu_set_mode(options->density_mode);
+    return true;
+}
+
+void cleanup() {
+    pacer_report(&game.pacer);
+    frame_log_close(&game.frames);
+    streamer_destroy(game.streamer);
+    input_destroy(game.input);
+    simulation_destroy(game.simulation);
 }
 
 
-int main() {
+int main(int argc, char **argv) {
+    game.start = timer_now();
+    struct Options options = {.view_distance = 12, .chunk_cache = -1, .depth_mode = DEPTH_MODE_SORTED,
+                              .capture = {.every = CAPTURE_EVERY, .tolerance = CAPTURE_TOLERANCE},
+                              .present_mode = PRESENT_MODE_MAILBOX, .latency_mode = LATENCY_MODE_NORMAL};
+    if (!parse_args(argc, argv, &options)) return FAIL;
+
+    job_system_init(0);
+    if (!init(&options)) {
+        cleanup();
+        job_system_shutdown();
+        return FAIL;
+    }
+
     if (!window_create(width, height, title)) {
         FATAL("Failed to create main window");
         window_destroy();
+        cleanup();
+        job_system_shutdown();
         return FAIL;
     }
 
-    window_loop();
+    bool ok = true;
+    if (options.gen_bench > 0) ok = density_gpu_benchmark(options.gen_bench, game.simulation->seed);
+    else window_loop();
     window_destroy();
+    if (!capture_finish()) ok = false;
+    cleanup();
+    job_system_shutdown();
 
+    if (!ok) return FAIL;
     return OK;
-}
\ No newline at end of file
+}
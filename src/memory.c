@@ -0,0 +1,220 @@
+#include "memory.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define HEADER_SIZE     16
+#define HEADER_MAGIC    0x6d656d21u
+#define ARENA_ALIGN     16
+
+struct Header {
+    uint64_t size;
+    uint32_t tag;
+    uint32_t magic;     // catches a free of memory that did not come from here
+};
+
+_Static_assert(sizeof(struct Header) == HEADER_SIZE, "the header must keep the 16 byte alignment of malloc");
+
+static struct MemoryStats tag_stats[MEMORY_TAG_COUNT];
+
+static const char *tag_names[MEMORY_TAG_COUNT] = {
+    [MEMORY_TAG_RENDERER]   = "renderer",
+    [MEMORY_TAG_WORLD]      = "world",
+    [MEMORY_TAG_MESHER]     = "mesher",
+    [MEMORY_TAG_IO]         = "io",
+    [MEMORY_TAG_SIMULATION] = "simulation",
+    [MEMORY_TAG_JOB]        = "job",
+};
+
+static void count_alloc(enum memory_tag tag, uint64_t size) {
+    struct MemoryStats *stats = &tag_stats[tag];
+    uint64_t bytes = __atomic_add_fetch(&stats->bytes, size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats->allocations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats->calls, 1, __ATOMIC_RELAXED);
+    uint64_t peak = __atomic_load_n(&stats->peak, __ATOMIC_RELAXED);
+    while (bytes > peak && !__atomic_compare_exchange_n(&stats->peak, &peak, bytes, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+static void count_free(enum memory_tag tag, uint64_t size) {
+    __atomic_sub_fetch(&tag_stats[tag].bytes, size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&tag_stats[tag].allocations, 1, __ATOMIC_RELAXED);
+}
+
+static struct Header *get_header(void *ptr) {
+    struct Header *header = (struct Header *) ((uint8_t *) ptr - HEADER_SIZE);
+    if (header->magic != HEADER_MAGIC || header->tag >= MEMORY_TAG_COUNT) {
+        FATAL("MEMORY %p was not allocated by memory_alloc", ptr);
+        abort();
+    }
+    return header;
+}
+
+void *memory_alloc(size_t size, enum memory_tag tag) {
+    if (size > SIZE_MAX - HEADER_SIZE) return NULL;
+    struct Header *header = malloc(HEADER_SIZE + size);
+    if (header == NULL) return NULL;
+    header->size = size;
+    header->tag = tag;
+    header->magic = HEADER_MAGIC;
+    count_alloc(tag, size);
+    return (uint8_t *) header + HEADER_SIZE;
+}
+
+void *memory_calloc(size_t count, size_t size, enum memory_tag tag) {
+    if (size != 0 && count > SIZE_MAX / size) return NULL;
+    void *ptr = memory_alloc(count * size, tag);
+    if (ptr != NULL) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void *memory_realloc(void *ptr, size_t size, enum memory_tag tag) {
+    if (ptr == NULL) return memory_alloc(size, tag);
+    if (size > SIZE_MAX - HEADER_SIZE) return NULL;
+
+    struct Header *header = get_header(ptr);
+    uint64_t old_size = header->size;
+    tag = header->tag;
+    header = realloc(header, HEADER_SIZE + size);
+    if (header == NULL) return NULL;     // the old block is untouched and still counted
+    header->size = size;
+    count_free(tag, old_size);
+    count_alloc(tag, size);
+    return (uint8_t *) header + HEADER_SIZE;
+}
+
+void memory_free(void *ptr) {
+    if (ptr == NULL) return;
+    struct Header *header = get_header(ptr);
+    count_free(header->tag, header->size);
+    header->magic = 0;
+    free(header);
+}
+
+const char *memory_tag_name(enum memory_tag tag) {
+    return tag < MEMORY_TAG_COUNT ? tag_names[tag] : "unknown";
+}
+
+void memory_stats(enum memory_tag tag, struct MemoryStats *stats) {
+    stats->bytes       = __atomic_load_n(&tag_stats[tag].bytes, __ATOMIC_RELAXED);
+    stats->peak        = __atomic_load_n(&tag_stats[tag].peak, __ATOMIC_RELAXED);
+    stats->allocations = __atomic_load_n(&tag_stats[tag].allocations, __ATOMIC_RELAXED);
+    stats->calls       = __atomic_load_n(&tag_stats[tag].calls, __ATOMIC_RELAXED);
+}
+
+void memory_report() {
+    for (int tag=0; tag<MEMORY_TAG_COUNT; tag++) {
+        struct MemoryStats stats;
+        memory_stats(tag, &stats);
+        INFO("MEMORY %-10s %9.2f MB live in %7llu allocations, %9.2f MB peak, %9llu calls",
+             tag_names[tag], stats.bytes / (1024.0 * 1024.0), (unsigned long long) stats.allocations,
+             stats.peak / (1024.0 * 1024.0), (unsigned long long) stats.calls);
+    }
+}
+
+uint64_t memory_check_leaks(enum memory_tag tag) {
+    struct MemoryStats stats;
+    memory_stats(tag, &stats);
+    if (stats.allocations > 0) {
+        WARNING("MEMORY %s leaked %llu allocations, %llu bytes", tag_names[tag],
+                (unsigned long long) stats.allocations, (unsigned long long) stats.bytes);
+    }
+    return stats.allocations;
+}
+
+
+// a block that did not fit in the buffer, freed when the buffer is reused
+struct Overflow {
+    struct Overflow *next;
+    uint64_t pad;       // keeps the memory after it 16 byte aligned
+};
+
+struct ArenaBuffer {
+    uint8_t *data;
+    size_t capacity;
+    size_t used;
+    size_t overflow_bytes;
+    struct Overflow *overflow;
+};
+
+struct FrameArena {
+    struct ArenaBuffer buffers[2];
+    int current;
+    enum memory_tag tag;
+};
+
+static void buffer_reset(struct FrameArena *arena, struct ArenaBuffer *buffer) {
+    size_t needed = buffer->used + buffer->overflow_bytes;
+    while (buffer->overflow != NULL) {
+        struct Overflow *next = buffer->overflow->next;
+        memory_free(buffer->overflow);
+        buffer->overflow = next;
+    }
+    // the last frame did not fit, grow so the next ones do
+    if (buffer->overflow_bytes > 0) {
+        uint8_t *data = memory_alloc(needed, arena->tag);
+        if (data != NULL) {
+            memory_free(buffer->data);
+            buffer->data = data;
+            buffer->capacity = needed;
+        }
+    }
+    buffer->used = 0;
+    buffer->overflow_bytes = 0;
+}
+
+struct FrameArena *frame_arena_create(size_t capacity, enum memory_tag tag) {
+    struct FrameArena *arena = memory_calloc(1, sizeof(*arena), tag);
+    if (arena == NULL) {
+        FATAL("MEMORY failed to allocate the frame arena");
+        return NULL;
+    }
+    arena->tag = tag;
+    capacity = (capacity + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+    for (int i=0; i<2; i++) {
+        arena->buffers[i].data = memory_alloc(capacity, tag);
+        if (arena->buffers[i].data == NULL) {
+            FATAL("MEMORY failed to allocate %zu bytes for the frame arena", capacity);
+            frame_arena_destroy(arena);
+            return NULL;
+        }
+        arena->buffers[i].capacity = capacity;
+    }
+    return arena;
+}
+
+void frame_arena_destroy(struct FrameArena *arena) {
+    if (arena == NULL) return;
+    for (int i=0; i<2; i++) {
+        buffer_reset(arena, &arena->buffers[i]);
+        memory_free(arena->buffers[i].data);
+    }
+    memory_free(arena);
+}
+
+void frame_arena_begin_frame(struct FrameArena *arena) {
+    arena->current ^= 1;
+    buffer_reset(arena, &arena->buffers[arena->current]);
+}
+
+void *frame_arena_alloc(struct FrameArena *arena, size_t size) {
+    struct ArenaBuffer *buffer = &arena->buffers[arena->current];
+    size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+    if (size <= buffer->capacity - buffer->used) {
+        void *ptr = buffer->data + buffer->used;
+        buffer->used += size;
+        return ptr;
+    }
+
+    struct Overflow *overflow = memory_alloc(sizeof(*overflow) + size, arena->tag);
+    if (overflow == NULL) return NULL;
+    overflow->next = buffer->overflow;
+    buffer->overflow = overflow;
+    buffer->overflow_bytes += size;
+    return overflow + 1;
+}
+
+size_t frame_arena_used(const struct FrameArena *arena) {
+    const struct ArenaBuffer *buffer = &arena->buffers[arena->current];
+    return buffer->used + buffer->overflow_bytes;
+}
@@ -0,0 +1,70 @@
+// Tagged heap allocations and the frame arena.
+// Every allocation is counted against the subsystem that made it: live bytes,
+// peak bytes and number of calls, so a hot path that keeps hitting the heap
+// shows up in memory_report(), and whatever is still live at shutdown is a leak.
+// A 16 byte header in front of each block keeps its size and tag, memory_free()
+// and memory_realloc() need nothing else.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum memory_tag {
+    MEMORY_TAG_RENDERER = 0,
+    MEMORY_TAG_WORLD,
+    MEMORY_TAG_MESHER,
+    MEMORY_TAG_IO,          // network, protocol, region files and saves
+    MEMORY_TAG_SIMULATION,  // entities and physics
+    MEMORY_TAG_JOB,
+    MEMORY_TAG_COUNT
+};
+
+// how close a memory budget is to running out, sent to the subsystems that
+// can give memory back (drop far meshes, shorten the LOD distances, ...)
+enum memory_pressure {
+    MEMORY_PRESSURE_NONE = 0,
+    MEMORY_PRESSURE_HIGH,
+    MEMORY_PRESSURE_CRITICAL
+};
+
+typedef void (*memory_pressure_fn)(void *ctx, enum memory_pressure pressure);
+
+struct MemoryStats {
+    uint64_t bytes;         // live
+    uint64_t peak;
+    uint64_t allocations;   // live
+    uint64_t calls;         // alloc and realloc calls since the start
+};
+
+// NULL when out of memory, like malloc. memory_calloc zeroes
+void *memory_alloc(size_t size, enum memory_tag tag);
+void *memory_calloc(size_t count, size_t size, enum memory_tag tag);
+// keeps the tag of ptr, a NULL ptr needs one
+void *memory_realloc(void *ptr, size_t size, enum memory_tag tag);
+void memory_free(void *ptr);
+
+const char *memory_tag_name(enum memory_tag tag);
+void memory_stats(enum memory_tag tag, struct MemoryStats *stats);
+// one line per subsystem
+void memory_report();
+// warns about what is still allocated under the tag, returns the live allocations
+uint64_t memory_check_leaks(enum memory_tag tag);
+
+
+// Linear allocator for scratch memory that only lives for a frame.
+// Double buffered: memory from frame N is still valid during frame N + 1,
+// long enough for what the GPU or the next frame reads. An allocation that
+// does not fit goes to the heap and the buffer grows to fit at the next reset.
+// Not thread safe, one arena per thread.
+struct FrameArena;
+
+struct FrameArena *frame_arena_create(size_t capacity, enum memory_tag tag);
+void frame_arena_destroy(struct FrameArena *arena);
+// switch to the other buffer and empty it
+void frame_arena_begin_frame(struct FrameArena *arena);
+// 16 byte aligned, NULL when out of memory
+void *frame_arena_alloc(struct FrameArena *arena, size_t size);
+// bytes used in the current frame, heap fallbacks included
+size_t frame_arena_used(const struct FrameArena *arena);
@@ -0,0 +1,265 @@
+#include "mesher.h"
+#include "log.h"
+#include "memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// distinct blocks tracked when looking for the dominant one in a cell
+#define DOMINANT_SLOTS 16
+
+// corners of each face in counter clockwise order seen from outside the block
+static const uint8_t FACE_CORNERS[FACE_COUNT][4][3] = {
+    [FACE_NEG_X] = {{0,0,1}, {0,1,1}, {0,1,0}, {0,0,0}},
+    [FACE_POS_X] = {{1,0,0}, {1,1,0}, {1,1,1}, {1,0,1}},
+    [FACE_NEG_Y] = {{0,0,0}, {1,0,0}, {1,0,1}, {0,0,1}},
+    [FACE_POS_Y] = {{0,1,0}, {0,1,1}, {1,1,1}, {1,1,0}},
+    [FACE_NEG_Z] = {{0,0,0}, {0,1,0}, {1,1,0}, {1,0,0}},
+    [FACE_POS_Z] = {{1,0,1}, {1,1,1}, {0,1,1}, {0,0,1}},
+};
+
+enum mesh_layer block_mesh_layer(block_t block) {
+    // block_register() and blockgen refuse both flags, translucent would win
+    if (block_has(block, BLOCK_FLAG_TRANSLUCENT)) return MESH_LAYER_TRANSLUCENT;
+    if (block_has(block, BLOCK_FLAG_CUTOUT)) return MESH_LAYER_CUTOUT;
+    return MESH_LAYER_SOLID;
+}
+
+uint32_t mesher_grid_size(int lod) {
+    uint32_t side = (uint32_t) lod_cells(lod) + 2;
+    return side * side * side;
+}
+
+// the section holding a block, NULL when its chunk is not loaded
+static const struct Section *access_section(struct BlockAccess *access, int32_t x, int32_t y, int32_t z) {
+    int32_t chunk_x = block_to_chunk(x);
+    int32_t chunk_z = block_to_chunk(z);
+    if (chunk_x != access->chunk_x || chunk_z != access->chunk_z) {
+        access->chunk = world_get_chunk(access->world, chunk_x, chunk_z);
+        access->chunk_x = chunk_x;
+        access->chunk_z = chunk_z;
+    }
+    if (access->chunk == NULL) return NULL;
+    return &access->chunk->sections[y >> SECTION_SHIFT];
+}
+
+// most common block of the scale^3 cube at x0,y0,z0. The cubes are aligned
+// on their size so a cube never spans two sections. Only the ids, the meshes
+// do not show the states
+static block_t dominant_block(struct BlockAccess *access, int32_t x0, int32_t y0, int32_t z0, int scale) {
+    // nobody looks at the underside of the world, keep its faces out of the mesh
+    if (y0 < 0) return BLOCK_BEDROCK;
+    if (y0 >= WORLD_HEIGHT) return BLOCK_AIR;
+
+    const struct Section *section = access_section(access, x0, y0, z0);
+    if (section == NULL) return BLOCK_AIR;
+    if (section->blocks == NULL) return block_id(section->single);
+
+    int lx = x0 & SECTION_MASK, ly = y0 & SECTION_MASK, lz = z0 & SECTION_MASK;
+    if (scale == 1) return block_id(section->blocks[section_index(lx, ly, lz)]);
+
+    block_t blocks[DOMINANT_SLOTS];
+    uint32_t counts[DOMINANT_SLOTS];
+    int distinct = 0;
+    for (int y=ly; y<ly+scale; y++) {
+        for (int z=lz; z<lz+scale; z++) {
+            for (int x=lx; x<lx+scale; x++) {
+                block_t block = block_id(section->blocks[section_index(x, y, z)]);
+                int i = 0;
+                while (i < distinct && blocks[i] != block) i++;
+                if (i == distinct) {
+                    // more kinds than slots is rare enough to just lump them in the last one
+                    if (distinct == DOMINANT_SLOTS) i = DOMINANT_SLOTS - 1;
+                    else {
+                        blocks[distinct] = block;
+                        counts[distinct++] = 0;
+                    }
+                }
+                counts[i]++;
+            }
+        }
+    }
+
+    int best = 0;
+    for (int i=1; i<distinct; i++) {
+        if (counts[i] > counts[best]) best = i;
+    }
+    return blocks[best];
+}
+
+// border cell seen from a neighbor drawn with cells of neighbor_scale.
+// x0,y0,z0 is the corner of our cell, axis and toward point from our border to the neighbor
+static block_t neighbor_block(struct BlockAccess *access, int32_t x0, int32_t y0, int32_t z0, int scale,
+                              int neighbor_scale, int axis, int toward) {
+    if (neighbor_scale >= scale) {
+        // our cell sits inside one of the neighbor's
+        int32_t mask = ~(int32_t) (neighbor_scale - 1);
+        return dominant_block(access, x0 & mask, y0 & mask, z0 & mask, neighbor_scale);
+    }
+
+    // our cell covers several of the neighbor's, only the layer on the border shows.
+    // One of them not hiding our face is enough to keep it
+    int32_t origin[3] = {x0, y0, z0};
+    int steps = scale / neighbor_scale;
+    block_t first = BLOCK_AIR;
+    for (int a=0; a<steps; a++) {
+        for (int b=0; b<steps; b++) {
+            int32_t p[3];
+            int u = (axis + 1) % 3, v = (axis + 2) % 3;
+            p[axis] = toward > 0 ? origin[axis] : origin[axis] + scale - neighbor_scale;
+            p[u] = origin[u] + a * neighbor_scale;
+            p[v] = origin[v] + b * neighbor_scale;
+            block_t block = dominant_block(access, p[0], p[1], p[2], neighbor_scale);
+            if (!block_is_opaque(block)) return block;
+            if (a == 0 && b == 0) first = block;
+        }
+    }
+    return first;
+}
+
+void mesher_gather(struct World *world, const struct Chunk *chunk, int section, int lod,
+                   const int8_t *side_lods, block_t *grid) {
+    int cells = lod_cells(lod);
+    int scale = 1 << lod;
+    int32_t base_x = chunk->x * SECTION_SIZE;
+    int32_t base_y = section * SECTION_SIZE;
+    int32_t base_z = chunk->z * SECTION_SIZE;
+
+    struct BlockAccess access;
+    block_access_init(&access, world);
+
+    uint32_t i = 0;
+    for (int y=-1; y<=cells; y++) {
+        for (int z=-1; z<=cells; z++) {
+            for (int x=-1; x<=cells; x++) {
+                int32_t wx = base_x + x * scale, wy = base_y + y * scale, wz = base_z + z * scale;
+
+                int side = FACE_NONE;
+                if (x < 0) side = FACE_NEG_X;
+                else if (x == cells) side = FACE_POS_X;
+                else if (z < 0) side = FACE_NEG_Z;
+                else if (z == cells) side = FACE_POS_Z;
+
+                if (side != FACE_NONE && side_lods != NULL && side_lods[side] >= 0 && side_lods[side] != lod) {
+                    int axis = side < FACE_NEG_Y ? 0 : 2;
+                    int toward = side & 1 ? 1 : -1;
+                    grid[i++] = neighbor_block(&access, wx, wy, wz, scale, 1 << side_lods[side], axis, toward);
+                } else {
+                    grid[i++] = dominant_block(&access, wx, wy, wz, scale);
+                }
+            }
+        }
+    }
+}
+
+// opaque is the bitset of block.h copied on the stack: the vertex writes would
+// make the compiler load it again for every face otherwise
+static bool face_visible(const uint64_t *opaque, block_t block, block_t neighbor) {
+    if (neighbor == BLOCK_AIR) return true;
+    if ((opaque[(neighbor >> 6) & (BLOCK_WORDS - 1)] >> (neighbor & 63)) & 1) return false;
+    // no faces between two blocks of water or two panes of glass
+    return neighbor != block;
+}
+
+static bool mesh_reserve(struct Mesh *mesh, uint32_t extra) {
+    if (mesh->count + extra <= mesh->capacity) return true;
+    uint32_t capacity = mesh->capacity ? mesh->capacity * 2 : 256;
+    while (capacity < mesh->count + extra) capacity *= 2;
+    struct BlockVertex *vertices = memory_realloc(mesh->vertices, capacity * sizeof(*vertices), MEMORY_TAG_MESHER);
+    if (vertices == NULL) {
+        FATAL("MESHER out of memory growing a mesh to %u vertices", capacity);
+        return false;
+    }
+    mesh->vertices = vertices;
+    mesh->capacity = capacity;
+    return true;
+}
+
+static void emit_face(struct Mesh *mesh, int x, int y, int z, int scale, int face, block_t block, bool skirt) {
+    if (!mesh_reserve(mesh, 4)) return;
+    struct BlockVertex *v = &mesh->vertices[mesh->count];
+    for (int c=0; c<4; c++) {
+        const uint8_t *corner = FACE_CORNERS[face][c];
+        v[c].x = (int16_t) ((x + corner[0]) * scale);
+        v[c].y = (int16_t) ((y + corner[1]) * scale);
+        v[c].z = (int16_t) ((z + corner[2]) * scale);
+        // the skirt hangs one cell below the border face
+        if (skirt && corner[1] == 0) v[c].y = (int16_t) (v[c].y - scale);
+        v[c].block = block;
+        v[c].face = (uint8_t) face;
+        v[c].size = (uint8_t) scale;
+    }
+    mesh->count += 4;
+}
+
+void mesher_mesh_grid(const block_t *grid, int lod, uint32_t skirt_sides, struct SectionMesh *out) {
+    section_mesh_clear(out);
+
+    int cells = lod_cells(lod);
+    int scale = 1 << lod;
+    int side = cells + 2;
+    const int offsets[FACE_COUNT] = {-1, 1, -side * side, side * side, -side, side};
+    uint64_t opaque[BLOCK_WORDS];
+    memcpy(opaque, block_tables.flags[BLOCK_FLAG_OPAQUE], sizeof(opaque));
+
+    for (int y=0; y<cells; y++) {
+        for (int z=0; z<cells; z++) {
+            const block_t *row = &grid[((y + 1) * side + z + 1) * side + 1];
+            for (int x=0; x<cells; x++) {
+                block_t block = row[x];
+                if (block == BLOCK_AIR) continue;
+
+                uint32_t skirts = ((x == 0 ? 1u << FACE_NEG_X : 0) | (x == cells - 1 ? 1u << FACE_POS_X : 0) |
+                                   (z == 0 ? 1u << FACE_NEG_Z : 0) | (z == cells - 1 ? 1u << FACE_POS_Z : 0)) & skirt_sides;
+                struct Mesh *mesh = &out->layers[block_mesh_layer(block)];
+
+                for (int face=0; face<FACE_COUNT; face++) {
+                    if (!face_visible(opaque, block, row[x + offsets[face]])) continue;
+                    emit_face(mesh, x, y, z, scale, face, block, skirts & (1u << face));
+                }
+            }
+        }
+    }
+}
+
+void mesher_mesh_section(struct World *world, const struct Chunk *chunk, int section, int lod,
+                         const int8_t *side_lods, block_t *scratch, struct SectionMesh *out) {
+    const struct Section *s = &chunk->sections[section];
+    if (s->blocks == NULL && s->single == BLOCK_AIR) {
+        // nothing to draw, skip the gather
+        section_mesh_clear(out);
+        return;
+    }
+
+    uint32_t skirt_sides = 0;
+    if (side_lods != NULL) {
+        for (int face=0; face<FACE_COUNT; face++) {
+            if (side_lods[face] >= 0 && side_lods[face] != lod) skirt_sides |= 1u << face;
+        }
+    }
+    mesher_gather(world, chunk, section, lod, side_lods, scratch);
+    mesher_mesh_grid(scratch, lod, skirt_sides, out);
+}
+
+void section_mesh_clear(struct SectionMesh *mesh) {
+    for (int i=0; i<MESH_LAYER_COUNT; i++) {
+        mesh->layers[i].count = 0;
+    }
+}
+
+void section_mesh_free(struct SectionMesh *mesh) {
+    for (int i=0; i<MESH_LAYER_COUNT; i++) {
+        memory_free(mesh->layers[i].vertices);
+        mesh->layers[i].vertices = NULL;
+        mesh->layers[i].count = 0;
+        mesh->layers[i].capacity = 0;
+    }
+}
+
+uint32_t section_mesh_vertices(const struct SectionMesh *mesh) {
+    uint32_t count = 0;
+    for (int i=0; i<MESH_LAYER_COUNT; i++) {
+        count += mesh->layers[i].count;
+    }
+    return count;
+}
@@ -0,0 +1,70 @@
+// Section mesher: one quad per visible block face.
+// The mesher works on a padded grid (the section plus a one cell border taken
+// from the neighbors) so the same code meshes full detail sections and the
+// downsampled LOD grids.
+
+#pragma once
+
+#include "world.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LOD_COUNT 4     // full detail, then 2x, 4x and 8x downsampled
+
+// matches the pipeline passes
+enum mesh_layer {
+    MESH_LAYER_SOLID = 0,
+    MESH_LAYER_CUTOUT,
+    MESH_LAYER_TRANSLUCENT,
+    MESH_LAYER_COUNT
+};
+
+// 10 bytes, the quads share one index buffer (0 1 2 2 3 0 pattern)
+struct BlockVertex {
+    int16_t x, y, z;    // relative to the section origin, in blocks
+    uint16_t block;
+    uint8_t face;       // enum block_face
+    uint8_t size;       // cell size in blocks, 1 at full detail
+};
+
+struct Mesh {
+    struct BlockVertex *vertices;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+struct SectionMesh {
+    struct Mesh layers[MESH_LAYER_COUNT];
+};
+
+enum mesh_layer block_mesh_layer(block_t block);
+
+// cells per side of a section at this LOD
+static inline int lod_cells(int lod) {
+    return SECTION_SIZE >> lod;
+}
+
+// (cells + 2)^3 blocks
+uint32_t mesher_grid_size(int lod);
+
+// Fill the padded grid of a section at the given LOD. Above LOD 0 every cell
+// is the dominant block of the 2^lod cube it covers.
+// side_lods gives the LOD each neighbor is drawn at, indexed by enum block_face
+// (only the horizontal sides are used, NULL when they all match). The border
+// cells are taken from the neighbor as it is drawn, so wherever the two
+// surfaces do not line up the border faces stay and close the gap
+void mesher_gather(struct World *world, const struct Chunk *chunk, int section, int lod,
+                   const int8_t *side_lods, block_t *grid);
+
+// skirt_sides: one bit per enum block_face, the border faces on those sides
+// hang one cell lower to hide the pixel cracks between two LODs
+void mesher_mesh_grid(const block_t *grid, int lod, uint32_t skirt_sides, struct SectionMesh *out);
+
+// gather + mesh, with skirts on the sides drawn at another LOD
+void mesher_mesh_section(struct World *world, const struct Chunk *chunk, int section, int lod,
+                         const int8_t *side_lods, block_t *scratch, struct SectionMesh *out);
+
+void section_mesh_clear(struct SectionMesh *mesh);
+void section_mesh_free(struct SectionMesh *mesh);
+uint32_t section_mesh_vertices(const struct SectionMesh *mesh);
@@ -0,0 +1,149 @@
+#include "net.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+typedef int socklen_t;
+#define close_socket closesocket
+#define would_block() (WSAGetLastError() == WSAEWOULDBLOCK)
+
+static bool set_non_blocking(SOCKET s) {
+    u_long mode = 1;
+    return ioctlsocket(s, FIONBIO, &mode) == 0;
+}
+
+bool net_init() {
+    WSADATA data;
+    if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+        FATAL("NET failed to start Winsock");
+        return false;
+    }
+    return true;
+}
+
+void net_shutdown() {
+    WSACleanup();
+}
+
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define close_socket close
+#define would_block() (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+
+static bool set_non_blocking(int s) {
+    int flags = fcntl(s, F_GETFL, 0);
+    return flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+bool net_init() {
+    // a peer going away must be an error from send, not a signal killing the server
+    signal(SIGPIPE, SIG_IGN);
+    return true;
+}
+
+void net_shutdown() {
+}
+#endif
+
+// the packets are batched per tick already, do not hold them back any longer
+static void set_no_delay(net_socket_t s) {
+    int on = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char *) &on, sizeof(on));
+}
+
+net_socket_t net_listen(uint16_t port) {
+    net_socket_t s = (net_socket_t) socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == NET_INVALID_SOCKET) {
+        ERROR("NET failed to create the listening socket");
+        return NET_INVALID_SOCKET;
+    }
+
+    int on = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char *) &on, sizeof(on));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(s, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(s, 16) != 0 || !set_non_blocking(s)) {
+        ERROR("NET failed to listen on port %u", port);
+        close_socket(s);
+        return NET_INVALID_SOCKET;
+    }
+    return s;
+}
+
+net_socket_t net_accept(net_socket_t listener) {
+    net_socket_t s = (net_socket_t) accept(listener, NULL, NULL);
+    if (s == NET_INVALID_SOCKET) return NET_INVALID_SOCKET;
+    if (!set_non_blocking(s)) {
+        close_socket(s);
+        return NET_INVALID_SOCKET;
+    }
+    set_no_delay(s);
+    return s;
+}
+
+net_socket_t net_connect(const char *host, uint16_t port) {
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+
+    struct addrinfo hints, *result = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, service, &hints, &result) != 0 || result == NULL) {
+        ERROR("NET failed to resolve %s", host);
+        return NET_INVALID_SOCKET;
+    }
+
+    net_socket_t s = (net_socket_t) socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (s == NET_INVALID_SOCKET || connect(s, result->ai_addr, (socklen_t) result->ai_addrlen) != 0 || !set_non_blocking(s)) {
+        ERROR("NET failed to connect to %s:%u", host, port);
+        if (s != NET_INVALID_SOCKET) close_socket(s);
+        freeaddrinfo(result);
+        return NET_INVALID_SOCKET;
+    }
+    freeaddrinfo(result);
+    set_no_delay(s);
+    return s;
+}
+
+uint16_t net_local_port(net_socket_t s) {
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    if (getsockname(s, (struct sockaddr *) &address, &length) != 0) return 0;
+    return ntohs(address.sin_port);
+}
+
+void net_close(net_socket_t s) {
+    if (s != NET_INVALID_SOCKET) close_socket(s);
+}
+
+int64_t net_send(net_socket_t s, const void *data, size_t size) {
+    int64_t sent = send(s, data, (int) size, 0);
+    if (sent < 0) return would_block() ? 0 : -1;
+    return sent;
+}
+
+int64_t net_recv(net_socket_t s, void *data, size_t size) {
+    int64_t received = recv(s, data, (int) size, 0);
+    if (received == 0) return -1;   // closed by the peer
+    if (received < 0) return would_block() ? 0 : -1;
+    return received;
+}
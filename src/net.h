@@ -0,0 +1,28 @@
+// Thin wrapper over BSD sockets / Winsock. TCP only, every socket is non blocking
+// so the tick loops never wait on the network.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef intptr_t net_socket_t;
+
+#define NET_INVALID_SOCKET ((net_socket_t) -1)
+
+bool net_init();
+void net_shutdown();
+
+// listen on every interface, port 0 picks a free one (see net_local_port)
+net_socket_t net_listen(uint16_t port);
+// NET_INVALID_SOCKET when nobody is waiting
+net_socket_t net_accept(net_socket_t listener);
+// the connection is set up blocking, then switched to non blocking
+net_socket_t net_connect(const char *host, uint16_t port);
+uint16_t net_local_port(net_socket_t socket);
+void net_close(net_socket_t socket);
+
+// bytes moved, 0 when the call would block, -1 when the connection is gone
+int64_t net_send(net_socket_t socket, const void *data, size_t size);
+int64_t net_recv(net_socket_t socket, void *data, size_t size);
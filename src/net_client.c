@@ -0,0 +1,130 @@
+#include "net_client.h"
+#include "log.h"
+#include "memory.h"
+
+#include <stdlib.h>
+
+struct NetClient {
+    struct Connection connection;
+    struct World *world;
+    struct SnapshotHistory history;
+    uint32_t latest;                // last snapshot applied
+    bool welcomed;
+    struct Buffer scratch;
+    struct NetClientStats stats;
+};
+
+struct NetClient *net_client_connect(const char *host, uint16_t port, struct World *world, int view_distance) {
+    net_socket_t socket = net_connect(host, port);
+    if (socket == NET_INVALID_SOCKET) return NULL;
+
+    struct NetClient *client = memory_calloc(1, sizeof(*client), MEMORY_TAG_IO);
+    if (client == NULL) {
+        FATAL("NET CLIENT failed to allocate");
+        net_close(socket);
+        return NULL;
+    }
+    connection_init(&client->connection, socket);
+    client->world = world;
+
+    size_t start = packet_begin(&client->connection.out, PACKET_HELLO);
+    write_varint(&client->connection.out, PROTOCOL_VERSION);
+    write_varint(&client->connection.out, (uint64_t) view_distance);
+    packet_end(&client->connection.out, start);
+    connection_flush(&client->connection);
+
+    INFO("NET CLIENT connected to %s:%u", host, port);
+    return client;
+}
+
+void net_client_destroy(struct NetClient *client) {
+    if (client == NULL) return;
+    connection_close(&client->connection);
+    snapshot_history_free(&client->history);
+    buffer_free(&client->scratch);
+    memory_free(client);
+}
+
+static bool handle_packet(struct NetClient *client, uint8_t type, struct Reader *payload) {
+    switch (type) {
+    case PACKET_WELCOME:
+        read_varint(payload);   // tick rate
+        read_f32(payload);      // spawn position
+        read_f32(payload);
+        read_f32(payload);
+        client->welcomed = !payload->error;
+        return client->welcomed;
+    case PACKET_CHUNK:
+        if (protocol_read_chunk(payload, client->world, &client->scratch) == NULL) return false;
+        client->stats.chunks_received++;
+        return true;
+    case PACKET_SECTIONS:
+        if (!protocol_read_sections(payload, client->world, &client->scratch)) return false;
+        client->stats.sections_received++;
+        return true;
+    case PACKET_UNLOAD_CHUNK: {
+        int32_t x = (int32_t) read_svarint(payload);
+        int32_t z = (int32_t) read_svarint(payload);
+        if (payload->error) return false;
+        world_remove_chunk(client->world, x, z);
+        client->stats.chunks_unloaded++;
+        return true;
+    }
+    case PACKET_ENTITIES: {
+        uint32_t sequence = protocol_read_entities(payload, &client->history);
+        if (sequence == 0) return false;
+        if (sequence > client->latest) client->latest = sequence;
+        client->stats.snapshots_received++;
+        return true;
+    }
+    default:
+        WARNING("NET CLIENT unexpected packet %u", type);
+        return false;
+    }
+}
+
+bool net_client_update(struct NetClient *client, float x, float y, float z) {
+    struct Connection *connection = &client->connection;
+    if (connection->closed) return false;
+
+    connection_receive(connection);
+    uint8_t type;
+    struct Reader payload;
+    uint32_t latest_before = client->latest;
+    while (connection_next_packet(connection, &type, &payload)) {
+        if (!handle_packet(client, type, &payload)) {
+            ERROR("NET CLIENT bad packet %u, disconnecting", type);
+            connection->closed = true;
+            return false;
+        }
+    }
+
+    if (client->welcomed) {
+        size_t start = packet_begin(&connection->out, PACKET_PLAYER_POSITION);
+        write_f32(&connection->out, x);
+        write_f32(&connection->out, y);
+        write_f32(&connection->out, z);
+        packet_end(&connection->out, start);
+    }
+    // one ack for all the snapshots of this tick
+    if (client->latest != latest_before) {
+        size_t start = packet_begin(&connection->out, PACKET_ACK);
+        write_varint(&connection->out, client->latest);
+        packet_end(&connection->out, start);
+    }
+    return connection_flush(connection) && !connection->closed;
+}
+
+bool net_client_welcomed(struct NetClient *client) {
+    return client->welcomed;
+}
+
+const struct Snapshot *net_client_entities(struct NetClient *client) {
+    return snapshot_history_get(&client->history, client->latest);
+}
+
+void net_client_stats(struct NetClient *client, struct NetClientStats *stats) {
+    *stats = client->stats;
+    stats->bytes_sent = client->connection.bytes_sent;
+    stats->bytes_received = client->connection.bytes_received;
+}
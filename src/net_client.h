@@ -0,0 +1,35 @@
+// Client side of the protocol: joins a server, keeps the received chunks in a
+// world and the entities in a snapshot history, acknowledging each snapshot so
+// the server can send the next one as a delta.
+
+#pragma once
+
+#include "protocol.h"
+#include "world.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct NetClientStats {
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t chunks_received;
+    uint64_t sections_received;     // updates of the columns already received
+    uint64_t chunks_unloaded;
+    uint64_t snapshots_received;
+};
+
+struct NetClient;
+
+// chunks land in world, which stays owned by the caller
+struct NetClient *net_client_connect(const char *host, uint16_t port, struct World *world, int view_distance);
+void net_client_destroy(struct NetClient *client);
+
+// once per tick: apply what arrived, then send the player position and the ack.
+// false when the connection is gone
+bool net_client_update(struct NetClient *client, float x, float y, float z);
+
+bool net_client_welcomed(struct NetClient *client);
+// latest snapshot applied, NULL before the first
+const struct Snapshot *net_client_entities(struct NetClient *client);
+void net_client_stats(struct NetClient *client, struct NetClientStats *stats);
@@ -0,0 +1,538 @@
+#include "net_server.h"
+#include "entity.h"
+#include "generator.h"
+#include "log.h"
+#include "memory.h"
+#include "protocol.h"
+#include "save.h"
+#include "spatial.h"
+#include "worldgen.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_GENERATING 256      // columns requested from the generator at once
+#define RESEND_SHARE   4        // changed sections take at most 1/4 of the chunk budget of a tick
+
+struct ChunkOffset {
+    int16_t dx, dz;
+    int32_t distance2;
+};
+
+struct ChunkPos {
+    int32_t x, z;
+};
+
+// chunk column the client holds, kept in a ring indexed by coordinates
+struct SentChunk {
+    int32_t x, z;
+    uint32_t version;
+    bool sent;
+};
+
+struct ClientSession {
+    struct Connection connection;
+    bool joined;
+    float x, y, z;
+    int view_distance;
+    int32_t side;                   // ring size
+    struct SentChunk *sent;
+    struct SnapshotHistory history;
+    uint32_t sequence;              // last snapshot sent
+    uint32_t acked;                 // last snapshot the client applied
+    int32_t resend_cursor;          // in sent, where the changed columns are looked for first
+};
+
+struct NetServer {
+    struct Simulation *simulation;
+    struct NetServerConfig config;
+    net_socket_t listener;
+    struct ClientSession *clients[NET_SERVER_MAX_CLIENTS];
+
+    struct ChunkOffset *offsets;    // every offset within the max view distance, nearest first
+    uint32_t offsets_count;
+    struct Snapshot entities;       // every entity this tick, sorted by id
+    struct SpatialIndex *spatial;   // of entities, the ids are indices in it
+    struct SpatialEntity *spatial_entities;
+    uint32_t *visible;              // indices in entities of what a client sees
+    uint32_t spatial_capacity;
+    struct Buffer scratch;
+
+    // the columns a client wants that are neither in the world nor saved are
+    // generated off the tick, they go in the world once done
+    struct Generator *generator;
+    struct ChunkPos generating[MAX_GENERATING];
+    uint32_t generating_count;
+    struct ChunkPos *unload;        // scratch of net_server_unload_chunks()
+    uint32_t unload_capacity;
+
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t chunks_sent;
+    uint64_t chunk_bytes;
+    uint64_t entity_bytes;
+    uint64_t sections_sent;
+    uint64_t section_bytes;
+    uint64_t chunks_unloaded;
+};
+
+struct NetServerConfig net_server_default_config() {
+    struct NetServerConfig config = {
+        .port = PROTOCOL_PORT,
+        .max_view_distance = 16,
+        .chunk_bytes_per_tick = 256 * 1024,    // 5 MB/s at 20 TPS
+    };
+    return config;
+}
+
+static int compare_offsets(const void *a, const void *b) {
+    return ((const struct ChunkOffset *) a)->distance2 - ((const struct ChunkOffset *) b)->distance2;
+}
+
+struct NetServer *net_server_create(struct Simulation *simulation, const struct NetServerConfig *config) {
+    struct NetServer *server = memory_calloc(1, sizeof(*server), MEMORY_TAG_IO);
+    if (server == NULL) {
+        FATAL("NET SERVER failed to allocate");
+        return NULL;
+    }
+    server->simulation = simulation;
+    server->config = *config;
+    server->spatial = spatial_create();
+    server->generator = generator_create(simulation->seed);
+    if (server->spatial == NULL || server->generator == NULL) {
+        spatial_destroy(server->spatial);
+        generator_destroy(server->generator);
+        memory_free(server);
+        return NULL;
+    }
+
+    int radius = config->max_view_distance;
+    server->offsets = memory_alloc((size_t) (2 * radius + 1) * (2 * radius + 1) * sizeof(*server->offsets), MEMORY_TAG_IO);
+    if (server->offsets == NULL) {
+        FATAL("NET SERVER failed to allocate the chunk offsets");
+        spatial_destroy(server->spatial);
+        generator_destroy(server->generator);
+        memory_free(server);
+        return NULL;
+    }
+    for (int dz=-radius; dz<=radius; dz++) {
+        for (int dx=-radius; dx<=radius; dx++) {
+            if (dx * dx + dz * dz > radius * radius) continue;
+            server->offsets[server->offsets_count++] = (struct ChunkOffset) {(int16_t) dx, (int16_t) dz, dx * dx + dz * dz};
+        }
+    }
+    qsort(server->offsets, server->offsets_count, sizeof(*server->offsets), compare_offsets);
+
+    server->listener = net_listen(config->port);
+    if (server->listener == NET_INVALID_SOCKET) {
+        spatial_destroy(server->spatial);
+        generator_destroy(server->generator);
+        memory_free(server->offsets);
+        memory_free(server);
+        return NULL;
+    }
+    INFO("NET SERVER listening on port %u", net_local_port(server->listener));
+    return server;
+}
+
+static void session_free(struct ClientSession *session) {
+    connection_close(&session->connection);
+    snapshot_history_free(&session->history);
+    memory_free(session->sent);
+    memory_free(session);
+}
+
+void net_server_destroy(struct NetServer *server) {
+    if (server == NULL) return;
+    for (int i=0; i<NET_SERVER_MAX_CLIENTS; i++) {
+        if (server->clients[i] != NULL) session_free(server->clients[i]);
+    }
+    net_close(server->listener);
+    memory_free(server->entities.states);
+    spatial_destroy(server->spatial);
+    memory_free(server->spatial_entities);
+    memory_free(server->visible);
+    buffer_free(&server->scratch);
+    memory_free(server->offsets);
+    memory_free(server->unload);
+    generator_report(server->generator);
+    generator_destroy(server->generator);
+    memory_free(server);
+}
+
+uint16_t net_server_port(struct NetServer *server) {
+    return net_local_port(server->listener);
+}
+
+static void accept_clients(struct NetServer *server) {
+    for (;;) {
+        net_socket_t socket = net_accept(server->listener);
+        if (socket == NET_INVALID_SOCKET) return;
+
+        int free_slot = -1;
+        for (int i=0; i<NET_SERVER_MAX_CLIENTS && free_slot < 0; i++) {
+            if (server->clients[i] == NULL) free_slot = i;
+        }
+        struct ClientSession *session = free_slot >= 0 ? memory_calloc(1, sizeof(*session), MEMORY_TAG_IO) : NULL;
+        if (session == NULL) {
+            WARNING("NET SERVER refused a client, %d connected", NET_SERVER_MAX_CLIENTS);
+            net_close(socket);
+            continue;
+        }
+        connection_init(&session->connection, socket);
+        server->clients[free_slot] = session;
+        INFO("NET SERVER client %d connected", free_slot);
+    }
+}
+
+static bool handle_hello(struct NetServer *server, struct ClientSession *session, struct Reader *payload) {
+    uint32_t version = (uint32_t) read_varint(payload);
+    int view_distance = (int) read_varint(payload);
+    if (payload->error || version != PROTOCOL_VERSION || session->joined) {
+        WARNING("NET SERVER bad hello, protocol %u", version);
+        return false;
+    }
+    if (view_distance < 1) view_distance = 1;
+    if (view_distance > server->config.max_view_distance) view_distance = server->config.max_view_distance;
+
+    session->view_distance = view_distance;
+    session->side = 2 * (view_distance + 1) + 1;
+    session->sent = memory_calloc((size_t) session->side * session->side, sizeof(*session->sent), MEMORY_TAG_IO);
+    if (session->sent == NULL) return false;
+
+    session->x = 0.5f;
+    session->y = (float) worldgen_height(0, 0, server->simulation->seed) + 1.0f;
+    session->z = 0.5f;
+    session->joined = true;
+
+    size_t start = packet_begin(&session->connection.out, PACKET_WELCOME);
+    write_varint(&session->connection.out, TICKS_PER_SECOND);
+    write_f32(&session->connection.out, session->x);
+    write_f32(&session->connection.out, session->y);
+    write_f32(&session->connection.out, session->z);
+    packet_end(&session->connection.out, start);
+    return true;
+}
+
+// false drops the client
+static bool read_client(struct NetServer *server, struct ClientSession *session) {
+    struct Connection *connection = &session->connection;
+    uint64_t before = connection->bytes_received;
+    bool alive = connection_receive(connection);
+    server->bytes_received += connection->bytes_received - before;
+
+    uint8_t type;
+    struct Reader payload;
+    while (connection_next_packet(connection, &type, &payload)) {
+        switch (type) {
+        case PACKET_HELLO:
+            if (!handle_hello(server, session, &payload)) return false;
+            break;
+        case PACKET_PLAYER_POSITION:
+            session->x = read_f32(&payload);
+            session->y = read_f32(&payload);
+            session->z = read_f32(&payload);
+            if (payload.error || !isfinite(session->x) || !isfinite(session->z)) return false;
+            break;
+        case PACKET_ACK: {
+            uint32_t sequence = (uint32_t) read_varint(&payload);
+            if (sequence > session->acked && sequence <= session->sequence) session->acked = sequence;
+            break;
+        }
+        default:
+            WARNING("NET SERVER unexpected packet %u", type);
+            return false;
+        }
+    }
+    return alive && !connection->closed;
+}
+
+static int32_t wrap(int32_t v, int32_t side) {
+    int32_t m = v % side;
+    return m < 0 ? m + side : m;
+}
+
+static void write_unload(struct Buffer *out, int32_t x, int32_t z) {
+    size_t start = packet_begin(out, PACKET_UNLOAD_CHUNK);
+    write_svarint(out, x);
+    write_svarint(out, z);
+    packet_end(out, start);
+}
+
+static int32_t session_chunk_x(const struct ClientSession *session) {
+    return block_to_chunk((int32_t) floorf(session->x));
+}
+
+static int32_t session_chunk_z(const struct ClientSession *session) {
+    return block_to_chunk((int32_t) floorf(session->z));
+}
+
+// whether a client has the column or is about to get it
+static bool wanted(const struct NetServer *server, int32_t x, int32_t z) {
+    for (int i=0; i<NET_SERVER_MAX_CLIENTS; i++) {
+        const struct ClientSession *session = server->clients[i];
+        if (session == NULL || !session->joined) continue;
+        int32_t keep = session->view_distance + 1;
+        if (abs(x - session_chunk_x(session)) <= keep && abs(z - session_chunk_z(session)) <= keep) return true;
+    }
+    return false;
+}
+
+// the column from the world or the save, else asked of the generator: NULL until it is done
+static struct Chunk *column_for(struct NetServer *server, int32_t x, int32_t z, uint32_t priority) {
+    struct Simulation *simulation = server->simulation;
+    struct Chunk *chunk = world_get_chunk(simulation->world, x, z);
+    if (chunk != NULL) return chunk;
+    if (simulation->storage != NULL && world_load_chunk(simulation->storage, simulation->world, x, z)) {
+        return world_get_chunk(simulation->world, x, z);
+    }
+
+    for (uint32_t i=0; i<server->generating_count; i++) {
+        if (server->generating[i].x == x && server->generating[i].z == z) return NULL;
+    }
+    if (server->generating_count == MAX_GENERATING) return NULL;
+    server->generating[server->generating_count++] = (struct ChunkPos) {x, z};
+    generator_request(server->generator, x, z, priority);
+    return NULL;
+}
+
+// the generated columns go in the world, those nobody wants any more are dropped
+static void collect_generated(struct NetServer *server) {
+    generator_update(server->generator);
+    uint32_t kept = 0;
+    for (uint32_t i=0; i<server->generating_count; i++) {
+        struct ChunkPos pos = server->generating[i];
+        struct Chunk *chunk = generator_take(server->generator, pos.x, pos.z);
+        if (chunk != NULL) {
+            // the world may have got one meanwhile
+            if (!world_insert_chunk(server->simulation->world, chunk)) chunk_free(chunk);
+        } else if (!wanted(server, pos.x, pos.z)) {
+            generator_cancel(server->generator, pos.x, pos.z);
+        } else {
+            server->generating[kept++] = pos;
+        }
+    }
+    server->generating_count = kept;
+}
+
+static void send_chunks(struct NetServer *server, struct ClientSession *session) {
+    struct Buffer *out = &session->connection.out;
+    int32_t center_x = session_chunk_x(session);
+    int32_t center_z = session_chunk_z(session);
+    int32_t keep = session->view_distance + 1;
+
+    // drop the columns the player left behind
+    for (int32_t i=0; i<session->side * session->side; i++) {
+        struct SentChunk *sent = &session->sent[i];
+        if (sent->sent && (abs(sent->x - center_x) > keep || abs(sent->z - center_z) > keep)) {
+            write_unload(out, sent->x, sent->z);
+            sent->sent = false;
+        }
+    }
+
+    // whatever did not make it out last tick counts against this tick's budget,
+    // a slow link gets fewer new chunks instead of an ever growing backlog
+    if (out->size >= server->config.chunk_bytes_per_tick) return;
+    size_t budget_end = server->config.chunk_bytes_per_tick;
+    int32_t limit = session->view_distance * session->view_distance;
+
+    // blocks changed since a column was sent (random ticks, fluids): the sections they are in, before
+    // the new columns but within a share of the budget. The rest waits, the ring is walked from
+    // where the last tick stopped so no column waits for ever
+    size_t resend_end = out->size + server->config.chunk_bytes_per_tick / RESEND_SHARE;
+    if (resend_end > budget_end) resend_end = budget_end;
+    int32_t slots = session->side * session->side;
+    int32_t start = session->resend_cursor;
+    for (int32_t n=0; n<slots && out->size < resend_end; n++) {
+        int32_t i = (start + n) % slots;
+        struct SentChunk *sent = &session->sent[i];
+        if (!sent->sent) continue;
+        struct Chunk *chunk = world_get_chunk(server->simulation->world, sent->x, sent->z);
+        if (chunk == NULL || chunk->version == sent->version) continue;
+        uint32_t mask = 0, sections = 0;
+        for (int s=0; s<CHUNK_SECTIONS; s++) {
+            // the versions wrap around
+            if ((int32_t) (chunk->changed[s] - sent->version) <= 0) continue;
+            mask |= 1u << s;
+            sections++;
+        }
+        size_t before = out->size;
+        protocol_write_sections(out, chunk, mask, &server->scratch);
+        server->section_bytes += out->size - before;
+        server->sections_sent += sections;
+        sent->version = chunk->version;
+        session->resend_cursor = (i + 1) % slots;
+    }
+
+    for (uint32_t i=0; i<server->offsets_count && out->size < budget_end; i++) {
+        const struct ChunkOffset *offset = &server->offsets[i];
+        if (offset->distance2 > limit) break;
+
+        int32_t x = center_x + offset->dx, z = center_z + offset->dz;
+        struct SentChunk *sent = &session->sent[wrap(z, session->side) * session->side + wrap(x, session->side)];
+        if (sent->sent && sent->x == x && sent->z == z) continue;
+
+        // the nearest ones not generated yet are skipped for those ready further out
+        struct Chunk *chunk = column_for(server, x, z, (uint32_t) offset->distance2);
+        if (chunk == NULL) continue;
+        if (sent->sent) write_unload(out, sent->x, sent->z);
+
+        size_t before = out->size;
+        protocol_write_chunk(out, chunk, &server->scratch);
+        server->chunk_bytes += out->size - before;
+        server->chunks_sent++;
+        *sent = (struct SentChunk) {x, z, chunk->version, true};
+    }
+}
+
+struct GatherContext {
+    struct Snapshot *snapshot;
+};
+
+static void gather_entities(struct EcsView *view, void *ctx) {
+    struct GatherContext *gather = ctx;
+    struct EntityPosition *positions = ecs_column(view, COMPONENT_POSITION);
+    struct EntityVelocity *velocities = ecs_column(view, COMPONENT_VELOCITY);
+    for (uint32_t row=view->begin; row<view->end; row++) {
+        entity_t entity = ecs_view_entity(view, row);
+        struct EntityState state = {
+            .id = (uint64_t) entity.index << 32 | entity.generation,
+            .x = (int32_t) lroundf(positions[row].x * ENTITY_POSITION_SCALE),
+            .y = (int32_t) lroundf(positions[row].y * ENTITY_POSITION_SCALE),
+            .z = (int32_t) lroundf(positions[row].z * ENTITY_POSITION_SCALE),
+            .vx = (int32_t) lroundf(velocities[row].x * ENTITY_VELOCITY_SCALE),
+            .vy = (int32_t) lroundf(velocities[row].y * ENTITY_VELOCITY_SCALE),
+            .vz = (int32_t) lroundf(velocities[row].z * ENTITY_VELOCITY_SCALE),
+        };
+        snapshot_push(gather->snapshot, &state);
+    }
+}
+
+// the spatial index of this tick's entities, every client queries it. False out of memory
+static bool index_entities(struct NetServer *server) {
+    uint32_t count = server->entities.count;
+    if (count > server->spatial_capacity) {
+        struct SpatialEntity *entities = memory_realloc(server->spatial_entities, count * sizeof(*entities), MEMORY_TAG_IO);
+        if (entities != NULL) server->spatial_entities = entities;
+        uint32_t *visible = memory_realloc(server->visible, count * sizeof(*visible), MEMORY_TAG_IO);
+        if (visible != NULL) server->visible = visible;
+        if (entities == NULL || visible == NULL) {
+            FATAL("NET SERVER out of memory indexing %u entities", count);
+            return false;
+        }
+        server->spatial_capacity = count;
+    }
+    for (uint32_t i=0; i<count; i++) {
+        const struct EntityState *state = &server->entities.states[i];
+        server->spatial_entities[i] = (struct SpatialEntity) {
+            (float) state->x / ENTITY_POSITION_SCALE,
+            (float) state->y / ENTITY_POSITION_SCALE,
+            (float) state->z / ENTITY_POSITION_SCALE,
+            0.0f,
+        };
+    }
+    return spatial_rebuild(server->spatial, server->spatial_entities, count);
+}
+
+static int compare_indices(const void *a, const void *b) {
+    uint32_t ia = *(const uint32_t *) a, ib = *(const uint32_t *) b;
+    return (ia > ib) - (ia < ib);
+}
+
+static void send_entities(struct NetServer *server, struct ClientSession *session) {
+    struct Snapshot *snapshot = snapshot_history_slot(&session->history, ++session->sequence);
+
+    // the entities within the view distance, in index order the snapshot comes out sorted
+    float range = (float) (session->view_distance * SECTION_SIZE);
+    struct Aabb view = {session->x - range, -INFINITY, session->z - range, session->x + range, INFINITY, session->z + range};
+    uint32_t count = spatial_query_box(server->spatial, &view, server->visible, server->spatial_capacity);
+    if (count > server->spatial_capacity) count = server->spatial_capacity;
+    qsort(server->visible, count, sizeof(*server->visible), compare_indices);
+    for (uint32_t i=0; i<count; i++) snapshot_push(snapshot, &server->entities.states[server->visible[i]]);
+
+    // delta against what the client has for sure, in full when that is too old
+    const struct Snapshot *baseline = NULL;
+    if (session->acked != 0 && session->sequence - session->acked < SNAPSHOT_HISTORY) {
+        baseline = snapshot_history_get(&session->history, session->acked);
+    }
+
+    size_t before = session->connection.out.size;
+    protocol_write_entities(&session->connection.out, snapshot, baseline);
+    server->entity_bytes += session->connection.out.size - before;
+}
+
+void net_server_tick(struct NetServer *server) {
+    accept_clients(server);
+    collect_generated(server);
+
+    // one pass over the entities for all the clients, sorted so the snapshots come out sorted
+    server->entities.count = 0;
+    struct GatherContext gather = {&server->entities};
+    struct EcsQuery query = {ECS_BIT(COMPONENT_POSITION) | ECS_BIT(COMPONENT_VELOCITY), 0};
+    ecs_query_each(server->simulation->ecs, query, gather_entities, &gather);
+    snapshot_sort(&server->entities);
+    if (!index_entities(server)) server->entities.count = 0;
+
+    for (int i=0; i<NET_SERVER_MAX_CLIENTS; i++) {
+        struct ClientSession *session = server->clients[i];
+        if (session == NULL) continue;
+
+        if (!read_client(server, session)) {
+            session->connection.closed = true;
+        } else if (session->joined) {
+            send_chunks(server, session);
+            send_entities(server, session);
+        }
+
+        uint64_t before = session->connection.bytes_sent;
+        connection_flush(&session->connection);
+        server->bytes_sent += session->connection.bytes_sent - before;
+
+        if (session->connection.closed) {
+            INFO("NET SERVER client %d disconnected", i);
+            session_free(session);
+            server->clients[i] = NULL;
+        }
+    }
+}
+
+uint32_t net_server_unload_chunks(struct NetServer *server, int keep_radius) {
+    struct Simulation *simulation = server->simulation;
+    uint32_t count = 0, cursor = 0;
+    struct Chunk *chunk;
+    // gathered first, removing while iterating would skip some
+    while ((chunk = world_next_chunk(simulation->world, &cursor)) != NULL) {
+        if (abs(chunk->x) <= keep_radius && abs(chunk->z) <= keep_radius) continue;
+        if (simulation->storage != NULL && chunk->unsaved != 0) continue;
+        if (wanted(server, chunk->x, chunk->z)) continue;
+        if (count == server->unload_capacity) {
+            uint32_t capacity = server->unload_capacity ? server->unload_capacity * 2 : 256;
+            struct ChunkPos *unload = memory_realloc(server->unload, capacity * sizeof(*unload), MEMORY_TAG_IO);
+            if (unload == NULL) break;
+            server->unload = unload;
+            server->unload_capacity = capacity;
+        }
+        server->unload[count++] = (struct ChunkPos) {chunk->x, chunk->z};
+    }
+    for (uint32_t i=0; i<count; i++) world_remove_chunk(simulation->world, server->unload[i].x, server->unload[i].z);
+    server->chunks_unloaded += count;
+    return count;
+}
+
+void net_server_stats(struct NetServer *server, struct NetServerStats *stats) {
+    *stats = (struct NetServerStats) {
+        .generating = server->generating_count,
+        .chunks_unloaded = server->chunks_unloaded,
+        .sections_sent = server->sections_sent,
+        .section_bytes = server->section_bytes,
+        .bytes_sent = server->bytes_sent,
+        .bytes_received = server->bytes_received,
+        .chunks_sent = server->chunks_sent,
+        .chunk_bytes = server->chunk_bytes,
+        .entity_bytes = server->entity_bytes,
+    };
+    for (int i=0; i<NET_SERVER_MAX_CLIENTS; i++) {
+        if (server->clients[i] != NULL) stats->clients++;
+    }
+}
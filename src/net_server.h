@@ -0,0 +1,48 @@
+// Server side of the protocol: accepts clients, streams them the chunks
+// around their player nearest first within a per tick byte budget, and sends
+// the entities around them as delta snapshots.
+// The chunks missing from the world are read from the save or generated on the
+// job system (generator.h), a client gets them once they are done.
+
+#pragma once
+
+#include "simulation.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define NET_SERVER_MAX_CLIENTS 32
+
+struct NetServerConfig {
+    uint16_t port;                  // 0 picks a free one
+    int max_view_distance;          // in chunks, caps what the clients ask for
+    uint32_t chunk_bytes_per_tick;  // per client, keeps fast travel from flooding the link
+};
+
+struct NetServerStats {
+    uint32_t clients;
+    uint32_t generating;            // columns waiting for the generator
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t chunks_sent;
+    uint64_t chunk_bytes;           // compressed, with headers
+    uint64_t entity_bytes;
+    uint64_t sections_sent;         // changed since their column was sent
+    uint64_t section_bytes;
+    uint64_t chunks_unloaded;
+};
+
+struct NetServer;
+
+struct NetServerConfig net_server_default_config();
+struct NetServer *net_server_create(struct Simulation *simulation, const struct NetServerConfig *config);
+void net_server_destroy(struct NetServer *server);
+uint16_t net_server_port(struct NetServer *server);
+
+// once per simulation tick: accept, read the clients, queue their updates and send the batch
+void net_server_tick(struct NetServer *server);
+// removes the columns no client holds, but for those within keep_radius chunks of
+// the origin. With storage only the saved ones go: call it while no save is being
+// written, they are read back from it. Without, their changes are lost. Returns the count
+uint32_t net_server_unload_chunks(struct NetServer *server, int keep_radius);
+void net_server_stats(struct NetServer *server, struct NetServerStats *stats);
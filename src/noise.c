@@ -0,0 +1,115 @@
+#include "noise.h"
+
+#include <math.h>
+
+static uint32_t hash3(int32_t x, int32_t y, int32_t z, uint32_t seed) {
+    uint32_t h = seed ^ 0x27D4EB2Du;
+    h ^= (uint32_t) x * 0x8DA6B343u;
+    h ^= (uint32_t) y * 0xD8163841u;
+    h ^= (uint32_t) z * 0xCB1AB31Fu;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+    return h;
+}
+
+static float fade(float t) {
+    return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+static float lerp(float a, float b, float t) {
+    return a + (b - a) * t;
+}
+
+// 8 directions in 2D
+static float grad2(uint32_t hash, float x, float y) {
+    switch (hash & 7) {
+    case 0: return  x + y;
+    case 1: return  x - y;
+    case 2: return -x + y;
+    case 3: return -x - y;
+    case 4: return  x;
+    case 5: return -x;
+    case 6: return  y;
+    default: return -y;
+    }
+}
+
+// the 12 cube edges of the improved Perlin noise
+static float grad3(uint32_t hash, float x, float y, float z) {
+    switch (hash % 12) {
+    case 0:  return  x + y;
+    case 1:  return -x + y;
+    case 2:  return  x - y;
+    case 3:  return -x - y;
+    case 4:  return  x + z;
+    case 5:  return -x + z;
+    case 6:  return  x - z;
+    case 7:  return -x - z;
+    case 8:  return  y + z;
+    case 9:  return -y + z;
+    case 10: return  y - z;
+    default: return -y - z;
+    }
+}
+
+float noise2(float x, float y, uint32_t seed) {
+    float fx = floorf(x), fy = floorf(y);
+    int32_t ix = (int32_t) fx, iy = (int32_t) fy;
+    float dx = x - fx, dy = y - fy;
+    float u = fade(dx), v = fade(dy);
+
+    float n00 = grad2(hash3(ix,     iy,     0, seed), dx,        dy);
+    float n10 = grad2(hash3(ix + 1, iy,     0, seed), dx - 1.0f, dy);
+    float n01 = grad2(hash3(ix,     iy + 1, 0, seed), dx,        dy - 1.0f);
+    float n11 = grad2(hash3(ix + 1, iy + 1, 0, seed), dx - 1.0f, dy - 1.0f);
+    return lerp(lerp(n00, n10, u), lerp(n01, n11, u), v) * 0.7071f;
+}
+
+float noise3(float x, float y, float z, uint32_t seed) {
+    float fx = floorf(x), fy = floorf(y), fz = floorf(z);
+    int32_t ix = (int32_t) fx, iy = (int32_t) fy, iz = (int32_t) fz;
+    float dx = x - fx, dy = y - fy, dz = z - fz;
+    float u = fade(dx), v = fade(dy), w = fade(dz);
+
+    float n000 = grad3(hash3(ix,     iy,     iz,     seed), dx,        dy,        dz);
+    float n100 = grad3(hash3(ix + 1, iy,     iz,     seed), dx - 1.0f, dy,        dz);
+    float n010 = grad3(hash3(ix,     iy + 1, iz,     seed), dx,        dy - 1.0f, dz);
+    float n110 = grad3(hash3(ix + 1, iy + 1, iz,     seed), dx - 1.0f, dy - 1.0f, dz);
+    float n001 = grad3(hash3(ix,     iy,     iz + 1, seed), dx,        dy,        dz - 1.0f);
+    float n101 = grad3(hash3(ix + 1, iy,     iz + 1, seed), dx - 1.0f, dy,        dz - 1.0f);
+    float n011 = grad3(hash3(ix,     iy + 1, iz + 1, seed), dx,        dy - 1.0f, dz - 1.0f);
+    float n111 = grad3(hash3(ix + 1, iy + 1, iz + 1, seed), dx - 1.0f, dy - 1.0f, dz - 1.0f);
+
+    float x00 = lerp(n000, n100, u), x10 = lerp(n010, n110, u);
+    float x01 = lerp(n001, n101, u), x11 = lerp(n011, n111, u);
+    return lerp(lerp(x00, x10, v), lerp(x01, x11, v), w);
+}
+
+float fbm2(float x, float y, int octaves, uint32_t seed) {
+    float sum = 0.0f, amplitude = 1.0f, norm = 0.0f;
+    for (int i=0; i<octaves; i++) {
+        sum += noise2(x, y, seed + (uint32_t) i) * amplitude;
+        norm += amplitude;
+        x *= 2.0f;
+        y *= 2.0f;
+        amplitude *= 0.5f;
+    }
+    // a multiply, the GPU copy (shaders/density.comp) has no exact division
+    return sum * (1.0f / norm);
+}
+
+float fbm3(float x, float y, float z, int octaves, uint32_t seed) {
+    float sum = 0.0f, amplitude = 1.0f, norm = 0.0f;
+    for (int i=0; i<octaves; i++) {
+        sum += noise3(x, y, z, seed + (uint32_t) i) * amplitude;
+        norm += amplitude;
+        x *= 2.0f;
+        y *= 2.0f;
+        z *= 2.0f;
+        amplitude *= 0.5f;
+    }
+    return sum * (1.0f / norm);
+}
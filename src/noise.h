@@ -0,0 +1,14 @@
+// gradient noise for the terrain generator.
+// shaders/density.comp does the same operations in the same order, keep them in sync
+
+#pragma once
+
+#include <stdint.h>
+
+// value in about [-1, 1], 0 on the integer lattice
+float noise2(float x, float y, uint32_t seed);
+float noise3(float x, float y, float z, uint32_t seed);
+
+// sum of octaves, every octave doubles the frequency and halves the amplitude
+float fbm2(float x, float y, int octaves, uint32_t seed);
+float fbm3(float x, float y, float z, int octaves, uint32_t seed);
@@ -0,0 +1,512 @@
+#include "overlay.h"
+
+#include "defines.h"
+#include "font.h"
+#include "gpu_memory.h"
+#include "log.h"
+#include "memory.h"
+#include "pipeline.h"
+#include "simulation.h"
+#include "streamer.h"
+#include "stats.h"
+#include "terrain.h"
+#include "texture.h"
+#include "timer.h"
+#include "vulkan_if.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_QUADS       2048
+#define SCALE           2       // screen pixels per font pixel
+#define MARGIN          8       // from the window corner
+#define PADDING         6       // inside the panel
+#define LINE_HEIGHT     (FONT_GLYPH_SIZE * SCALE + 2)
+#define LINES           11
+#define LINE_LENGTH     48
+#define BAR_WIDTH       2
+#define GRAPH_HEIGHT    100
+#define GRAPH_MAX_MS    50.0    // top of the graph, longer frames are clipped
+#define SPLIT_HEIGHT    8
+#define SPLIT_MAX_MS    33.3    // full width of the CPU / GPU bar
+
+// glyphs of the font texture, in a 16 x 6 grid
+#define FONT_COLUMNS    16
+#define FONT_ROWS       (FONT_GLYPH_COUNT / FONT_COLUMNS)
+
+#define RGBA(r, g, b, a) ((uint32_t) (r) | (uint32_t) (g) << 8 | (uint32_t) (b) << 16 | (uint32_t) (a) << 24)
+
+struct OverlayVertex {
+    float x, y;         // pixels from the top left corner of the window
+    float u, v;
+    uint32_t color;     // R8G8B8A8
+};
+
+struct FrameSample {
+    float frame_ms;
+    float cpu_ms;
+    float gpu_ms;       // -1 when unknown
+};
+
+static bool visible;
+static struct FrameSample history[OVERLAY_HISTORY];
+static uint32_t history_next;       // oldest sample, overwritten next
+static uint32_t history_count;
+static struct RenderStats last_render;  // of the last complete frame
+
+static char lines[LINES][LINE_LENGTH];
+static double last_text;
+
+static struct Texture font;
+static VkDescriptorSetLayout set_layout;
+static VkDescriptorPool descriptor_pool;
+static VkDescriptorSet descriptor_set;
+static VkPipelineLayout overlay_layout;
+static VkPipeline overlay_pipeline;
+
+static VkBuffer vertex_buffer;
+static VkDeviceMemory vertex_memory;
+static struct OverlayVertex *vertices;  // mapped for the lifetime of the overlay
+static uint32_t vertex_count;
+
+
+static bool create_font_texture() {
+    uint8_t pixels[FONT_COLUMNS * FONT_ROWS * FONT_GLYPH_SIZE * FONT_GLYPH_SIZE];
+    font_rasterize(pixels, FONT_COLUMNS, FONT_ROWS);
+    return texture_create(&font, pixels, FONT_COLUMNS * FONT_GLYPH_SIZE, FONT_ROWS * FONT_GLYPH_SIZE,
+                          VK_FORMAT_R8_UNORM, 1, VK_FILTER_NEAREST);
+}
+
+static bool create_descriptors() {
+    VkDescriptorSetLayoutBinding binding = {};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = 1;
+    layout_info.pBindings = &binding;
+    if (vkCreateDescriptorSetLayout(logical_device, &layout_info, NULL, &set_layout) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkDescriptorPoolSize pool_size = {};
+    pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_size.descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    pool_info.maxSets = 1;
+    if (vkCreateDescriptorPool(logical_device, &pool_info, NULL, &descriptor_pool) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = descriptor_pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &set_layout;
+    if (vkAllocateDescriptorSets(logical_device, &alloc_info, &descriptor_set) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkDescriptorImageInfo image_info = {};
+    image_info.sampler = font.sampler;
+    image_info.imageView = font.view;
+    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = descriptor_set;
+    write.dstBinding = 0;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.descriptorCount = 1;
+    write.pImageInfo = &image_info;
+    vkUpdateDescriptorSets(logical_device, 1, &write, 0, NULL);
+    return true;
+}
+
+static bool create_overlay_pipeline() {
+    size_t vert_size = 0, frag_size = 0;
+    unsigned char *vert_code = load_shader("overlay.vert.spv", &vert_size);
+    unsigned char *frag_code = load_shader("overlay.frag.spv", &frag_size);
+    VkShaderModule vert_module = vert_code ? create_shader_module(vert_code, vert_size) : NULL;
+    VkShaderModule frag_module = frag_code ? create_shader_module(frag_code, frag_size) : NULL;
+    memory_free(vert_code);
+    memory_free(frag_code);
+    if (vert_module == NULL || frag_module == NULL) {
+        if (vert_module != NULL) vkDestroyShaderModule(logical_device, vert_module, NULL);
+        if (frag_module != NULL) vkDestroyShaderModule(logical_device, frag_module, NULL);
+        return false;
+    }
+
+    VkPushConstantRange push_range = {};
+    push_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    push_range.size = 2 * sizeof(float);   // screen size
+
+    VkPipelineLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &set_layout;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_range;
+    if (vkCreatePipelineLayout(logical_device, &layout_info, NULL, &overlay_layout) != VK_SUCCESS) {
+        vkDestroyShaderModule(logical_device, vert_module, NULL);
+        vkDestroyShaderModule(logical_device, frag_module, NULL);
+        return false;
+    }
+
+    VkPipelineShaderStageCreateInfo stages[2] = {};
+    stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[0].module = vert_module;
+    stages[0].pName = "main";
+    stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[1].module = frag_module;
+    stages[1].pName = "main";
+
+    VkVertexInputBindingDescription binding = {};
+    binding.binding = 0;
+    binding.stride = sizeof(struct OverlayVertex);
+    binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    VkVertexInputAttributeDescription attributes[3] = {};
+    attributes[0].location = 0;
+    attributes[0].format = VK_FORMAT_R32G32_SFLOAT;
+    attributes[0].offset = offsetof(struct OverlayVertex, x);
+    attributes[1].location = 1;
+    attributes[1].format = VK_FORMAT_R32G32_SFLOAT;
+    attributes[1].offset = offsetof(struct OverlayVertex, u);
+    attributes[2].location = 2;
+    attributes[2].format = VK_FORMAT_R8G8B8A8_UNORM;
+    attributes[2].offset = offsetof(struct OverlayVertex, color);
+
+    VkPipelineVertexInputStateCreateInfo vertex_input = {};
+    vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input.vertexBindingDescriptionCount = 1;
+    vertex_input.pVertexBindingDescriptions = &binding;
+    vertex_input.vertexAttributeDescriptionCount = 3;
+    vertex_input.pVertexAttributeDescriptions = attributes;
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
+    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPipelineViewportStateCreateInfo viewport_state = {};
+    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount = 1;
+    viewport_state.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer = {};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling = {};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    // always on top of the scene
+    VkPipelineDepthStencilStateCreateInfo depth_stencil = {};
+    depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil.depthTestEnable = VK_FALSE;
+    depth_stencil.depthWriteEnable = VK_FALSE;
+
+    VkPipelineColorBlendAttachmentState blend_attachment = {};
+    blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    blend_attachment.blendEnable = VK_TRUE;
+    blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+    blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo color_blending = {};
+    color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blending.attachmentCount = 1;
+    color_blending.pAttachments = &blend_attachment;
+
+    VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamic_state = {};
+    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state.dynamicStateCount = 2;
+    dynamic_state.pDynamicStates = dynamic_states;
+
+    VkGraphicsPipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.stageCount = 2;
+    pipeline_info.pStages = stages;
+    pipeline_info.pVertexInputState = &vertex_input;
+    pipeline_info.pInputAssemblyState = &input_assembly;
+    pipeline_info.pViewportState = &viewport_state;
+    pipeline_info.pRasterizationState = &rasterizer;
+    pipeline_info.pMultisampleState = &multisampling;
+    pipeline_info.pDepthStencilState = &depth_stencil;
+    pipeline_info.pColorBlendState = &color_blending;
+    pipeline_info.pDynamicState = &dynamic_state;
+    pipeline_info.layout = overlay_layout;
+    pipeline_info.renderPass = render_pass;
+    pipeline_info.subpass = 0;
+
+    VkResult result = vkCreateGraphicsPipelines(logical_device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &overlay_pipeline);
+    vkDestroyShaderModule(logical_device, vert_module, NULL);
+    vkDestroyShaderModule(logical_device, frag_module, NULL);
+    return result == VK_SUCCESS;
+}
+
+bool overlay_create() {
+    if (!create_font_texture()) {
+        FATAL("Failed to create the overlay font");
+        return false;
+    }
+    if (!create_descriptors()) {
+        FATAL("Failed to create the overlay descriptors");
+        return false;
+    }
+    if (!create_overlay_pipeline()) {
+        FATAL("Failed to create the overlay pipeline");
+        return false;
+    }
+
+    // host visible, rewritten by the CPU each frame the overlay is shown
+    VkDeviceSize size = MAX_QUADS * 6 * sizeof(struct OverlayVertex);
+    if (!create_buffer(size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                       &vertex_buffer, &vertex_memory)) {
+        FATAL("Failed to create the overlay vertex buffer");
+        return false;
+    }
+    vkMapMemory(logical_device, vertex_memory, 0, size, 0, (void **) &vertices);
+    INFO("Overlay created, F3 to show it");
+    return true;
+}
+
+void overlay_destroy() {
+    if (vertex_buffer != VK_NULL_HANDLE) {
+        vkUnmapMemory(logical_device, vertex_memory);
+        vkDestroyBuffer(logical_device, vertex_buffer, NULL);
+        vkFreeMemory(logical_device, vertex_memory, NULL);
+        vertex_buffer = VK_NULL_HANDLE;
+        vertices = NULL;
+    }
+    if (overlay_pipeline != VK_NULL_HANDLE) vkDestroyPipeline(logical_device, overlay_pipeline, NULL);
+    if (overlay_layout != VK_NULL_HANDLE) vkDestroyPipelineLayout(logical_device, overlay_layout, NULL);
+    if (descriptor_pool != VK_NULL_HANDLE) vkDestroyDescriptorPool(logical_device, descriptor_pool, NULL);
+    if (set_layout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(logical_device, set_layout, NULL);
+    overlay_pipeline = VK_NULL_HANDLE;
+    overlay_layout = VK_NULL_HANDLE;
+    descriptor_pool = VK_NULL_HANDLE;
+    set_layout = VK_NULL_HANDLE;
+    texture_destroy(&font);
+}
+
+void overlay_toggle() {
+    visible = !visible;
+    // the numbers are stale, refresh them on the first frame shown
+    last_text = 0.0;
+}
+
+bool overlay_visible() {
+    return visible;
+}
+
+void overlay_add_frame(double seconds) {
+    struct FrameSample *sample = &history[history_next];
+    sample->frame_ms = (float) (seconds * 1000.0);
+    sample->cpu_ms = (float) (seconds * 1000.0 - render_stats.wait_ms);
+    if (sample->cpu_ms < 0.0f) sample->cpu_ms = 0.0f;
+    sample->gpu_ms = (float) render_stats.gpu_ms;
+    history_next = (history_next + 1) % OVERLAY_HISTORY;
+    if (history_count < OVERLAY_HISTORY) history_count++;
+    last_render = render_stats;
+}
+
+
+static void format_bytes(char *out, size_t size, uint64_t bytes) {
+    if (bytes >= 1024ull * 1024 * 1024) snprintf(out, size, "%.2f GB", bytes / (1024.0 * 1024.0 * 1024.0));
+    else if (bytes >= 1024 * 1024)      snprintf(out, size, "%.1f MB", bytes / (1024.0 * 1024.0));
+    else                                snprintf(out, size, "%.1f KB", bytes / 1024.0);
+}
+
+static void update_text() {
+    const struct FrameSample *last = &history[(history_next + OVERLAY_HISTORY - 1) % OVERLAY_HISTORY];
+    double total = 0.0, worst = 0.0;
+    for (uint32_t i=0; i<history_count; i++) {
+        total += history[i].frame_ms;
+        if (history[i].frame_ms > worst) worst = history[i].frame_ms;
+    }
+    double average = history_count > 0 ? total / history_count : 0.0;
+    snprintf(lines[0], LINE_LENGTH, "ms %5.1f avg %5.1f max %5.1f", last->frame_ms, average, worst);
+    if (last->gpu_ms >= 0.0f) snprintf(lines[1], LINE_LENGTH, "cpu %5.1f ms  gpu %5.1f ms", last->cpu_ms, last->gpu_ms);
+    else                      snprintf(lines[1], LINE_LENGTH, "cpu %5.1f ms  gpu n/a", last->cpu_ms);
+
+    uint32_t loaded = game.simulation != NULL ? world_chunk_count(game.simulation->world) : 0;
+    snprintf(lines[2], LINE_LENGTH, "chunks %6u loaded", loaded);
+    snprintf(lines[3], LINE_LENGTH, "%6u meshed %6u visible", last_render.chunks_meshed, last_render.chunks_visible);
+
+    char a[16], b[16];
+    format_bytes(a, sizeof(a), last_render.upload_bytes);
+    snprintf(lines[4], LINE_LENGTH, "draws %5u upload %s", last_render.draw_calls, a);
+    if (last_render.fragments >= 0) {
+        snprintf(lines[5], LINE_LENGTH, "depth %-8s %7.2fM fragments", depth_mode_name(terrain_depth_mode()),
+                 last_render.fragments / 1e6);
+    } else {
+        snprintf(lines[5], LINE_LENGTH, "depth %-8s fragments n/a", depth_mode_name(terrain_depth_mode()));
+    }
+    snprintf(lines[6], LINE_LENGTH, "sorts %4u %6.2f ms on workers", last_render.sorts, last_render.sort_ms);
+
+    uint64_t heap = 0;
+    for (int tag=0; tag<MEMORY_TAG_COUNT; tag++) {
+        struct MemoryStats stats;
+        memory_stats(tag, &stats);
+        heap += stats.bytes;
+    }
+    format_bytes(a, sizeof(a), heap);
+    format_bytes(b, sizeof(b), stats_resident_memory());
+    snprintf(lines[7], LINE_LENGTH, "heap %s rss %s", a, b);
+
+    struct GpuMemoryStats gpu;
+    gpu_memory_stats(&gpu);
+    uint64_t usage = 0, budget = 0;
+    for (uint32_t i=0; i<gpu.heap_count; i++) {
+        if (!gpu.heaps[i].device_local) continue;
+        usage += gpu.heaps[i].usage;
+        budget += gpu.heaps[i].budget;
+    }
+    format_bytes(b, sizeof(b), budget);
+    if (gpu.budget_supported) {
+        format_bytes(a, sizeof(a), usage);
+        snprintf(lines[8], LINE_LENGTH, "vram %s of %s", a, b);
+    } else {
+        snprintf(lines[8], LINE_LENGTH, "vram ? of %s", b);
+    }
+    snprintf(lines[9], LINE_LENGTH, "%s %s latency %5.1f ms", present_mode_name(game.pacer.present_mode),
+             latency_mode_name(game.pacer.latency_mode), game.pacer.latency * 1e3);
+
+    struct ChunkCacheStats cache = {0};
+    if (game.streamer != NULL) chunk_cache_stats(streamer_cache(game.streamer), &cache);
+    format_bytes(a, sizeof(a), cache.bytes);
+    snprintf(lines[10], LINE_LENGTH, "cache %s %3.0f%% hits %4.1fx", a, chunk_cache_hit_rate(&cache) * 100.0,
+             chunk_cache_compression(&cache));
+}
+
+
+static void add_quad(float x, float y, float w, float h, float u0, float v0, float u1, float v1, uint32_t color) {
+    if (vertex_count + 6 > MAX_QUADS * 6) return;
+    struct OverlayVertex *v = &vertices[vertex_count];
+    v[0] = (struct OverlayVertex) {x,     y,     u0, v0, color};
+    v[1] = (struct OverlayVertex) {x + w, y,     u1, v0, color};
+    v[2] = (struct OverlayVertex) {x + w, y + h, u1, v1, color};
+    v[3] = (struct OverlayVertex) {x + w, y + h, u1, v1, color};
+    v[4] = (struct OverlayVertex) {x,     y + h, u0, v1, color};
+    v[5] = (struct OverlayVertex) {x,     y,     u0, v0, color};
+    vertex_count += 6;
+}
+
+static void add_glyph(float x, float y, int c, uint32_t color) {
+    if (c < FONT_FIRST_CHAR || c >= FONT_FIRST_CHAR + FONT_GLYPH_COUNT) c = '?';
+    int glyph = c - FONT_FIRST_CHAR;
+    float u0 = (float) (glyph % FONT_COLUMNS) / FONT_COLUMNS;
+    float v0 = (float) (glyph / FONT_COLUMNS) / FONT_ROWS;
+    float size = FONT_GLYPH_SIZE * SCALE;
+    add_quad(x, y, size, size, u0, v0, u0 + 1.0f / FONT_COLUMNS, v0 + 1.0f / FONT_ROWS, color);
+}
+
+// plain quads sample the solid glyph
+static void add_rect(float x, float y, float w, float h, uint32_t color) {
+    int glyph = FONT_SOLID_CHAR - FONT_FIRST_CHAR;
+    float u = ((float) (glyph % FONT_COLUMNS) + 0.5f) / FONT_COLUMNS;
+    float v = ((float) (glyph / FONT_COLUMNS) + 0.5f) / FONT_ROWS;
+    add_quad(x, y, w, h, u, v, u, v, color);
+}
+
+static void add_text(float x, float y, const char *text, uint32_t color) {
+    for (; *text != '\0'; text++, x += FONT_GLYPH_SIZE * SCALE) {
+        if (*text != ' ') add_glyph(x, y, (unsigned char) *text, color);
+    }
+}
+
+static uint32_t frame_color(float ms) {
+    if (ms <= 1000.0f / 60.0f + 0.5f) return RGBA(80, 220, 80, 230);
+    if (ms <= 1000.0f / 30.0f + 0.5f) return RGBA(230, 200, 60, 230);
+    return RGBA(240, 70, 60, 230);
+}
+
+static void build() {
+    vertex_count = 0;
+
+    size_t longest = 0;
+    for (int i=0; i<LINES; i++) {
+        size_t length = strlen(lines[i]);
+        if (length > longest) longest = length;
+    }
+    float graph_width = OVERLAY_HISTORY * BAR_WIDTH;
+    float text_width = (float) longest * FONT_GLYPH_SIZE * SCALE;
+    float width = (text_width > graph_width ? text_width : graph_width) + 2 * PADDING;
+    float height = LINES * LINE_HEIGHT + SPLIT_HEIGHT + GRAPH_HEIGHT + 4 * PADDING;
+    add_rect(MARGIN, MARGIN, width, height, RGBA(0, 0, 0, 170));
+
+    float x = MARGIN + PADDING;
+    float y = MARGIN + PADDING;
+    for (int i=0; i<LINES; i++, y += LINE_HEIGHT) {
+        add_text(x, y, lines[i], RGBA(255, 255, 255, 255));
+    }
+
+    // CPU and GPU time of the last frame side by side, the frame is as long as the longest
+    y += PADDING;
+    const struct FrameSample *last = &history[(history_next + OVERLAY_HISTORY - 1) % OVERLAY_HISTORY];
+    float cpu = (float) (last->cpu_ms / SPLIT_MAX_MS) * graph_width;
+    float gpu = last->gpu_ms > 0.0f ? (float) (last->gpu_ms / SPLIT_MAX_MS) * graph_width : 0.0f;
+    if (cpu > graph_width) cpu = graph_width;
+    if (gpu > graph_width) gpu = graph_width;
+    add_rect(x, y, cpu, SPLIT_HEIGHT / 2, RGBA(90, 150, 255, 230));
+    add_rect(x, y + SPLIT_HEIGHT / 2, gpu, SPLIT_HEIGHT / 2, RGBA(255, 150, 60, 230));
+
+    // frame times, oldest on the left, with the 60 and 30 fps lines
+    y += SPLIT_HEIGHT + PADDING;
+    add_rect(x, y, graph_width, GRAPH_HEIGHT, RGBA(40, 40, 40, 170));
+    float bottom = y + GRAPH_HEIGHT;
+    for (uint32_t i=0; i<history_count; i++) {
+        uint32_t index = (history_next + OVERLAY_HISTORY - history_count + i) % OVERLAY_HISTORY;
+        float ms = history[index].frame_ms;
+        float bar = (float) (ms / GRAPH_MAX_MS) * GRAPH_HEIGHT;
+        if (bar > GRAPH_HEIGHT) bar = GRAPH_HEIGHT;
+        float bar_x = x + graph_width - (float) (history_count - i) * BAR_WIDTH;
+        add_rect(bar_x, bottom - bar, BAR_WIDTH, bar, frame_color(ms));
+    }
+    add_rect(x, bottom - (float) (1000.0 / 60.0 / GRAPH_MAX_MS) * GRAPH_HEIGHT, graph_width, 1, RGBA(255, 255, 255, 120));
+    add_rect(x, bottom - (float) (1000.0 / 30.0 / GRAPH_MAX_MS) * GRAPH_HEIGHT, graph_width, 1, RGBA(255, 255, 255, 120));
+}
+
+void overlay_record(VkCommandBuffer cmd_buffer) {
+    if (!visible || vertices == NULL) return;
+
+    double now = timer_now();
+    if (now - last_text >= OVERLAY_TEXT_INTERVAL) {
+        update_text();
+        last_text = now;
+    }
+    // one frame in flight: the fence was waited on, the GPU is done with the buffer
+    build();
+    if (vertex_count == 0) return;
+
+    float screen[2] = {(float) swap_chain.extent.width, (float) swap_chain.extent.height};
+    VkDeviceSize offset = 0;
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, overlay_pipeline);
+    vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, overlay_layout, 0, 1, &descriptor_set, 0, NULL);
+    vkCmdPushConstants(cmd_buffer, overlay_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(screen), screen);
+    vkCmdBindVertexBuffers(cmd_buffer, 0, 1, &vertex_buffer, &offset);
+    vkCmdDraw(cmd_buffer, vertex_count, 1, 0, 0);
+
+    render_stats.draw_calls++;
+    render_stats.upload_bytes += vertex_count * sizeof(struct OverlayVertex);
+}
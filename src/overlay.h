@@ -0,0 +1,24 @@
+// Performance overlay, toggled with F3.
+// Frame time graph, CPU / GPU split, chunks, draw calls, uploads, shaded fragments, memory,
+// frame pacing and the chunk cache, drawn over the scene with its own pipeline and the 8x8 font (font.h).
+// Hidden, it only keeps the frame times of the graph: nothing is built nor drawn.
+
+#pragma once
+
+#include <stdbool.h>
+#include <vulkan/vulkan.h>
+
+#define OVERLAY_HISTORY         240     // frames in the graph
+#define OVERLAY_TEXT_INTERVAL   0.25    // seconds between two refreshes of the numbers
+
+// after the render pass and the command pool
+bool overlay_create();
+void overlay_destroy();
+
+void overlay_toggle();
+bool overlay_visible();
+
+// once per frame, after draw_frame()
+void overlay_add_frame(double seconds);
+// inside the render pass, after the scene
+void overlay_record(VkCommandBuffer cmd_buffer);
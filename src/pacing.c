@@ -0,0 +1,126 @@
+#include "pacing.h"
+
+#include "log.h"
+#include "timer.h"
+
+#include <math.h>
+#include <string.h>
+
+#define MAX_DELAY 0.1   // seconds, a frame slower than that is not worth waiting for
+
+static const char *PRESENT_MODE_NAMES[PRESENT_MODE_COUNT] = {
+    [PRESENT_MODE_IMMEDIATE]    = "immediate",
+    [PRESENT_MODE_MAILBOX]      = "mailbox",
+    [PRESENT_MODE_FIFO]         = "fifo",
+    [PRESENT_MODE_FIFO_RELAXED] = "fifo_relaxed",
+};
+
+static const char *LATENCY_MODE_NAMES[LATENCY_MODE_COUNT] = {
+    [LATENCY_MODE_NORMAL] = "normal",
+    [LATENCY_MODE_LOW]    = "low",
+};
+
+
+const char *present_mode_name(enum present_mode mode) {
+    return mode < PRESENT_MODE_COUNT ? PRESENT_MODE_NAMES[mode] : "?";
+}
+
+enum present_mode present_mode_from_name(const char *name) {
+    for (int i=0; i<PRESENT_MODE_COUNT; i++) {
+        if (strcmp(name, PRESENT_MODE_NAMES[i]) == 0) return i;
+    }
+    return PRESENT_MODE_COUNT;
+}
+
+const char *latency_mode_name(enum latency_mode mode) {
+    return mode < LATENCY_MODE_COUNT ? LATENCY_MODE_NAMES[mode] : "?";
+}
+
+enum latency_mode latency_mode_from_name(const char *name) {
+    for (int i=0; i<LATENCY_MODE_COUNT; i++) {
+        if (strcmp(name, LATENCY_MODE_NAMES[i]) == 0) return i;
+    }
+    return LATENCY_MODE_COUNT;
+}
+
+// Welford's, no catastrophic cancellation over long runs
+void pacing_stats_add(struct PacingStats *stats, double value) {
+    stats->count++;
+    double delta = value - stats->mean;
+    stats->mean += delta / stats->count;
+    stats->m2 += delta * (value - stats->mean);
+    if (value > stats->max) stats->max = value;
+}
+
+double pacing_stats_deviation(const struct PacingStats *stats) {
+    return stats->count > 1 ? sqrt(stats->m2 / (stats->count - 1)) : 0.0;
+}
+
+void pacer_init(struct FramePacer *pacer, enum present_mode present_mode, enum latency_mode latency_mode, double fps_cap) {
+    memset(pacer, 0, sizeof(*pacer));
+    pacer->present_mode = present_mode;
+    pacer->latency_mode = latency_mode;
+    pacer->fps_cap = fps_cap > 0.0 ? fps_cap : 0.0;
+}
+
+void pacer_set_latency_mode(struct FramePacer *pacer, enum latency_mode mode) {
+    pacer->latency_mode = mode;
+    pacer->delay = 0.0;
+}
+
+// sleeps most of it, spins the end
+static void wait_until(double until) {
+    double remaining = until - timer_now();
+    if (remaining > PACING_SPIN) timer_sleep(remaining - PACING_SPIN);
+    while (timer_now() < until) {}
+}
+
+void pacer_begin_frame(struct FramePacer *pacer) {
+    double now = timer_now();
+    double until = now;
+    if (pacer->fps_cap > 0.0) {
+        double period = 1.0 / pacer->fps_cap;
+        // a frame late by more than a period starts the schedule over, no burst to catch up
+        if (pacer->deadline == 0.0 || now - pacer->deadline > period) pacer->deadline = now;
+        until = pacer->deadline;
+        pacer->deadline += period;
+    }
+    if (pacer->latency_mode == LATENCY_MODE_LOW) until += pacer->delay;
+    wait_until(until);
+
+    pacer->previous_sample = pacer->sample;
+    pacer->sample = timer_now();
+    if (pacer->previous_sample > 0.0) {
+        pacing_stats_add(&pacer->frame_times[pacer->present_mode][pacer->latency_mode],
+                         pacer->sample - pacer->previous_sample);
+    }
+}
+
+void pacer_end_frame(struct FramePacer *pacer, double wait, double gpu_done) {
+    if (pacer->previous_sample > 0.0) {
+        pacer->latency = gpu_done - pacer->previous_sample;
+        pacing_stats_add(&pacer->latencies[pacer->present_mode][pacer->latency_mode], pacer->latency);
+    }
+
+    // the input could have been sampled as much later as the frame waited: follow
+    // the wait slowly, a single long frame is not a trend. Once there is no wait
+    // the delay went past the GPU, which costs frame rate, back off quicker
+    if (pacer->latency_mode != LATENCY_MODE_LOW) return;
+    if (wait > PACING_SAFETY) pacer->delay += PACING_SMOOTHING * (wait - PACING_SAFETY);
+    else pacer->delay -= PACING_SMOOTHING * pacer->delay;
+    if (pacer->delay > MAX_DELAY) pacer->delay = MAX_DELAY;
+}
+
+void pacer_report(const struct FramePacer *pacer) {
+    for (int p=0; p<PRESENT_MODE_COUNT; p++) {
+        for (int l=0; l<LATENCY_MODE_COUNT; l++) {
+            const struct PacingStats *frames = &pacer->frame_times[p][l];
+            const struct PacingStats *latency = &pacer->latencies[p][l];
+            if (frames->count == 0) continue;
+            INFO("PACING %-12s %-6s %6llu frames %6.2f ms +- %5.2f max %6.2f, latency %6.2f ms +- %5.2f max %6.2f",
+                 present_mode_name(p), latency_mode_name(l), (unsigned long long) frames->count,
+                 frames->mean * 1e3, pacing_stats_deviation(frames) * 1e3, frames->max * 1e3,
+                 latency->mean * 1e3, pacing_stats_deviation(latency) * 1e3, latency->max * 1e3);
+        }
+    }
+}
@@ -0,0 +1,76 @@
+// Frame pacing: when the loop starts a frame.
+// Without it the loop runs as fast as the present mode lets it, the CPU spins
+// on frames nobody sees or samples the input long before the GPU can take the
+// frame, which is latency.
+//  - a frame rate cap sleeps until the next frame is due
+//  - the low latency mode sleeps before sampling the input for about as long
+//    as draw_frame() blocked on the GPU in the last frames, so the input and the
+//    simulation are fresh when the frame is submitted
+// Frame time variance and latency (input sampled to the GPU done with the frame,
+// the display is not counted) are kept for each present and latency mode.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PACING_SAFETY       0.001   // seconds left between the end of the delay and the GPU being ready
+#define PACING_SMOOTHING    0.1     // weight of the last frame in the delay
+#define PACING_SPIN         0.002   // the end of a wait spins, sleeping is not that precise
+
+// the values of VkPresentModeKHR
+enum present_mode {
+    PRESENT_MODE_IMMEDIATE = 0,     // tears, no wait
+    PRESENT_MODE_MAILBOX,           // no tearing, the newest frame replaces the queued one
+    PRESENT_MODE_FIFO,              // vsync, always supported
+    PRESENT_MODE_FIFO_RELAXED,      // vsync, tears when a frame is late
+    PRESENT_MODE_COUNT
+};
+
+enum latency_mode {
+    LATENCY_MODE_NORMAL = 0,
+    LATENCY_MODE_LOW,
+    LATENCY_MODE_COUNT
+};
+
+// running mean and variance
+struct PacingStats {
+    uint64_t count;
+    double mean;
+    double m2;                      // sum of the squared differences to the mean
+    double max;
+};
+
+struct FramePacer {
+    enum present_mode present_mode; // in use, set by the renderer
+    enum latency_mode latency_mode;
+    double fps_cap;                 // 0 uncapped
+    double delay;                   // low latency: slept before sampling the input
+    double deadline;                // of the capped frame
+    double sample;                  // the input of the frame in flight was sampled
+    double previous_sample;         // of the frame before, on the GPU
+    double latency;                 // of the last frame done, seconds
+    struct PacingStats frame_times[PRESENT_MODE_COUNT][LATENCY_MODE_COUNT];
+    struct PacingStats latencies[PRESENT_MODE_COUNT][LATENCY_MODE_COUNT];
+};
+
+const char *present_mode_name(enum present_mode mode);
+// PRESENT_MODE_COUNT for an unknown name
+enum present_mode present_mode_from_name(const char *name);
+const char *latency_mode_name(enum latency_mode mode);
+// LATENCY_MODE_COUNT for an unknown name
+enum latency_mode latency_mode_from_name(const char *name);
+
+void pacing_stats_add(struct PacingStats *stats, double value);
+double pacing_stats_deviation(const struct PacingStats *stats);
+
+void pacer_init(struct FramePacer *pacer, enum present_mode present_mode, enum latency_mode latency_mode, double fps_cap);
+void pacer_set_latency_mode(struct FramePacer *pacer, enum latency_mode mode);
+// Before the input is sampled: waits for the cap and the low latency delay. The
+// frame time is between two of these, when the player's input is taken
+void pacer_begin_frame(struct FramePacer *pacer);
+// After draw_frame(). wait: seconds it blocked on the GPU and the swap chain,
+// gpu_done: when it saw the previous frame done
+void pacer_end_frame(struct FramePacer *pacer, double wait, double gpu_done);
+// frame time average and deviation, latency for every mode that ran
+void pacer_report(const struct FramePacer *pacer);
@@ -0,0 +1,459 @@
+#include "physics.h"
+#include "entity.h"
+#include "job.h"
+#include "log.h"
+#include "memory.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// blocks per axis gathered for one sweep, faster moves are split
+#define SWEEP_GRID 16
+
+// speed added to two overlapping entities to separate them, blocks/s per tick
+#define PUSH_SPEED 0.5f
+
+struct Physics {
+    struct Broadphase broadphase;
+    struct Aabb *boxes;
+    struct EntityVelocity **velocities;     // velocity of each box, to apply the pushes
+    uint32_t capacity;
+};
+
+
+bool aabb_overlap(const struct Aabb *a, const struct Aabb *b) {
+    return a->min_x < b->max_x && a->max_x > b->min_x &&
+           a->min_y < b->max_y && a->max_y > b->min_y &&
+           a->min_z < b->max_z && a->max_z > b->min_z;
+}
+
+// Clip the move along one axis against the unit cubes of the solid blocks.
+// lo/hi are the box, origin is the block at grid [0][0][0], solid[y][z] has one bit per x
+static float clip_axis(int axis, float move, const float lo[3], const float hi[3],
+                       const int32_t origin[3], const int size[3], uint16_t solid[SWEEP_GRID][SWEEP_GRID]) {
+    int a1 = (axis + 1) % 3;
+    int a2 = (axis + 2) % 3;
+
+    for (int y=0; y<size[1]; y++) {
+        for (int z=0; z<size[2]; z++) {
+            uint16_t row = solid[y][z];
+            while (row) {
+                int x = __builtin_ctz(row);
+                row &= row - 1;
+
+                int32_t block[3] = {origin[0] + x, origin[1] + y, origin[2] + z};
+                // the block must overlap the box on the two other axes
+                if (!(hi[a1] > block[a1] && lo[a1] < block[a1] + 1 &&
+                      hi[a2] > block[a2] && lo[a2] < block[a2] + 1)) {
+                    continue;
+                }
+                if (move > 0 && hi[axis] <= block[axis]) {
+                    float limit = block[axis] - hi[axis];
+                    if (limit < move) move = limit;
+                } else if (move < 0 && lo[axis] >= block[axis] + 1) {
+                    float limit = block[axis] + 1 - lo[axis];
+                    if (limit > move) move = limit;
+                }
+            }
+        }
+    }
+    return move;
+}
+
+uint32_t physics_sweep_voxels(struct BlockAccess *access, struct Aabb *box, float delta[3]) {
+    float lo[3] = {box->min_x, box->min_y, box->min_z};
+    float hi[3] = {box->max_x, box->max_y, box->max_z};
+
+    // blocks touched by the box along the whole move
+    int32_t origin[3];
+    int size[3];
+    for (int i=0; i<3; i++) {
+        float from = lo[i] + (delta[i] < 0 ? delta[i] : 0);
+        float to   = hi[i] + (delta[i] > 0 ? delta[i] : 0);
+        origin[i] = (int32_t) floorf(from);
+        size[i] = (int32_t) floorf(to) - origin[i] + 1;
+    }
+
+    if (size[0] > SWEEP_GRID || size[1] > SWEEP_GRID || size[2] > SWEEP_GRID) {
+        // too fast for one gather, do it in two halves
+        float first[3] = {delta[0] * 0.5f, delta[1] * 0.5f, delta[2] * 0.5f};
+        uint32_t hit = physics_sweep_voxels(access, box, first);
+        float second[3] = {
+            (hit & PHYSICS_HIT_X) ? 0 : delta[0] * 0.5f,
+            (hit & (PHYSICS_HIT_Y_DOWN | PHYSICS_HIT_Y_UP)) ? 0 : delta[1] * 0.5f,
+            (hit & PHYSICS_HIT_Z) ? 0 : delta[2] * 0.5f};
+        hit |= physics_sweep_voxels(access, box, second);
+        for (int i=0; i<3; i++) delta[i] = first[i] + second[i];
+        return hit;
+    }
+
+    // Read the solidity once, in storage order (x fastest, then z, then y),
+    // the three axis passes below only touch this little bit grid
+    uint16_t solid[SWEEP_GRID][SWEEP_GRID];
+    bool any_solid = false;
+    for (int y=0; y<size[1]; y++) {
+        for (int z=0; z<size[2]; z++) {
+            uint16_t row = 0;
+            for (int x=0; x<size[0]; x++) {
+                if (block_is_solid(block_access_get(access, origin[0] + x, origin[1] + y, origin[2] + z))) {
+                    row |= (uint16_t) (1u << x);
+                }
+            }
+            solid[y][z] = row;
+            any_solid |= row != 0;
+        }
+    }
+
+    uint32_t hit = 0;
+    float moved[3] = {delta[0], delta[1], delta[2]};
+    if (any_solid) {
+        // y first so walking on the ground does not snag on the blocks below
+        static const int order[3] = {1, 0, 2};
+        for (int i=0; i<3; i++) {
+            int axis = order[i];
+            if (moved[axis] == 0) continue;
+            moved[axis] = clip_axis(axis, moved[axis], lo, hi, origin, size, solid);
+            lo[axis] += moved[axis];
+            hi[axis] += moved[axis];
+        }
+    } else {
+        for (int i=0; i<3; i++) {
+            lo[i] += moved[i];
+            hi[i] += moved[i];
+        }
+    }
+
+    if (moved[0] != delta[0]) hit |= PHYSICS_HIT_X;
+    if (moved[1] != delta[1]) hit |= delta[1] < 0 ? PHYSICS_HIT_Y_DOWN : PHYSICS_HIT_Y_UP;
+    if (moved[2] != delta[2]) hit |= PHYSICS_HIT_Z;
+
+    box->min_x = lo[0]; box->min_y = lo[1]; box->min_z = lo[2];
+    box->max_x = hi[0]; box->max_y = hi[1]; box->max_z = hi[2];
+    for (int i=0; i<3; i++) delta[i] = moved[i];
+    return hit;
+}
+
+
+// 21 bits per axis is plenty for cells of a couple of blocks
+static uint64_t pack_cell(int32_t x, int32_t y, int32_t z) {
+    return ((uint64_t) (x & 0x1FFFFF) << 42) | ((uint64_t) (y & 0x1FFFFF) << 21) | (uint64_t) (z & 0x1FFFFF);
+}
+
+static uint32_t hash_cell(uint64_t cell) {
+    cell ^= cell >> 33;
+    cell *= 0xFF51AFD7ED558CCDULL;
+    cell ^= cell >> 33;
+    return (uint32_t) cell;
+}
+
+void broadphase_init(struct Broadphase *broadphase, float cell_size) {
+    memset(broadphase, 0, sizeof(*broadphase));
+    broadphase->cell_size = cell_size;
+}
+
+void broadphase_free(struct Broadphase *broadphase) {
+    memory_free(broadphase->entries);
+    memory_free(broadphase->sorted);
+    memory_free(broadphase->buckets);
+    memory_free(broadphase->pairs);
+    for (int i=0; i<BROADPHASE_JOBS; i++) {
+        memory_free(broadphase->lists[i].pairs);
+    }
+    memset(broadphase, 0, sizeof(*broadphase));
+}
+
+static bool pair_list_push(struct PairList *list, uint32_t a, uint32_t b) {
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 256;
+        struct PhysicsPair *pairs = memory_realloc(list->pairs, capacity * sizeof(*pairs), MEMORY_TAG_SIMULATION);
+        if (pairs == NULL) return false;
+        list->pairs = pairs;
+        list->capacity = capacity;
+    }
+    list->pairs[list->count].a = a < b ? a : b;
+    list->pairs[list->count].b = a < b ? b : a;
+    list->count++;
+    return true;
+}
+
+struct PairSearch {
+    struct Broadphase *broadphase;
+    const struct Aabb *boxes;
+    uint32_t buckets_per_job;
+};
+
+static int32_t cell_of(float v, float inv_cell) {
+    return (int32_t) floorf(v * inv_cell);
+}
+
+static void find_pairs_job(void *ctx, uint32_t begin, uint32_t end) {
+    struct PairSearch *search = ctx;
+    struct Broadphase *broadphase = search->broadphase;
+    struct PairList *list = &broadphase->lists[begin / search->buckets_per_job];
+    float inv_cell = 1.0f / broadphase->cell_size;
+
+    for (uint32_t bucket=begin; bucket<end; bucket++) {
+        uint32_t first = broadphase->buckets[bucket];
+        uint32_t last = broadphase->buckets[bucket + 1];
+        for (uint32_t i=first; i<last; i++) {
+            const struct BroadphaseEntry *ei = &broadphase->sorted[i];
+            const struct Aabb *a = &search->boxes[ei->box];
+            for (uint32_t j=i+1; j<last; j++) {
+                const struct BroadphaseEntry *ej = &broadphase->sorted[j];
+                // different cells can land in the same bucket
+                if (ej->cell != ei->cell || ej->box == ei->box) continue;
+
+                const struct Aabb *b = &search->boxes[ej->box];
+                if (!aabb_overlap(a, b)) continue;
+
+                // a pair sharing several cells is reported only by the cell
+                // holding the min corner of the overlap
+                uint64_t owner = pack_cell(
+                    cell_of(a->min_x > b->min_x ? a->min_x : b->min_x, inv_cell),
+                    cell_of(a->min_y > b->min_y ? a->min_y : b->min_y, inv_cell),
+                    cell_of(a->min_z > b->min_z ? a->min_z : b->min_z, inv_cell));
+                if (owner == ei->cell) {
+                    pair_list_push(list, ei->box, ej->box);
+                }
+            }
+        }
+    }
+}
+
+uint32_t broadphase_find_pairs(struct Broadphase *broadphase, const struct Aabb *boxes, uint32_t count) {
+    float inv_cell = 1.0f / broadphase->cell_size;
+    broadphase->pairs_count = 0;
+    if (count < 2) return 0;
+
+    // every box goes in every cell it touches
+    uint32_t entries_count = 0;
+    for (uint32_t i=0; i<count; i++) {
+        uint32_t nx = cell_of(boxes[i].max_x, inv_cell) - cell_of(boxes[i].min_x, inv_cell) + 1;
+        uint32_t ny = cell_of(boxes[i].max_y, inv_cell) - cell_of(boxes[i].min_y, inv_cell) + 1;
+        uint32_t nz = cell_of(boxes[i].max_z, inv_cell) - cell_of(boxes[i].min_z, inv_cell) + 1;
+        entries_count += nx * ny * nz;
+    }
+
+    if (entries_count > broadphase->entries_capacity) {
+        memory_free(broadphase->entries);
+        memory_free(broadphase->sorted);
+        broadphase->entries = memory_alloc(entries_count * sizeof(struct BroadphaseEntry), MEMORY_TAG_SIMULATION);
+        broadphase->sorted = memory_alloc(entries_count * sizeof(struct BroadphaseEntry), MEMORY_TAG_SIMULATION);
+        if (broadphase->entries == NULL || broadphase->sorted == NULL) {
+            FATAL("PHYSICS out of memory for the broadphase");
+            broadphase->entries_capacity = 0;
+            return 0;
+        }
+        broadphase->entries_capacity = entries_count;
+    }
+
+    uint32_t buckets_count = 64;
+    while (buckets_count < entries_count) buckets_count *= 2;
+    if (buckets_count + 1 > broadphase->buckets_capacity) {
+        memory_free(broadphase->buckets);
+        broadphase->buckets = memory_alloc((buckets_count + 1) * sizeof(uint32_t), MEMORY_TAG_SIMULATION);
+        if (broadphase->buckets == NULL) {
+            FATAL("PHYSICS out of memory for the broadphase");
+            broadphase->buckets_capacity = 0;
+            return 0;
+        }
+        broadphase->buckets_capacity = buckets_count + 1;
+    }
+    broadphase->buckets_count = buckets_count;
+    memset(broadphase->buckets, 0, (buckets_count + 1) * sizeof(uint32_t));
+
+    uint32_t n = 0;
+    for (uint32_t i=0; i<count; i++) {
+        int32_t x0 = cell_of(boxes[i].min_x, inv_cell), x1 = cell_of(boxes[i].max_x, inv_cell);
+        int32_t y0 = cell_of(boxes[i].min_y, inv_cell), y1 = cell_of(boxes[i].max_y, inv_cell);
+        int32_t z0 = cell_of(boxes[i].min_z, inv_cell), z1 = cell_of(boxes[i].max_z, inv_cell);
+        for (int32_t y=y0; y<=y1; y++) {
+            for (int32_t z=z0; z<=z1; z++) {
+                for (int32_t x=x0; x<=x1; x++) {
+                    uint64_t cell = pack_cell(x, y, z);
+                    broadphase->entries[n].cell = cell;
+                    broadphase->entries[n].box = i;
+                    broadphase->buckets[hash_cell(cell) & (buckets_count - 1)]++;
+                    n++;
+                }
+            }
+        }
+    }
+
+    // counting sort by bucket: the entries of a bucket end up contiguous
+    uint32_t sum = 0;
+    for (uint32_t b=0; b<buckets_count; b++) {
+        uint32_t bucket_size = broadphase->buckets[b];
+        broadphase->buckets[b] = sum;
+        sum += bucket_size;
+    }
+    broadphase->buckets[buckets_count] = sum;
+    for (uint32_t i=0; i<n; i++) {
+        uint32_t bucket = hash_cell(broadphase->entries[i].cell) & (buckets_count - 1);
+        broadphase->sorted[broadphase->buckets[bucket]++] = broadphase->entries[i];
+    }
+    // the scatter moved every start to the next bucket, shift them back
+    for (uint32_t b=buckets_count; b>0; b--) {
+        broadphase->buckets[b] = broadphase->buckets[b - 1];
+    }
+    broadphase->buckets[0] = 0;
+
+    for (int i=0; i<BROADPHASE_JOBS; i++) {
+        broadphase->lists[i].count = 0;
+    }
+    struct PairSearch search = {broadphase, boxes, (buckets_count + BROADPHASE_JOBS - 1) / BROADPHASE_JOBS};
+    job_parallel_for(buckets_count, search.buckets_per_job, find_pairs_job, &search);
+
+    uint32_t total = 0;
+    for (int i=0; i<BROADPHASE_JOBS; i++) {
+        total += broadphase->lists[i].count;
+    }
+    if (total > broadphase->pairs_capacity) {
+        struct PhysicsPair *pairs = memory_realloc(broadphase->pairs, total * sizeof(*pairs), MEMORY_TAG_SIMULATION);
+        if (pairs == NULL) {
+            FATAL("PHYSICS out of memory for the pairs");
+            return 0;
+        }
+        broadphase->pairs = pairs;
+        broadphase->pairs_capacity = total;
+    }
+    for (int i=0; i<BROADPHASE_JOBS; i++) {
+        // an empty list may have no array yet, memcpy wants one even for 0 bytes
+        if (broadphase->lists[i].count == 0) continue;
+        memcpy(broadphase->pairs + broadphase->pairs_count, broadphase->lists[i].pairs,
+               broadphase->lists[i].count * sizeof(struct PhysicsPair));
+        broadphase->pairs_count += broadphase->lists[i].count;
+    }
+    return broadphase->pairs_count;
+}
+
+
+struct Physics *physics_create() {
+    struct Physics *physics = memory_calloc(1, sizeof(*physics), MEMORY_TAG_SIMULATION);
+    if (physics == NULL) {
+        FATAL("PHYSICS failed to allocate");
+        return NULL;
+    }
+    // a couple of blocks, most entities fit in one or two cells
+    broadphase_init(&physics->broadphase, 2.0f);
+    return physics;
+}
+
+void physics_destroy(struct Physics *physics) {
+    if (physics == NULL) return;
+    broadphase_free(&physics->broadphase);
+    memory_free(physics->boxes);
+    memory_free(physics->velocities);
+    memory_free(physics);
+}
+
+struct TerrainStep {
+    struct World *world;
+    float dt;
+};
+
+static void terrain_collision(struct EcsView *view, void *ctx) {
+    struct TerrainStep *step = ctx;
+    struct EntityPosition *position = ecs_column(view, COMPONENT_POSITION);
+    struct EntityVelocity *velocity = ecs_column(view, COMPONENT_VELOCITY);
+    struct EntityCollider *collider = ecs_column(view, COMPONENT_COLLIDER);
+
+    struct BlockAccess access;
+    block_access_init(&access, step->world);
+
+    for (uint32_t i=view->begin; i<view->end; i++) {
+        struct Aabb box = {
+            position[i].x - collider[i].half_width, position[i].y, position[i].z - collider[i].half_width,
+            position[i].x + collider[i].half_width, position[i].y + collider[i].height, position[i].z + collider[i].half_width};
+        float delta[3] = {velocity[i].x * step->dt, velocity[i].y * step->dt, velocity[i].z * step->dt};
+
+        uint32_t hit = physics_sweep_voxels(&access, &box, delta);
+
+        position[i].x = (box.min_x + box.max_x) * 0.5f;
+        position[i].y = box.min_y;
+        position[i].z = (box.min_z + box.max_z) * 0.5f;
+        if (hit & PHYSICS_HIT_X) velocity[i].x = 0;
+        if (hit & (PHYSICS_HIT_Y_DOWN | PHYSICS_HIT_Y_UP)) velocity[i].y = 0;
+        if (hit & PHYSICS_HIT_Z) velocity[i].z = 0;
+        collider[i].on_ground = (hit & PHYSICS_HIT_Y_DOWN) != 0;
+    }
+}
+
+struct Gather {
+    struct Physics *physics;
+    uint32_t count;
+};
+
+static void gather_boxes(struct EcsView *view, void *ctx) {
+    struct Gather *gather = ctx;
+    struct EntityPosition *position = ecs_column(view, COMPONENT_POSITION);
+    struct EntityVelocity *velocity = ecs_column(view, COMPONENT_VELOCITY);
+    struct EntityCollider *collider = ecs_column(view, COMPONENT_COLLIDER);
+
+    for (uint32_t i=view->begin; i<view->end; i++) {
+        uint32_t n = gather->count++;
+        struct Aabb *box = &gather->physics->boxes[n];
+        box->min_x = position[i].x - collider[i].half_width;
+        box->min_y = position[i].y;
+        box->min_z = position[i].z - collider[i].half_width;
+        box->max_x = position[i].x + collider[i].half_width;
+        box->max_y = position[i].y + collider[i].height;
+        box->max_z = position[i].z + collider[i].half_width;
+        gather->physics->velocities[n] = &velocity[i];
+    }
+}
+
+static void count_boxes(struct EcsView *view, void *ctx) {
+    *(uint32_t *) ctx += view->end - view->begin;
+}
+
+void physics_step(struct Physics *physics, struct Ecs *ecs, struct World *world, float dt) {
+    struct EcsQuery query = {ECS_BIT(COMPONENT_POSITION) | ECS_BIT(COMPONENT_VELOCITY) | ECS_BIT(COMPONENT_COLLIDER), 0};
+
+    // terrain: every entity is independent
+    struct TerrainStep step = {world, dt};
+    ecs_query_parallel(ecs, query, 2048, terrain_collision, &step);
+
+    // entities: flatten the boxes for the broadphase
+    uint32_t count = 0;
+    ecs_query_each(ecs, query, count_boxes, &count);
+    if (count > physics->capacity) {
+        memory_free(physics->boxes);
+        memory_free(physics->velocities);
+        physics->boxes = memory_alloc(count * sizeof(*physics->boxes), MEMORY_TAG_SIMULATION);
+        physics->velocities = memory_alloc(count * sizeof(*physics->velocities), MEMORY_TAG_SIMULATION);
+        if (physics->boxes == NULL || physics->velocities == NULL) {
+            FATAL("PHYSICS out of memory for %u boxes", count);
+            physics->capacity = 0;
+            return;
+        }
+        physics->capacity = count;
+    }
+    struct Gather gather = {physics, 0};
+    ecs_query_each(ecs, query, gather_boxes, &gather);
+
+    uint32_t pairs = broadphase_find_pairs(&physics->broadphase, physics->boxes, count);
+
+    // push apart horizontally, like mobs in a crowd. Few pairs, done on this thread
+    for (uint32_t p=0; p<pairs; p++) {
+        const struct PhysicsPair *pair = &physics->broadphase.pairs[p];
+        const struct Aabb *a = &physics->boxes[pair->a];
+        const struct Aabb *b = &physics->boxes[pair->b];
+        float dx = (b->min_x + b->max_x) * 0.5f - (a->min_x + a->max_x) * 0.5f;
+        float dz = (b->min_z + b->max_z) * 0.5f - (a->min_z + a->max_z) * 0.5f;
+        float distance = sqrtf(dx * dx + dz * dz);
+        if (distance < 0.01f) continue;
+
+        dx = dx / distance * PUSH_SPEED;
+        dz = dz / distance * PUSH_SPEED;
+        physics->velocities[pair->a]->x -= dx;
+        physics->velocities[pair->a]->z -= dz;
+        physics->velocities[pair->b]->x += dx;
+        physics->velocities[pair->b]->z += dz;
+    }
+}
+
+uint32_t physics_last_pairs_count(struct Physics *physics) {
+    return physics->broadphase.pairs_count;
+}
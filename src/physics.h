@@ -0,0 +1,78 @@
+// Entity collisions.
+//  - narrow phase against the terrain: the box is swept one axis at a time (y, x, z)
+//    against the solid blocks it crosses
+//  - broad phase between entities: spatial hash of the boxes, sorted in flat arrays,
+//    only boxes sharing a cell are tested
+
+#pragma once
+
+#include "world.h"
+#include "ecs.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct Aabb {
+    float min_x, min_y, min_z;
+    float max_x, max_y, max_z;
+};
+
+// returned by physics_sweep_voxels
+enum physics_hit {
+    PHYSICS_HIT_X      = 1,
+    PHYSICS_HIT_Y_DOWN = 2,     // landed
+    PHYSICS_HIT_Y_UP   = 4,
+    PHYSICS_HIT_Z      = 8
+};
+
+struct PhysicsPair {
+    uint32_t a, b;      // indices in the box array, a < b
+};
+
+#define BROADPHASE_JOBS 32     // the buckets are split in this many jobs
+
+struct BroadphaseEntry {
+    uint64_t cell;      // packed cell coordinates
+    uint32_t box;
+};
+
+struct PairList {
+    struct PhysicsPair *pairs;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+struct Broadphase {
+    float cell_size;
+    // scratch arrays kept between calls so a tick does not allocate
+    struct BroadphaseEntry *entries;
+    struct BroadphaseEntry *sorted;
+    uint32_t entries_capacity;
+    uint32_t *buckets;              // start of each bucket in sorted, buckets_count + 1 entries
+    uint32_t buckets_capacity;
+    uint32_t buckets_count;
+    struct PairList lists[BROADPHASE_JOBS];    // output of each job
+    struct PhysicsPair *pairs;
+    uint32_t pairs_count;
+    uint32_t pairs_capacity;
+};
+
+struct Physics;
+
+bool aabb_overlap(const struct Aabb *a, const struct Aabb *b);
+
+// Move the box by delta, clipping the movement against the solid blocks.
+// delta is updated with the movement actually done, returns enum physics_hit flags
+uint32_t physics_sweep_voxels(struct BlockAccess *access, struct Aabb *box, float delta[3]);
+
+void broadphase_init(struct Broadphase *broadphase, float cell_size);
+void broadphase_free(struct Broadphase *broadphase);
+// fills broadphase->pairs with every pair of overlapping boxes, each pair once
+uint32_t broadphase_find_pairs(struct Broadphase *broadphase, const struct Aabb *boxes, uint32_t count);
+
+struct Physics *physics_create();
+void physics_destroy(struct Physics *physics);
+// one physics tick for every entity with position, velocity and collider:
+// terrain collision in parallel, then entities pushing each other apart
+void physics_step(struct Physics *physics, struct Ecs *ecs, struct World *world, float dt);
+uint32_t physics_last_pairs_count(struct Physics *physics);
@@ -1,15 +1,60 @@
-//#include "pipeline.h"
+#include "pipeline.h"
 
 #include "log.h"
+#include "memory.h"
 #include "vulkan_if.h"
+#include "job.h"
+#include "mesher.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
-
-static VkPipelineLayout pipeline_layout;
+#include <stddef.h>
+#include <string.h>
+
+// open addressing table, way bigger than the number of variants we expect
+#define PIPELINE_REGISTRY_SIZE 64
+
+enum pipeline_state {
+    PIPELINE_EMPTY = 0,
+    PIPELINE_COMPILING,
+    PIPELINE_READY,
+    PIPELINE_FAILED
+};
+
+struct pipeline_entry {
+    uint64_t hash;
+    struct pipeline_desc desc;
+    VkPipeline handle;
+    int state;              // enum pipeline_state, written by the workers
+};
+
+static VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+static VkShaderModule vert_shader_module = VK_NULL_HANDLE;
+static VkShaderModule frag_shader_module = VK_NULL_HANDLE;
+
+// every SPIR-V file, read ahead by load_shaders()
+static const char *SHADER_FILES[] = {
+    "block.vert.spv",
+    "block.frag.spv",
+    "overlay.vert.spv",
+    "overlay.frag.spv",
+    "density.comp.spv",
+};
+#define SHADER_FILE_COUNT (sizeof(SHADER_FILES) / sizeof(SHADER_FILES[0]))
+
+struct shader_file {
+    unsigned char *code;    // NULL once taken
+    size_t size;
+};
+
+static struct shader_file shader_files[SHADER_FILE_COUNT];
+
+static struct pipeline_entry registry[PIPELINE_REGISTRY_SIZE];
+static struct JobCounter compile_jobs;
 
 VkRenderPass render_pass;
+VkPipelineLayout pipeline_layout;
 VkPipeline pipeline;
 
 unsigned char *load_file(const char *file_name, size_t *bytes_read ){
@@ -22,7 +67,7 @@ unsigned char *load_file(const char *file_name, size_t *bytes_read ){
         fseek(file, 0, SEEK_SET);   //go back to the begining
 
         if (size> 0) {
-            data = malloc (size * sizeof(unsigned char));
+            data = memory_alloc(size * sizeof(unsigned char), MEMORY_TAG_RENDERER);
 
             size_t count = fread(data, sizeof(unsigned char), size, file);
             *bytes_read =  count;
@@ -45,7 +90,29 @@ unsigned char *load_file(const char *file_name, size_t *bytes_read ){
     return data;
 }
 
-static VkShaderModule create_shader_module(const unsigned char *code, size_t size) {
+bool load_shaders() {
+    for (uint32_t i=0; i<SHADER_FILE_COUNT; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s%s", SHADERS_PATH, SHADER_FILES[i]);
+        shader_files[i].code = load_file(path, &shader_files[i].size);
+    }
+    return true;
+}
+
+unsigned char *load_shader(const char *name, size_t *size) {
+    for (uint32_t i=0; i<SHADER_FILE_COUNT; i++) {
+        if (strcmp(name, SHADER_FILES[i]) != 0 || shader_files[i].code == NULL) continue;
+        unsigned char *code = shader_files[i].code;
+        *size = shader_files[i].size;
+        shader_files[i].code = NULL;
+        return code;
+    }
+    char path[512];
+    snprintf(path, sizeof(path), "%s%s", SHADERS_PATH, name);
+    return load_file(path, size);
+}
+
+VkShaderModule create_shader_module(const unsigned char *code, size_t size) {
     VkShaderModuleCreateInfo create_info = {};
     create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     create_info.codeSize = size;
@@ -59,27 +126,71 @@ static VkShaderModule create_shader_module(const unsigned char *code, size_t siz
     return shader_module;
 }
 
-bool create_pipeline() {
-    size_t vert_shader_file_size;
-    size_t frag_shader_file_size;
-    unsigned char *vert_shader_file = load_file(SHADERS_PATH"triangle.vert.spv", &vert_shader_file_size);
-    unsigned char *frag_shader_file = load_file(SHADERS_PATH"triangle.frag.spv", &frag_shader_file_size);
-
-    INFO("FILE I/O vert. size:%d frag. size:%d", vert_shader_file_size, frag_shader_file_size);
-
-    // create a wrap around the shader files
-    VkShaderModule vert_shader_module = NULL;
-    VkShaderModule frag_shader_module = NULL; 
-    if ((vert_shader_module = create_shader_module(vert_shader_file, vert_shader_file_size)) == NULL) {
-        FATAL("Fail to create vertex shader");
-        return false;
+struct pipeline_desc pipeline_desc_for_pass(enum pipeline_pass pass) {
+    struct pipeline_desc desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.pass = pass;
+    desc.polygon_mode = VK_POLYGON_MODE_FILL;
+    desc.cull_mode = VK_CULL_MODE_BACK_BIT;
+    desc.blend_enable = VK_FALSE;
+    desc.alpha_cutoff = 0.0f;
+    desc.depth_write = VK_TRUE;
+    desc.depth_compare = VK_COMPARE_OP_GREATER_OR_EQUAL;
+    desc.color_write = VK_TRUE;
+
+    switch (pass) {
+    case PIPELINE_PASS_CUTOUT:
+        // leaves and such are visible from both sides
+        desc.cull_mode = VK_CULL_MODE_NONE;
+        desc.alpha_cutoff = 0.5f;
+        break;
+    case PIPELINE_PASS_TRANSLUCENT:
+        desc.cull_mode = VK_CULL_MODE_NONE;
+        desc.blend_enable = VK_TRUE;
+        // tested against the blocks but does not hide what is behind
+        desc.depth_write = VK_FALSE;
+        break;
+    case PIPELINE_PASS_WIREFRAME:
+        desc.polygon_mode = VK_POLYGON_MODE_LINE;
+        desc.cull_mode = VK_CULL_MODE_NONE;
+        break;
+    case PIPELINE_PASS_DEPTH:
+        desc.color_write = VK_FALSE;
+        break;
+    default:
+        break;
     }
+    return desc;
+}
 
-    if ((frag_shader_module = create_shader_module(frag_shader_file, frag_shader_file_size)) == NULL) {
-        FATAL("Fail to create fragment shader");
-        false;
+// FNV-1a over the raw bytes of the description
+static uint64_t hash_desc(const struct pipeline_desc *desc) {
+    const unsigned char *bytes = (const unsigned char *) desc;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i=0; i<sizeof(*desc); i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
     }
-    
+    return hash;
+}
+
+static VkPipeline build_pipeline(const struct pipeline_desc *desc) {
+    // The pass is baked into the shader through specialization constants,
+    // the driver strips the unused branches when the variant is compiled
+    VkSpecializationMapEntry spec_entries[2] = {};
+    spec_entries[0].constantID = 0;
+    spec_entries[0].offset = offsetof(struct pipeline_desc, pass);
+    spec_entries[0].size = sizeof(desc->pass);
+    spec_entries[1].constantID = 1;
+    spec_entries[1].offset = offsetof(struct pipeline_desc, alpha_cutoff);
+    spec_entries[1].size = sizeof(desc->alpha_cutoff);
+
+    VkSpecializationInfo spec_info = {};
+    spec_info.mapEntryCount = 2;
+    spec_info.pMapEntries = spec_entries;
+    spec_info.dataSize = sizeof(*desc);
+    spec_info.pData = desc;
+
     // To actually use the shaders we'll need to assign them to a specific pipeline stage through 
     // VkPipelineShaderStageCreateInfo structures as part of the actual pipeline creation process.
     VkPipelineShaderStageCreateInfo vert_shader_stage_info = {};
@@ -93,16 +204,35 @@ bool create_pipeline() {
     frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
     frag_shader_stage_info.module = frag_shader_module;
     frag_shader_stage_info.pName = "main";
+    frag_shader_stage_info.pSpecializationInfo = &spec_info;
 
     VkPipelineShaderStageCreateInfo shader_stages[] = {vert_shader_stage_info, frag_shader_stage_info};
 
     // Fixed function setup
+    // one struct BlockVertex per vertex: x y z block as 4 int16, face and size as 2 uint8
+    VkVertexInputBindingDescription binding = {};
+    binding.binding = 0;
+    binding.stride = sizeof(struct BlockVertex);
+    binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    VkVertexInputAttributeDescription attributes[2] = {};
+    attributes[0].location = 0;
+    attributes[0].binding = 0;
+    attributes[0].format = VK_FORMAT_R16G16B16A16_SINT;
+    attributes[0].offset = offsetof(struct BlockVertex, x);
+    attributes[1].location = 1;
+    attributes[1].binding = 0;
+    attributes[1].format = VK_FORMAT_R8G8_UINT;
+    attributes[1].offset = offsetof(struct BlockVertex, face);
+
     VkPipelineVertexInputStateCreateInfo  vertex_input_info = {};
     vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
     // Bindings: spacing between data and whether the data is per-vertex or per-instance
-    vertex_input_info.vertexBindingDescriptionCount = 0; 
+    vertex_input_info.vertexBindingDescriptionCount = 1; 
+    vertex_input_info.pVertexBindingDescriptions = &binding;
     // type of the attributes passed to the vertex shader, which binding to load them from and at which offset
-    vertex_input_info.vertexAttributeDescriptionCount = 0; 
+    vertex_input_info.vertexAttributeDescriptionCount = 2; 
+    vertex_input_info.pVertexAttributeDescriptions = attributes;
 
     VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
     input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -118,10 +248,11 @@ bool create_pipeline() {
     rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
     rasterizer.depthClampEnable = VK_FALSE;
     rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL; //The polygonMode determines how fragments are generated for geometry
+    rasterizer.polygonMode = desc->polygon_mode; //The polygonMode determines how fragments are generated for geometry
     rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    rasterizer.cullMode = desc->cull_mode;
+    // the faces are counter clockwise seen from outside, the projection flips y
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
     rasterizer.depthBiasEnable = VK_FALSE;
    
     VkPipelineMultisampleStateCreateInfo multisampling = {};
@@ -129,9 +260,26 @@ bool create_pipeline() {
     multisampling.sampleShadingEnable = VK_FALSE;
     multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
+    // reversed-Z: cleared to 0, nearer is greater
+    VkPipelineDepthStencilStateCreateInfo depth_stencil = {};
+    depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil.depthTestEnable = VK_TRUE;
+    depth_stencil.depthWriteEnable = desc->depth_write;
+    depth_stencil.depthCompareOp = desc->depth_compare;
+    depth_stencil.depthBoundsTestEnable = VK_FALSE;
+    depth_stencil.stencilTestEnable = VK_FALSE;
+
     VkPipelineColorBlendAttachmentState color_blend_attachment = {};
-    color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    color_blend_attachment.blendEnable = VK_FALSE;
+    if (desc->color_write) {
+        color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    }
+    color_blend_attachment.blendEnable = desc->blend_enable;
+    color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+    color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
 
     VkPipelineColorBlendStateCreateInfo color_blending = {};
     color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
@@ -155,26 +303,18 @@ bool create_pipeline() {
     dynamic_state.dynamicStateCount = 2;
     dynamic_state.pDynamicStates = dynamic_states;
 
-    VkPipelineLayoutCreateInfo pipeline_layout_info = {};
-    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipeline_layout_info.setLayoutCount = 0;
-    pipeline_layout_info.pushConstantRangeCount = 0;
-
-    if (vkCreatePipelineLayout(logical_device, &pipeline_layout_info, NULL, &pipeline_layout) != VK_SUCCESS) {
-        FATAL("Failed to create pipeline layout");
-        return false;
-    }
-
     // finally pipline creation
     VkGraphicsPipelineCreateInfo pipeline_info = {};
     pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipeline_info.stageCount = 2;
+    // the depth pass only needs the vertex shader
+    pipeline_info.stageCount = desc->color_write ? 2 : 1;
     pipeline_info.pStages = shader_stages;
     pipeline_info.pVertexInputState = &vertex_input_info;
     pipeline_info.pInputAssemblyState = &input_assembly;
     pipeline_info.pViewportState = &viewport_state;
     pipeline_info.pRasterizationState = &rasterizer;
     pipeline_info.pMultisampleState = &multisampling;
+    pipeline_info.pDepthStencilState = &depth_stencil;
     pipeline_info.pColorBlendState = &color_blending;
     pipeline_info.pDynamicState = &dynamic_state;
     pipeline_info.layout = pipeline_layout;
@@ -182,22 +322,181 @@ bool create_pipeline() {
     pipeline_info.subpass = 0;
     pipeline_info.basePipelineHandle = VK_NULL_HANDLE; 
 
-    if (vkCreateGraphicsPipelines(logical_device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &pipeline) != VK_SUCCESS) {
-        FATAL("Failed to create graphics pipeline!");
+    // the pipeline cache is internally synchronized, workers can share it
+    VkPipeline handle = VK_NULL_HANDLE;
+    if (vkCreateGraphicsPipelines(logical_device, pipeline_cache, 1, &pipeline_info, NULL, &handle) != VK_SUCCESS) {
+        return VK_NULL_HANDLE;
+    }
+    return handle;
+}
+
+static void compile_job(void *arg) {
+    struct pipeline_entry *entry = arg;
+    entry->handle = build_pipeline(&entry->desc);
+    int state = entry->handle != VK_NULL_HANDLE ? PIPELINE_READY : PIPELINE_FAILED;
+    __atomic_store_n(&entry->state, state, __ATOMIC_RELEASE);
+    if (state == PIPELINE_FAILED) {
+        ERROR("Failed to create pipeline variant for pass %d", entry->desc.pass);
+    }
+}
+
+// One thread inserts, the init step of the pipelines then the main thread. The
+// workers only fill handle and state of their own entry, the state is read and
+// written atomically since they store it while the main thread looks it up
+static struct pipeline_entry *registry_find(const struct pipeline_desc *desc, uint64_t hash, bool insert) {
+    uint32_t slot = (uint32_t) hash & (PIPELINE_REGISTRY_SIZE - 1);
+    for (int i=0; i<PIPELINE_REGISTRY_SIZE; i++) {
+        struct pipeline_entry *entry = &registry[(slot + i) & (PIPELINE_REGISTRY_SIZE - 1)];
+        if (__atomic_load_n(&entry->state, __ATOMIC_ACQUIRE) == PIPELINE_EMPTY) {
+            if (!insert) return NULL;
+            entry->hash = hash;
+            entry->desc = *desc;
+            entry->handle = VK_NULL_HANDLE;
+            __atomic_store_n(&entry->state, PIPELINE_COMPILING, __ATOMIC_RELEASE);
+            return entry;
+        }
+        if (entry->hash == hash && memcmp(&entry->desc, desc, sizeof(*desc)) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// wireframe needs fillModeNonSolid, fall back to fill when the device does not have it
+static struct pipeline_desc sanitize_desc(const struct pipeline_desc *desc) {
+    struct pipeline_desc out = *desc;
+    if (out.polygon_mode != VK_POLYGON_MODE_FILL && !enabled_device_features.fillModeNonSolid) {
+        out.polygon_mode = VK_POLYGON_MODE_FILL;
+    }
+    return out;
+}
+
+static struct pipeline_entry *request_variant(const struct pipeline_desc *requested) {
+    struct pipeline_desc desc = sanitize_desc(requested);
+    uint64_t hash = hash_desc(&desc);
+
+    struct pipeline_entry *entry = registry_find(&desc, hash, false);
+    if (entry != NULL) return entry;
+
+    entry = registry_find(&desc, hash, true);
+    if (entry == NULL) {
+        ERROR("Pipeline registry is full");
+        return NULL;
+    }
+    job_submit(compile_job, entry, &compile_jobs);
+    return entry;
+}
+
+void pipeline_prewarm(const struct pipeline_desc *descs, uint32_t count) {
+    for (uint32_t i=0; i<count; i++) {
+        request_variant(&descs[i]);
+    }
+}
+
+VkPipeline pipeline_get(const struct pipeline_desc *desc) {
+    struct pipeline_entry *entry = request_variant(desc);
+    if (entry != NULL && __atomic_load_n(&entry->state, __ATOMIC_ACQUIRE) == PIPELINE_READY) {
+        return entry->handle;
+    }
+    return pipeline;
+}
+
+bool create_pipeline() {
+    size_t vert_shader_file_size;
+    size_t frag_shader_file_size;
+    unsigned char *vert_shader_file = load_shader("block.vert.spv", &vert_shader_file_size);
+    unsigned char *frag_shader_file = load_shader("block.frag.spv", &frag_shader_file_size);
+
+    INFO("FILE I/O vert. size:%d frag. size:%d", vert_shader_file_size, frag_shader_file_size);
+
+    // create a wrap around the shader files, they are kept alive until destroy_pipeline()
+    // because the variants are compiled later on the worker threads
+    if ((vert_shader_module = create_shader_module(vert_shader_file, vert_shader_file_size)) == NULL) {
+        FATAL("Fail to create vertex shader");
         return false;
     }
 
+    if ((frag_shader_module = create_shader_module(frag_shader_file, frag_shader_file_size)) == NULL) {
+        FATAL("Fail to create fragment shader");
+        return false;
+    }
+    memory_free(vert_shader_file);
+    memory_free(frag_shader_file);
 
-    vkDestroyShaderModule(logical_device, vert_shader_module, NULL);
-    vkDestroyShaderModule(logical_device, frag_shader_module, NULL);
-    free(vert_shader_file);
-    free(frag_shader_file);
+    // 80 bytes, within the 128 every device has
+    VkPushConstantRange push_range = {};
+    push_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    push_range.offset = 0;
+    push_range.size = sizeof(struct block_push_constants);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 0;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_range;
+
+    if (vkCreatePipelineLayout(logical_device, &pipeline_layout_info, NULL, &pipeline_layout) != VK_SUCCESS) {
+        FATAL("Failed to create pipeline layout");
+        return false;
+    }
+
+    VkPipelineCacheCreateInfo cache_info = {};
+    cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    if (vkCreatePipelineCache(logical_device, &cache_info, NULL, &pipeline_cache) != VK_SUCCESS) {
+        WARNING("Failed to create pipeline cache");
+        pipeline_cache = VK_NULL_HANDLE;
+    }
+
+    // the opaque variant is the fallback, it is built right away
+    struct pipeline_desc fallback = pipeline_desc_for_pass(PIPELINE_PASS_OPAQUE);
+    struct pipeline_entry *entry = registry_find(&fallback, hash_desc(&fallback), true);
+    entry->handle = build_pipeline(&fallback);
+    if (entry->handle == VK_NULL_HANDLE) {
+        FATAL("Failed to create graphics pipeline!");
+        entry->state = PIPELINE_FAILED;
+        return false;
+    }
+    entry->state = PIPELINE_READY;
+    pipeline = entry->handle;
+
+    // everything else compiles in the background
+    struct pipeline_desc variants[PIPELINE_PASS_COUNT + 1];
+    for (int i=0; i<PIPELINE_PASS_COUNT; i++) {
+        variants[i] = pipeline_desc_for_pass(i);
+    }
+    // the opaque pass after a depth pre-pass only shades what is in front
+    variants[PIPELINE_PASS_COUNT] = pipeline_desc_for_pass(PIPELINE_PASS_OPAQUE);
+    variants[PIPELINE_PASS_COUNT].depth_write = VK_FALSE;
+    variants[PIPELINE_PASS_COUNT].depth_compare = VK_COMPARE_OP_EQUAL;
+    pipeline_prewarm(variants, PIPELINE_PASS_COUNT + 1);
     return true;
 }
 
 void destroy_pipeline() {
-    vkDestroyPipeline(logical_device, pipeline, NULL);
+    // variants may still be compiling
+    job_wait(&compile_jobs);
+
+    for (int i=0; i<PIPELINE_REGISTRY_SIZE; i++) {
+        if (registry[i].state == PIPELINE_READY) {
+            vkDestroyPipeline(logical_device, registry[i].handle, NULL);
+        }
+        memset(&registry[i], 0, sizeof(registry[i]));
+    }
+    pipeline = VK_NULL_HANDLE;
+
+    if (pipeline_cache != VK_NULL_HANDLE) {
+        vkDestroyPipelineCache(logical_device, pipeline_cache, NULL);
+        pipeline_cache = VK_NULL_HANDLE;
+    }
+    vkDestroyShaderModule(logical_device, vert_shader_module, NULL);
+    vkDestroyShaderModule(logical_device, frag_shader_module, NULL);
     vkDestroyPipelineLayout(logical_device, pipeline_layout, NULL);
+
+    // read ahead but never used, the density shader without GPU generation
+    for (uint32_t i=0; i<SHADER_FILE_COUNT; i++) {
+        memory_free(shader_files[i].code);
+        shader_files[i].code = NULL;
+    }
 }
 
 
@@ -216,33 +515,60 @@ bool create_render_passes() {
     color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
+    // only used within the frame, never stored
+    VkAttachmentDescription depth_attachment = {};
+    depth_attachment.format = depth_format;
+    depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
     // Subpasses and attachment references
     VkAttachmentReference color_attachment_ref = {};
     color_attachment_ref.attachment = 0;
     color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+    VkAttachmentReference depth_attachment_ref = {};
+    depth_attachment_ref.attachment = 1;
+    depth_attachment_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
     VkSubpassDescription subpass = {};
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &color_attachment_ref;
-
-
-    VkSubpassDependency dependency = {};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    subpass.pDepthStencilAttachment = &depth_attachment_ref;
+
+
+    VkSubpassDependency dependencies[2] = {};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    // the depth image is shared by the swap chain images, the clear waits for the last frame's tests
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    // the color writes and the transition to the present layout happen before
+    // the readback copies the image (readback_record)
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    VkAttachmentDescription attachments[2] = {color_attachment, depth_attachment};
 
     VkRenderPassCreateInfo render_pass_info = {};
     render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    render_pass_info.attachmentCount = 1;
-    render_pass_info.pAttachments = &color_attachment;
+    render_pass_info.attachmentCount = 2;
+    render_pass_info.pAttachments = attachments;
     render_pass_info.subpassCount = 1;
     render_pass_info.pSubpasses = &subpass;
-    render_pass_info.dependencyCount = 1;
-    render_pass_info.pDependencies = &dependency;
+    render_pass_info.dependencyCount = 2;
+    render_pass_info.pDependencies = dependencies;
 
     if (vkCreateRenderPass(logical_device, &render_pass_info, NULL, &render_pass) != VK_SUCCESS) {
         FATAL("failed to create render pass!");
@@ -2,14 +2,65 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
 
-extern VkPipeline pipeline;
+// fed to the fragment shader as specialization constant 0 so the shader
+// does not branch on the pass at runtime
+enum pipeline_pass {
+    PIPELINE_PASS_OPAQUE = 0,
+    PIPELINE_PASS_CUTOUT,
+    PIPELINE_PASS_TRANSLUCENT,
+    PIPELINE_PASS_WIREFRAME,
+    PIPELINE_PASS_DEPTH,        // depth pre-pass of the opaque blocks, no fragment shader
+    PIPELINE_PASS_COUNT
+};
+
+// Everything that makes a pipeline variant different from another one.
+// Only 32 bit fields so the struct has no padding and can be hashed as raw bytes.
+struct pipeline_desc {
+    uint32_t pass;          // enum pipeline_pass
+    uint32_t polygon_mode;  // VkPolygonMode
+    uint32_t cull_mode;     // VkCullModeFlags
+    uint32_t blend_enable;
+    float alpha_cutoff;     // specialization constant 1, used by the cutout pass
+    uint32_t depth_write;
+    uint32_t depth_compare; // VkCompareOp, depth is reversed: near is 1, far is 0
+    uint32_t color_write;   // false drops the fragment shader too
+};
+
+// what the block shaders get, positions are relative to the camera so they keep
+// their precision far away from the origin
+struct block_push_constants {
+    float view_proj[16];    // column major
+    float origin[4];        // section origin minus the camera position
+};
+
+extern VkPipeline pipeline;     // the fallback (opaque) pipeline, always ready after create_pipeline()
 extern VkRenderPass render_pass;
+extern VkPipelineLayout pipeline_layout;
 
 unsigned char *load_file(const char *file_name, size_t *bytes_read );
+// Reads the SPIR-V of every shader, blocking file I/O: init_vulkan() runs it on
+// a worker while the device is created. Always true, a missing file fails later
+bool load_shaders();
+// name within SHADERS_PATH. The copy read ahead when there is one (each file is
+// taken once), else read now. NULL on failure, the caller frees it
+unsigned char *load_shader(const char *name, size_t *size);
+// NULL on failure, code is SPIR-V as loaded by load_file()
+VkShaderModule create_shader_module(const unsigned char *code, size_t size);
 
 bool create_pipeline();
 void destroy_pipeline();
 
 bool create_render_passes();
-void destroy_render_passes();
\ No newline at end of file
+void destroy_render_passes();
+
+// default state for each block pass
+struct pipeline_desc pipeline_desc_for_pass(enum pipeline_pass pass);
+
+// Queue the variants on the worker threads, call it at load time
+void pipeline_prewarm(const struct pipeline_desc *descs, uint32_t count);
+// Never blocks: if the variant is not compiled yet it is queued (first use)
+// and the fallback pipeline is returned until it is ready
+VkPipeline pipeline_get(const struct pipeline_desc *desc);
@@ -0,0 +1,28 @@
+#include "player.h"
+
+#include <math.h>
+
+#define MAX_PITCH 1.55f    // just short of straight up or down
+
+void player_init(struct Player *player, float x, float y, float z) {
+    *player = (struct Player) {.x = x, .y = y, .z = z};
+}
+
+void player_update(struct Player *player, const struct InputState *input, float dt) {
+    player->yaw -= (float) input->cursor_dx * PLAYER_SENSITIVITY;
+    player->pitch -= (float) input->cursor_dy * PLAYER_SENSITIVITY;
+    if (player->pitch > MAX_PITCH) player->pitch = MAX_PITCH;
+    if (player->pitch < -MAX_PITCH) player->pitch = -MAX_PITCH;
+
+    float forward = (float) input->keys[INPUT_KEY_W] - (float) input->keys[INPUT_KEY_S];
+    float right = (float) input->keys[INPUT_KEY_D] - (float) input->keys[INPUT_KEY_A];
+    float up = (float) input->keys[INPUT_KEY_SPACE] - (float) input->keys[INPUT_KEY_LEFT_SHIFT];
+    float speed = PLAYER_SPEED * (input->keys[INPUT_KEY_LEFT_CONTROL] ? PLAYER_SPRINT : 1.0f) * dt;
+
+    // flying: forward follows the pitch, strafing stays level
+    float sin_yaw = sinf(player->yaw), cos_yaw = cosf(player->yaw);
+    float cos_pitch = cosf(player->pitch);
+    player->x += (sin_yaw * cos_pitch * forward - cos_yaw * right) * speed;
+    player->z += (cos_yaw * cos_pitch * forward + sin_yaw * right) * speed;
+    player->y += (sinf(player->pitch) * forward + up) * speed;
+}
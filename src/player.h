@@ -0,0 +1,20 @@
+// The local player: a free flying camera moved by the input of each tick.
+// Only reads the InputState, so a replayed recording moves it exactly the same.
+
+#pragma once
+
+#include "input.h"
+
+#define PLAYER_SPEED        10.0f   // blocks/s
+#define PLAYER_SPRINT       4.0f    // speed multiplier with control held
+#define PLAYER_SENSITIVITY  0.0025f // radians per pixel of cursor movement
+
+struct Player {
+    float x, y, z;      // eyes
+    float yaw;          // radians, 0 looks toward +z
+    float pitch;        // radians, positive looks up
+};
+
+void player_init(struct Player *player, float x, float y, float z);
+// WASD moves along the view, space and shift go up and down, the cursor looks around
+void player_update(struct Player *player, const struct InputState *input, float dt);
@@ -0,0 +1,536 @@
+#include "protocol.h"
+#include "compress.h"
+#include "log.h"
+#include "memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define RECEIVE_CHUNK 65536
+
+bool buffer_reserve(struct Buffer *buffer, size_t extra) {
+    if (buffer->size + extra <= buffer->capacity) return true;
+    size_t capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+    while (capacity < buffer->size + extra) capacity *= 2;
+    uint8_t *data = memory_realloc(buffer->data, capacity, MEMORY_TAG_IO);
+    if (data == NULL) {
+        FATAL("PROTOCOL out of memory growing a buffer to %zu bytes", capacity);
+        return false;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+void buffer_free(struct Buffer *buffer) {
+    memory_free(buffer->data);
+    *buffer = (struct Buffer) {0};
+}
+
+void write_bytes(struct Buffer *buffer, const void *data, size_t size) {
+    if (!buffer_reserve(buffer, size)) return;
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+void write_u8(struct Buffer *buffer, uint8_t v) {
+    write_bytes(buffer, &v, 1);
+}
+
+void write_varint(struct Buffer *buffer, uint64_t v) {
+    uint8_t bytes[10];
+    int count = 0;
+    do {
+        uint8_t byte = v & 0x7F;
+        v >>= 7;
+        bytes[count++] = byte | (v ? 0x80 : 0);
+    } while (v);
+    write_bytes(buffer, bytes, (size_t) count);
+}
+
+void write_svarint(struct Buffer *buffer, int64_t v) {
+    write_varint(buffer, ((uint64_t) v << 1) ^ (uint64_t) (v >> 63));
+}
+
+void write_f32(struct Buffer *buffer, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    uint8_t bytes[4] = {(uint8_t) bits, (uint8_t) (bits >> 8), (uint8_t) (bits >> 16), (uint8_t) (bits >> 24)};
+    write_bytes(buffer, bytes, 4);
+}
+
+const uint8_t *read_bytes(struct Reader *reader, size_t size) {
+    if (reader->error || size > reader->size - reader->position) {
+        reader->error = true;
+        return NULL;
+    }
+    const uint8_t *p = reader->data + reader->position;
+    reader->position += size;
+    return p;
+}
+
+uint8_t read_u8(struct Reader *reader) {
+    const uint8_t *p = read_bytes(reader, 1);
+    return p ? *p : 0;
+}
+
+uint64_t read_varint(struct Reader *reader) {
+    uint64_t v = 0;
+    for (int shift=0; shift<64; shift+=7) {
+        uint8_t byte = read_u8(reader);
+        v |= (uint64_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return v;
+    }
+    reader->error = true;
+    return 0;
+}
+
+int64_t read_svarint(struct Reader *reader) {
+    uint64_t v = read_varint(reader);
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+float read_f32(struct Reader *reader) {
+    const uint8_t *p = read_bytes(reader, 4);
+    if (p == NULL) return 0.0f;
+    uint32_t bits = p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+    float v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+size_t packet_begin(struct Buffer *buffer, enum packet_type type) {
+    size_t start = buffer->size;
+    uint8_t header[PACKET_HEADER] = {0, 0, 0, (uint8_t) type};
+    write_bytes(buffer, header, PACKET_HEADER);
+    return start;
+}
+
+void packet_end(struct Buffer *buffer, size_t start) {
+    // the length counts the type byte and the payload
+    size_t length = buffer->size - start - 3;
+    if (length > PACKET_MAX_SIZE) {
+        ERROR("PROTOCOL packet of %zu bytes is too big, dropped", length);
+        buffer->size = start;
+        return;
+    }
+    buffer->data[start] = (uint8_t) length;
+    buffer->data[start + 1] = (uint8_t) (length >> 8);
+    buffer->data[start + 2] = (uint8_t) (length >> 16);
+}
+
+void connection_init(struct Connection *connection, net_socket_t socket) {
+    *connection = (struct Connection) {0};
+    connection->socket = socket;
+}
+
+void connection_close(struct Connection *connection) {
+    net_close(connection->socket);
+    connection->socket = NET_INVALID_SOCKET;
+    connection->closed = true;
+    buffer_free(&connection->out);
+    buffer_free(&connection->in);
+}
+
+bool connection_flush(struct Connection *connection) {
+    if (connection->closed) return false;
+    size_t sent_total = 0;
+    while (sent_total < connection->out.size) {
+        int64_t sent = net_send(connection->socket, connection->out.data + sent_total, connection->out.size - sent_total);
+        if (sent < 0) {
+            connection->closed = true;
+            return false;
+        }
+        if (sent == 0) break;   // the socket buffer is full, try again next tick
+        sent_total += (size_t) sent;
+    }
+    memmove(connection->out.data, connection->out.data + sent_total, connection->out.size - sent_total);
+    connection->out.size -= sent_total;
+    connection->bytes_sent += sent_total;
+    return true;
+}
+
+bool connection_receive(struct Connection *connection) {
+    if (connection->closed) return false;
+
+    // drop what was parsed already
+    if (connection->in_position > 0) {
+        memmove(connection->in.data, connection->in.data + connection->in_position, connection->in.size - connection->in_position);
+        connection->in.size -= connection->in_position;
+        connection->in_position = 0;
+    }
+
+    for (;;) {
+        if (!buffer_reserve(&connection->in, RECEIVE_CHUNK)) return false;
+        int64_t received = net_recv(connection->socket, connection->in.data + connection->in.size, RECEIVE_CHUNK);
+        if (received < 0) {
+            connection->closed = true;
+            return false;
+        }
+        if (received == 0) return true;
+        connection->in.size += (size_t) received;
+        connection->bytes_received += (uint64_t) received;
+    }
+}
+
+bool connection_next_packet(struct Connection *connection, uint8_t *type, struct Reader *payload) {
+    size_t available = connection->in.size - connection->in_position;
+    if (available < PACKET_HEADER) return false;
+
+    const uint8_t *p = connection->in.data + connection->in_position;
+    size_t length = p[0] | (size_t) p[1] << 8 | (size_t) p[2] << 16;
+    if (length == 0) {
+        connection->closed = true;
+        return false;
+    }
+    if (available < 3 + length) return false;
+
+    *type = p[3];
+    *payload = (struct Reader) {p + PACKET_HEADER, length - 1, 0, false};
+    connection->in_position += 3 + length;
+    return true;
+}
+
+
+static int palette_bits(uint32_t count) {
+    int bits = 0;
+    while ((1u << bits) < count) bits++;
+    return bits;
+}
+
+// palette then the indices packed with the fewest bits, least significant first
+static void write_section(struct Buffer *buffer, const struct Section *section) {
+    if (section->blocks == NULL) {
+        write_varint(buffer, 1);
+        write_varint(buffer, section->single);
+        return;
+    }
+
+    // few distinct blocks in practice, a linear search with the last hit first is enough
+    block_t palette[SECTION_VOLUME];
+    uint16_t indices[SECTION_VOLUME];
+    uint32_t count = 0, last = 0;
+    for (int i=0; i<SECTION_VOLUME; i++) {
+        block_t block = section->blocks[i];
+        if (count == 0 || palette[last] != block) {
+            last = 0;
+            while (last < count && palette[last] != block) last++;
+            if (last == count) palette[count++] = block;
+        }
+        indices[i] = (uint16_t) last;
+    }
+
+    write_varint(buffer, count);
+    for (uint32_t i=0; i<count; i++) write_varint(buffer, palette[i]);
+
+    int bits = palette_bits(count);
+    if (bits == 0) return;
+    size_t bytes = (SECTION_VOLUME * (size_t) bits + 7) / 8;
+    if (!buffer_reserve(buffer, bytes)) return;
+    uint8_t *out = buffer->data + buffer->size;
+    memset(out, 0, bytes);
+    size_t bit = 0;
+    for (int i=0; i<SECTION_VOLUME; i++, bit+=(size_t) bits) {
+        uint32_t v = (uint32_t) indices[i] << (bit & 7);
+        size_t byte = bit >> 3;
+        // bits <= 12, so a value spans at most 3 bytes
+        out[byte] |= (uint8_t) v;
+        if (byte + 1 < bytes) out[byte + 1] |= (uint8_t) (v >> 8);
+        if (byte + 2 < bytes) out[byte + 2] |= (uint8_t) (v >> 16);
+    }
+    buffer->size += bytes;
+}
+
+static bool read_section(struct Reader *reader, struct Section *section) {
+    uint32_t count = (uint32_t) read_varint(reader);
+    if (reader->error || count == 0 || count > SECTION_VOLUME) return false;
+
+    block_t palette[SECTION_VOLUME];
+    for (uint32_t i=0; i<count; i++) palette[i] = (block_t) read_varint(reader);
+    if (reader->error) return false;
+    if (count == 1) {
+        section_fill(section, palette[0]);
+        return true;
+    }
+
+    int bits = palette_bits(count);
+    size_t bytes = (SECTION_VOLUME * (size_t) bits + 7) / 8;
+    const uint8_t *in = read_bytes(reader, bytes);
+    if (in == NULL) return false;
+
+    block_t *blocks = section_write_blocks(section);
+    if (blocks == NULL) return false;
+    uint32_t mask = (1u << bits) - 1;
+    size_t bit = 0;
+    for (int i=0; i<SECTION_VOLUME; i++, bit+=(size_t) bits) {
+        size_t byte = bit >> 3;
+        uint32_t v = in[byte];
+        if (byte + 1 < bytes) v |= (uint32_t) in[byte + 1] << 8;
+        if (byte + 2 < bytes) v |= (uint32_t) in[byte + 2] << 16;
+        uint32_t index = (v >> (bit & 7)) & mask;
+        if (index >= count) return false;
+        blocks[i] = palette[index];
+    }
+    return true;
+}
+
+void protocol_write_column(struct Buffer *out, const struct Section *sections) {
+    // mask of the sections that are not all air, then those sections
+    uint32_t mask = 0;
+    for (int s=0; s<CHUNK_SECTIONS; s++) {
+        if (sections[s].blocks != NULL || sections[s].single != BLOCK_AIR) mask |= 1u << s;
+    }
+    write_varint(out, mask);
+    for (int s=0; s<CHUNK_SECTIONS; s++) {
+        if (mask & (1u << s)) write_section(out, &sections[s]);
+    }
+}
+
+bool protocol_read_column(struct Reader *reader, struct Section *sections) {
+    uint32_t mask = (uint32_t) read_varint(reader);
+    if (reader->error) return false;
+    for (int s=0; s<CHUNK_SECTIONS; s++) {
+        if (!(mask & (1u << s))) {
+            section_fill(&sections[s], BLOCK_AIR);
+        } else if (!read_section(reader, &sections[s])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the column coordinates then scratch compressed, with its size
+static void write_compressed(struct Buffer *out, enum packet_type type, const struct Chunk *chunk, const struct Buffer *scratch) {
+    size_t start = packet_begin(out, type);
+    write_svarint(out, chunk->x);
+    write_svarint(out, chunk->z);
+    write_varint(out, scratch->size);
+    size_t bound = compress_bound(scratch->size);
+    if (!buffer_reserve(out, bound)) {
+        out->size = start;
+        return;
+    }
+    out->size += compress_block(scratch->data, scratch->size, out->data + out->size, bound);
+    packet_end(out, start);
+}
+
+// the other way, the payload uncompressed goes in scratch and column reads it
+static bool read_compressed(struct Reader *payload, int32_t *x, int32_t *z, struct Buffer *scratch, struct Reader *column) {
+    *x = (int32_t) read_svarint(payload);
+    *z = (int32_t) read_svarint(payload);
+    size_t size = (size_t) read_varint(payload);
+    if (payload->error || size > PACKET_MAX_SIZE) return false;
+
+    const uint8_t *compressed = read_bytes(payload, payload->size - payload->position);
+    scratch->size = 0;
+    if (!buffer_reserve(scratch, size)) return false;
+    if (!decompress_block(compressed, payload->size - (size_t) (compressed - payload->data), scratch->data, size)) {
+        ERROR("PROTOCOL corrupt chunk %d,%d", *x, *z);
+        return false;
+    }
+    *column = (struct Reader) {scratch->data, size, 0, false};
+    return true;
+}
+
+void protocol_write_chunk(struct Buffer *out, const struct Chunk *chunk, struct Buffer *scratch) {
+    scratch->size = 0;
+    protocol_write_column(scratch, chunk->sections);
+    write_compressed(out, PACKET_CHUNK, chunk, scratch);
+}
+
+struct Chunk *protocol_read_chunk(struct Reader *payload, struct World *world, struct Buffer *scratch) {
+    int32_t x, z;
+    struct Reader column;
+    if (!read_compressed(payload, &x, &z, scratch, &column)) return NULL;
+
+    struct Chunk *chunk = world_create_chunk(world, x, z);
+    if (chunk == NULL) return NULL;
+    if (!protocol_read_column(&column, chunk->sections)) {
+        ERROR("PROTOCOL bad column %d,%d", x, z);
+        world_remove_chunk(world, x, z);
+        return NULL;
+    }
+    chunk->dirty = (1u << CHUNK_SECTIONS) - 1;
+    chunk->recount = (1u << CHUNK_SECTIONS) - 1;
+    return chunk;
+}
+
+void protocol_write_sections(struct Buffer *out, const struct Chunk *chunk, uint32_t mask, struct Buffer *scratch) {
+    scratch->size = 0;
+    write_varint(scratch, mask);
+    for (int s=0; s<CHUNK_SECTIONS; s++) {
+        if (mask & (1u << s)) write_section(scratch, &chunk->sections[s]);
+    }
+    write_compressed(out, PACKET_SECTIONS, chunk, scratch);
+}
+
+bool protocol_read_sections(struct Reader *payload, struct World *world, struct Buffer *scratch) {
+    int32_t x, z;
+    struct Reader column;
+    if (!read_compressed(payload, &x, &z, scratch, &column)) return false;
+    uint32_t mask = (uint32_t) read_varint(&column);
+    if (column.error || mask >> CHUNK_SECTIONS != 0) return false;
+
+    // unloaded since, nothing to update
+    struct Chunk *chunk = world_get_chunk(world, x, z);
+    if (chunk == NULL) return true;
+    for (int s=0; s<CHUNK_SECTIONS; s++) {
+        if (!(mask & (1u << s))) continue;
+        if (!read_section(&column, &chunk->sections[s])) {
+            ERROR("PROTOCOL bad section %d of %d,%d", s, x, z);
+            return false;
+        }
+    }
+    chunk->dirty |= mask;
+    chunk->recount |= mask;
+    return true;
+}
+
+
+struct Snapshot *snapshot_history_get(struct SnapshotHistory *history, uint32_t sequence) {
+    if (sequence == 0) return NULL;
+    struct Snapshot *snapshot = &history->snapshots[sequence % SNAPSHOT_HISTORY];
+    return snapshot->sequence == sequence ? snapshot : NULL;
+}
+
+struct Snapshot *snapshot_history_slot(struct SnapshotHistory *history, uint32_t sequence) {
+    struct Snapshot *snapshot = &history->snapshots[sequence % SNAPSHOT_HISTORY];
+    snapshot->sequence = sequence;
+    snapshot->count = 0;
+    return snapshot;
+}
+
+void snapshot_history_free(struct SnapshotHistory *history) {
+    for (int i=0; i<SNAPSHOT_HISTORY; i++) {
+        memory_free(history->snapshots[i].states);
+    }
+    *history = (struct SnapshotHistory) {0};
+}
+
+bool snapshot_push(struct Snapshot *snapshot, const struct EntityState *state) {
+    if (snapshot->count == snapshot->capacity) {
+        uint32_t capacity = snapshot->capacity ? snapshot->capacity * 2 : 256;
+        struct EntityState *states = memory_realloc(snapshot->states, capacity * sizeof(*states), MEMORY_TAG_IO);
+        if (states == NULL) {
+            FATAL("PROTOCOL out of memory growing a snapshot");
+            return false;
+        }
+        snapshot->states = states;
+        snapshot->capacity = capacity;
+    }
+    snapshot->states[snapshot->count++] = *state;
+    return true;
+}
+
+static int compare_states(const void *a, const void *b) {
+    uint64_t ia = ((const struct EntityState *) a)->id;
+    uint64_t ib = ((const struct EntityState *) b)->id;
+    return ia < ib ? -1 : ia > ib;
+}
+
+void snapshot_sort(struct Snapshot *snapshot) {
+    qsort(snapshot->states, snapshot->count, sizeof(*snapshot->states), compare_states);
+}
+
+#define ENTITY_FIELDS   6
+#define ENTITY_REMOVED  0x80
+
+static void state_fields(const struct EntityState *state, int32_t fields[ENTITY_FIELDS]) {
+    fields[0] = state->x;  fields[1] = state->y;  fields[2] = state->z;
+    fields[3] = state->vx; fields[4] = state->vy; fields[5] = state->vz;
+}
+
+static void write_entity(struct Buffer *out, uint64_t *last_id, const struct EntityState *state, const struct EntityState *base) {
+    int32_t now[ENTITY_FIELDS], before[ENTITY_FIELDS] = {0};
+    state_fields(state, now);
+    if (base != NULL) state_fields(base, before);
+
+    uint8_t mask = 0;
+    for (int i=0; i<ENTITY_FIELDS; i++) {
+        if (now[i] != before[i]) mask |= (uint8_t) (1u << i);
+    }
+    if (base != NULL && mask == 0) return;  // unchanged since the baseline
+
+    write_varint(out, state->id - *last_id);
+    *last_id = state->id;
+    write_u8(out, mask);
+    for (int i=0; i<ENTITY_FIELDS; i++) {
+        if (mask & (1u << i)) write_svarint(out, (int64_t) now[i] - before[i]);
+    }
+}
+
+void protocol_write_entities(struct Buffer *out, const struct Snapshot *current, const struct Snapshot *baseline) {
+    size_t start = packet_begin(out, PACKET_ENTITIES);
+    write_varint(out, current->sequence);
+    write_varint(out, baseline ? baseline->sequence : 0);
+
+    // records: id (delta from the previous record), field mask, changed fields as deltas.
+    // Both snapshots are sorted by id, walk them together
+    uint64_t last_id = 0;
+    uint32_t i = 0, j = 0;
+    uint32_t base_count = baseline ? baseline->count : 0;
+    while (i < current->count || j < base_count) {
+        const struct EntityState *now = i < current->count ? &current->states[i] : NULL;
+        const struct EntityState *base = j < base_count ? &baseline->states[j] : NULL;
+
+        if (base == NULL || (now != NULL && now->id < base->id)) {
+            write_entity(out, &last_id, now, NULL);    // new since the baseline
+            i++;
+        } else if (now == NULL || base->id < now->id) {
+            write_varint(out, base->id - last_id);      // gone since the baseline
+            last_id = base->id;
+            write_u8(out, ENTITY_REMOVED);
+            j++;
+        } else {
+            write_entity(out, &last_id, now, base);
+            i++;
+            j++;
+        }
+    }
+    packet_end(out, start);
+}
+
+uint32_t protocol_read_entities(struct Reader *payload, struct SnapshotHistory *history) {
+    uint32_t sequence = (uint32_t) read_varint(payload);
+    uint32_t baseline_sequence = (uint32_t) read_varint(payload);
+    if (payload->error || sequence == 0) return 0;
+
+    const struct Snapshot *baseline = NULL;
+    if (baseline_sequence != 0) {
+        baseline = snapshot_history_get(history, baseline_sequence);
+        if (baseline == NULL || baseline_sequence % SNAPSHOT_HISTORY == sequence % SNAPSHOT_HISTORY) {
+            ERROR("PROTOCOL snapshot %u needs baseline %u which is gone", sequence, baseline_sequence);
+            return 0;
+        }
+    }
+    struct Snapshot *snapshot = snapshot_history_slot(history, sequence);
+
+    uint32_t j = 0;
+    uint32_t base_count = baseline ? baseline->count : 0;
+    uint64_t id = 0;
+    while (payload->position < payload->size) {
+        id += read_varint(payload);
+        uint8_t mask = read_u8(payload);
+        if (payload->error) return 0;
+
+        // the entities the packet skips are unchanged
+        while (j < base_count && baseline->states[j].id < id) {
+            if (!snapshot_push(snapshot, &baseline->states[j++])) return 0;
+        }
+        const struct EntityState *base = j < base_count && baseline->states[j].id == id ? &baseline->states[j++] : NULL;
+        if (mask & ENTITY_REMOVED) continue;
+
+        int32_t fields[ENTITY_FIELDS] = {0};
+        if (base != NULL) state_fields(base, fields);
+        for (int i=0; i<ENTITY_FIELDS; i++) {
+            if (mask & (1u << i)) fields[i] = (int32_t) ((uint32_t) fields[i] + (uint32_t) read_svarint(payload));
+        }
+        struct EntityState state = {id, fields[0], fields[1], fields[2], fields[3], fields[4], fields[5]};
+        if (!snapshot_push(snapshot, &state)) return 0;
+    }
+    while (j < base_count) {
+        if (!snapshot_push(snapshot, &baseline->states[j++])) return 0;
+    }
+    if (payload->error) return 0;
+    return sequence;
+}
@@ -0,0 +1,136 @@
+// Client/server wire format.
+// A packet is a 3 byte little endian length, a type byte and the payload.
+// Everything a peer has to say during a tick goes in one buffer sent in one go.
+//
+//  - chunk columns: every section as a palette plus bit packed indices,
+//    the whole column then compressed (compress.h). A column the client has
+//    is updated with only the sections that changed, encoded the same way
+//  - entities: numbered snapshots, each one delta encoded against the last
+//    snapshot the client acknowledged. Unchanged entities cost nothing
+
+#pragma once
+
+#include "net.h"
+#include "world.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROTOCOL_VERSION 2
+#define PROTOCOL_PORT 25565
+#define PACKET_HEADER 4
+#define PACKET_MAX_SIZE ((1u << 24) - 1)
+
+enum packet_type {
+    PACKET_HELLO = 1,       // client: protocol version, view distance
+    PACKET_WELCOME,         // server: tick rate, spawn position
+    PACKET_PLAYER_POSITION, // client: where the player is
+    PACKET_CHUNK,           // server: a compressed chunk column
+    PACKET_UNLOAD_CHUNK,    // server: forget a chunk column
+    PACKET_ENTITIES,        // server: delta encoded entity snapshot
+    PACKET_ACK,             // client: last snapshot applied
+    PACKET_SECTIONS,        // server: the changed sections of a column the client has, compressed
+};
+
+struct Buffer {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+};
+
+// reads past the end set error instead of crashing, check it once at the end
+struct Reader {
+    const uint8_t *data;
+    size_t size;
+    size_t position;
+    bool error;
+};
+
+bool buffer_reserve(struct Buffer *buffer, size_t extra);
+void buffer_free(struct Buffer *buffer);
+void write_u8(struct Buffer *buffer, uint8_t v);
+void write_varint(struct Buffer *buffer, uint64_t v);
+void write_svarint(struct Buffer *buffer, int64_t v);     // zigzag
+void write_f32(struct Buffer *buffer, float v);
+void write_bytes(struct Buffer *buffer, const void *data, size_t size);
+
+uint8_t read_u8(struct Reader *reader);
+uint64_t read_varint(struct Reader *reader);
+int64_t read_svarint(struct Reader *reader);
+float read_f32(struct Reader *reader);
+const uint8_t *read_bytes(struct Reader *reader, size_t size);
+
+// reserve the header, write the payload, then close the packet
+size_t packet_begin(struct Buffer *buffer, enum packet_type type);
+void packet_end(struct Buffer *buffer, size_t start);
+
+struct Connection {
+    net_socket_t socket;
+    struct Buffer out;          // packets of this tick, see connection_flush
+    struct Buffer in;           // received, not parsed yet
+    size_t in_position;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    bool closed;
+};
+
+void connection_init(struct Connection *connection, net_socket_t socket);
+void connection_close(struct Connection *connection);
+// send as much of the batch as the socket takes, the rest goes out next time
+bool connection_flush(struct Connection *connection);
+// pull everything the socket has
+bool connection_receive(struct Connection *connection);
+// next complete packet, false when there is none yet
+bool connection_next_packet(struct Connection *connection, uint8_t *type, struct Reader *payload);
+
+// a chunk column without compression nor header: section mask, then every
+// section that is not all air as a palette and packed indices. Also what the
+// region files store
+void protocol_write_column(struct Buffer *out, const struct Section *sections);
+bool protocol_read_column(struct Reader *reader, struct Section *sections);
+
+// PACKET_CHUNK. scratch holds the uncompressed column between calls
+void protocol_write_chunk(struct Buffer *out, const struct Chunk *chunk, struct Buffer *scratch);
+// creates or overwrites the column in the world, NULL on a bad packet
+struct Chunk *protocol_read_chunk(struct Reader *payload, struct World *world, struct Buffer *scratch);
+// PACKET_SECTIONS, the sections of mask
+void protocol_write_sections(struct Buffer *out, const struct Chunk *chunk, uint32_t mask, struct Buffer *scratch);
+// overwrites them in the column of the world, skipped when it has none. False on a bad packet
+bool protocol_read_sections(struct Reader *payload, struct World *world, struct Buffer *scratch);
+
+// Entities go over the wire quantized, both sides keep the quantized values
+// so the deltas add up exactly
+#define ENTITY_POSITION_SCALE 256.0f    // 1/256 block
+#define ENTITY_VELOCITY_SCALE 256.0f    // 1/256 block per second
+#define SNAPSHOT_HISTORY 32
+
+struct EntityState {
+    uint64_t id;                // entity index << 32 | generation
+    int32_t x, y, z;
+    int32_t vx, vy, vz;
+};
+
+struct Snapshot {
+    uint32_t sequence;          // 0 is never used
+    uint32_t count;
+    uint32_t capacity;
+    struct EntityState *states; // sorted by id
+};
+
+struct SnapshotHistory {
+    struct Snapshot snapshots[SNAPSHOT_HISTORY];
+};
+
+// NULL when that snapshot is gone from the history
+struct Snapshot *snapshot_history_get(struct SnapshotHistory *history, uint32_t sequence);
+// the slot for a new snapshot, emptied
+struct Snapshot *snapshot_history_slot(struct SnapshotHistory *history, uint32_t sequence);
+void snapshot_history_free(struct SnapshotHistory *history);
+bool snapshot_push(struct Snapshot *snapshot, const struct EntityState *state);
+void snapshot_sort(struct Snapshot *snapshot);
+
+// PACKET_ENTITIES. baseline NULL sends every entity in full
+void protocol_write_entities(struct Buffer *out, const struct Snapshot *current, const struct Snapshot *baseline);
+// rebuilds the snapshot in the history from its baseline, returns its sequence, 0 on a bad packet
+uint32_t protocol_read_entities(struct Reader *payload, struct SnapshotHistory *history);
@@ -0,0 +1,164 @@
+#include "raycast.h"
+#include "job.h"
+
+#include <math.h>
+#include <stddef.h>
+
+// rays per job in raycast_batch()
+#define RAYCAST_BATCH 256
+
+static bool solid_filter(block_t block) {
+    return block_is_solid(block);
+}
+
+// entering a block while stepping +x means hitting its -x face
+static uint8_t entry_face(int axis, int step) {
+    return (uint8_t) (axis * 2 + (step > 0 ? 0 : 1));
+}
+
+bool raycast(struct World *world, const struct Ray *ray, raycast_filter filter, struct RayHit *hit) {
+    hit->hit = false;
+    hit->face = FACE_NONE;
+    hit->block = BLOCK_AIR;
+    hit->distance = ray->max_distance;
+    if (filter == NULL) filter = solid_filter;
+
+    float length = sqrtf(ray->direction[0] * ray->direction[0] +
+                         ray->direction[1] * ray->direction[1] +
+                         ray->direction[2] * ray->direction[2]);
+    if (length == 0.0f) return false;
+
+    const float *origin = ray->origin;
+    float dir[3];
+    int32_t voxel[3];
+    int step[3];
+    float t_delta[3], t_max[3];
+    for (int i=0; i<3; i++) {
+        dir[i] = ray->direction[i] / length;
+        voxel[i] = (int32_t) floorf(origin[i]);
+        if (dir[i] > 0) {
+            step[i] = 1;
+            t_delta[i] = 1.0f / dir[i];
+            t_max[i] = (voxel[i] + 1 - origin[i]) / dir[i];
+        } else if (dir[i] < 0) {
+            step[i] = -1;
+            t_delta[i] = -1.0f / dir[i];
+            t_max[i] = (voxel[i] - origin[i]) / dir[i];
+        } else {
+            step[i] = 0;
+            t_delta[i] = INFINITY;
+            t_max[i] = INFINITY;
+        }
+    }
+
+    struct Chunk *chunk = NULL;
+    int32_t chunk_x = INT32_MIN, chunk_z = INT32_MIN;
+    float t = 0.0f;
+    uint8_t face = FACE_NONE;
+
+    while (t <= ray->max_distance) {
+        bool skip_section = false;
+        block_t block = BLOCK_AIR;
+
+        if (voxel[1] < 0 || voxel[1] >= WORLD_HEIGHT) {
+            // nothing out there, stop if the ray is moving away
+            if ((voxel[1] < 0 && step[1] <= 0) || (voxel[1] >= WORLD_HEIGHT && step[1] >= 0)) break;
+            skip_section = true;
+        } else {
+            if (block_to_chunk(voxel[0]) != chunk_x || block_to_chunk(voxel[2]) != chunk_z) {
+                chunk_x = block_to_chunk(voxel[0]);
+                chunk_z = block_to_chunk(voxel[2]);
+                chunk = world_get_chunk(world, chunk_x, chunk_z);
+            }
+
+            if (chunk == NULL) {
+                skip_section = true;
+            } else {
+                const struct Section *section = &chunk->sections[voxel[1] >> SECTION_SHIFT];
+                if (section->blocks == NULL) {
+                    block = section->single;
+                    skip_section = !filter(block);
+                } else {
+                    block = section->blocks[section_index(voxel[0] & SECTION_MASK, voxel[1] & SECTION_MASK, voxel[2] & SECTION_MASK)];
+                }
+            }
+        }
+
+        if (!skip_section && filter(block)) {
+            hit->hit = true;
+            hit->x = voxel[0];
+            hit->y = voxel[1];
+            hit->z = voxel[2];
+            hit->block = block;
+            hit->face = face;
+            hit->distance = t;
+            return true;
+        }
+
+        if (skip_section) {
+            // jump straight to where the ray leaves this 16^3 cell
+            int32_t cell_min[3];
+            float t_exit = INFINITY;
+            int exit_axis = -1;
+            for (int i=0; i<3; i++) {
+                cell_min[i] = voxel[i] & ~SECTION_MASK;
+                if (step[i] == 0) continue;
+                int32_t bound = step[i] > 0 ? cell_min[i] + SECTION_SIZE : cell_min[i];
+                float t_axis = (bound - origin[i]) / dir[i];
+                if (t_axis < t_exit) {
+                    t_exit = t_axis;
+                    exit_axis = i;
+                }
+            }
+            if (exit_axis < 0 || t_exit > ray->max_distance) break;
+
+            for (int i=0; i<3; i++) {
+                if (i == exit_axis) {
+                    voxel[i] = step[i] > 0 ? cell_min[i] + SECTION_SIZE : cell_min[i] - 1;
+                } else {
+                    int32_t v = (int32_t) floorf(origin[i] + dir[i] * t_exit);
+                    if (v < cell_min[i]) v = cell_min[i];
+                    if (v > cell_min[i] + SECTION_MASK) v = cell_min[i] + SECTION_MASK;
+                    voxel[i] = v;
+                }
+                if (step[i] != 0) {
+                    t_max[i] = (voxel[i] + (step[i] > 0 ? 1 : 0) - origin[i]) / dir[i];
+                }
+            }
+            t = t_exit;
+            face = entry_face(exit_axis, step[exit_axis]);
+            continue;
+        }
+
+        // regular DDA step to the next voxel
+        int axis = 0;
+        if (t_max[1] < t_max[axis]) axis = 1;
+        if (t_max[2] < t_max[axis]) axis = 2;
+        t = t_max[axis];
+        voxel[axis] += step[axis];
+        t_max[axis] += t_delta[axis];
+        face = entry_face(axis, step[axis]);
+    }
+
+    return false;
+}
+
+
+struct RaycastBatch {
+    struct World *world;
+    const struct Ray *rays;
+    struct RayHit *hits;
+    raycast_filter filter;
+};
+
+static void raycast_job(void *ctx, uint32_t begin, uint32_t end) {
+    struct RaycastBatch *batch = ctx;
+    for (uint32_t i=begin; i<end; i++) {
+        raycast(batch->world, &batch->rays[i], batch->filter, &batch->hits[i]);
+    }
+}
+
+void raycast_batch(struct World *world, const struct Ray *rays, struct RayHit *hits, uint32_t count, raycast_filter filter) {
+    struct RaycastBatch batch = {world, rays, hits, filter};
+    job_parallel_for(count, RAYCAST_BATCH, raycast_job, &batch);
+}
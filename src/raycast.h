@@ -0,0 +1,32 @@
+// Voxel ray casting (Amanatides & Woo DDA) over the section storage.
+// Uniform sections that can't stop the ray (air, water for a solid test,
+// unloaded chunks) are crossed in a single step.
+
+#pragma once
+
+#include "world.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// does the ray stop on this block? NULL means block_is_solid
+typedef bool (*raycast_filter)(block_t block);
+
+struct Ray {
+    float origin[3];
+    float direction[3];     // does not need to be normalized
+    float max_distance;     // in blocks along the normalized direction
+};
+
+struct RayHit {
+    bool hit;
+    int32_t x, y, z;        // the block hit
+    block_t block;
+    uint8_t face;           // enum block_face the ray entered from, FACE_NONE if it started inside
+    float distance;
+};
+
+bool raycast(struct World *world, const struct Ray *ray, raycast_filter filter, struct RayHit *hit);
+
+// many rays at once (explosions, line of sight for every mob) split on the job system
+void raycast_batch(struct World *world, const struct Ray *rays, struct RayHit *hits, uint32_t count, raycast_filter filter);
@@ -0,0 +1,180 @@
+#include "readback.h"
+
+#include "job.h"
+#include "log.h"
+#include "vulkan_if.h"
+
+enum slot_state {
+    SLOT_FREE = 0,
+    SLOT_REQUESTED,     // the next frame recorded copies into it
+    SLOT_RECORDED,      // the copy is in a submitted frame
+    SLOT_DELIVERING,    // the copy is done, a job reads it
+};
+
+struct Slot {
+    enum slot_state state;
+    uint64_t tag;
+    readback_fn fn;
+    void *user;
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    const uint8_t *mapped;      // for the lifetime of the slot
+    struct JobCounter job;
+};
+
+static struct Slot slots[READBACK_SLOTS];
+static bool created;
+static bool bgra;               // red and blue swapped in the swap chain format
+static uint32_t width, height;
+
+
+bool readback_create() {
+    switch (swap_chain.image_format) {
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        bgra = true;
+        break;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        bgra = false;
+        break;
+    default:
+        WARNING("READBACK swap chain format %d can not be read back", swap_chain.image_format);
+        return false;
+    }
+    if (!(swap_chain.usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+        WARNING("READBACK the swap chain images can not be copied");
+        return false;
+    }
+
+    width = swap_chain.extent.width;
+    height = swap_chain.extent.height;
+    // coherent, the fence is all the host needs to wait on. Uncached on most
+    // drivers, slow to read but only the jobs read it
+    for (int i=0; i<READBACK_SLOTS; i++) {
+        struct Slot *slot = &slots[i];
+        if (!create_buffer((VkDeviceSize) width * height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                           &slot->buffer, &slot->memory)) {
+            readback_destroy();
+            return false;
+        }
+        void *mapped;
+        if (vkMapMemory(logical_device, slot->memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+            ERROR("READBACK failed to map a buffer");
+            readback_destroy();
+            return false;
+        }
+        slot->mapped = mapped;
+    }
+    created = true;
+    INFO("READBACK %u buffers of %ux%u", READBACK_SLOTS, width, height);
+    return true;
+}
+
+void readback_destroy() {
+    // the device is idle, whatever was recorded is done
+    if (created) readback_poll();
+    for (int i=0; i<READBACK_SLOTS; i++) {
+        struct Slot *slot = &slots[i];
+        job_wait(&slot->job);
+        if (slot->memory != VK_NULL_HANDLE) vkFreeMemory(logical_device, slot->memory, NULL);
+        if (slot->buffer != VK_NULL_HANDLE) vkDestroyBuffer(logical_device, slot->buffer, NULL);
+        *slot = (struct Slot) {0};
+    }
+    created = false;
+}
+
+bool readback_request(uint64_t tag, readback_fn fn, void *user) {
+    if (!created) return false;
+    for (int i=0; i<READBACK_SLOTS; i++) {
+        struct Slot *slot = &slots[i];
+        if (slot->state != SLOT_FREE) continue;
+        slot->state = SLOT_REQUESTED;
+        slot->tag = tag;
+        slot->fn = fn;
+        slot->user = user;
+        return true;
+    }
+    return false;
+}
+
+void readback_record(VkCommandBuffer cmd, VkImage image) {
+    if (!created) return;
+    for (int i=0; i<READBACK_SLOTS; i++) {
+        struct Slot *slot = &slots[i];
+        if (slot->state != SLOT_REQUESTED) continue;
+
+        VkImageMemoryBarrier to_transfer = {};
+        to_transfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        to_transfer.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        to_transfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        to_transfer.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        to_transfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        to_transfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        to_transfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        to_transfer.image = image;
+        to_transfer.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        to_transfer.subresourceRange.levelCount = 1;
+        to_transfer.subresourceRange.layerCount = 1;
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                             0, NULL, 0, NULL, 1, &to_transfer);
+
+        VkBufferImageCopy region = {};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent.width = width;
+        region.imageExtent.height = height;
+        region.imageExtent.depth = 1;
+        vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer, 1, &region);
+
+        // back for the present, and the copy made visible to the host
+        VkImageMemoryBarrier to_present = to_transfer;
+        to_present.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        to_present.dstAccessMask = 0;
+        to_present.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        to_present.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        VkMemoryBarrier to_host = {};
+        to_host.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        to_host.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        to_host.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0,
+                             1, &to_host, 0, NULL, 1, &to_present);
+        slot->state = SLOT_RECORDED;
+    }
+}
+
+// the swap chain layout to top down RGB
+static void deliver_job(void *arg) {
+    struct Slot *slot = arg;
+    struct Image image;
+    if (!image_create(&image, width, height)) {
+        slot->fn(slot->user, slot->tag, NULL);
+        return;
+    }
+    const uint8_t *src = slot->mapped;
+    uint8_t *dst = image.pixels;
+    int r = bgra ? 2 : 0, b = bgra ? 0 : 2;
+    for (uint64_t i=0, count=(uint64_t) width * height; i<count; i++, src+=4, dst+=3) {
+        dst[0] = src[r];
+        dst[1] = src[1];
+        dst[2] = src[b];
+    }
+    slot->fn(slot->user, slot->tag, &image);
+    image_destroy(&image);
+}
+
+void readback_poll() {
+    for (int i=0; i<READBACK_SLOTS; i++) {
+        struct Slot *slot = &slots[i];
+        if (slot->state == SLOT_DELIVERING && job_done(&slot->job)) slot->state = SLOT_FREE;
+    }
+    // recorded before the fence that was just waited on, the copies are done
+    for (int i=0; i<READBACK_SLOTS; i++) {
+        struct Slot *slot = &slots[i];
+        if (slot->state != SLOT_RECORDED) continue;
+        slot->state = SLOT_DELIVERING;
+        job_submit(deliver_job, slot, &slot->job);
+    }
+}
@@ -0,0 +1,33 @@
+// Asynchronous readback of rendered frames.
+// A requested frame is copied from the swap chain image into a host visible
+// buffer at the end of its command buffer. The copy is done once the frame's
+// fence signaled, which draw_frame() waits on anyway a frame later, and a job
+// turns the pixels into an image for the caller. The render thread never waits
+// on a copy: with every buffer busy a request is refused.
+
+#pragma once
+
+#include "image.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#define READBACK_SLOTS  3       // frames in flight to the host at once
+
+// on a worker, the image is freed after the call. NULL when it could not be
+// allocated, the frame is lost
+typedef void (*readback_fn)(void *user, uint64_t tag, const struct Image *image);
+
+// after the swap chain. False when its images can not be copied or their format
+// is not 8 bit RGBA or BGRA, requests are refused then
+bool readback_create();
+// delivers the copies already done, waits for their jobs
+void readback_destroy();
+
+// the next frame recorded goes to fn with tag. False when no buffer is free
+bool readback_request(uint64_t tag, readback_fn fn, void *user);
+// in the frame's command buffer after the render pass, the image is in the present layout
+void readback_record(VkCommandBuffer cmd, VkImage image);
+// after the frame's fence was waited on, hands the finished copies to the jobs
+void readback_poll();
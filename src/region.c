@@ -0,0 +1,234 @@
+#include "region.h"
+#include "log.h"
+#include "memory.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <direct.h>
+#define make_directory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define make_directory(path) mkdir(path, 0755)
+#endif
+
+#define HEADER_SECTORS  ((REGION_CHUNKS * 8 + REGION_SECTOR - 1) / REGION_SECTOR)
+#define OPEN_REGIONS    16      // files kept open
+#define PATH_LENGTH     512
+
+struct Region {
+    FILE *file;
+    int32_t x, z;
+    uint32_t offsets[REGION_CHUNKS];    // first sector, 0 when not stored
+    uint32_t lengths[REGION_CHUNKS];    // bytes
+    uint8_t *used;                      // one byte per sector of the file
+    uint32_t sectors;
+};
+
+struct RegionStorage {
+    char directory[PATH_LENGTH];
+    pthread_mutex_t mutex;
+    struct Region *open[OPEN_REGIONS];
+    uint32_t next_evict;
+};
+
+static uint32_t get_u32(const uint8_t *p) {
+    return p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+    p[2] = (uint8_t) (v >> 16);
+    p[3] = (uint8_t) (v >> 24);
+}
+
+static void region_close(struct Region *region) {
+    if (region == NULL) return;
+    if (region->file) fclose(region->file);
+    memory_free(region->used);
+    memory_free(region);
+}
+
+static bool mark_sectors(struct Region *region, uint32_t first, uint32_t count, uint8_t value) {
+    if (first + count > region->sectors) {
+        uint8_t *used = memory_realloc(region->used, first + count, MEMORY_TAG_IO);
+        if (used == NULL) return false;
+        memset(used + region->sectors, 0, first + count - region->sectors);
+        region->used = used;
+        region->sectors = first + count;
+    }
+    memset(region->used + first, value, count);
+    return true;
+}
+
+static struct Region *region_load(const char *directory, int32_t x, int32_t z, bool create) {
+    char path[PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/r.%d.%d.region", directory, x, z);
+
+    struct Region *region = memory_calloc(1, sizeof(*region), MEMORY_TAG_IO);
+    if (region == NULL) return NULL;
+    region->x = x;
+    region->z = z;
+
+    uint8_t header[HEADER_SECTORS * REGION_SECTOR];
+    region->file = fopen(path, "r+b");
+    if (region->file == NULL) {
+        if (!create) {
+            memory_free(region);
+            return NULL;
+        }
+        region->file = fopen(path, "w+b");
+        memset(header, 0, sizeof(header));
+        if (region->file == NULL || fwrite(header, sizeof(header), 1, region->file) != 1) {
+            ERROR("REGION failed to create %s", path);
+            region_close(region);
+            return NULL;
+        }
+    } else if (fread(header, sizeof(header), 1, region->file) != 1) {
+        ERROR("REGION %s has a truncated header", path);
+        region_close(region);
+        return NULL;
+    }
+
+    mark_sectors(region, 0, HEADER_SECTORS, 1);
+    for (int i=0; i<REGION_CHUNKS; i++) {
+        region->offsets[i] = get_u32(header + i * 8);
+        region->lengths[i] = get_u32(header + i * 8 + 4);
+        if (region->offsets[i] != 0) {
+            uint32_t count = (region->lengths[i] + REGION_SECTOR - 1) / REGION_SECTOR;
+            if (!mark_sectors(region, region->offsets[i], count, 1)) {
+                region_close(region);
+                return NULL;
+            }
+        }
+    }
+    return region;
+}
+
+struct RegionStorage *region_storage_open(const char *directory) {
+    struct RegionStorage *storage = memory_calloc(1, sizeof(*storage), MEMORY_TAG_IO);
+    if (storage == NULL) {
+        FATAL("REGION failed to allocate the storage");
+        return NULL;
+    }
+    snprintf(storage->directory, sizeof(storage->directory), "%s", directory);
+    // parents first, mkdir fails harmlessly on the ones that exist
+    char path[PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s", directory);
+    for (char *p=path + 1; *p; p++) {
+        if (*p != '/' && *p != '\\') continue;
+        char c = *p;
+        *p = '\0';
+        make_directory(path);
+        *p = c;
+    }
+    make_directory(path);
+    pthread_mutex_init(&storage->mutex, NULL);
+    INFO("REGION saving to %s", directory);
+    return storage;
+}
+
+void region_storage_close(struct RegionStorage *storage) {
+    if (storage == NULL) return;
+    for (int i=0; i<OPEN_REGIONS; i++) {
+        region_close(storage->open[i]);
+    }
+    pthread_mutex_destroy(&storage->mutex);
+    memory_free(storage);
+}
+
+// caller holds the lock
+static struct Region *get_region(struct RegionStorage *storage, int32_t chunk_x, int32_t chunk_z, bool create) {
+    int32_t x = chunk_x >> REGION_SHIFT, z = chunk_z >> REGION_SHIFT;
+    for (int i=0; i<OPEN_REGIONS; i++) {
+        if (storage->open[i] != NULL && storage->open[i]->x == x && storage->open[i]->z == z) return storage->open[i];
+    }
+
+    struct Region *region = region_load(storage->directory, x, z, create);
+    if (region == NULL) return NULL;
+
+    int slot = -1;
+    for (int i=0; i<OPEN_REGIONS && slot < 0; i++) {
+        if (storage->open[i] == NULL) slot = i;
+    }
+    if (slot < 0) {
+        slot = (int) (storage->next_evict++ % OPEN_REGIONS);
+        region_close(storage->open[slot]);
+    }
+    storage->open[slot] = region;
+    return region;
+}
+
+static uint32_t find_free(struct Region *region, uint32_t count) {
+    uint32_t run = 0;
+    for (uint32_t i=HEADER_SECTORS; i<region->sectors; i++) {
+        run = region->used[i] ? 0 : run + 1;
+        if (run == count) return i + 1 - count;
+    }
+    // grow the file, reusing the free run at its end
+    return region->sectors - run;
+}
+
+bool region_storage_write(struct RegionStorage *storage, int32_t chunk_x, int32_t chunk_z, const uint8_t *record, size_t size) {
+    pthread_mutex_lock(&storage->mutex);
+    struct Region *region = get_region(storage, chunk_x, chunk_z, true);
+    if (region == NULL) {
+        pthread_mutex_unlock(&storage->mutex);
+        return false;
+    }
+
+    int index = (chunk_z & (REGION_SIZE - 1)) * REGION_SIZE + (chunk_x & (REGION_SIZE - 1));
+    uint32_t count = (uint32_t) ((size + REGION_SECTOR - 1) / REGION_SECTOR);
+    uint32_t first = find_free(region, count);
+
+    // the new copy first, then the header, then free the old copy
+    bool ok = fseek(region->file, (long) first * REGION_SECTOR, SEEK_SET) == 0 &&
+              fwrite(record, size, 1, region->file) == 1;
+    // pad the last sector so the file length stays a whole number of sectors
+    static const uint8_t zeros[REGION_SECTOR];
+    size_t padding = (size_t) count * REGION_SECTOR - size;
+    if (ok && padding > 0) ok = fwrite(zeros, padding, 1, region->file) == 1;
+    if (ok) ok = fflush(region->file) == 0;
+
+    uint8_t entry[8];
+    put_u32(entry, first);
+    put_u32(entry + 4, (uint32_t) size);
+    if (ok) ok = fseek(region->file, (long) index * 8, SEEK_SET) == 0 &&
+                 fwrite(entry, sizeof(entry), 1, region->file) == 1 &&
+                 fflush(region->file) == 0;
+
+    if (ok) {
+        if (region->offsets[index] != 0) {
+            mark_sectors(region, region->offsets[index], (region->lengths[index] + REGION_SECTOR - 1) / REGION_SECTOR, 0);
+        }
+        mark_sectors(region, first, count, 1);
+        region->offsets[index] = first;
+        region->lengths[index] = (uint32_t) size;
+    } else {
+        ERROR("REGION failed to write chunk %d,%d", chunk_x, chunk_z);
+    }
+    pthread_mutex_unlock(&storage->mutex);
+    return ok;
+}
+
+bool region_storage_read(struct RegionStorage *storage, int32_t chunk_x, int32_t chunk_z, struct Buffer *record) {
+    pthread_mutex_lock(&storage->mutex);
+    struct Region *region = get_region(storage, chunk_x, chunk_z, false);
+    bool ok = false;
+    if (region != NULL) {
+        int index = (chunk_z & (REGION_SIZE - 1)) * REGION_SIZE + (chunk_x & (REGION_SIZE - 1));
+        uint32_t length = region->lengths[index];
+        record->size = 0;
+        if (region->offsets[index] != 0 && buffer_reserve(record, length)) {
+            ok = fseek(region->file, (long) region->offsets[index] * REGION_SECTOR, SEEK_SET) == 0 &&
+                 fread(record->data, length, 1, region->file) == 1;
+            if (ok) record->size = length;
+        }
+    }
+    pthread_mutex_unlock(&storage->mutex);
+    return ok;
+}
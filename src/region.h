@@ -0,0 +1,29 @@
+// Region files: the chunk columns of a 32x32 area in one file,
+// r.<x>.<z>.region in the world directory.
+//  - header: 1024 entries of first sector and byte length, u32 little endian
+//  - records in 4 KB sectors. A chunk is written to free sectors first and the
+//    header updated after, so a crash mid-save leaves the previous copy readable
+// The storage is shared by the loader and the save thread, every call takes its lock.
+
+#pragma once
+
+#include "protocol.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define REGION_SHIFT    5
+#define REGION_SIZE     (1 << REGION_SHIFT)
+#define REGION_CHUNKS   (REGION_SIZE * REGION_SIZE)
+#define REGION_SECTOR   4096
+
+struct RegionStorage;
+
+// creates the directory if needed
+struct RegionStorage *region_storage_open(const char *directory);
+void region_storage_close(struct RegionStorage *storage);
+
+bool region_storage_write(struct RegionStorage *storage, int32_t chunk_x, int32_t chunk_z, const uint8_t *record, size_t size);
+// false when the chunk is not stored (or the file is unreadable)
+bool region_storage_read(struct RegionStorage *storage, int32_t chunk_x, int32_t chunk_z, struct Buffer *record);
@@ -0,0 +1,219 @@
+#include "save.h"
+#include "compress.h"
+#include "log.h"
+#include "memory.h"
+#include "protocol.h"
+#include "timer.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+// what the snapshot holds of a chunk: its sections, sharing the block arrays
+struct ChunkSnapshot {
+    int32_t x, z;
+    struct Section sections[CHUNK_SECTIONS];
+};
+
+struct WorldSaver {
+    struct RegionStorage *storage;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool busy;
+    bool quit;
+
+    struct ChunkSnapshot *chunks;
+    uint32_t count;
+    uint32_t capacity;
+    struct SaveStats stats;
+};
+
+// record: raw column size, u32 little endian, then the compressed column
+static bool write_chunk(struct RegionStorage *storage, int32_t x, int32_t z, const struct Section *sections,
+                        struct Buffer *column, struct Buffer *record) {
+    column->size = 0;
+    protocol_write_column(column, sections);
+
+    record->size = 0;
+    size_t bound = compress_bound(column->size);
+    if (!buffer_reserve(record, 4 + bound)) return false;
+    uint32_t raw = (uint32_t) column->size;
+    uint8_t header[4] = {(uint8_t) raw, (uint8_t) (raw >> 8), (uint8_t) (raw >> 16), (uint8_t) (raw >> 24)};
+    write_bytes(record, header, 4);
+    record->size += compress_block(column->data, column->size, record->data + record->size, bound);
+
+    return region_storage_write(storage, x, z, record->data, record->size);
+}
+
+static void *save_thread(void *arg) {
+    struct WorldSaver *saver = arg;
+    struct Buffer column = {0}, record = {0};
+
+    pthread_mutex_lock(&saver->mutex);
+    for (;;) {
+        while (!saver->busy && !saver->quit) pthread_cond_wait(&saver->cond, &saver->mutex);
+        if (!saver->busy && saver->quit) break;
+        pthread_mutex_unlock(&saver->mutex);
+
+        // the snapshot is ours until busy goes back to false
+        double start = timer_now();
+        uint64_t bytes = 0;
+        for (uint32_t i=0; i<saver->count; i++) {
+            struct ChunkSnapshot *chunk = &saver->chunks[i];
+            if (write_chunk(saver->storage, chunk->x, chunk->z, chunk->sections, &column, &record)) bytes += record.size;
+            for (int s=0; s<CHUNK_SECTIONS; s++) {
+                section_blocks_release(chunk->sections[s].blocks);
+            }
+        }
+
+        pthread_mutex_lock(&saver->mutex);
+        saver->stats.bytes = bytes;
+        saver->stats.write_seconds = timer_now() - start;
+        saver->busy = false;
+        pthread_cond_broadcast(&saver->cond);
+    }
+    pthread_mutex_unlock(&saver->mutex);
+
+    buffer_free(&column);
+    buffer_free(&record);
+    return NULL;
+}
+
+struct WorldSaver *world_saver_create(struct RegionStorage *storage) {
+    struct WorldSaver *saver = memory_calloc(1, sizeof(*saver), MEMORY_TAG_IO);
+    if (saver == NULL) {
+        FATAL("SAVE failed to allocate the saver");
+        return NULL;
+    }
+    saver->storage = storage;
+    pthread_mutex_init(&saver->mutex, NULL);
+    pthread_cond_init(&saver->cond, NULL);
+    if (pthread_create(&saver->thread, NULL, save_thread, saver) != 0) {
+        FATAL("SAVE failed to start the save thread");
+        pthread_mutex_destroy(&saver->mutex);
+        pthread_cond_destroy(&saver->cond);
+        memory_free(saver);
+        return NULL;
+    }
+    return saver;
+}
+
+void world_saver_destroy(struct WorldSaver *saver) {
+    if (saver == NULL) return;
+    pthread_mutex_lock(&saver->mutex);
+    saver->quit = true;
+    pthread_cond_broadcast(&saver->cond);
+    pthread_mutex_unlock(&saver->mutex);
+    pthread_join(saver->thread, NULL);
+
+    pthread_mutex_destroy(&saver->mutex);
+    pthread_cond_destroy(&saver->cond);
+    memory_free(saver->chunks);
+    memory_free(saver);
+}
+
+bool world_saver_busy(struct WorldSaver *saver) {
+    pthread_mutex_lock(&saver->mutex);
+    bool busy = saver->busy;
+    pthread_mutex_unlock(&saver->mutex);
+    return busy;
+}
+
+void world_saver_wait(struct WorldSaver *saver) {
+    pthread_mutex_lock(&saver->mutex);
+    while (saver->busy) pthread_cond_wait(&saver->cond, &saver->mutex);
+    pthread_mutex_unlock(&saver->mutex);
+}
+
+void world_saver_last_stats(struct WorldSaver *saver, struct SaveStats *stats) {
+    pthread_mutex_lock(&saver->mutex);
+    *stats = saver->stats;
+    pthread_mutex_unlock(&saver->mutex);
+}
+
+bool world_saver_begin(struct WorldSaver *saver, struct World *world) {
+    if (world_saver_busy(saver)) return false;
+    double start = timer_now();
+
+    // the thread is idle, the snapshot array is ours to fill
+    saver->count = 0;
+    uint32_t cursor = 0;
+    struct Chunk *chunk;
+    while ((chunk = world_next_chunk(world, &cursor)) != NULL) {
+        if (chunk->unsaved == 0) continue;
+        if (saver->count == saver->capacity) {
+            uint32_t capacity = saver->capacity ? saver->capacity * 2 : 256;
+            struct ChunkSnapshot *chunks = memory_realloc(saver->chunks, capacity * sizeof(*chunks), MEMORY_TAG_IO);
+            if (chunks == NULL) {
+                FATAL("SAVE out of memory taking the snapshot");
+                break;
+            }
+            saver->chunks = chunks;
+            saver->capacity = capacity;
+        }
+
+        // the whole column goes to disk, the clean sections are shared references too
+        struct ChunkSnapshot *snapshot = &saver->chunks[saver->count++];
+        snapshot->x = chunk->x;
+        snapshot->z = chunk->z;
+        for (int s=0; s<CHUNK_SECTIONS; s++) {
+            snapshot->sections[s] = chunk->sections[s];
+            section_blocks_retain(chunk->sections[s].blocks);
+        }
+        chunk->unsaved = 0;
+    }
+
+    pthread_mutex_lock(&saver->mutex);
+    saver->stats = (struct SaveStats) {.chunks = saver->count, .capture_seconds = timer_now() - start};
+    saver->busy = true;
+    pthread_cond_broadcast(&saver->cond);
+    pthread_mutex_unlock(&saver->mutex);
+    return true;
+}
+
+uint32_t world_save_blocking(struct RegionStorage *storage, struct World *world, struct SaveStats *stats) {
+    double start = timer_now();
+    struct Buffer column = {0}, record = {0};
+    *stats = (struct SaveStats) {0};
+
+    uint32_t cursor = 0;
+    struct Chunk *chunk;
+    while ((chunk = world_next_chunk(world, &cursor)) != NULL) {
+        if (chunk->unsaved == 0) continue;
+        if (write_chunk(storage, chunk->x, chunk->z, chunk->sections, &column, &record)) stats->bytes += record.size;
+        chunk->unsaved = 0;
+        stats->chunks++;
+    }
+    buffer_free(&column);
+    buffer_free(&record);
+    stats->write_seconds = stats->capture_seconds = timer_now() - start;
+    return stats->chunks;
+}
+
+bool world_load_chunk(struct RegionStorage *storage, struct World *world, int32_t chunk_x, int32_t chunk_z) {
+    struct Buffer record = {0}, column = {0};
+    bool ok = region_storage_read(storage, chunk_x, chunk_z, &record) && record.size >= 4;
+    if (ok) {
+        uint32_t raw = record.data[0] | (uint32_t) record.data[1] << 8 | (uint32_t) record.data[2] << 16 | (uint32_t) record.data[3] << 24;
+        ok = raw <= PACKET_MAX_SIZE && buffer_reserve(&column, raw) &&
+             decompress_block(record.data + 4, record.size - 4, column.data, raw);
+        column.size = raw;
+    }
+
+    if (ok) {
+        struct Chunk *chunk = world_create_chunk(world, chunk_x, chunk_z);
+        struct Reader reader = {column.data, column.size, 0, false};
+        ok = chunk != NULL && protocol_read_column(&reader, chunk->sections);
+        if (chunk != NULL && !ok) {
+            ERROR("SAVE chunk %d,%d is corrupt, it will be generated again", chunk_x, chunk_z);
+            world_remove_chunk(world, chunk_x, chunk_z);
+        } else if (ok) {
+            chunk->dirty = (1u << CHUNK_SECTIONS) - 1;
+            chunk->recount = (1u << CHUNK_SECTIONS) - 1;
+            chunk->unsaved = 0;
+        }
+    }
+    buffer_free(&record);
+    buffer_free(&column);
+    return ok;
+}
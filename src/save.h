@@ -0,0 +1,40 @@
+// World saving without stalling the tick.
+// world_saver_begin() runs between two ticks: it takes a reference to the block
+// arrays of every chunk with unsaved changes, no copy. The save thread then
+// encodes, compresses and writes them to the region files while the tick goes
+// on. A write to an array the snapshot holds copies it first
+// (section_write_blocks), so the snapshot keeps the state of the tick boundary.
+
+#pragma once
+
+#include "region.h"
+#include "world.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct SaveStats {
+    uint32_t chunks;
+    uint64_t bytes;             // written to the region files
+    double capture_seconds;     // spent in the tick
+    double write_seconds;       // spent on the save thread
+};
+
+struct WorldSaver;
+
+struct WorldSaver *world_saver_create(struct RegionStorage *storage);
+// finishes the save in progress first
+void world_saver_destroy(struct WorldSaver *saver);
+
+// snapshot the unsaved chunks and hand them to the save thread.
+// false when the previous save is still running, the changes wait for the next one
+bool world_saver_begin(struct WorldSaver *saver, struct World *world);
+bool world_saver_busy(struct WorldSaver *saver);
+void world_saver_wait(struct WorldSaver *saver);
+void world_saver_last_stats(struct WorldSaver *saver, struct SaveStats *stats);
+
+// the same save done entirely on the calling thread, the tick waits for the disk
+uint32_t world_save_blocking(struct RegionStorage *storage, struct World *world, struct SaveStats *stats);
+
+// puts a stored chunk in the world, false when it was never saved
+bool world_load_chunk(struct RegionStorage *storage, struct World *world, int32_t chunk_x, int32_t chunk_z);
@@ -0,0 +1,229 @@
+// Dedicated server: runs the simulation headless at a fixed tick rate
+//
+//   minecraft-server [--radius chunks] [--entities count] [--seed seed]
+//                    [--ticks count] [--report seconds] [--workers count]
+//                    [--port port] [--view-distance chunks]
+//                    [--world directory] [--save-interval seconds]
+
+#include "defines.h"
+#include "entity.h"
+#include "job.h"
+#include "log.h"
+#include "memory.h"
+#include "net.h"
+#include "net_server.h"
+#include "save.h"
+#include "simulation.h"
+#include "stats.h"
+#include "timer.h"
+#include "worldgen.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// a tick this late gives up catching up instead of running a burst of ticks
+#define MAX_TICK_DEBT 1.0
+#define UNLOAD_INTERVAL 1.0     // seconds between two passes over the chunks nobody holds
+
+struct ServerConfig {
+    int radius;             // chunks loaded around the spawn
+    uint32_t entities;      // test entities dropped around the spawn
+    uint32_t seed;
+    uint64_t ticks;         // 0 runs until interrupted
+    double report_interval;
+    int workers;
+    const char *world;      // NULL: the world is not saved
+    double save_interval;
+    struct NetServerConfig net;
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void handle_signal(int sig) {
+    (void) sig;
+    running = 0;
+}
+
+static bool parse_args(int argc, char **argv, struct ServerConfig *config) {
+    for (int i=1; i<argc; i++) {
+        if (i + 1 >= argc) {
+            ERROR("SERVER missing value for %s", argv[i]);
+            return false;
+        }
+        const char *value = argv[++i];
+        if      (strcmp(argv[i - 1], "--radius") == 0)   config->radius = atoi(value);
+        else if (strcmp(argv[i - 1], "--entities") == 0) config->entities = (uint32_t) strtoul(value, NULL, 10);
+        else if (strcmp(argv[i - 1], "--seed") == 0)     config->seed = (uint32_t) strtoul(value, NULL, 10);
+        else if (strcmp(argv[i - 1], "--ticks") == 0)    config->ticks = strtoull(value, NULL, 10);
+        else if (strcmp(argv[i - 1], "--report") == 0)   config->report_interval = atof(value);
+        else if (strcmp(argv[i - 1], "--workers") == 0)  config->workers = atoi(value);
+        else if (strcmp(argv[i - 1], "--port") == 0)     config->net.port = (uint16_t) atoi(value);
+        else if (strcmp(argv[i - 1], "--view-distance") == 0) config->net.max_view_distance = atoi(value);
+        else if (strcmp(argv[i - 1], "--world") == 0)    config->world = value;
+        else if (strcmp(argv[i - 1], "--save-interval") == 0) config->save_interval = atof(value);
+        else {
+            ERROR("SERVER unknown option %s", argv[i - 1]);
+            return false;
+        }
+    }
+    if (config->radius < 0 || config->report_interval <= 0 || config->net.max_view_distance < 1 || config->save_interval <= 0) {
+        ERROR("SERVER invalid radius, report interval, view distance or save interval");
+        return false;
+    }
+    return true;
+}
+
+static void spawn_entities(struct Simulation *simulation, uint32_t count, int radius) {
+    ecs_mask_t mask = ECS_BIT(COMPONENT_POSITION) | ECS_BIT(COMPONENT_VELOCITY) |
+                      ECS_BIT(COMPONENT_GRAVITY) | ECS_BIT(COMPONENT_COLLIDER);
+    float extent = (float) (radius * SECTION_SIZE);
+    srand(simulation->seed);
+    for (uint32_t i=0; i<count; i++) {
+        entity_t entity = ecs_create_entity(simulation->ecs, mask);
+        struct EntityPosition *position = ecs_get(simulation->ecs, entity, COMPONENT_POSITION);
+        struct EntityVelocity *velocity = ecs_get(simulation->ecs, entity, COMPONENT_VELOCITY);
+        struct EntityGravity *gravity = ecs_get(simulation->ecs, entity, COMPONENT_GRAVITY);
+        struct EntityCollider *collider = ecs_get(simulation->ecs, entity, COMPONENT_COLLIDER);
+        position->x = ((float) rand() / RAND_MAX * 2.0f - 1.0f) * extent;
+        position->z = ((float) rand() / RAND_MAX * 2.0f - 1.0f) * extent;
+        position->y = (float) worldgen_height((int32_t) position->x, (int32_t) position->z, simulation->seed) + 2.0f;
+        velocity->x = (float) rand() / RAND_MAX * 4.0f - 2.0f;
+        velocity->y = 0.0f;
+        velocity->z = (float) rand() / RAND_MAX * 4.0f - 2.0f;
+        gravity->scale = 1.0f;
+        collider->half_width = 0.3f;
+        collider->height = 1.8f;
+        collider->on_ground = 0;
+    }
+}
+
+static void report(struct Simulation *simulation, struct NetServer *net, struct WorldSaver *saver,
+                   const struct TickStats *stats, double elapsed) {
+    INFO("SERVER tick %llu: %.1f TPS, tick %.2f ms avg %.2f ms max, %u over budget, "
+         "%u chunks (%.1f MB), %u entities, %.1f MB resident",
+         (unsigned long long) simulation->tick,
+         elapsed > 0 ? stats->count / elapsed : 0.0,
+         tick_stats_average(stats) * 1000.0, stats->max * 1000.0, stats->overruns,
+         world_chunk_count(simulation->world), world_memory_usage(simulation->world) / (1024.0 * 1024.0),
+         ecs_entity_count(simulation->ecs),
+         stats_resident_memory() / (1024.0 * 1024.0));
+
+    struct NetServerStats net_stats;
+    net_server_stats(net, &net_stats);
+    INFO("SERVER %u clients, %.1f MB sent, %.1f MB received, %llu chunks sent, %u generating, %llu unloaded",
+         net_stats.clients, net_stats.bytes_sent / (1024.0 * 1024.0), net_stats.bytes_received / (1024.0 * 1024.0),
+         (unsigned long long) net_stats.chunks_sent, net_stats.generating, (unsigned long long) net_stats.chunks_unloaded);
+
+    if (saver != NULL && !world_saver_busy(saver)) {
+        struct SaveStats save;
+        world_saver_last_stats(saver, &save);
+        INFO("SERVER last save %u chunks, %.1f KB, %.2f ms in the tick, %.0f ms writing",
+             save.chunks, save.bytes / 1024.0, save.capture_seconds * 1000.0, save.write_seconds * 1000.0);
+    }
+}
+
+int main(int argc, char **argv) {
+    struct ServerConfig config = {
+        .radius = 8,
+        .entities = 1000,
+        .seed = 1234,
+        .ticks = 0,
+        .report_interval = 5.0,
+        .workers = 0,
+        .world = NULL,
+        .save_interval = 30.0,
+        .net = net_server_default_config(),
+    };
+    if (!parse_args(argc, argv, &config)) return FAIL;
+    // the status reports are INFO, release builds only show errors by default
+    set_log_level(INFO);
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    if (!net_init()) return FAIL;
+    job_system_init(config.workers);
+    struct Simulation *simulation = simulation_create(config.seed);
+    struct NetServer *net = simulation ? net_server_create(simulation, &config.net) : NULL;
+    struct WorldSaver *saver = NULL;
+    if (net != NULL && config.world != NULL) {
+        saver = simulation_open_storage(simulation, config.world) ? world_saver_create(simulation->storage) : NULL;
+        if (saver == NULL) {
+            net_server_destroy(net);
+            net = NULL;
+        }
+    }
+    if (net == NULL) {
+        simulation_destroy(simulation);
+        job_system_shutdown();
+        net_shutdown();
+        return FAIL;
+    }
+
+    double start = timer_now();
+    uint32_t loaded = simulation_load_area(simulation, 0, 0, config.radius);
+    INFO("SERVER loaded %u chunks in %.0f ms with %d workers", loaded, (timer_now() - start) * 1000.0, job_worker_count());
+    spawn_entities(simulation, config.entities, config.radius);
+
+    struct TickStats stats = {0};
+    double next_tick = timer_now();
+    double last_report = next_tick;
+    double last_save = next_tick;
+    double last_unload = next_tick;
+    while (running && (config.ticks == 0 || simulation->tick < config.ticks)) {
+        double tick_start = timer_now();
+        simulation_tick(simulation);
+        net_server_tick(net);
+        // between two ticks: the snapshot only takes references, the save thread writes it
+        if (saver != NULL && tick_start - last_save >= config.save_interval) {
+            if (world_saver_begin(saver, simulation->world)) {
+                last_save = tick_start;
+            } else {
+                WARNING("SERVER previous save still running, saving later");
+            }
+        }
+        // the spawn area stays, the entities are there. A chunk being written is read back
+        // from the save once it is done, until then it stays
+        if (tick_start - last_unload >= UNLOAD_INTERVAL && (saver == NULL || !world_saver_busy(saver))) {
+            net_server_unload_chunks(net, config.radius);
+            last_unload = tick_start;
+        }
+        double now = timer_now();
+        tick_stats_add(&stats, now - tick_start, TICK_DT);
+
+        if (now - last_report >= config.report_interval) {
+            report(simulation, net, saver, &stats, now - last_report);
+            tick_stats_reset(&stats);
+            last_report = now;
+        }
+
+        next_tick += TICK_DT;
+        if (now < next_tick) {
+            timer_sleep(next_tick - now);
+        } else if (now - next_tick > MAX_TICK_DEBT) {
+            WARNING("SERVER can't keep up, %.0f ms behind, skipping ticks", (now - next_tick) * 1000.0);
+            next_tick = now;
+        }
+    }
+    if (stats.count > 0) report(simulation, net, saver, &stats, timer_now() - last_report);
+
+    INFO("SERVER stopping");
+    if (saver != NULL) {
+        world_saver_wait(saver);
+        world_saver_begin(saver, simulation->world);
+        world_saver_destroy(saver);
+        INFO("SERVER world saved to %s", config.world);
+    }
+    net_server_destroy(net);
+    simulation_destroy(simulation);
+    job_system_shutdown();
+    net_shutdown();
+
+    memory_report();
+    for (int tag=0; tag<MEMORY_TAG_COUNT; tag++) {
+        memory_check_leaks(tag);
+    }
+    return OK;
+}
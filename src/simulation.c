@@ -0,0 +1,146 @@
+#include "simulation.h"
+#include "entity.h"
+#include "job.h"
+#include "log.h"
+#include "memory.h"
+#include "save.h"
+#include "worldgen.h"
+
+#include <stdlib.h>
+
+struct Simulation *simulation_create(uint32_t seed) {
+    struct Simulation *simulation = memory_calloc(1, sizeof(*simulation), MEMORY_TAG_SIMULATION);
+    if (simulation == NULL) {
+        FATAL("SIMULATION failed to allocate");
+        return NULL;
+    }
+    simulation->seed = seed;
+    simulation->world = world_create();
+    simulation->ecs = ecs_create();
+    simulation->physics = physics_create();
+    simulation->fluids = fluid_create();
+    simulation->block_ticks = block_ticks_create();
+    simulation->random = seed;
+    if (simulation->world == NULL || simulation->ecs == NULL || simulation->physics == NULL || simulation->fluids == NULL ||
+        simulation->block_ticks == NULL) {
+        simulation_destroy(simulation);
+        return NULL;
+    }
+    entity_register_components(simulation->ecs);
+    return simulation;
+}
+
+void simulation_destroy(struct Simulation *simulation) {
+    if (simulation == NULL) return;
+    block_ticks_destroy(simulation->block_ticks);
+    fluid_destroy(simulation->fluids);
+    physics_destroy(simulation->physics);
+    ecs_destroy(simulation->ecs);
+    world_destroy(simulation->world);
+    region_storage_close(simulation->storage);
+    memory_free(simulation);
+}
+
+bool simulation_open_storage(struct Simulation *simulation, const char *directory) {
+    region_storage_close(simulation->storage);
+    simulation->storage = region_storage_open(directory);
+    return simulation->storage != NULL;
+}
+
+struct LoadArea {
+    struct Chunk **chunks;
+    uint32_t seed;
+};
+
+static void generate_job(void *ctx, uint32_t begin, uint32_t end) {
+    struct LoadArea *area = ctx;
+    for (uint32_t i=begin; i<end; i++) {
+        worldgen_fill_chunk(area->chunks[i], area->seed);
+    }
+}
+
+uint32_t simulation_load_area(struct Simulation *simulation, int32_t chunk_x, int32_t chunk_z, int radius) {
+    uint32_t side = 2 * (uint32_t) radius + 1;
+    struct Chunk **chunks = memory_alloc(side * side * sizeof(*chunks), MEMORY_TAG_WORLD);
+    if (chunks == NULL) {
+        FATAL("SIMULATION out of memory loading %u chunks", side * side);
+        return 0;
+    }
+
+    // the chunk table is only changed here, the jobs fill chunks they own
+    uint32_t count = 0, loaded = 0;
+    for (int32_t z=chunk_z - radius; z<=chunk_z + radius; z++) {
+        for (int32_t x=chunk_x - radius; x<=chunk_x + radius; x++) {
+            if (world_get_chunk(simulation->world, x, z) != NULL) continue;
+            if (simulation->storage != NULL && world_load_chunk(simulation->storage, simulation->world, x, z)) {
+                loaded++;
+                continue;
+            }
+            struct Chunk *chunk = world_create_chunk(simulation->world, x, z);
+            if (chunk != NULL) chunks[count++] = chunk;
+        }
+    }
+
+    struct LoadArea area = {chunks, simulation->seed};
+    job_parallel_for(count, 4, generate_job, &area);
+    memory_free(chunks);
+    return count + loaded;
+}
+
+#define FALL_DELAY          2       // ticks a falling block takes per block
+#define BLOCK_TICK_BUDGET   65536
+
+static void schedule_fall(struct Simulation *simulation, int32_t x, int32_t y, int32_t z) {
+    if (block_has(world_get_block(simulation->world, x, y, z), BLOCK_FLAG_FALLS)) {
+        block_ticks_schedule(simulation->block_ticks, x, y, z, FALL_DELAY);
+    }
+}
+
+// a falling block goes down through anything that is not solid
+static void scheduled_tick(void *user, int32_t x, int32_t y, int32_t z) {
+    struct Simulation *simulation = user;
+    block_t block = world_get_block(simulation->world, x, y, z);
+    if (!block_has(block, BLOCK_FLAG_FALLS) || y == 0) return;
+    if (block_is_solid(world_get_block(simulation->world, x, y - 1, z))) return;
+    simulation_set_block(simulation, x, y - 1, z, block);
+    simulation_set_block(simulation, x, y, z, BLOCK_AIR);
+}
+
+// grass dies under an opaque block and spreads to the dirt around it that is not covered
+static void random_tick(void *user, int32_t x, int32_t y, int32_t z) {
+    struct Simulation *simulation = user;
+    struct World *world = simulation->world;
+    if (world_get_block(world, x, y, z) != BLOCK_GRASS) return;
+    if (block_is_opaque(world_get_block(world, x, y + 1, z))) {
+        simulation_set_block(simulation, x, y, z, BLOCK_DIRT);
+        return;
+    }
+    uint32_t bits = simulation->random = simulation->random * 1664525u + 1013904223u;     // the random ticks draw from it too
+    int32_t nx = x + (int32_t) ((bits >> 16) % 3) - 1;
+    int32_t ny = y + (int32_t) ((bits >> 20) % 5) - 3;
+    int32_t nz = z + (int32_t) ((bits >> 24) % 3) - 1;
+    if (world_get_block(world, nx, ny, nz) == BLOCK_DIRT && !block_is_opaque(world_get_block(world, nx, ny + 1, nz))) {
+        simulation_set_block(simulation, nx, ny, nz, BLOCK_GRASS);
+    }
+}
+
+static void fluid_set(void *user, int32_t x, int32_t y, int32_t z, block_t block) {
+    simulation_set_block(user, x, y, z, block);
+}
+
+void simulation_tick(struct Simulation *simulation) {
+    fluid_tick(simulation->fluids, simulation->world, fluid_set, simulation);
+    block_ticks_advance(simulation->block_ticks, BLOCK_TICK_BUDGET, scheduled_tick, simulation);
+    block_random_ticks(simulation->world, RANDOM_TICKS_PER_SECTION, &simulation->random, random_tick, simulation);
+    system_gravity(simulation->ecs, TICK_DT);
+    physics_step(simulation->physics, simulation->ecs, simulation->world, TICK_DT);
+    system_movement(simulation->ecs, TICK_DT);
+    simulation->tick++;
+}
+
+void simulation_set_block(struct Simulation *simulation, int32_t x, int32_t y, int32_t z, block_t block) {
+    world_set_block(simulation->world, x, y, z, block);
+    fluid_wake(simulation->fluids, simulation->world, x, y, z);
+    schedule_fall(simulation, x, y, z);
+    schedule_fall(simulation, x, y + 1, z);
+}
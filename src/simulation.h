@@ -0,0 +1,45 @@
+// The game state advanced at a fixed tick rate: blocks, entities and physics.
+// Shared by the client and the dedicated server, nothing in here draws.
+
+#pragma once
+
+#include "world.h"
+#include "blocktick.h"
+#include "ecs.h"
+#include "fluid.h"
+#include "physics.h"
+#include "region.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TICKS_PER_SECOND 20
+#define TICK_DT (1.0f / TICKS_PER_SECOND)
+
+struct Simulation {
+    struct World *world;
+    struct Ecs *ecs;
+    struct Physics *physics;
+    struct Fluids *fluids;
+    struct BlockTicks *block_ticks;
+    struct RegionStorage *storage;  // NULL: nothing persists, chunks are always generated
+    uint32_t seed;
+    uint32_t random;                // state of the random ticks
+    uint64_t tick;
+};
+
+struct Simulation *simulation_create(uint32_t seed);
+void simulation_destroy(struct Simulation *simulation);
+// load the chunks saved in a world directory instead of generating them
+bool simulation_open_storage(struct Simulation *simulation, const char *directory);
+
+// load or generate the missing chunks within radius (in chunks) of a chunk,
+// generation runs in parallel. Returns how many were added
+uint32_t simulation_load_area(struct Simulation *simulation, int32_t chunk_x, int32_t chunk_z, int radius);
+
+// one fixed step of TICK_DT
+void simulation_tick(struct Simulation *simulation);
+
+// changes a block of the running game, the fluids around it start flowing and
+// the blocks that fall are scheduled
+void simulation_set_block(struct Simulation *simulation, int32_t x, int32_t y, int32_t z, block_t block);
@@ -0,0 +1,438 @@
+#include "spatial.h"
+#include "job.h"
+#include "log.h"
+#include "memory.h"
+
+#include <math.h>
+
+#define NONE UINT32_MAX
+
+struct SpatialEntry {
+    float x, y, z;
+    float radius;
+    uint32_t id;
+};
+
+// a chunk column of entities, once created it stays even when empty
+struct Cell {
+    int32_t x, z;
+    struct SpatialEntry *entries;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+struct Location {
+    uint32_t cell;      // NONE when the id is not in the index
+    uint32_t slot;
+};
+
+struct SpatialIndex {
+    struct Cell *cells;
+    uint32_t cells_count;
+    uint32_t cells_capacity;
+    uint32_t *table;            // open addressing on the cell coordinates, index in cells or NONE
+    uint32_t table_capacity;    // power of 2
+    int32_t min_x, max_x, min_z, max_z;     // of the cells, where a nearest search stops
+    struct Location *locations; // per id
+    uint32_t locations_capacity;
+    uint32_t count;
+    float max_radius;           // how loose the cells are, only grows until a rebuild
+    // rebuild scratch, per entity
+    uint32_t *rebuild_cells;
+    uint32_t *rebuild_slots;
+    uint32_t rebuild_capacity;
+};
+
+static int32_t cell_of(float v) {
+    return (int32_t) floorf(v * (1.0f / SPATIAL_CELL_SIZE));
+}
+
+static uint32_t hash_cell(int32_t x, int32_t z) {
+    uint64_t cell = (uint64_t) (uint32_t) x << 32 | (uint32_t) z;
+    cell ^= cell >> 33;
+    cell *= 0xFF51AFD7ED558CCDULL;
+    cell ^= cell >> 33;
+    return (uint32_t) cell;
+}
+
+static uint32_t find_slot(const struct SpatialIndex *index, int32_t x, int32_t z) {
+    uint32_t mask = index->table_capacity - 1;
+    uint32_t slot = hash_cell(x, z) & mask;
+    while (index->table[slot] != NONE) {
+        const struct Cell *cell = &index->cells[index->table[slot]];
+        if (cell->x == x && cell->z == z) break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static uint32_t find_cell(const struct SpatialIndex *index, int32_t x, int32_t z) {
+    return index->table[find_slot(index, x, z)];
+}
+
+static bool grow_table(struct SpatialIndex *index) {
+    uint32_t capacity = index->table_capacity * 2;
+    uint32_t *table = memory_alloc(capacity * sizeof(*table), MEMORY_TAG_SIMULATION);
+    if (table == NULL) return false;
+    for (uint32_t i=0; i<capacity; i++) table[i] = NONE;
+    memory_free(index->table);
+    index->table = table;
+    index->table_capacity = capacity;
+    for (uint32_t c=0; c<index->cells_count; c++) {
+        index->table[find_slot(index, index->cells[c].x, index->cells[c].z)] = c;
+    }
+    return true;
+}
+
+static uint32_t create_cell(struct SpatialIndex *index, int32_t x, int32_t z) {
+    uint32_t slot = find_slot(index, x, z);
+    if (index->table[slot] != NONE) return index->table[slot];
+
+    if ((index->cells_count + 1) * 2 > index->table_capacity) {
+        if (!grow_table(index)) return NONE;
+        slot = find_slot(index, x, z);
+    }
+    if (index->cells_count == index->cells_capacity) {
+        uint32_t capacity = index->cells_capacity ? index->cells_capacity * 2 : 64;
+        struct Cell *cells = memory_realloc(index->cells, capacity * sizeof(*cells), MEMORY_TAG_SIMULATION);
+        if (cells == NULL) return NONE;
+        index->cells = cells;
+        index->cells_capacity = capacity;
+    }
+    if (index->cells_count == 0) {
+        index->min_x = index->max_x = x;
+        index->min_z = index->max_z = z;
+    }
+    if (x < index->min_x) index->min_x = x;
+    if (x > index->max_x) index->max_x = x;
+    if (z < index->min_z) index->min_z = z;
+    if (z > index->max_z) index->max_z = z;
+
+    uint32_t c = index->cells_count++;
+    index->cells[c] = (struct Cell) {x, z, NULL, 0, 0};
+    index->table[slot] = c;
+    return c;
+}
+
+static bool reserve_entries(struct Cell *cell, uint32_t count) {
+    if (count <= cell->capacity) return true;
+    uint32_t capacity = cell->capacity ? cell->capacity : 16;
+    while (capacity < count) capacity *= 2;
+    struct SpatialEntry *entries = memory_realloc(cell->entries, capacity * sizeof(*entries), MEMORY_TAG_SIMULATION);
+    if (entries == NULL) return false;
+    cell->entries = entries;
+    cell->capacity = capacity;
+    return true;
+}
+
+static bool reserve_locations(struct SpatialIndex *index, uint32_t count) {
+    if (count <= index->locations_capacity) return true;
+    uint32_t capacity = index->locations_capacity ? index->locations_capacity : 1024;
+    while (capacity < count) capacity *= 2;
+    struct Location *locations = memory_realloc(index->locations, capacity * sizeof(*locations), MEMORY_TAG_SIMULATION);
+    if (locations == NULL) return false;
+    for (uint32_t i=index->locations_capacity; i<capacity; i++) locations[i].cell = NONE;
+    index->locations = locations;
+    index->locations_capacity = capacity;
+    return true;
+}
+
+struct SpatialIndex *spatial_create() {
+    struct SpatialIndex *index = memory_calloc(1, sizeof(*index), MEMORY_TAG_SIMULATION);
+    if (index == NULL) {
+        FATAL("SPATIAL failed to allocate");
+        return NULL;
+    }
+    index->table_capacity = 64;
+    index->table = memory_alloc(index->table_capacity * sizeof(*index->table), MEMORY_TAG_SIMULATION);
+    if (index->table == NULL) {
+        FATAL("SPATIAL failed to allocate the cell table");
+        memory_free(index);
+        return NULL;
+    }
+    for (uint32_t i=0; i<index->table_capacity; i++) index->table[i] = NONE;
+    return index;
+}
+
+void spatial_destroy(struct SpatialIndex *index) {
+    if (index == NULL) return;
+    for (uint32_t c=0; c<index->cells_count; c++) memory_free(index->cells[c].entries);
+    memory_free(index->cells);
+    memory_free(index->table);
+    memory_free(index->locations);
+    memory_free(index->rebuild_cells);
+    memory_free(index->rebuild_slots);
+    memory_free(index);
+}
+
+// swap remove from its cell
+static void unlink_entry(struct SpatialIndex *index, uint32_t id) {
+    struct Location *location = &index->locations[id];
+    struct Cell *cell = &index->cells[location->cell];
+    struct SpatialEntry *last = &cell->entries[--cell->count];
+    if (location->slot != cell->count) {
+        cell->entries[location->slot] = *last;
+        index->locations[last->id].slot = location->slot;
+    }
+    location->cell = NONE;
+    index->count--;
+}
+
+static bool link_entry(struct SpatialIndex *index, uint32_t id, const struct SpatialEntity *entity) {
+    uint32_t c = create_cell(index, cell_of(entity->x), cell_of(entity->z));
+    if (c == NONE || !reserve_entries(&index->cells[c], index->cells[c].count + 1)) {
+        FATAL("SPATIAL out of memory adding entity %u", id);
+        return false;
+    }
+    struct Cell *cell = &index->cells[c];
+    cell->entries[cell->count] = (struct SpatialEntry) {entity->x, entity->y, entity->z, entity->radius, id};
+    index->locations[id] = (struct Location) {c, cell->count++};
+    if (entity->radius > index->max_radius) index->max_radius = entity->radius;
+    index->count++;
+    return true;
+}
+
+bool spatial_insert(struct SpatialIndex *index, uint32_t id, const struct SpatialEntity *entity) {
+    if (id == NONE || !reserve_locations(index, id + 1)) {
+        FATAL("SPATIAL out of memory for entity id %u", id);
+        return false;
+    }
+    if (index->locations[id].cell != NONE) unlink_entry(index, id);
+    return link_entry(index, id, entity);
+}
+
+void spatial_remove(struct SpatialIndex *index, uint32_t id) {
+    if (id < index->locations_capacity && index->locations[id].cell != NONE) unlink_entry(index, id);
+}
+
+bool spatial_move(struct SpatialIndex *index, uint32_t id, float x, float y, float z) {
+    if (id >= index->locations_capacity || index->locations[id].cell == NONE) return false;
+    struct Location *location = &index->locations[id];
+    struct Cell *cell = &index->cells[location->cell];
+    struct SpatialEntry *entry = &cell->entries[location->slot];
+    if (cell_of(x) == cell->x && cell_of(z) == cell->z) {
+        entry->x = x;
+        entry->y = y;
+        entry->z = z;
+        return true;
+    }
+    struct SpatialEntity entity = {x, y, z, entry->radius};
+    unlink_entry(index, id);
+    return link_entry(index, id, &entity);
+}
+
+struct Rebuild {
+    struct SpatialIndex *index;
+    const struct SpatialEntity *entities;
+};
+
+// the cells of the entities, NONE for the ones not created yet. The table is only read
+static void find_cells_job(void *ctx, uint32_t begin, uint32_t end) {
+    struct Rebuild *rebuild = ctx;
+    const struct SpatialIndex *index = rebuild->index;
+    for (uint32_t i=begin; i<end; i++) {
+        index->rebuild_cells[i] = find_cell(index, cell_of(rebuild->entities[i].x), cell_of(rebuild->entities[i].z));
+    }
+}
+
+// every entity writes its own slot
+static void fill_job(void *ctx, uint32_t begin, uint32_t end) {
+    struct Rebuild *rebuild = ctx;
+    struct SpatialIndex *index = rebuild->index;
+    for (uint32_t i=begin; i<end; i++) {
+        const struct SpatialEntity *entity = &rebuild->entities[i];
+        uint32_t c = index->rebuild_cells[i], slot = index->rebuild_slots[i];
+        index->cells[c].entries[slot] = (struct SpatialEntry) {entity->x, entity->y, entity->z, entity->radius, i};
+        index->locations[i] = (struct Location) {c, slot};
+    }
+}
+
+static void clear(struct SpatialIndex *index) {
+    for (uint32_t c=0; c<index->cells_count; c++) index->cells[c].count = 0;
+    for (uint32_t i=0; i<index->locations_capacity; i++) index->locations[i].cell = NONE;
+    index->count = 0;
+}
+
+bool spatial_rebuild(struct SpatialIndex *index, const struct SpatialEntity *entities, uint32_t count) {
+    clear(index);
+    if (count > index->rebuild_capacity) {
+        uint32_t *cells = memory_realloc(index->rebuild_cells, count * sizeof(*cells), MEMORY_TAG_SIMULATION);
+        if (cells != NULL) index->rebuild_cells = cells;
+        uint32_t *slots = memory_realloc(index->rebuild_slots, count * sizeof(*slots), MEMORY_TAG_SIMULATION);
+        if (slots != NULL) index->rebuild_slots = slots;
+        if (cells == NULL || slots == NULL) {
+            FATAL("SPATIAL out of memory rebuilding %u entities", count);
+            return false;
+        }
+        index->rebuild_capacity = count;
+    }
+    if (!reserve_locations(index, count)) {
+        FATAL("SPATIAL out of memory rebuilding %u entities", count);
+        return false;
+    }
+
+    struct Rebuild rebuild = {index, entities};
+    job_parallel_for(count, SPATIAL_REBUILD_JOB, find_cells_job, &rebuild);
+
+    // the new cells and the slots, one light pass
+    index->max_radius = 0.0f;
+    for (uint32_t i=0; i<count; i++) {
+        uint32_t c = index->rebuild_cells[i];
+        if (c == NONE) {
+            c = create_cell(index, cell_of(entities[i].x), cell_of(entities[i].z));
+            if (c == NONE) {
+                FATAL("SPATIAL out of memory rebuilding %u entities", count);
+                clear(index);
+                return false;
+            }
+            index->rebuild_cells[i] = c;
+        }
+        index->rebuild_slots[i] = index->cells[c].count++;
+        if (entities[i].radius > index->max_radius) index->max_radius = entities[i].radius;
+    }
+    for (uint32_t c=0; c<index->cells_count; c++) {
+        if (!reserve_entries(&index->cells[c], index->cells[c].count)) {
+            FATAL("SPATIAL out of memory rebuilding %u entities", count);
+            clear(index);
+            return false;
+        }
+    }
+
+    job_parallel_for(count, SPATIAL_REBUILD_JOB, fill_job, &rebuild);
+    index->count = count;
+    return true;
+}
+
+uint32_t spatial_count(const struct SpatialIndex *index) {
+    return index->count;
+}
+
+// the cells of [x0, x1] x [z0, z1]: looked up one by one, or when the area holds
+// more cells than there are, a pass over them all
+typedef void (*cell_fn)(const struct Cell *cell, void *ctx);
+
+static void for_cells(const struct SpatialIndex *index, int32_t x0, int32_t x1, int32_t z0, int32_t z1,
+                      cell_fn fn, void *ctx) {
+    if ((uint64_t) (x1 - x0 + 1) * (uint64_t) (z1 - z0 + 1) > index->cells_count) {
+        for (uint32_t c=0; c<index->cells_count; c++) {
+            const struct Cell *cell = &index->cells[c];
+            if (cell->count > 0 && cell->x >= x0 && cell->x <= x1 && cell->z >= z0 && cell->z <= z1) fn(cell, ctx);
+        }
+        return;
+    }
+    for (int32_t z=z0; z<=z1; z++) {
+        for (int32_t x=x0; x<=x1; x++) {
+            uint32_t c = find_cell(index, x, z);
+            if (c != NONE && index->cells[c].count > 0) fn(&index->cells[c], ctx);
+        }
+    }
+}
+
+struct Found {
+    uint32_t *ids;
+    uint32_t capacity;
+    uint32_t count;
+    float x, y, z, range;
+    const struct Aabb *box;
+};
+
+static void range_cell(const struct Cell *cell, void *ctx) {
+    struct Found *found = ctx;
+    for (uint32_t i=0; i<cell->count; i++) {
+        const struct SpatialEntry *entry = &cell->entries[i];
+        float dx = entry->x - found->x, dy = entry->y - found->y, dz = entry->z - found->z;
+        float reach = found->range + entry->radius;
+        if (dx * dx + dy * dy + dz * dz > reach * reach) continue;
+        if (found->count < found->capacity) found->ids[found->count] = entry->id;
+        found->count++;
+    }
+}
+
+uint32_t spatial_query_range(const struct SpatialIndex *index, float x, float y, float z, float range,
+                             uint32_t *ids, uint32_t capacity) {
+    struct Found found = {ids, capacity, 0, x, y, z, range, NULL};
+    float reach = range + index->max_radius;
+    for_cells(index, cell_of(x - reach), cell_of(x + reach), cell_of(z - reach), cell_of(z + reach), range_cell, &found);
+    return found.count;
+}
+
+static void box_cell(const struct Cell *cell, void *ctx) {
+    struct Found *found = ctx;
+    const struct Aabb *box = found->box;
+    for (uint32_t i=0; i<cell->count; i++) {
+        const struct SpatialEntry *entry = &cell->entries[i];
+        float r = entry->radius;
+        if (entry->x + r < box->min_x || entry->x - r > box->max_x ||
+            entry->y + r < box->min_y || entry->y - r > box->max_y ||
+            entry->z + r < box->min_z || entry->z - r > box->max_z) {
+            continue;
+        }
+        if (found->count < found->capacity) found->ids[found->count] = entry->id;
+        found->count++;
+    }
+}
+
+uint32_t spatial_query_box(const struct SpatialIndex *index, const struct Aabb *box, uint32_t *ids, uint32_t capacity) {
+    struct Found found = {ids, capacity, 0, 0.0f, 0.0f, 0.0f, 0.0f, box};
+    float r = index->max_radius;
+    for_cells(index, cell_of(box->min_x - r), cell_of(box->max_x + r), cell_of(box->min_z - r), cell_of(box->max_z + r),
+              box_cell, &found);
+    return found.count;
+}
+
+struct Nearest {
+    uint32_t *ids;
+    float *distances;           // squared while searching
+    uint32_t k;
+    uint32_t count;
+    float x, y, z;
+    float limit;                // squared, the k-th distance once there are k
+};
+
+// insertion in the sorted arrays, k is small
+static void nearest_cell(const struct Cell *cell, void *ctx) {
+    struct Nearest *nearest = ctx;
+    for (uint32_t i=0; i<cell->count; i++) {
+        const struct SpatialEntry *entry = &cell->entries[i];
+        float dx = entry->x - nearest->x, dy = entry->y - nearest->y, dz = entry->z - nearest->z;
+        float d = dx * dx + dy * dy + dz * dz;
+        if (d > nearest->limit) continue;
+        uint32_t n = nearest->count < nearest->k ? nearest->count++ : nearest->k - 1;
+        while (n > 0 && nearest->distances[n - 1] > d) {
+            nearest->distances[n] = nearest->distances[n - 1];
+            nearest->ids[n] = nearest->ids[n - 1];
+            n--;
+        }
+        nearest->distances[n] = d;
+        nearest->ids[n] = entry->id;
+        if (nearest->count == nearest->k) nearest->limit = nearest->distances[nearest->k - 1];
+    }
+}
+
+// rings of cells around the one of x,z, until a ring can not be closer than the k-th found
+uint32_t spatial_query_nearest(const struct SpatialIndex *index, float x, float y, float z, float max_distance,
+                               uint32_t k, uint32_t *ids, float *distances) {
+    if (k == 0 || index->count == 0) return 0;
+    struct Nearest nearest = {ids, distances, k, 0, x, y, z, max_distance * max_distance};
+    int32_t cx = cell_of(x), cz = cell_of(z);
+    int32_t last = index->max_x - cx;
+    if (cx - index->min_x > last) last = cx - index->min_x;
+    if (index->max_z - cz > last) last = index->max_z - cz;
+    if (cz - index->min_z > last) last = cz - index->min_z;
+
+    for (int32_t ring=0; ring<=last; ring++) {
+        // the cells of this ring are at least ring - 1 cells away
+        float gap = (float) (ring - 1) * SPATIAL_CELL_SIZE;
+        if (ring > 1 && gap * gap > nearest.limit) break;
+        if (ring == 0) {
+            for_cells(index, cx, cx, cz, cz, nearest_cell, &nearest);
+            continue;
+        }
+        for_cells(index, cx - ring, cx + ring, cz - ring, cz - ring, nearest_cell, &nearest);
+        for_cells(index, cx - ring, cx + ring, cz + ring, cz + ring, nearest_cell, &nearest);
+        for_cells(index, cx - ring, cx - ring, cz - ring + 1, cz + ring - 1, nearest_cell, &nearest);
+        for_cells(index, cx + ring, cx + ring, cz - ring + 1, cz + ring - 1, nearest_cell, &nearest);
+    }
+    for (uint32_t i=0; i<nearest.count; i++) distances[i] = sqrtf(distances[i]);
+    return nearest.count;
+}
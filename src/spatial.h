@@ -0,0 +1,53 @@
+// Spatial index of the entities: which ones are within a range of a point, in a
+// box, or the nearest ones (AI targeting, item pickup, network interest).
+// A loose grid of chunk columns: an entity is in the bucket of the column its
+// center is in whatever its size, the queries widen their search by the largest
+// radius. The buckets keep a copy of the positions so a query only reads them.
+//  - moving within a column updates the entry, to another column it is a swap
+//    remove and an append
+//  - after a bulk move (every entity of a tick) spatial_rebuild() is faster,
+//    it runs on the job system
+//  - the queries write to the caller's arrays, they never allocate
+
+#pragma once
+
+#include "physics.h"
+#include "world.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SPATIAL_CELL_SIZE   SECTION_SIZE    // blocks per side of a bucket
+#define SPATIAL_REBUILD_JOB 4096            // entities per job of a rebuild
+
+// an entity is a sphere, its box is center +- radius
+struct SpatialEntity {
+    float x, y, z;
+    float radius;
+};
+
+struct SpatialIndex;
+
+struct SpatialIndex *spatial_create();
+void spatial_destroy(struct SpatialIndex *index);
+
+// ids are the caller's, dense from 0: the index keeps a location per id up to the largest.
+// Inserting an id already in moves it. False out of memory
+bool spatial_insert(struct SpatialIndex *index, uint32_t id, const struct SpatialEntity *entity);
+void spatial_remove(struct SpatialIndex *index, uint32_t id);
+// the radius is kept
+bool spatial_move(struct SpatialIndex *index, uint32_t id, float x, float y, float z);
+// replaces everything by entities[0, count), the id of each is its index. Empty on failure
+bool spatial_rebuild(struct SpatialIndex *index, const struct SpatialEntity *entities, uint32_t count);
+uint32_t spatial_count(const struct SpatialIndex *index);
+
+// The ids of the entities whose sphere meets the sphere of range around x,y,z.
+// At most capacity are written, returns how many there are in all
+uint32_t spatial_query_range(const struct SpatialIndex *index, float x, float y, float z, float range,
+                             uint32_t *ids, uint32_t capacity);
+// the entities whose box overlaps box, same as above
+uint32_t spatial_query_box(const struct SpatialIndex *index, const struct Aabb *box, uint32_t *ids, uint32_t capacity);
+// the k nearest centers within max_distance of x,y,z, nearest first, with their
+// distances (both arrays hold k). Returns how many, at most k
+uint32_t spatial_query_nearest(const struct SpatialIndex *index, float x, float y, float z, float max_distance,
+                               uint32_t k, uint32_t *ids, float *distances);
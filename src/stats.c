@@ -0,0 +1,94 @@
+#include "stats.h"
+#include "log.h"
+#include "memory.h"
+
+#include <stdlib.h>
+
+void tick_stats_add(struct TickStats *stats, double seconds, double budget) {
+    stats->count++;
+    stats->total += seconds;
+    if (seconds > stats->max) stats->max = seconds;
+    if (seconds > budget) stats->overruns++;
+}
+
+double tick_stats_average(const struct TickStats *stats) {
+    return stats->count ? stats->total / stats->count : 0.0;
+}
+
+void tick_stats_reset(struct TickStats *stats) {
+    *stats = (struct TickStats) {0};
+}
+
+bool frame_log_open(struct FrameLog *log, const char *path) {
+    *log = (struct FrameLog) {0};
+    if (path == NULL) return true;
+    log->file = fopen(path, "w");
+    if (log->file == NULL) {
+        ERROR("STATS failed to create the frame log %s", path);
+        return false;
+    }
+    fprintf(log->file, "frame,tick,ms\n");
+    return true;
+}
+
+void frame_log_add(struct FrameLog *log, uint64_t tick, double seconds) {
+    if (log->file != NULL) fprintf(log->file, "%u,%llu,%.3f\n", log->count, (unsigned long long) tick, seconds * 1000.0);
+    if (log->count == log->capacity) {
+        uint32_t capacity = log->capacity ? log->capacity * 2 : 1024;
+        double *samples = memory_realloc(log->samples, capacity * sizeof(*samples), MEMORY_TAG_IO);
+        if (samples == NULL) return;
+        log->samples = samples;
+        log->capacity = capacity;
+    }
+    log->samples[log->count++] = seconds;
+}
+
+static int compare_seconds(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+void frame_log_close(struct FrameLog *log) {
+    if (log->file != NULL) fclose(log->file);
+    if (log->count > 0) {
+        double total = 0.0;
+        for (uint32_t i=0; i<log->count; i++) total += log->samples[i];
+        qsort(log->samples, log->count, sizeof(double), compare_seconds);
+        double *s = log->samples;
+        uint32_t n = log->count;
+        INFO("STATS %u frames: %.2f ms avg, %.2f ms median, %.2f ms 95%%, %.2f ms 99%%, %.2f ms worst",
+             n, total / n * 1000.0, s[n / 2] * 1000.0, s[n * 95 / 100] * 1000.0, s[n * 99 / 100] * 1000.0, s[n - 1] * 1000.0);
+    }
+    memory_free(log->samples);
+    *log = (struct FrameLog) {0};
+}
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+
+uint64_t stats_resident_memory() {
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.WorkingSetSize;
+}
+
+#elif defined(__linux__)
+#include <unistd.h>
+
+uint64_t stats_resident_memory() {
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (file == NULL) return 0;
+    unsigned long long size = 0, resident = 0;
+    int read = fscanf(file, "%llu %llu", &size, &resident);
+    fclose(file);
+    if (read != 2) return 0;
+    return resident * (uint64_t) sysconf(_SC_PAGESIZE);
+}
+
+#else
+
+uint64_t stats_resident_memory() {
+    return 0;
+}
+#endif
@@ -0,0 +1,37 @@
+// Runtime statistics for the status reports
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// durations collected over one report interval
+struct TickStats {
+    uint32_t count;
+    uint32_t overruns;      // ticks longer than the budget
+    double total;
+    double max;
+};
+
+void tick_stats_add(struct TickStats *stats, double seconds, double budget);
+double tick_stats_average(const struct TickStats *stats);
+void tick_stats_reset(struct TickStats *stats);
+
+// every frame of a run: written as CSV (frame, tick, ms) when there is a file,
+// summarized with percentiles when closed
+struct FrameLog {
+    FILE *file;
+    double *samples;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+// path NULL keeps the samples for the summary only
+bool frame_log_open(struct FrameLog *log, const char *path);
+void frame_log_add(struct FrameLog *log, uint64_t tick, double seconds);
+// logs the average, median, 95th, 99th percentile and worst frame
+void frame_log_close(struct FrameLog *log);
+
+// resident memory of the process in bytes, 0 where it is not known
+uint64_t stats_resident_memory();
@@ -0,0 +1,333 @@
+#include "streamer.h"
+#include "chunk_cache.h"
+#include "memory.h"
+#include "generator.h"
+#include "job.h"
+#include "log.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// the ring loads one chunk past the view distance so every meshed chunk has its neighbors
+#define LOAD_MARGIN 1
+
+struct Streamer {
+    struct World *world;
+    struct StreamerConfig config;
+    int32_t side;                   // slots per side of the ring
+    struct ChunkMesh *slots;
+    int32_t center_x, center_z;     // chunk the player was in at the last update
+
+    struct Generator *generator;
+    struct ChunkCache *cache;
+
+    // scratch list reused between updates
+    struct ChunkMesh **remesh;
+    uint32_t meshed_last_update;
+    uint32_t cached_last_update;
+
+    float detail;                   // lowered under memory pressure
+};
+
+static const int SIDE_DX[4] = {-1, 1, 0, 0};
+static const int SIDE_DZ[4] = {0, 0, -1, 1};
+static const int SIDE_FACE[4] = {FACE_NEG_X, FACE_POS_X, FACE_NEG_Z, FACE_POS_Z};
+
+struct StreamerConfig streamer_default_config(int view_distance, uint32_t seed) {
+    struct StreamerConfig config = {
+        .view_distance = view_distance,
+        .lod_distances = {8, 16, 24},
+        .lod = true,
+        .cache_budget = CHUNK_CACHE_BUDGET,
+        .seed = seed,
+    };
+    return config;
+}
+
+static int32_t wrap(int32_t v, int32_t side) {
+    int32_t m = v % side;
+    return m < 0 ? m + side : m;
+}
+
+static struct ChunkMesh *slot_for(struct Streamer *streamer, int32_t chunk_x, int32_t chunk_z) {
+    return &streamer->slots[wrap(chunk_z, streamer->side) * streamer->side + wrap(chunk_x, streamer->side)];
+}
+
+struct Streamer *streamer_create(struct World *world, const struct StreamerConfig *config) {
+    if (config->view_distance < 1 || config->view_distance > STREAMER_MAX_VIEW_DISTANCE) {
+        ERROR("STREAMER view distance %d out of range 1..%d", config->view_distance, STREAMER_MAX_VIEW_DISTANCE);
+        return NULL;
+    }
+
+    struct Streamer *streamer = memory_calloc(1, sizeof(*streamer), MEMORY_TAG_MESHER);
+    if (streamer == NULL) {
+        FATAL("STREAMER failed to allocate the streamer");
+        return NULL;
+    }
+    streamer->world = world;
+    streamer->config = *config;
+    streamer->detail = 1.0f;
+    streamer->side = 2 * (config->view_distance + LOAD_MARGIN) + 1;
+
+    uint32_t count = (uint32_t) (streamer->side * streamer->side);
+    streamer->slots = memory_calloc(count, sizeof(*streamer->slots), MEMORY_TAG_MESHER);
+    streamer->remesh = memory_alloc(count * sizeof(*streamer->remesh), MEMORY_TAG_MESHER);
+    streamer->generator = generator_create(config->seed);
+    streamer->cache = chunk_cache_create(config->cache_budget);
+    if (streamer->slots == NULL || streamer->remesh == NULL || streamer->generator == NULL || streamer->cache == NULL) {
+        FATAL("STREAMER failed to allocate %u chunk slots", count);
+        streamer_destroy(streamer);
+        return NULL;
+    }
+    for (uint32_t i=0; i<count; i++) {
+        streamer->slots[i].lod = -1;
+        for (int face=0; face<FACE_COUNT; face++) streamer->slots[i].side_lods[face] = -1;
+    }
+    INFO("STREAMER view distance %d, %u chunk slots, LOD %s, cache %.0f MB", config->view_distance, count,
+         config->lod ? "on" : "off", config->cache_budget / (1024.0 * 1024.0));
+    return streamer;
+}
+
+void streamer_destroy(struct Streamer *streamer) {
+    if (streamer == NULL) return;
+    if (streamer->generator != NULL) {
+        generator_report(streamer->generator);
+        generator_destroy(streamer->generator);
+    }
+    if (streamer->slots != NULL) {
+        uint32_t count = (uint32_t) (streamer->side * streamer->side);
+        for (uint32_t i=0; i<count; i++) {
+            struct ChunkMesh *slot = &streamer->slots[i];
+            if (slot->loaded) world_remove_chunk(streamer->world, slot->x, slot->z);
+            for (int s=0; s<CHUNK_SECTIONS; s++) {
+                section_mesh_free(&slot->sections[s]);
+            }
+        }
+    }
+    if (streamer->cache != NULL) {
+        chunk_cache_report(streamer->cache);
+        chunk_cache_destroy(streamer->cache);
+    }
+    memory_free(streamer->slots);
+    memory_free(streamer->remesh);
+    memory_free(streamer);
+}
+
+const struct StreamerConfig *streamer_config(const struct Streamer *streamer) {
+    return &streamer->config;
+}
+
+struct Generator *streamer_generator(struct Streamer *streamer) {
+    return streamer->generator;
+}
+
+struct ChunkCache *streamer_cache(struct Streamer *streamer) {
+    return streamer->cache;
+}
+
+int streamer_lod_for_distance(const struct StreamerConfig *config, float distance) {
+    if (!config->lod) return 0;
+    for (int i=0; i<LOD_COUNT - 1; i++) {
+        if (distance <= config->lod_distances[i]) return i;
+    }
+    return LOD_COUNT - 1;
+}
+
+static void mesh_job(void *ctx, uint32_t begin, uint32_t end) {
+    struct Streamer *streamer = ctx;
+    block_t scratch[(SECTION_SIZE + 2) * (SECTION_SIZE + 2) * (SECTION_SIZE + 2)];
+
+    for (uint32_t i=begin; i<end; i++) {
+        struct ChunkMesh *slot = streamer->remesh[i];
+        struct Chunk *chunk = world_get_chunk(streamer->world, slot->x, slot->z);
+
+        for (int s=0; s<CHUNK_SECTIONS; s++) {
+            mesher_mesh_section(streamer->world, chunk, s, slot->lod, slot->side_lods, scratch, &slot->sections[s]);
+        }
+        slot->version++;
+        slot->meshed = true;
+    }
+}
+
+void streamer_set_detail(struct Streamer *streamer, float detail) {
+    if (detail < STREAMER_MIN_DETAIL) detail = STREAMER_MIN_DETAIL;
+    if (detail > 1.0f) detail = 1.0f;
+    if (detail != streamer->detail) {
+        INFO("STREAMER detail %.0f%%, view distance %.0f chunks", detail * 100.0f, streamer->config.view_distance * detail);
+    }
+    streamer->detail = detail;
+}
+
+void streamer_memory_pressure(void *streamer, enum memory_pressure pressure) {
+    static const float detail[] = {
+        [MEMORY_PRESSURE_NONE]     = 1.0f,
+        [MEMORY_PRESSURE_HIGH]     = 0.75f,
+        [MEMORY_PRESSURE_CRITICAL] = 0.5f,
+    };
+    streamer_set_detail(streamer, detail[pressure]);
+}
+
+void streamer_update(struct Streamer *streamer, float player_x, float player_z) {
+    // the chunks are still loaded out to the full distance, only what is drawn shrinks
+    struct StreamerConfig drawn = streamer->config;
+    drawn.view_distance = (int) ceilf(drawn.view_distance * streamer->detail);
+    for (int i=0; i<LOD_COUNT - 1; i++) {
+        drawn.lod_distances[i] = (int) ceilf(drawn.lod_distances[i] * streamer->detail);
+    }
+    const struct StreamerConfig *config = &drawn;
+    int32_t load_radius = streamer->config.view_distance + LOAD_MARGIN;
+    int32_t center_x = block_to_chunk((int32_t) floorf(player_x));
+    int32_t center_z = block_to_chunk((int32_t) floorf(player_z));
+    streamer->center_x = center_x;
+    streamer->center_z = center_z;
+
+    // hand the slots over to the chunks now in range, the ring exactly covers the load square
+    uint32_t cached = 0;
+    for (int32_t z=center_z - load_radius; z<=center_z + load_radius; z++) {
+        for (int32_t x=center_x - load_radius; x<=center_x + load_radius; x++) {
+            struct ChunkMesh *slot = slot_for(streamer, x, z);
+            if ((slot->loaded || slot->generating) && slot->x == x && slot->z == z) continue;
+
+            if (slot->loaded) {
+                // edits the cache has no room for stay in the world, the slot takes them back later
+                struct Chunk *leaving = world_get_chunk(streamer->world, slot->x, slot->z);
+                bool kept = leaving != NULL && !chunk_cache_put(streamer->cache, leaving) && leaving->unsaved != 0;
+                if (!kept) world_remove_chunk(streamer->world, slot->x, slot->z);
+            }
+            if (slot->generating) generator_cancel(streamer->generator, slot->x, slot->z);
+            slot->x = x;
+            slot->z = z;
+            slot->meshed = false;
+            slot->lod = -1;
+            for (int s=0; s<CHUNK_SECTIONS; s++) {
+                section_mesh_clear(&slot->sections[s]);
+            }
+
+            // a chunk already in the world, put there by somebody else or left with its edits,
+            // is adopted as loaded: cached and removed like the others when the slot moves on
+            slot->loaded = world_get_chunk(streamer->world, x, z) != NULL;
+            if (!slot->loaded) {
+                // meshed like a generated one, edits included
+                struct Chunk *chunk = chunk_cache_take(streamer->cache, x, z);
+                if (chunk != NULL && world_insert_chunk(streamer->world, chunk)) {
+                    slot->loaded = true;
+                    cached++;
+                } else {
+                    chunk_free(chunk);
+                }
+            }
+            slot->generating = !slot->loaded;
+            if (slot->generating) {
+                uint32_t priority = (uint32_t) ((x - center_x) * (x - center_x) + (z - center_z) * (z - center_z));
+                generator_request(streamer->generator, x, z, priority);
+            }
+        }
+    }
+    if (streamer->config.wait_generation) generator_flush(streamer->generator);
+    else generator_update(streamer->generator);
+
+    for (int32_t z=center_z - load_radius; z<=center_z + load_radius; z++) {
+        for (int32_t x=center_x - load_radius; x<=center_x + load_radius; x++) {
+            struct ChunkMesh *slot = slot_for(streamer, x, z);
+            if (!slot->generating) continue;
+            struct Chunk *chunk = generator_take(streamer->generator, x, z);
+            if (chunk == NULL) continue;
+            // generation is not an edit, the streamer meshes new chunks anyway and nothing
+            // saves them, they are generated again. Only edited chunks have unsaved sections
+            chunk->dirty = 0;
+            chunk->unsaved = 0;
+            // the world may have got one meanwhile
+            if (!world_insert_chunk(streamer->world, chunk)) chunk_free(chunk);
+            slot->generating = false;
+            slot->loaded = true;
+        }
+    }
+
+    // pick the LODs first, the remesh decision needs the neighbors' new LOD
+    for (int32_t z=center_z - load_radius; z<=center_z + load_radius; z++) {
+        for (int32_t x=center_x - load_radius; x<=center_x + load_radius; x++) {
+            struct ChunkMesh *slot = slot_for(streamer, x, z);
+            float distance = sqrtf((float) ((x - center_x) * (x - center_x) + (z - center_z) * (z - center_z)));
+            // the border faces need the neighbors' blocks
+            bool ready = slot->loaded;
+            for (int side=0; side<4 && ready; side++) {
+                ready = world_get_chunk(streamer->world, x + SIDE_DX[side], z + SIDE_DZ[side]) != NULL;
+            }
+            int lod = ready && distance <= config->view_distance ? streamer_lod_for_distance(config, distance) : -1;
+            if (lod != slot->lod) slot->meshed = false;
+            slot->lod = (int8_t) lod;
+        }
+    }
+
+    uint32_t remesh_count = 0;
+    for (int32_t z=center_z - load_radius; z<=center_z + load_radius; z++) {
+        for (int32_t x=center_x - load_radius; x<=center_x + load_radius; x++) {
+            struct ChunkMesh *slot = slot_for(streamer, x, z);
+            if (slot->lod < 0) {
+                // out of view, give the memory back
+                if (slot->meshed) {
+                    for (int s=0; s<CHUNK_SECTIONS; s++) section_mesh_free(&slot->sections[s]);
+                    slot->meshed = false;
+                }
+                continue;
+            }
+
+            struct Chunk *chunk = world_get_chunk(streamer->world, x, z);
+            bool remesh = !slot->meshed || chunk->dirty != 0;
+
+            // the border is meshed against the neighbors as they are drawn
+            for (int side=0; side<4; side++) {
+                int32_t nx = x + SIDE_DX[side], nz = z + SIDE_DZ[side];
+                const struct ChunkMesh *neighbor = slot_for(streamer, nx, nz);
+                int8_t neighbor_lod = neighbor->x == nx && neighbor->z == nz ? neighbor->lod : -1;
+                if (neighbor_lod != slot->side_lods[SIDE_FACE[side]]) remesh = true;
+                slot->side_lods[SIDE_FACE[side]] = neighbor_lod;
+
+                // an edit on the border shows on both sides
+                struct Chunk *neighbor_chunk = world_get_chunk(streamer->world, nx, nz);
+                if (neighbor_chunk != NULL && neighbor_chunk->dirty != 0) remesh = true;
+            }
+            if (remesh) streamer->remesh[remesh_count++] = slot;
+        }
+    }
+
+    job_parallel_for(remesh_count, 1, mesh_job, streamer);
+
+    // the edits are in the meshes now, out of view ones are picked up when they come back in
+    for (int32_t z=center_z - load_radius; z<=center_z + load_radius; z++) {
+        for (int32_t x=center_x - load_radius; x<=center_x + load_radius; x++) {
+            struct Chunk *chunk = world_get_chunk(streamer->world, x, z);
+            if (chunk != NULL) chunk->dirty = 0;
+        }
+    }
+    streamer->meshed_last_update = remesh_count;
+    streamer->cached_last_update = cached;
+}
+
+const struct ChunkMesh *streamer_chunk_mesh(struct Streamer *streamer, int32_t chunk_x, int32_t chunk_z) {
+    const struct ChunkMesh *slot = slot_for(streamer, chunk_x, chunk_z);
+    if (!slot->meshed || slot->x != chunk_x || slot->z != chunk_z) return NULL;
+    return slot;
+}
+
+void streamer_stats(struct Streamer *streamer, struct StreamerStats *stats) {
+    *stats = (struct StreamerStats) {0};
+    stats->chunks_meshed = streamer->meshed_last_update;
+    stats->chunks_cached = streamer->cached_last_update;
+
+    uint32_t count = (uint32_t) (streamer->side * streamer->side);
+    for (uint32_t i=0; i<count; i++) {
+        const struct ChunkMesh *slot = &streamer->slots[i];
+        if (slot->loaded) stats->chunks_loaded++;
+        if (slot->generating) stats->chunks_generating++;
+        if (!slot->meshed) continue;
+
+        stats->chunks_drawn[slot->lod]++;
+        for (int s=0; s<CHUNK_SECTIONS; s++) {
+            stats->vertices[slot->lod] += section_mesh_vertices(&slot->sections[s]);
+        }
+    }
+    for (int lod=0; lod<LOD_COUNT; lod++) {
+        stats->vertex_bytes += stats->vertices[lod] * sizeof(struct BlockVertex);
+    }
+}
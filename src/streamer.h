@@ -0,0 +1,81 @@
+// Chunk streamer: keeps the chunks around the player generated and meshed.
+// The chunks are generated in the background (generator.h) and meshed once
+// they and their 4 neighbors are in the world.
+// Chunks live in a ring of slots indexed by their coordinates modulo the ring
+// size, so moving around only touches the slots that changed hands.
+// Far chunks are meshed from downsampled sections (LOD 1..3). Where two chunks
+// at different LODs meet each one culls its border against the other as drawn
+// and adds skirts, so no cracks show between them.
+// Chunks leaving the loaded area go to a compressed cache (chunk_cache.h), a
+// chunk coming back is taken from there before asking the generator.
+
+#pragma once
+
+#include "world.h"
+#include "chunk_cache.h"
+#include "memory.h"
+#include "mesher.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define STREAMER_MAX_VIEW_DISTANCE 64
+#define STREAMER_MIN_DETAIL 0.25f
+
+struct StreamerConfig {
+    int view_distance;                  // radius in chunks of the meshed area
+    int lod_distances[LOD_COUNT - 1];   // furthest chunk drawn at LOD 0, 1 and 2. Beyond is LOD 3
+    bool lod;                           // false draws everything at full detail
+    bool wait_generation;               // streamer_update() blocks until the chunks in range are generated (benchmarks)
+    uint64_t cache_budget;              // bytes of compressed chunks kept past the loaded area, 0 none
+    uint32_t seed;
+};
+
+struct ChunkMesh {
+    int32_t x, z;
+    bool loaded;                        // in the world
+    bool generating;                    // requested from the generator, not in the world yet
+    bool meshed;
+    uint32_t version;                   // bumped at each mesh, the renderer uploads again when it changes
+    int8_t lod;                         // -1 when out of view
+    int8_t side_lods[FACE_COUNT];       // neighbor LODs at the last mesh, -1 for the vertical sides and out of view
+    struct SectionMesh sections[CHUNK_SECTIONS];
+};
+
+struct StreamerStats {
+    uint32_t chunks_loaded;
+    uint32_t chunks_generating;
+    uint32_t chunks_cached;             // out of the cache by the last update
+    uint32_t chunks_drawn[LOD_COUNT];
+    uint32_t chunks_meshed;             // by the last update
+    uint64_t vertices[LOD_COUNT];
+    uint64_t vertex_bytes;              // what the vertex buffers take on the GPU
+};
+
+struct Streamer;
+
+struct StreamerConfig streamer_default_config(int view_distance, uint32_t seed);
+struct Streamer *streamer_create(struct World *world, const struct StreamerConfig *config);
+void streamer_destroy(struct Streamer *streamer);
+const struct StreamerConfig *streamer_config(const struct Streamer *streamer);
+// generates the chunks it requests, see generator_set_density_backend()
+struct Generator *streamer_generator(struct Streamer *streamer);
+// holds the chunks that left the loaded area
+struct ChunkCache *streamer_cache(struct Streamer *streamer);
+
+// LOD for a chunk this many chunks away from the player
+int streamer_lod_for_distance(const struct StreamerConfig *config, float distance);
+
+// request the chunks coming in range, drop the ones leaving it, move the generated
+// ones to the world, then remesh whatever changed LOD, had a neighbor change LOD or was edited
+void streamer_update(struct Streamer *streamer, float player_x, float player_z);
+
+// scale the drawn distance and the LOD distances by detail (STREAMER_MIN_DETAIL..1),
+// the meshes that fall out of view free their memory at the next update
+void streamer_set_detail(struct Streamer *streamer, float detail);
+// memory_pressure_fn for a Streamer: less detail the closer to the budget
+void streamer_memory_pressure(void *streamer, enum memory_pressure pressure);
+
+// NULL when the chunk is not meshed
+const struct ChunkMesh *streamer_chunk_mesh(struct Streamer *streamer, int32_t chunk_x, int32_t chunk_z);
+void streamer_stats(struct Streamer *streamer, struct StreamerStats *stats);
@@ -0,0 +1,603 @@
+#include "terrain.h"
+
+#include "defines.h"
+#include "gpu_memory.h"
+#include "log.h"
+#include "memory.h"
+#include "job.h"
+#include "pipeline.h"
+#include "timer.h"
+#include "translucent.h"
+#include "vulkan_if.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// quads in one draw, the shared index buffer covers that many
+#define MAX_QUADS 16384
+
+struct GpuChunk {
+    int32_t x, z;
+    uint32_t version;               // of the ChunkMesh uploaded
+    bool used;
+    int8_t lod;
+    VkBuffer buffer;                // VK_NULL_HANDLE for an empty chunk
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    void *mapped;                   // for the lifetime of the buffer
+    uint32_t first[CHUNK_SECTIONS][MESH_LAYER_COUNT];   // in vertices
+    uint32_t count[CHUNK_SECTIONS][MESH_LAYER_COUNT];
+
+    // translucent quads: their own indices after the vertices, in back to front order
+    VkDeviceSize index_offset;                          // bytes
+    uint32_t translucent_first[CHUNK_SECTIONS];         // in quads
+    int16_t (*centers)[3];                              // of the translucent quads, see translucent.h
+    int16_t sort_cell[CHUNK_SECTIONS][3];               // camera cell of the last sort
+    bool sorted[CHUNK_SECTIONS];
+    bool sorting[CHUNK_SECTIONS];                       // a job is in flight
+};
+
+// One section sorted on a worker. Everything the job reads is copied in,
+// the chunk can be remeshed or dropped before the job runs
+struct SortJob {
+    struct JobCounter counter;
+    int32_t x, z;
+    uint32_t version;
+    int section;
+    int16_t cell[3];
+    float camera[3];                // from the section origin
+    uint32_t quads;
+    double seconds;                 // spent in the job
+    uint32_t *indices;              // quads * 6, the result
+    uint32_t *scratch;              // quads * 2
+    int16_t (*centers)[3];
+};
+
+struct SectionDraw {
+    struct GpuChunk *chunk;
+    int section;
+    float distance;                 // squared, camera to section center
+};
+
+struct ModeTotals {
+    uint64_t frames;
+    uint64_t fragments;
+    uint64_t fragment_frames;       // frames with a fragment count
+    double gpu_ms;
+    uint64_t gpu_frames;
+};
+
+static const char *DEPTH_MODE_NAMES[DEPTH_MODE_COUNT] = {"unsorted", "sorted", "prepass"};
+
+static enum depth_mode depth_mode = DEPTH_MODE_SORTED;
+static struct Streamer *streamer;
+
+// indexed like the streamer's ring: chunk coordinates modulo the side
+static struct GpuChunk *chunks;
+static int32_t side;
+
+static VkBuffer index_buffer = VK_NULL_HANDLE;
+static VkDeviceMemory index_memory = VK_NULL_HANDLE;
+static bool allocation_failed;      // warned once
+
+static struct SortJob *sorts[TERRAIN_MAX_SORTS];   // in flight
+static uint32_t sort_count;
+static uint64_t sorts_total;
+static double sort_seconds_total;
+static bool wait_sorts;            // for the next frame, see terrain_set_wait_sorts()
+static uint64_t frames_total;
+
+static struct ModeTotals totals[DEPTH_MODE_COUNT];
+static int recorded_mode = -1;      // of the frame in flight, its counters come back after the fence
+
+
+const char *depth_mode_name(enum depth_mode mode) {
+    return mode < DEPTH_MODE_COUNT ? DEPTH_MODE_NAMES[mode] : "?";
+}
+
+enum depth_mode depth_mode_from_name(const char *name) {
+    for (int i=0; i<DEPTH_MODE_COUNT; i++) {
+        if (strcmp(name, DEPTH_MODE_NAMES[i]) == 0) return i;
+    }
+    return DEPTH_MODE_COUNT;
+}
+
+void terrain_set_depth_mode(enum depth_mode mode) {
+    if (mode >= DEPTH_MODE_COUNT) return;
+    if (mode != depth_mode) INFO("TERRAIN depth mode %s", depth_mode_name(mode));
+    depth_mode = mode;
+}
+
+enum depth_mode terrain_depth_mode() {
+    return depth_mode;
+}
+
+void terrain_set_wait_sorts(bool wait) {
+    wait_sorts = wait;
+}
+
+static int32_t wrap(int32_t v, int32_t side) {
+    int32_t m = v % side;
+    return m < 0 ? m + side : m;
+}
+
+static struct GpuChunk *chunk_for(int32_t chunk_x, int32_t chunk_z) {
+    return &chunks[wrap(chunk_z, side) * side + wrap(chunk_x, side)];
+}
+
+// the fence was waited on, nothing still reads the buffer
+static void release_chunk(struct GpuChunk *chunk) {
+    if (chunk->buffer != VK_NULL_HANDLE) {
+        vkUnmapMemory(logical_device, chunk->memory);
+        vkDestroyBuffer(logical_device, chunk->buffer, NULL);
+        vkFreeMemory(logical_device, chunk->memory, NULL);
+    }
+    memory_free(chunk->centers);
+    memset(chunk, 0, sizeof(*chunk));
+}
+
+// the 0 1 2 2 3 0 pattern for quads [first, first + count)
+static void quad_indices(uint32_t *indices, uint32_t first, uint32_t count) {
+    static const uint32_t pattern[6] = {0, 1, 2, 2, 3, 0};
+    for (uint32_t q=0; q<count; q++) {
+        for (int i=0; i<6; i++) indices[q * 6 + i] = (first + q) * 4 + pattern[i];
+    }
+}
+
+// One allocation per chunk, enough for the view distances we run.
+// When the driver runs out of allocations the chunk is not drawn.
+static bool upload_chunk(struct GpuChunk *chunk, const struct ChunkMesh *mesh) {
+    release_chunk(chunk);
+    chunk->x = mesh->x;
+    chunk->z = mesh->z;
+    chunk->version = mesh->version;
+    chunk->lod = mesh->lod;
+    chunk->used = true;
+
+    uint32_t total = 0, translucent = 0;
+    for (int s=0; s<CHUNK_SECTIONS; s++) {
+        for (int l=0; l<MESH_LAYER_COUNT; l++) {
+            chunk->first[s][l] = total;
+            chunk->count[s][l] = mesh->sections[s].layers[l].count;
+            total += mesh->sections[s].layers[l].count;
+        }
+        chunk->translucent_first[s] = translucent;
+        translucent += chunk->count[s][MESH_LAYER_TRANSLUCENT] / 4;
+    }
+    if (total == 0) return true;
+
+    if (translucent > 0) {
+        chunk->centers = memory_alloc(translucent * sizeof(*chunk->centers), MEMORY_TAG_RENDERER);
+        if (chunk->centers == NULL) {
+            chunk->used = false;
+            return false;
+        }
+    }
+    // index offsets are multiples of 4
+    chunk->index_offset = ((VkDeviceSize) total * sizeof(struct BlockVertex) + 3) & ~(VkDeviceSize) 3;
+    chunk->size = chunk->index_offset + (VkDeviceSize) translucent * 6 * sizeof(uint32_t);
+    if (!create_buffer(chunk->size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                       &chunk->buffer, &chunk->memory)) {
+        if (!allocation_failed) WARNING("TERRAIN out of GPU memory, some chunks are not drawn");
+        allocation_failed = true;
+        chunk->buffer = VK_NULL_HANDLE;
+        release_chunk(chunk);
+        return false;
+    }
+
+    vkMapMemory(logical_device, chunk->memory, 0, chunk->size, 0, &chunk->mapped);
+    struct BlockVertex *vertices = chunk->mapped;
+    uint32_t *indices = (uint32_t *) ((char *) chunk->mapped + chunk->index_offset);
+    for (int s=0; s<CHUNK_SECTIONS; s++) {
+        for (int l=0; l<MESH_LAYER_COUNT; l++) {
+            memcpy(vertices + chunk->first[s][l], mesh->sections[s].layers[l].vertices,
+                   chunk->count[s][l] * sizeof(struct BlockVertex));
+        }
+        // unsorted until the first sort comes back
+        const struct Mesh *layer = &mesh->sections[s].layers[MESH_LAYER_TRANSLUCENT];
+        if (layer->count > 0) {
+            translucent_centers(layer->vertices, layer->count / 4, chunk->centers + chunk->translucent_first[s]);
+            quad_indices(indices + chunk->translucent_first[s] * 6, 0, layer->count / 4);
+        }
+    }
+    render_stats.upload_bytes += chunk->size;
+    return true;
+}
+
+// 0 1 2 2 3 0 for every quad
+static bool create_index_buffer() {
+    VkDeviceSize size = MAX_QUADS * 6 * sizeof(uint32_t);
+    if (!create_buffer(size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                       &index_buffer, &index_memory)) {
+        return false;
+    }
+    uint32_t *indices;
+    vkMapMemory(logical_device, index_memory, 0, size, 0, (void **) &indices);
+    quad_indices(indices, 0, MAX_QUADS);
+    vkUnmapMemory(logical_device, index_memory);
+    return true;
+}
+
+static void sort_job(void *arg) {
+    struct SortJob *job = arg;
+    double start = timer_now();
+    translucent_sort((const int16_t (*)[3]) job->centers, job->quads, job->camera, job->indices, job->scratch);
+    job->seconds = timer_now() - start;
+}
+
+// one allocation for the job and its arrays, freed once the result is applied
+static void submit_sort(struct GpuChunk *chunk, int section, const float camera[3], const int16_t cell[3]) {
+    uint32_t quads = chunk->count[section][MESH_LAYER_TRANSLUCENT] / 4;
+    struct SortJob *job = memory_alloc(sizeof(*job) + quads * (6 + 2) * sizeof(uint32_t) + quads * sizeof(*job->centers),
+                                       MEMORY_TAG_RENDERER);
+    if (job == NULL) return;
+    memset(job, 0, sizeof(*job));
+    job->x = chunk->x;
+    job->z = chunk->z;
+    job->version = chunk->version;
+    job->section = section;
+    memcpy(job->cell, cell, sizeof(job->cell));
+    memcpy(job->camera, camera, sizeof(job->camera));
+    job->quads = quads;
+    job->indices = (uint32_t *) (job + 1);
+    job->scratch = job->indices + quads * 6;
+    job->centers = (int16_t (*)[3]) (job->scratch + quads * 2);
+    memcpy(job->centers, chunk->centers + chunk->translucent_first[section], quads * sizeof(*job->centers));
+
+    chunk->sorting[section] = true;
+    sorts[sort_count++] = job;
+    job_submit(sort_job, job, &job->counter);
+}
+
+// the finished sorts go in the index buffers, the fence was waited on so nothing reads them
+static void collect_sorts() {
+    render_stats.sorts = 0;
+    render_stats.sort_ms = 0.0;
+    for (uint32_t i=0; i<sort_count;) {
+        struct SortJob *job = sorts[i];
+        if (wait_sorts) job_wait(&job->counter);
+        if (!job_done(&job->counter)) {
+            i++;
+            continue;
+        }
+        struct GpuChunk *chunk = chunk_for(job->x, job->z);
+        // a remeshed chunk was reset, its sort is out of date
+        if (chunk->used && chunk->x == job->x && chunk->z == job->z && chunk->version == job->version) {
+            uint32_t *indices = (uint32_t *) ((char *) chunk->mapped + chunk->index_offset);
+            memcpy(indices + chunk->translucent_first[job->section] * 6, job->indices, job->quads * 6 * sizeof(uint32_t));
+            memcpy(chunk->sort_cell[job->section], job->cell, sizeof(job->cell));
+            chunk->sorted[job->section] = true;
+            chunk->sorting[job->section] = false;
+        }
+        render_stats.sorts++;
+        render_stats.sort_ms += job->seconds * 1000.0;
+        sorts_total++;
+        sort_seconds_total += job->seconds;
+
+        memory_free(job);
+        sorts[i] = sorts[--sort_count];
+    }
+}
+
+bool terrain_create(struct Streamer *_streamer) {
+    streamer = _streamer;
+    // exactly covers the drawn square, every slot is checked at each upload
+    side = 2 * streamer_config(streamer)->view_distance + 1;
+    chunks = memory_calloc((size_t) side * side, sizeof(*chunks), MEMORY_TAG_RENDERER);
+    if (chunks == NULL) {
+        FATAL("TERRAIN failed to allocate the chunk table");
+        return false;
+    }
+    if (!create_index_buffer()) {
+        FATAL("TERRAIN failed to create the index buffer");
+        return false;
+    }
+    // the meshes are the bulk of the GPU memory, the streamer draws less when it runs short
+    gpu_memory_add_callback(streamer_memory_pressure, streamer);
+    INFO("TERRAIN depth %s, depth mode %s", depth_format == VK_FORMAT_D32_SFLOAT ? "D32 float" : "fallback",
+         depth_mode_name(depth_mode));
+    return true;
+}
+
+static void report() {
+    if (frames_total > 0) {
+        INFO("TERRAIN %llu translucent sorts, %.2f per frame, %.1f us each", (unsigned long long) sorts_total,
+             (double) sorts_total / frames_total, sorts_total > 0 ? sort_seconds_total / sorts_total * 1e6 : 0.0);
+    }
+    const struct ModeTotals *base = &totals[DEPTH_MODE_UNSORTED];
+    for (int i=0; i<DEPTH_MODE_COUNT; i++) {
+        const struct ModeTotals *t = &totals[i];
+        if (t->frames == 0) continue;
+        double gpu = t->gpu_frames > 0 ? t->gpu_ms / t->gpu_frames : -1.0;
+        if (t->fragment_frames == 0) {
+            INFO("TERRAIN %-8s %6llu frames, fragments n/a, gpu %.2f ms", depth_mode_name(i),
+                 (unsigned long long) t->frames, gpu);
+            continue;
+        }
+        double fragments = (double) t->fragments / t->fragment_frames;
+        if (i != DEPTH_MODE_UNSORTED && base->fragment_frames > 0) {
+            double unsorted = (double) base->fragments / base->fragment_frames;
+            INFO("TERRAIN %-8s %6llu frames, %.2fM fragments/frame (%+.1f%% vs unsorted), gpu %.2f ms",
+                 depth_mode_name(i), (unsigned long long) t->frames, fragments / 1e6,
+                 unsorted > 0.0 ? (fragments / unsorted - 1.0) * 100.0 : 0.0, gpu);
+        } else {
+            INFO("TERRAIN %-8s %6llu frames, %.2fM fragments/frame, gpu %.2f ms", depth_mode_name(i),
+                 (unsigned long long) t->frames, fragments / 1e6, gpu);
+        }
+    }
+}
+
+void terrain_destroy() {
+    for (uint32_t i=0; i<sort_count; i++) {
+        job_wait(&sorts[i]->counter);
+        memory_free(sorts[i]);
+    }
+    sort_count = 0;
+
+    if (chunks != NULL) {
+        report();
+        for (int32_t i=0; i<side * side; i++) release_chunk(&chunks[i]);
+        memory_free(chunks);
+        chunks = NULL;
+        gpu_memory_remove_callback(streamer_memory_pressure, streamer);
+    }
+    if (index_buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(logical_device, index_buffer, NULL);
+        vkFreeMemory(logical_device, index_memory, NULL);
+        index_buffer = VK_NULL_HANDLE;
+    }
+}
+
+void terrain_upload() {
+    if (chunks == NULL) return;
+    collect_sorts();
+    frames_total++;
+
+    int32_t radius = streamer_config(streamer)->view_distance;
+    int32_t center_x = block_to_chunk((int32_t) floorf(game.player.x));
+    int32_t center_z = block_to_chunk((int32_t) floorf(game.player.z));
+
+    uint32_t uploads = 0, resident = 0;
+    for (int32_t z=center_z - radius; z<=center_z + radius; z++) {
+        for (int32_t x=center_x - radius; x<=center_x + radius; x++) {
+            struct GpuChunk *chunk = chunk_for(x, z);
+            bool same = chunk->used && chunk->x == x && chunk->z == z;
+            const struct ChunkMesh *mesh = streamer_chunk_mesh(streamer, x, z);
+            if (mesh == NULL) {
+                // out of view or not meshed yet, what is left in the slot is not drawn anymore
+                if (chunk->used) release_chunk(chunk);
+                continue;
+            }
+            if ((!same || chunk->version != mesh->version) && uploads < TERRAIN_UPLOADS_PER_FRAME) {
+                same = upload_chunk(chunk, mesh);
+                uploads++;
+            }
+            // an old version of the same chunk is drawn until its turn comes
+            if (same) resident++;
+        }
+    }
+    render_stats.chunks_meshed = resident;
+}
+
+// Column major, camera relative. Infinite far plane with reversed depth:
+// depth = near / distance along the view, 1 at the near plane and 0 at infinity.
+// y is flipped, Vulkan's clip space points down
+static void view_projection(float m[16], float forward[3]) {
+    float sy = sinf(game.player.yaw), cy = cosf(game.player.yaw);
+    float sp = sinf(game.player.pitch), cp = cosf(game.player.pitch);
+    float f[3] = {sy * cp, sp, cy * cp};
+    float r[3] = {-cy, 0.0f, sy};
+    float u[3] = {-sy * sp, cp, -cy * sp};
+
+    float focal = 1.0f / tanf(TERRAIN_FOV * 0.5f);
+    float aspect = (float) swap_chain.extent.width / (float) swap_chain.extent.height;
+
+    memset(m, 0, 16 * sizeof(float));
+    for (int i=0; i<3; i++) {
+        m[i * 4 + 0] = r[i] * focal / aspect;
+        m[i * 4 + 1] = -u[i] * focal;
+        m[i * 4 + 3] = f[i];
+        forward[i] = f[i];
+    }
+    m[3 * 4 + 2] = TERRAIN_NEAR;
+}
+
+// left, right, bottom, top and near, from the rows of the matrix. No far plane
+static void frustum_planes(const float m[16], float planes[5][4]) {
+    for (int i=0; i<4; i++) {
+        float row0 = m[i * 4 + 0], row1 = m[i * 4 + 1], row2 = m[i * 4 + 2], row3 = m[i * 4 + 3];
+        planes[0][i] = row3 + row0;
+        planes[1][i] = row3 - row0;
+        planes[2][i] = row3 + row1;
+        planes[3][i] = row3 - row1;
+        planes[4][i] = row3 - row2;
+    }
+}
+
+static bool box_visible(float planes[5][4], const float min[3], const float max[3]) {
+    for (int p=0; p<5; p++) {
+        // the corner furthest along the normal
+        float x = planes[p][0] >= 0.0f ? max[0] : min[0];
+        float y = planes[p][1] >= 0.0f ? max[1] : min[1];
+        float z = planes[p][2] >= 0.0f ? max[2] : min[2];
+        if (planes[p][0] * x + planes[p][1] * y + planes[p][2] * z + planes[p][3] < 0.0f) return false;
+    }
+    return true;
+}
+
+static int compare_distance(const void *a, const void *b) {
+    float da = ((const struct SectionDraw *) a)->distance;
+    float db = ((const struct SectionDraw *) b)->distance;
+    return (da > db) - (da < db);
+}
+
+// the counters read after the fence belong to the frame recorded before
+static void account_last_frame() {
+    if (recorded_mode < 0) return;
+    struct ModeTotals *t = &totals[recorded_mode];
+    t->frames++;
+    if (render_stats.fragments >= 0) {
+        t->fragments += (uint64_t) render_stats.fragments;
+        t->fragment_frames++;
+    }
+    if (render_stats.gpu_ms >= 0.0) {
+        t->gpu_ms += render_stats.gpu_ms;
+        t->gpu_frames++;
+    }
+}
+
+static void section_origin(const struct SectionDraw *draw, float origin[4]) {
+    origin[0] = (float) (draw->chunk->x * SECTION_SIZE) - game.player.x;
+    origin[1] = (float) (draw->section * SECTION_SIZE) - game.player.y;
+    origin[2] = (float) (draw->chunk->z * SECTION_SIZE) - game.player.z;
+    origin[3] = 0.0f;
+}
+
+static void draw_layer(VkCommandBuffer cmd_buffer, const struct SectionDraw *draws, uint32_t count,
+                       enum mesh_layer layer) {
+    const struct GpuChunk *bound = NULL;
+    for (uint32_t n=0; n<count; n++) {
+        const struct SectionDraw *draw = &draws[n];
+        uint32_t vertices = draw->chunk->count[draw->section][layer];
+        if (vertices == 0) continue;
+
+        if (draw->chunk != bound) {
+            VkDeviceSize offset = 0;
+            vkCmdBindVertexBuffers(cmd_buffer, 0, 1, &draw->chunk->buffer, &offset);
+            bound = draw->chunk;
+        }
+        float origin[4];
+        section_origin(draw, origin);
+        vkCmdPushConstants(cmd_buffer, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT,
+                           offsetof(struct block_push_constants, origin), sizeof(origin), origin);
+
+        uint32_t first = draw->chunk->first[draw->section][layer];
+        for (uint32_t quad=0; quad<vertices / 4; quad+=MAX_QUADS) {
+            uint32_t quads = vertices / 4 - quad < MAX_QUADS ? vertices / 4 - quad : MAX_QUADS;
+            vkCmdDrawIndexed(cmd_buffer, quads * 6, 1, 0, (int32_t) (first + quad * 4), 0);
+            render_stats.draw_calls++;
+        }
+    }
+}
+
+// each section with its own sorted indices, the sections back to front
+static void draw_translucent(VkCommandBuffer cmd_buffer, const struct SectionDraw *draws, uint32_t count) {
+    const struct GpuChunk *bound = NULL;
+    for (uint32_t n=count; n-->0;) {
+        const struct SectionDraw *draw = &draws[n];
+        uint32_t quads = draw->chunk->count[draw->section][MESH_LAYER_TRANSLUCENT] / 4;
+        if (quads == 0) continue;
+
+        if (draw->chunk != bound) {
+            VkDeviceSize offset = 0;
+            vkCmdBindVertexBuffers(cmd_buffer, 0, 1, &draw->chunk->buffer, &offset);
+            bound = draw->chunk;
+        }
+        VkDeviceSize indices = draw->chunk->index_offset + (VkDeviceSize) draw->chunk->translucent_first[draw->section] * 6 * sizeof(uint32_t);
+        vkCmdBindIndexBuffer(cmd_buffer, draw->chunk->buffer, indices, VK_INDEX_TYPE_UINT32);
+
+        float origin[4];
+        section_origin(draw, origin);
+        vkCmdPushConstants(cmd_buffer, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT,
+                           offsetof(struct block_push_constants, origin), sizeof(origin), origin);
+        vkCmdDrawIndexed(cmd_buffer, quads * 6, 1, 0, (int32_t) draw->chunk->first[draw->section][MESH_LAYER_TRANSLUCENT], 0);
+        render_stats.draw_calls++;
+    }
+}
+
+// draws is sorted front to back: the closest sections, where the order shows most, go first
+static void request_sorts(const struct SectionDraw *draws, uint32_t count) {
+    uint32_t submitted = 0;
+    for (uint32_t n=0; n<count && submitted < TERRAIN_SORTS_PER_FRAME && sort_count < TERRAIN_MAX_SORTS; n++) {
+        struct GpuChunk *chunk = draws[n].chunk;
+        int s = draws[n].section;
+        if (chunk->count[s][MESH_LAYER_TRANSLUCENT] == 0 || chunk->sorting[s]) continue;
+
+        float origin[4], camera[3];
+        section_origin(&draws[n], origin);
+        for (int i=0; i<3; i++) camera[i] = -origin[i];
+        int16_t cell[3];
+        translucent_camera_cell(camera, chunk->lod, cell);
+        if (chunk->sorted[s] && memcmp(cell, chunk->sort_cell[s], sizeof(cell)) == 0) continue;
+
+        submit_sort(chunk, s, camera, cell);
+        submitted++;
+    }
+}
+
+void terrain_record(VkCommandBuffer cmd_buffer) {
+    account_last_frame();
+    recorded_mode = -1;
+    if (chunks == NULL) return;
+
+    struct block_push_constants push;
+    float forward[3], planes[5][4];
+    view_projection(push.view_proj, forward);
+    frustum_planes(push.view_proj, planes);
+
+    // every section of the resident chunks that has something in view
+    struct SectionDraw *draws = frame_arena_alloc(frame_arena, (size_t) side * side * CHUNK_SECTIONS * sizeof(*draws));
+    if (draws == NULL) return;
+    uint32_t count = 0, visible_chunks = 0;
+    for (int32_t i=0; i<side * side; i++) {
+        struct GpuChunk *chunk = &chunks[i];
+        if (!chunk->used || chunk->buffer == VK_NULL_HANDLE) continue;
+
+        uint32_t before = count;
+        for (int s=0; s<CHUNK_SECTIONS; s++) {
+            uint32_t vertices = 0;
+            for (int l=0; l<MESH_LAYER_COUNT; l++) vertices += chunk->count[s][l];
+            if (vertices == 0) continue;
+
+            float min[3] = {
+                (float) (chunk->x * SECTION_SIZE) - game.player.x,
+                // the skirts hang one cell below the section
+                (float) (s * SECTION_SIZE - (1 << chunk->lod)) - game.player.y,
+                (float) (chunk->z * SECTION_SIZE) - game.player.z,
+            };
+            float max[3] = {min[0] + SECTION_SIZE, (float) ((s + 1) * SECTION_SIZE) - game.player.y, min[2] + SECTION_SIZE};
+            if (!box_visible(planes, min, max)) continue;
+
+            float dx = min[0] + SECTION_SIZE * 0.5f, dy = max[1] - SECTION_SIZE * 0.5f, dz = min[2] + SECTION_SIZE * 0.5f;
+            draws[count++] = (struct SectionDraw) {chunk, s, dx * dx + dy * dy + dz * dz};
+        }
+        if (count > before) visible_chunks++;
+    }
+    render_stats.chunks_visible = visible_chunks;
+
+    vkCmdBindIndexBuffer(cmd_buffer, index_buffer, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdPushConstants(cmd_buffer, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT,
+                       0, sizeof(push.view_proj), push.view_proj);
+
+    if (depth_mode != DEPTH_MODE_UNSORTED) qsort(draws, count, sizeof(*draws), compare_distance);
+
+    struct pipeline_desc opaque = pipeline_desc_for_pass(PIPELINE_PASS_OPAQUE);
+    if (depth_mode == DEPTH_MODE_PREPASS) {
+        struct pipeline_desc depth = pipeline_desc_for_pass(PIPELINE_PASS_DEPTH);
+        vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_get(&depth));
+        draw_layer(cmd_buffer, draws, count, MESH_LAYER_SOLID);
+        // the depth is final, only the front fragment of each pixel passes
+        opaque.depth_write = VK_FALSE;
+        opaque.depth_compare = VK_COMPARE_OP_EQUAL;
+    }
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_get(&opaque));
+    draw_layer(cmd_buffer, draws, count, MESH_LAYER_SOLID);
+
+    struct pipeline_desc cutout = pipeline_desc_for_pass(PIPELINE_PASS_CUTOUT);
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_get(&cutout));
+    draw_layer(cmd_buffer, draws, count, MESH_LAYER_CUTOUT);
+
+    // blending needs the far sections first whatever the mode
+    if (depth_mode == DEPTH_MODE_UNSORTED) qsort(draws, count, sizeof(*draws), compare_distance);
+    struct pipeline_desc translucent = pipeline_desc_for_pass(PIPELINE_PASS_TRANSLUCENT);
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_get(&translucent));
+    draw_translucent(cmd_buffer, draws, count);
+    // the results are used from the next frame on
+    request_sorts(draws, count);
+
+    recorded_mode = depth_mode;
+}
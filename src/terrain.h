@@ -0,0 +1,51 @@
+// Terrain renderer: draws the meshes of the streamer.
+// Each meshed chunk gets a vertex buffer, refilled when the streamer remeshes it.
+// Sections outside the view frustum are skipped, the rest is drawn by layer:
+// solid, cutout, then translucent back to front. The translucent quads of each
+// section have their own indices, sorted back to front on the job system when
+// the camera moves to another cell of the section (translucent.h).
+// Depth is reversed (near 1, far 0, infinite far plane) on a float depth buffer.
+// How the opaque blocks are drawn is the depth mode, to measure the overdraw each
+// one leaves: the fragment shader invocations and GPU time of every frame are
+// summed per mode and logged at exit.
+
+#pragma once
+
+#include "streamer.h"
+
+#include <stdbool.h>
+#include <vulkan/vulkan.h>
+
+#define TERRAIN_FOV                 1.2217f // vertical, radians (70 degrees)
+#define TERRAIN_NEAR                0.05f   // blocks
+#define TERRAIN_UPLOADS_PER_FRAME   32      // chunks, the others wait for the next frames
+#define TERRAIN_SORTS_PER_FRAME     32      // translucent sections queued in one frame
+#define TERRAIN_MAX_SORTS           128     // in flight
+
+enum depth_mode {
+    DEPTH_MODE_UNSORTED = 0,    // in chunk order, whatever the depth test rejects
+    DEPTH_MODE_SORTED,          // front to back, early depth tests reject what is hidden
+    DEPTH_MODE_PREPASS,         // depth of the opaque blocks first, then shade only the visible ones
+    DEPTH_MODE_COUNT
+};
+
+const char *depth_mode_name(enum depth_mode mode);
+// DEPTH_MODE_COUNT when the name is unknown
+enum depth_mode depth_mode_from_name(const char *name);
+
+// after the pipeline and the command pool, the streamer is owned by the caller
+bool terrain_create(struct Streamer *streamer);
+void terrain_destroy();
+
+// can be called before terrain_create()
+void terrain_set_depth_mode(enum depth_mode mode);
+enum depth_mode terrain_depth_mode();
+// the sorts requested in a frame are all applied at the next one instead of
+// whenever the workers finish them, the translucent blocks then look the same
+// on every run (captures)
+void terrain_set_wait_sorts(bool wait);
+
+// once per frame after the fence, outside the render pass
+void terrain_upload();
+// inside the render pass
+void terrain_record(VkCommandBuffer cmd_buffer);
@@ -0,0 +1,148 @@
+#include "texture.h"
+
+#include "log.h"
+#include "vulkan_if.h"
+
+#include <string.h>
+
+static bool create_image(struct Texture *texture, VkFormat format) {
+    VkImageCreateInfo image_info = {};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.extent.width = texture->width;
+    image_info.extent.height = texture->height;
+    image_info.extent.depth = 1;
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.format = format;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    if (vkCreateImage(logical_device, &image_info, NULL, &texture->image) != VK_SUCCESS) {
+        ERROR("Failed to create a %ux%u texture image", texture->width, texture->height);
+        return false;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(logical_device, texture->image, &requirements);
+
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = requirements.size;
+    alloc_info.memoryTypeIndex = find_memory_type(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (alloc_info.memoryTypeIndex == UINT32_MAX ||
+        vkAllocateMemory(logical_device, &alloc_info, NULL, &texture->memory) != VK_SUCCESS) {
+        ERROR("Failed to allocate the texture memory");
+        return false;
+    }
+    vkBindImageMemory(logical_device, texture->image, texture->memory, 0);
+    return true;
+}
+
+// UNDEFINED -> TRANSFER_DST, copy, TRANSFER_DST -> SHADER_READ_ONLY
+static void upload(struct Texture *texture, VkBuffer staging) {
+    VkCommandBuffer cmd_buffer = begin_single_time_commands();
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = texture->image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, NULL, 0, NULL, 1, &barrier);
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent.width = texture->width;
+    region.imageExtent.height = texture->height;
+    region.imageExtent.depth = 1;
+    vkCmdCopyBufferToImage(cmd_buffer, staging, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         0, 0, NULL, 0, NULL, 1, &barrier);
+
+    end_single_time_commands(cmd_buffer);
+}
+
+bool texture_create(struct Texture *texture, const void *pixels, uint32_t width, uint32_t height,
+                    VkFormat format, uint32_t pixel_size, VkFilter filter) {
+    memset(texture, 0, sizeof(*texture));
+    texture->width = width;
+    texture->height = height;
+
+    VkDeviceSize size = (VkDeviceSize) width * height * pixel_size;
+    VkBuffer staging;
+    VkDeviceMemory staging_memory;
+    if (!create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                       &staging, &staging_memory)) {
+        return false;
+    }
+    void *data;
+    vkMapMemory(logical_device, staging_memory, 0, size, 0, &data);
+    memcpy(data, pixels, size);
+    vkUnmapMemory(logical_device, staging_memory);
+
+    bool ok = create_image(texture, format);
+    if (ok) {
+        upload(texture, staging);
+        render_stats.upload_bytes += size;
+    }
+    vkDestroyBuffer(logical_device, staging, NULL);
+    vkFreeMemory(logical_device, staging_memory, NULL);
+    if (!ok) {
+        texture_destroy(texture);
+        return false;
+    }
+
+    VkImageViewCreateInfo view_info = {};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = texture->image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = format;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.layerCount = 1;
+    if (vkCreateImageView(logical_device, &view_info, NULL, &texture->view) != VK_SUCCESS) {
+        ERROR("Failed to create the texture image view");
+        texture_destroy(texture);
+        return false;
+    }
+
+    VkSamplerCreateInfo sampler_info = {};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = filter;
+    sampler_info.minFilter = filter;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    if (vkCreateSampler(logical_device, &sampler_info, NULL, &texture->sampler) != VK_SUCCESS) {
+        ERROR("Failed to create the texture sampler");
+        texture_destroy(texture);
+        return false;
+    }
+    return true;
+}
+
+void texture_destroy(struct Texture *texture) {
+    if (texture->sampler != VK_NULL_HANDLE) vkDestroySampler(logical_device, texture->sampler, NULL);
+    if (texture->view != VK_NULL_HANDLE) vkDestroyImageView(logical_device, texture->view, NULL);
+    if (texture->image != VK_NULL_HANDLE) vkDestroyImage(logical_device, texture->image, NULL);
+    if (texture->memory != VK_NULL_HANDLE) vkFreeMemory(logical_device, texture->memory, NULL);
+    memset(texture, 0, sizeof(*texture));
+}
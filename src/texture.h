@@ -0,0 +1,22 @@
+// Sampled textures: device local image, view and sampler, filled once from
+// memory through a staging buffer.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+struct Texture {
+    VkImage image;
+    VkDeviceMemory memory;
+    VkImageView view;
+    VkSampler sampler;
+    uint32_t width;
+    uint32_t height;
+};
+
+// pixel_size: bytes per pixel of format. Blocks until the upload is done, load time only
+bool texture_create(struct Texture *texture, const void *pixels, uint32_t width, uint32_t height,
+                    VkFormat format, uint32_t pixel_size, VkFilter filter);
+void texture_destroy(struct Texture *texture);
@@ -0,0 +1,34 @@
+#include "timer.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+
+double timer_now() {
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart / (double) frequency.QuadPart;
+}
+
+void timer_sleep(double seconds) {
+    if (seconds > 0) Sleep((DWORD) (seconds * 1000.0));
+}
+
+#else
+#include <time.h>
+
+double timer_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+void timer_sleep(double seconds) {
+    if (seconds <= 0) return;
+    struct timespec ts;
+    ts.tv_sec = (time_t) seconds;
+    ts.tv_nsec = (long) ((seconds - (double) ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+}
+#endif
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+
+// monotonic time in seconds, only differences are meaningful
+double timer_now();
+void timer_sleep(double seconds);
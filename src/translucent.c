@@ -0,0 +1,71 @@
+#include "translucent.h"
+
+#include <math.h>
+#include <string.h>
+
+void translucent_centers(const struct BlockVertex *vertices, uint32_t quads, int16_t (*centers)[3]) {
+    for (uint32_t q=0; q<quads; q++) {
+        // corners 0 and 2 are opposite
+        const struct BlockVertex *v = &vertices[q * 4];
+        centers[q][0] = (int16_t) (v[0].x + v[2].x);
+        centers[q][1] = (int16_t) (v[0].y + v[2].y);
+        centers[q][2] = (int16_t) (v[0].z + v[2].z);
+    }
+}
+
+void translucent_camera_cell(const float camera[3], int lod, int16_t cell[3]) {
+    int cells = lod_cells(lod);
+    float size = (float) (1 << lod);
+    for (int i=0; i<3; i++) {
+        float c = floorf(camera[i] / size);
+        if (c < -1.0f) c = -1.0f;
+        if (c > (float) cells) c = (float) cells;
+        cell[i] = (int16_t) c;
+    }
+}
+
+// one 8 bit digit of the key per pass, stable so equal keys keep their order
+static void radix_pass(const uint32_t *in, uint32_t *out, uint32_t count, int shift) {
+    uint32_t offsets[256];
+    memset(offsets, 0, sizeof(offsets));
+    for (uint32_t i=0; i<count; i++) offsets[(in[i] >> shift) & 0xff]++;
+    uint32_t total = 0;
+    for (int d=0; d<256; d++) {
+        uint32_t n = offsets[d];
+        offsets[d] = total;
+        total += n;
+    }
+    for (uint32_t i=0; i<count; i++) out[offsets[(in[i] >> shift) & 0xff]++] = in[i];
+}
+
+void translucent_sort(const int16_t (*centers)[3], uint32_t quads, const float camera[3],
+                      uint32_t *indices, uint32_t *scratch) {
+    if (quads == 0) return;
+    // the centers are doubled, so is the camera
+    float cx = camera[0] * 2.0f, cy = camera[1] * 2.0f, cz = camera[2] * 2.0f;
+
+    // distances go in the output first, it is big enough and written last
+    float *distances = (float *) indices;
+    float furthest = 0.0f;
+    for (uint32_t q=0; q<quads; q++) {
+        float dx = centers[q][0] - cx, dy = centers[q][1] - cy, dz = centers[q][2] - cz;
+        distances[q] = sqrtf(dx * dx + dy * dy + dz * dz);
+        if (distances[q] > furthest) furthest = distances[q];
+    }
+
+    // key in the high half, quad in the low half: the furthest quad gets key 0
+    float scale = furthest > 0.0f ? 65535.0f / furthest : 0.0f;
+    uint32_t *keys = scratch, *sorted = scratch + quads;
+    for (uint32_t q=0; q<quads; q++) {
+        uint32_t key = 65535u - (uint32_t) (distances[q] * scale);
+        keys[q] = key << 16 | q;
+    }
+    radix_pass(keys, sorted, quads, 16);
+    radix_pass(sorted, keys, quads, 24);
+
+    static const uint32_t pattern[6] = {0, 1, 2, 2, 3, 0};
+    for (uint32_t i=0; i<quads; i++) {
+        uint32_t q = keys[i] & 0xffff;
+        for (int k=0; k<6; k++) indices[i * 6 + k] = q * 4 + pattern[k];
+    }
+}
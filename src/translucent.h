@@ -0,0 +1,27 @@
+// Back to front order of the translucent quads of a section (water, glass).
+// The quads lie on the cell grid of the section, so which side of each quad
+// the camera is on only changes when the camera moves to another cell, or for
+// a camera outside the section, to another cell of the closest border. The
+// renderer sorts a section again only when that cell changes.
+// The sort is a radix sort of the quad distances quantized to 16 bits.
+
+#pragma once
+
+#include "mesher.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// a section has at most one face per side of each block
+#define TRANSLUCENT_MAX_QUADS (SECTION_VOLUME * FACE_COUNT)
+
+// twice the quad centers, in blocks from the section origin
+void translucent_centers(const struct BlockVertex *vertices, uint32_t quads, int16_t (*centers)[3]);
+
+// camera relative to the section origin, the cell clamped to one past the border
+void translucent_camera_cell(const float camera[3], int lod, int16_t cell[3]);
+
+// 6 indices per quad (0 1 2 2 3 0 pattern) in back to front order.
+// scratch holds 2 * quads values, quads is at most TRANSLUCENT_MAX_QUADS
+void translucent_sort(const int16_t (*centers)[3], uint32_t quads, const float camera[3],
+                      uint32_t *indices, uint32_t *scratch);
@@ -1,7 +1,16 @@
 #include "vulkan_if.h"
+#include "density_gpu.h"
 #include "log.h"
+#include "gpu_memory.h"
+#include "job.h"
+#include "memory.h"
+#include "overlay.h"
 #include "window.h"
 #include "pipeline.h"
+#include "readback.h"
+#include "streamer.h"
+#include "terrain.h"
+#include "timer.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -16,6 +25,10 @@ struct  queue_family_indices {
 
 VkDevice logical_device = VK_NULL_HANDLE; // the logical device
 swap_chain_t swap_chain;
+VkPhysicalDeviceFeatures enabled_device_features = {};
+struct FrameArena *frame_arena;
+struct RenderStats render_stats;
+VkFormat depth_format = VK_FORMAT_UNDEFINED;
 
 static VkInstance instance;
 static VkPhysicalDevice physical_device = VK_NULL_HANDLE; 
@@ -26,8 +39,15 @@ static VkQueue present_queue; // handler to the graphics queue
 static GLFWwindow *wnd;
 static VkSurfaceKHR surface;
 static struct queue_family_indices queue_indices; 
+static bool properties2_enabled;   // VK_KHR_get_physical_device_properties2, VK_EXT_memory_budget needs it
+static enum present_mode wanted_present_mode = PRESENT_MODE_MAILBOX;
+static double submitted_at;        // the last frame, to estimate when the GPU was done with it
 
 VkFramebuffer *swap_chain_framebuffers;
+// one depth image for all the framebuffers, a single frame is in flight
+static VkImage depth_image = VK_NULL_HANDLE;
+static VkDeviceMemory depth_memory = VK_NULL_HANDLE;
+static VkImageView depth_view = VK_NULL_HANDLE;
 VkCommandPool command_pool;
 VkCommandBuffer command_buffer;
 
@@ -35,6 +55,13 @@ VkSemaphore imageAvailableSemaphore;
 VkSemaphore renderFinishedSemaphore;
 VkFence inFlightFence;
 
+// GPU time of a frame: one timestamp before the render pass, one after
+static VkQueryPool timestamp_pool = VK_NULL_HANDLE;
+static double timestamp_period_ms;  // of one timestamp tick
+static bool queries_written;     // by a submitted frame, the first one has nothing to read
+// fragment shader invocations of a frame, needs the pipelineStatisticsQuery feature
+static VkQueryPool statistics_pool = VK_NULL_HANDLE;
+
 
 #if defined(__APPLE__)
 // https://stackoverflow.com/questions/68127785/how-to-fix-vk-khr-portability-subset-error-on-mac-m1-while-following-vulkan-tuto
@@ -52,6 +79,9 @@ VkFence inFlightFence;
     static const bool enable_validation_layers = true;
 #endif
 
+// scratch memory of the render thread, the setup code uses it too
+#define FRAME_ARENA_SIZE (256 * 1024)
+
 
 struct swap_chain_support_details {
     VkSurfaceCapabilitiesKHR capabilities;
@@ -67,6 +97,8 @@ static void setup_messanger_create_info();
 static void setup_debug_messenger();
 static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback();
 static bool is_validation_layer_available(const char *validation_layer);
+static bool is_instance_extension_available(const char *extension);
+static bool is_device_extension_available(const char *extension);
 static void destroy_debug_messanger();
 static void setup_messanger_create_info() ;
 static bool create_vulkan_instance();
@@ -84,6 +116,7 @@ static void destroy_swap_chain();
 static uint32_t clamp(uint32_t val, uint32_t min, uint32_t max);
 static bool create_image_views();
 static void destroy_image_views();
+static bool choose_depth_format();
 static bool create_framebuffers();
 static void destroy_framebuffers();
 static bool create_command_pool();
@@ -93,30 +126,202 @@ static void destroy_command_buffer();
 static bool record_command_buffer(VkCommandBuffer command_buffer, uint32_t image_index);
 static bool create_sync_objects();
 static void destroy_sync_objects();
+static void create_timestamp_queries();
+static void destroy_timestamp_queries();
+static void create_density();
+
+
+
+// Initialization is a graph of steps. The main thread runs its steps in order,
+// each after the ones it needs; a worker step starts as soon as its own are done.
+// The shader files are read and the block pipelines compiled on the workers
+// while the main thread builds the swap chain, the framebuffers and the rest.
+// Only the steps that take the queue or the window stay on the main thread.
+enum init_step {
+    INIT_SHADERS = 0,
+    INIT_INSTANCE,
+    INIT_SURFACE,
+    INIT_DEVICE,
+    INIT_SWAP_CHAIN,
+    INIT_RENDER_PASS,
+    INIT_PIPELINE,
+    INIT_FRAMEBUFFERS,
+    INIT_COMMANDS,
+    INIT_READBACK,
+    INIT_OVERLAY,
+    INIT_DENSITY,
+    INIT_TERRAIN,
+    INIT_STEP_COUNT
+};
+
+#define STEP(s) (1u << (s))
+
+struct InitStep {
+    const char *name;
+    bool (*run)();
+    uint32_t after;         // STEP() of the steps it needs
+    bool worker;
+    // filled in when it runs
+    bool ok;
+    bool submitted;
+    double start, end;
+    struct JobCounter job;
+};
+
+static bool init_instance() {
+    if (!create_vulkan_instance()) return false;
+    setup_debug_messenger( &messanger_create_info);
+    return true;
+}
+
+// pick a GPU. This object will be implicitly destroyed whith VkInstance
+static bool init_device() {
+    return pick_physical_device() && create_logical_device() && choose_depth_format();
+}
+
+static bool init_swap_chain() {
+    return create_swap_chain() && create_image_views();
+}
+
+static bool init_commands() {
+    if (!create_command_pool() || !create_command_buffer() || !create_sync_objects()) return false;
+    create_timestamp_queries();
+    return true;
+}
 
+// optional, only the captures need it
+static bool init_readback() {
+    readback_create();
+    return true;
+}
+
+static bool init_density() {
+    create_density();
+    return true;
+}
 
+static bool init_terrain() {
+    return terrain_create(game.streamer);
+}
+
+static struct InitStep init_steps[INIT_STEP_COUNT] = {
+    [INIT_SHADERS]      = {"shaders",      load_shaders,         0,                                    true},
+    [INIT_INSTANCE]     = {"instance",     init_instance,        0,                                    false},
+    [INIT_SURFACE]      = {"surface",      create_surface,       STEP(INIT_INSTANCE),                  false},
+    [INIT_DEVICE]       = {"device",       init_device,          STEP(INIT_SURFACE),                   false},
+    [INIT_SWAP_CHAIN]   = {"swap chain",   init_swap_chain,      STEP(INIT_DEVICE),                    false},
+    [INIT_RENDER_PASS]  = {"render pass",  create_render_passes, STEP(INIT_SWAP_CHAIN),                false},
+    [INIT_PIPELINE]     = {"pipelines",    create_pipeline,      STEP(INIT_SHADERS) | STEP(INIT_RENDER_PASS), true},
+    [INIT_FRAMEBUFFERS] = {"framebuffers", create_framebuffers,  STEP(INIT_RENDER_PASS),               false},
+    [INIT_COMMANDS]     = {"commands",     init_commands,        STEP(INIT_DEVICE),                    false},
+    [INIT_READBACK]     = {"readback",     init_readback,        STEP(INIT_SWAP_CHAIN),                false},
+    [INIT_OVERLAY]      = {"overlay",      overlay_create,       STEP(INIT_SHADERS) | STEP(INIT_RENDER_PASS) | STEP(INIT_COMMANDS), false},
+    [INIT_DENSITY]      = {"density",      init_density,         STEP(INIT_SHADERS) | STEP(INIT_COMMANDS), false},
+    [INIT_TERRAIN]      = {"terrain",      init_terrain,         STEP(INIT_COMMANDS),                  false},
+};
+
+static void run_step(struct InitStep *step) {
+    step->start = timer_now();
+    step->ok = step->run();
+    step->end = timer_now();
+}
+
+static void step_job(void *arg) {
+    run_step(arg);
+}
+
+// marks the worker steps that finished, starts the ones that can. False when one failed
+static bool update_workers(uint32_t *done) {
+    bool ok = true;
+    for (int i=0; i<INIT_STEP_COUNT; i++) {
+        struct InitStep *step = &init_steps[i];
+        if (!step->worker || !step->submitted || (*done & STEP(i)) || !job_done(&step->job)) continue;
+        if (!step->ok) ok = false;
+        *done |= STEP(i);
+    }
+    for (int i=0; i<INIT_STEP_COUNT && ok; i++) {
+        struct InitStep *step = &init_steps[i];
+        if (!step->worker || step->submitted || (step->after & ~*done) != 0) continue;
+        step->submitted = true;
+        job_submit(step_job, step, &step->job);
+    }
+    return ok;
+}
+
+// blocks until the steps are done, the main thread helps the workers meanwhile
+static bool wait_steps(uint32_t steps, uint32_t *done) {
+    while ((steps & ~*done) != 0) {
+        // a worker step not started yet waits for the ones it needs
+        uint32_t needed = steps & ~*done;
+        for (int pass=0; pass<INIT_STEP_COUNT; pass++) {
+            for (int i=0; i<INIT_STEP_COUNT; i++) {
+                const struct InitStep *step = &init_steps[i];
+                if ((needed & STEP(i)) && step->worker && !step->submitted) needed |= step->after & ~*done;
+            }
+        }
+        for (int i=0; i<INIT_STEP_COUNT; i++) {
+            if ((needed & STEP(i)) && init_steps[i].submitted) job_wait(&init_steps[i].job);
+        }
+        if (!update_workers(done)) return false;
+    }
+    return true;
+}
+
+static void report_init(double start, double end) {
+    double steps_ms = 0.0;
+    for (int i=0; i<INIT_STEP_COUNT; i++) steps_ms += (init_steps[i].end - init_steps[i].start) * 1000.0;
+    INFO("VULKAN initialized in %.1f ms, the steps took %.1f ms", (end - start) * 1000.0, steps_ms);
+    for (int i=0; i<INIT_STEP_COUNT; i++) {
+        const struct InitStep *step = &init_steps[i];
+        INFO("  %-12s %8.2f ms, from %8.2f ms on the %s", step->name, (step->end - step->start) * 1000.0,
+             (step->start - start) * 1000.0, step->worker ? "workers" : "main thread");
+    }
+}
 
 bool init_vulkan(GLFWwindow *window){
     wnd = window;
 
-    if (!create_vulkan_instance()) return false;
-    setup_debug_messenger( &messanger_create_info);
-    if (!create_surface()) return false;
-    if (!pick_physical_device())  return false; // pick a GPU. This object will be implicitly destroyed whith VkInstance
-    if (!create_logical_device()) return false;
-    if (!create_swap_chain()) return false;
-    if (!create_image_views()) return false;
-    if (!create_render_passes()) return false;
-    if (!create_pipeline()) return false;
-    if (!create_framebuffers()) return false;
-    if (!create_command_pool()) return false;
-    if (!create_command_buffer()) return false;
-    if (!create_sync_objects()) return false;
-
+    frame_arena = frame_arena_create(FRAME_ARENA_SIZE, MEMORY_TAG_RENDERER);
+    if (frame_arena == NULL) return false;
+
+    double start = timer_now();
+    uint32_t done = 0;
+    bool ok = update_workers(&done);
+    for (int i=0; i<INIT_STEP_COUNT && ok; i++) {
+        struct InitStep *step = &init_steps[i];
+        if (step->worker) continue;
+        if (!wait_steps(step->after, &done)) {
+            ok = false;
+            break;
+        }
+        run_step(step);
+        ok = step->ok;
+        done |= STEP(i);
+        if (ok) ok = update_workers(&done);
+    }
+    // the workers may still be compiling, nothing is left running on a failure either
+    uint32_t workers = 0;
+    for (int i=0; i<INIT_STEP_COUNT; i++) {
+        if (init_steps[i].worker && (ok || init_steps[i].submitted)) workers |= STEP(i);
+    }
+    if (!wait_steps(workers, &done)) ok = false;
+    if (!ok) {
+        for (int i=0; i<INIT_STEP_COUNT; i++) {
+            if (init_steps[i].end != 0.0 && !init_steps[i].ok) FATAL("VULKAN init failed at %s", init_steps[i].name);
+        }
+        return false;
+    }
+    report_init(start, timer_now());
     return true;
 }
 
 void destroy_vulkan() {
+    gpu_memory_report();
+    density_gpu_destroy();
+    terrain_destroy();
+    overlay_destroy();
+    readback_destroy();
+    destroy_timestamp_queries();
     destroy_sync_objects();
     destroy_command_pool();
     destroy_framebuffers();
@@ -128,6 +333,10 @@ void destroy_vulkan() {
     destroy_debug_messanger();
     vkDestroySurfaceKHR(instance, surface, NULL);
     vkDestroyInstance(instance, NULL);
+    frame_arena_destroy(frame_arena);
+    frame_arena = NULL;
+    memory_check_leaks(MEMORY_TAG_RENDERER);
+    memory_report();
     INFO("Vulkan destroyed")
 }
 
@@ -191,17 +400,39 @@ static bool is_validation_layer_available(const char *validation_layer) {
     uint32_t count = 0;
 
     vkEnumerateInstanceLayerProperties(&count, NULL);
-    VkLayerProperties *available_layers = ( VkLayerProperties *) malloc(count * sizeof(*available_layers));
+    VkLayerProperties *available_layers = frame_arena_alloc(frame_arena, count * sizeof(*available_layers));
     VkResult result = vkEnumerateInstanceLayerProperties(&count, available_layers);
 
     for (int i=0; i<count; i++) {
         if (strcmp(validation_layer, available_layers[i].layerName)==0) {
-            free(available_layers);
             return true;
         }
     }
 
-    free(available_layers);
+    return false;
+}
+
+static bool is_instance_extension_available(const char *extension) {
+    uint32_t count = 0;
+    vkEnumerateInstanceExtensionProperties(NULL, &count, NULL);
+    VkExtensionProperties *available = frame_arena_alloc(frame_arena, count * sizeof(*available));
+    if (available == NULL) return false;
+    vkEnumerateInstanceExtensionProperties(NULL, &count, available);
+    for (uint32_t i=0; i<count; i++) {
+        if (strcmp(extension, available[i].extensionName) == 0) return true;
+    }
+    return false;
+}
+
+static bool is_device_extension_available(const char *extension) {
+    uint32_t count = 0;
+    vkEnumerateDeviceExtensionProperties(physical_device, NULL, &count, NULL);
+    VkExtensionProperties *available = frame_arena_alloc(frame_arena, count * sizeof(*available));
+    if (available == NULL) return false;
+    vkEnumerateDeviceExtensionProperties(physical_device, NULL, &count, available);
+    for (uint32_t i=0; i<count; i++) {
+        if (strcmp(extension, available[i].extensionName) == 0) return true;
+    }
     return false;
 }
 
@@ -369,7 +600,13 @@ static void find_queue_families(){
 }
 
 static bool create_logical_device(){
-    VkPhysicalDeviceFeatures device_features = {};
+    VkPhysicalDeviceFeatures supported_features = {};
+    vkGetPhysicalDeviceFeatures(physical_device, &supported_features);
+    // needed by the wireframe debug pipeline
+    enabled_device_features.fillModeNonSolid = supported_features.fillModeNonSolid;
+    // counts the fragments shaded, to compare the depth modes
+    enabled_device_features.pipelineStatisticsQuery = supported_features.pipelineStatisticsQuery;
+
     VkDeviceCreateInfo create_info = {};
     VkDeviceQueueCreateInfo *queue_create_infos;
     float queue_priority =  1.0f;
@@ -377,7 +614,7 @@ static bool create_logical_device(){
 
     if (queue_indices.graphics_family != queue_indices.present_family) {
         uint32_t queue_families[] = {queue_indices.graphics_family, queue_indices.present_family};
-        queue_create_infos = malloc (2 * sizeof(VkDeviceQueueCreateInfo));
+        queue_create_infos = frame_arena_alloc(frame_arena, 2 * sizeof(VkDeviceQueueCreateInfo));
         queue_create_infos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
         queue_create_infos[0].queueFamilyIndex = queue_families[0];
         queue_create_infos[0].queueCount = 1;
@@ -392,7 +629,7 @@ static bool create_logical_device(){
         create_info.pQueueCreateInfos = queue_create_infos;
         create_info.queueCreateInfoCount = 2;
     } else  {
-         queue_create_infos = malloc (sizeof(VkDeviceQueueCreateInfo));
+         queue_create_infos = frame_arena_alloc(frame_arena, sizeof(VkDeviceQueueCreateInfo));
     
         queue_create_infos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
         queue_create_infos[0].queueFamilyIndex = queue_indices.graphics_family;
@@ -405,16 +642,21 @@ static bool create_logical_device(){
     create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     //create_info.pQueueCreateInfos = queue_create_info; 
     //create_info.queueCreateInfoCount = 2;
-    create_info.pEnabledFeatures = &device_features;
+    create_info.pEnabledFeatures = &enabled_device_features;
 
 https://stackoverflow.com/questions/68127785/how-to-fix-vk-khr-portability-subset-error-on-mac-m1-while-following-vulkan-tuto    
-#if defined(__APPLE__)
-    create_info.enabledExtensionCount = 2;
-    create_info.ppEnabledExtensionNames = device_extensions;
-#else
-    create_info.enabledExtensionCount = 1;
-    create_info.ppEnabledExtensionNames = device_extensions;
-#endif
+    const char *extensions[devie_extensions_count + 1];
+    uint32_t extensions_count = 0;
+    for (uint32_t i=0; i<devie_extensions_count; i++) {
+        extensions[extensions_count++] = device_extensions[i];
+    }
+    // optional, tells how much VRAM we may use before the driver starts paging
+    bool memory_budget = properties2_enabled && is_device_extension_available(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (memory_budget) {
+        extensions[extensions_count++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+    }
+    create_info.enabledExtensionCount = extensions_count;
+    create_info.ppEnabledExtensionNames = extensions;
 
 
     if (enable_validation_layers) {
@@ -434,6 +676,7 @@ https://stackoverflow.com/questions/68127785/how-to-fix-vk-khr-portability-subse
 
     vkGetDeviceQueue(logical_device, queue_indices.graphics_family, 0, &graphics_queue);
     vkGetDeviceQueue(logical_device, queue_indices.present_family, 0, &present_queue);
+    gpu_memory_init(instance, physical_device, memory_budget);
     return true;
 }
 
@@ -475,7 +718,8 @@ static bool create_vulkan_instance() {
     glfwExtensions = glfwGetRequiredInstanceExtensions(&count);
     aux_count = (enable_validation_layers) ? count + 1: count;
 
-    const char* extensions[count]; 
+    // room for the debug utils and the properties2 extensions
+    const char* extensions[count + 2]; 
     for(int i=0; i<count; i++) {
         extensions[i] = glfwExtensions[i];
     }
@@ -486,6 +730,15 @@ static bool create_vulkan_instance() {
         count = aux_count;
     }
 
+#if defined(__APPLE__)
+    properties2_enabled = true;     // added below with the portability extensions
+#else
+    properties2_enabled = is_instance_extension_available(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    if (properties2_enabled) {
+        extensions[count++] = VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME;
+    }
+#endif
+
 #if defined(__APPLE__)
     //count ++;
     const char *apple_extra_extensions[count+2];
@@ -561,10 +814,11 @@ static VkSurfaceFormatKHR choose_swap_surface_format(const VkSurfaceFormatKHR  *
 
 static VkPresentModeKHR choose_swap_present_mode(const VkPresentModeKHR *available_present_modes, uint32_t count){
     for (int i=0; i<count; i++){
-        if (available_present_modes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
+        if (available_present_modes[i] == (VkPresentModeKHR) wanted_present_mode) {
             return available_present_modes[i];
         }
     }
+    WARNING("Present mode %s not supported, using fifo", present_mode_name(wanted_present_mode));
     return VK_PRESENT_MODE_FIFO_KHR;
 }
 
@@ -585,6 +839,7 @@ static VkExtent2D choose_swap_extent(const VkSurfaceCapabilitiesKHR capabilities
 static struct swap_chain_support_details query_swap_chain_support() {
     // Swap chain support is sufficient for this tutorial if there is at least one supported 
     // image format and one supported presentation mode given the window surface we have.
+    // The arrays are frame scratch, they are gone two frames later
     struct swap_chain_support_details details;
     details.formats = NULL;
     details.present_modes = NULL;
@@ -592,14 +847,14 @@ static struct swap_chain_support_details query_swap_chain_support() {
 
     vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &details.formats_count, NULL);
     if (details.formats_count > 0) {
-        details.formats = malloc(details.formats_count * sizeof(*details.formats));
+        details.formats = frame_arena_alloc(frame_arena, details.formats_count * sizeof(*details.formats));
         vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &details.formats_count, details.formats);
     }
 
 
     vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &details.present_modes_count, NULL);
     if (details.present_modes_count > 0) {
-        details.present_modes = malloc(details.present_modes_count * sizeof(*details.present_modes));
+        details.present_modes = frame_arena_alloc(frame_arena, details.present_modes_count * sizeof(*details.present_modes));
         vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &details.present_modes_count, details.present_modes);
     }
 
@@ -630,6 +885,8 @@ static bool create_swap_chain() {
     create_info.imageExtent = extent;
     create_info.imageArrayLayers = 1;
     create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    // lets readback.c copy the frames out
+    create_info.imageUsage |= details.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
     if (queue_indices.graphics_family != queue_indices.present_family) {
         uint32_t queue_families[] = {queue_indices.graphics_family, queue_indices.present_family};
@@ -654,21 +911,25 @@ static bool create_swap_chain() {
 
     swap_chain.image_format = surface_format.format;
     swap_chain.extent = extent;
+    swap_chain.usage = create_info.imageUsage;
+    swap_chain.present_mode = present_mode;
+    INFO("Swap chain %ux%u, present mode %s", extent.width, extent.height, present_mode_name((enum present_mode) present_mode));
 
     // retriving swap chain images
     vkGetSwapchainImagesKHR(logical_device, swap_chain.handle, &swap_chain.images_count, NULL);
-    swap_chain.images = malloc(swap_chain.images_count * sizeof *swap_chain.images);
+    swap_chain.images = memory_alloc(swap_chain.images_count * sizeof *swap_chain.images, MEMORY_TAG_RENDERER);
     vkGetSwapchainImagesKHR(logical_device, swap_chain.handle, &swap_chain.images_count, swap_chain.images);    
     return true;
 }
 
 static void destroy_swap_chain() {
-    free(swap_chain.images);
+    memory_free(swap_chain.images);
+    swap_chain.images = NULL;
     vkDestroySwapchainKHR(logical_device, swap_chain.handle, NULL);
 }
 
 static bool create_image_views(){
-    swap_chain.image_views = malloc(swap_chain.images_count * sizeof *swap_chain.image_views);
+    swap_chain.image_views = memory_calloc(swap_chain.images_count, sizeof *swap_chain.image_views, MEMORY_TAG_RENDERER);
     for (int i=0; i<swap_chain.images_count; i++) {
         VkImageViewCreateInfo create_info = {};
         create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -698,10 +959,96 @@ static void destroy_image_views() {
     for (int i=0; i<swap_chain.images_count; i++) {
         vkDestroyImageView(logical_device, swap_chain.image_views[i], NULL);
     }
+    memory_free(swap_chain.image_views);
+    swap_chain.image_views = NULL;
+}
+
+// Reversed-Z maps the far plane to 0 where a float has the most precision,
+// which evens out the error of 1/z. A fixed point format gets none of that.
+static bool choose_depth_format() {
+    static const VkFormat candidates[] = {
+        VK_FORMAT_D32_SFLOAT,
+        VK_FORMAT_D32_SFLOAT_S8_UINT,
+        VK_FORMAT_D24_UNORM_S8_UINT,
+    };
+    for (int i=0; i<sizeof(candidates) / sizeof(candidates[0]); i++) {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physical_device, candidates[i], &properties);
+        if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+            depth_format = candidates[i];
+            if (depth_format == VK_FORMAT_D24_UNORM_S8_UINT) {
+                WARNING("No float depth format, far away blocks may z-fight");
+            }
+            return true;
+        }
+    }
+    FATAL("No supported depth format");
+    return false;
+}
+
+static bool create_depth_image() {
+    VkImageCreateInfo image_info = {};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.extent.width = swap_chain.extent.width;
+    image_info.extent.height = swap_chain.extent.height;
+    image_info.extent.depth = 1;
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.format = depth_format;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateImage(logical_device, &image_info, NULL, &depth_image) != VK_SUCCESS) {
+        FATAL("Failed to create the depth image");
+        return false;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(logical_device, depth_image, &requirements);
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = requirements.size;
+    alloc_info.memoryTypeIndex = find_memory_type(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (alloc_info.memoryTypeIndex == UINT32_MAX ||
+        vkAllocateMemory(logical_device, &alloc_info, NULL, &depth_memory) != VK_SUCCESS) {
+        FATAL("Failed to allocate the depth image memory");
+        return false;
+    }
+    vkBindImageMemory(logical_device, depth_image, depth_memory, 0);
+
+    VkImageViewCreateInfo view_info = {};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = depth_image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = depth_format;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    view_info.subresourceRange.baseMipLevel = 0;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.baseArrayLayer = 0;
+    view_info.subresourceRange.layerCount = 1;
+    if (vkCreateImageView(logical_device, &view_info, NULL, &depth_view) != VK_SUCCESS) {
+        FATAL("Failed to create the depth image view");
+        return false;
+    }
+    return true;
+}
+
+static void destroy_depth_image() {
+    if (depth_view != VK_NULL_HANDLE) vkDestroyImageView(logical_device, depth_view, NULL);
+    if (depth_image != VK_NULL_HANDLE) vkDestroyImage(logical_device, depth_image, NULL);
+    if (depth_memory != VK_NULL_HANDLE) vkFreeMemory(logical_device, depth_memory, NULL);
+    depth_view = VK_NULL_HANDLE;
+    depth_image = VK_NULL_HANDLE;
+    depth_memory = VK_NULL_HANDLE;
 }
 
 static bool create_framebuffers() {
-    swap_chain_framebuffers = malloc(swap_chain.images_count * sizeof(VkFramebuffer));
+    if (!create_depth_image()) return false;
+
+    swap_chain_framebuffers = memory_calloc(swap_chain.images_count, sizeof(VkFramebuffer), MEMORY_TAG_RENDERER);
     if (swap_chain_framebuffers  == NULL) {
         FATAL("Failed to allocate memoty for the framebuffers");
         return false;
@@ -709,13 +1056,14 @@ static bool create_framebuffers() {
     
     for (int i=0; i<swap_chain.images_count; i++) {
         VkImageView attachments[] = {
-            swap_chain.image_views[i]
+            swap_chain.image_views[i],
+            depth_view
         };
 
         VkFramebufferCreateInfo framebuffer_info = {};
         framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         framebuffer_info.renderPass = render_pass;
-        framebuffer_info.attachmentCount = 1;
+        framebuffer_info.attachmentCount = 2;
         framebuffer_info.pAttachments = attachments;
         framebuffer_info.width = swap_chain.extent.width;
         framebuffer_info.height = swap_chain.extent.height;
@@ -730,9 +1078,13 @@ static bool create_framebuffers() {
 }
 
 static void destroy_framebuffers() {
+    destroy_depth_image();
+    if (swap_chain_framebuffers == NULL) return;
     for (int i=0; i<swap_chain.images_count; i++) {
         vkDestroyFramebuffer(logical_device, swap_chain_framebuffers[i], NULL);
     }
+    memory_free(swap_chain_framebuffers);
+    swap_chain_framebuffers = NULL;
 }
 
 static bool create_command_pool(){
@@ -774,6 +1126,17 @@ static bool record_command_buffer(VkCommandBuffer cmd_buffer, uint32_t image_ind
         return false;
     }
 
+    if (timestamp_pool != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(cmd_buffer, timestamp_pool, 0, 2);
+        vkCmdWriteTimestamp(cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_pool, 0);
+    }
+    if (statistics_pool != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(cmd_buffer, statistics_pool, 0, 1);
+    }
+
+    // meshes that changed go to the GPU before anything is drawn
+    terrain_upload();
+
     VkRenderPassBeginInfo renderPassInfo = {};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     renderPassInfo.renderPass = render_pass;
@@ -783,14 +1146,15 @@ static bool record_command_buffer(VkCommandBuffer cmd_buffer, uint32_t image_ind
     renderPassInfo.renderArea.offset.y = 0;
     renderPassInfo.renderArea.extent = swap_chain.extent;
 
-    VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
+    // sky, then the far plane: depth is reversed
+    VkClearValue clear_values[2] = {};
+    clear_values[0].color = (VkClearColorValue) {{0.55f, 0.75f, 0.95f, 1.0f}};
+    clear_values[1].depthStencil = (VkClearDepthStencilValue) {0.0f, 0};
+    renderPassInfo.clearValueCount = 2;
+    renderPassInfo.pClearValues = clear_values;
 
     vkCmdBeginRenderPass(cmd_buffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-        vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-
         VkViewport viewport = {};
         viewport.x = 0.0f;
         viewport.y = 0.0f;
@@ -806,10 +1170,23 @@ static bool record_command_buffer(VkCommandBuffer cmd_buffer, uint32_t image_ind
         scissor.extent =  swap_chain.extent;
         vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);    
 
-        vkCmdDraw(cmd_buffer, 3, 1, 0, 0);
+        // the overlay is not counted, it is the same in every depth mode
+        if (statistics_pool != VK_NULL_HANDLE) vkCmdBeginQuery(cmd_buffer, statistics_pool, 0, 0);
+        terrain_record(cmd_buffer);
+        if (statistics_pool != VK_NULL_HANDLE) vkCmdEndQuery(cmd_buffer, statistics_pool, 0);
+
+        // last, over the scene
+        overlay_record(cmd_buffer);
 
     vkCmdEndRenderPass(cmd_buffer);
 
+    if (timestamp_pool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(cmd_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_pool, 1);
+    }
+    queries_written = true;
+    // after the timestamp, a capture does not count in the GPU time
+    readback_record(cmd_buffer, swap_chain.images[image_index]);
+
     if (vkEndCommandBuffer(cmd_buffer ) != VK_SUCCESS) {
         FATAL("Failed to record command buffer!");
         return false;
@@ -841,12 +1218,97 @@ static void destroy_sync_objects(){
     vkDestroyFence(logical_device, inFlightFence, NULL);
 }
 
+// not fatal, without timestamps the GPU time is unknown (-1), same for the fragment count
+static void create_timestamp_queries() {
+    render_stats.gpu_ms = -1.0;
+    render_stats.fragments = -1;
+
+    if (enabled_device_features.pipelineStatisticsQuery) {
+        VkQueryPoolCreateInfo statistics_info = {};
+        statistics_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        statistics_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        statistics_info.queryCount = 1;
+        statistics_info.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+        if (vkCreateQueryPool(logical_device, &statistics_info, NULL, &statistics_pool) != VK_SUCCESS) {
+            WARNING("Failed to create the pipeline statistics query pool");
+            statistics_pool = VK_NULL_HANDLE;
+        }
+    }
+
+    uint32_t queue_family_count;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, NULL);
+    VkQueueFamilyProperties queue_family[queue_family_count];
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_family);
+    if (queue_family[queue_indices.graphics_family].timestampValidBits == 0) {
+        WARNING("The graphics queue has no timestamps, GPU time unknown");
+        return;
+    }
+
+    VkPhysicalDeviceProperties properties = {};
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    timestamp_period_ms = properties.limits.timestampPeriod / 1000000.0;
+
+    VkQueryPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    pool_info.queryCount = 2;
+    if (vkCreateQueryPool(logical_device, &pool_info, NULL, &timestamp_pool) != VK_SUCCESS) {
+        WARNING("Failed to create the timestamp query pool");
+        timestamp_pool = VK_NULL_HANDLE;
+    }
+}
+
+static void destroy_timestamp_queries() {
+    if (statistics_pool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(logical_device, statistics_pool, NULL);
+        statistics_pool = VK_NULL_HANDLE;
+    }
+    if (timestamp_pool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(logical_device, timestamp_pool, NULL);
+        timestamp_pool = VK_NULL_HANDLE;
+    }
+}
+
+// the fence was waited on, the previous frame is done
+static void read_timestamps() {
+    if (!queries_written) return;
+
+    uint64_t timestamps[2];
+    if (timestamp_pool != VK_NULL_HANDLE &&
+        vkGetQueryPoolResults(logical_device, timestamp_pool, 0, 2, sizeof(timestamps), timestamps,
+                              sizeof(timestamps[0]), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        render_stats.gpu_ms = (double) (timestamps[1] - timestamps[0]) * timestamp_period_ms;
+    }
+
+    uint64_t fragments;
+    if (statistics_pool != VK_NULL_HANDLE &&
+        vkGetQueryPoolResults(logical_device, statistics_pool, 0, 1, sizeof(fragments), &fragments,
+                              sizeof(fragments), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        render_stats.fragments = (int64_t) fragments;
+    }
+}
+
 void draw_frame() {
+    frame_arena_begin_frame(frame_arena);
+    gpu_memory_update();
+    render_stats.draw_calls = 0;
+    render_stats.upload_bytes = 0;
+
+    double wait_start = timer_now();
     vkWaitForFences(logical_device, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
+    render_stats.gpu_done = timer_now();
     vkResetFences(logical_device, 1, &inFlightFence);
+    read_timestamps();
+    readback_poll();
+    // without a wait the frame was done earlier, by the GPU time after its submit
+    if (render_stats.gpu_done - wait_start < PACING_SAFETY && render_stats.gpu_ms >= 0.0 && submitted_at > 0.0 &&
+        submitted_at + render_stats.gpu_ms / 1000.0 < render_stats.gpu_done) {
+        render_stats.gpu_done = submitted_at + render_stats.gpu_ms / 1000.0;
+    }
 
     uint32_t imageIndex;
     vkAcquireNextImageKHR(logical_device, swap_chain.handle, UINT64_MAX, imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+    render_stats.wait_ms = (timer_now() - wait_start) * 1000.0;
 
     vkResetCommandBuffer(command_buffer, 0);
   
@@ -871,6 +1333,7 @@ void draw_frame() {
     if (vkQueueSubmit(graphics_queue, 1, &submitInfo, inFlightFence) != VK_SUCCESS) {
         FATAL("Failed to submit draw command buffer!");
     }
+    submitted_at = timer_now();
 
     VkPresentInfoKHR presentInfo = {};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -885,4 +1348,108 @@ void draw_frame() {
     presentInfo.pImageIndices = &imageIndex;
 
     vkQueuePresentKHR(present_queue, &presentInfo);
-}
\ No newline at end of file
+}
+
+
+// the render pass and the pipelines stay, the format does not change
+static bool recreate_swap_chain() {
+    vkDeviceWaitIdle(logical_device);
+    readback_destroy();
+    destroy_framebuffers();
+    destroy_image_views();
+    destroy_swap_chain();
+    if (!create_swap_chain() || !create_image_views() || !create_framebuffers()) return false;
+    readback_create();
+    return true;
+}
+
+void set_present_mode(enum present_mode mode) {
+    if (mode >= PRESENT_MODE_COUNT) return;
+    wanted_present_mode = mode;
+    if (logical_device == VK_NULL_HANDLE || swap_chain.handle == VK_NULL_HANDLE) return;
+    if (!recreate_swap_chain()) FATAL("Failed to create the swap chain again");
+}
+
+uint32_t find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags properties) {
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+    for (uint32_t i=0; i<memory_properties.memoryTypeCount; i++) {
+        if ((type_bits & (1u << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+    return UINT32_MAX;
+}
+
+bool create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+                   VkBuffer *buffer, VkDeviceMemory *memory) {
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(logical_device, &buffer_info, NULL, buffer) != VK_SUCCESS) {
+        ERROR("Failed to create a buffer of %llu bytes", (unsigned long long) size);
+        return false;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(logical_device, *buffer, &requirements);
+
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = requirements.size;
+    alloc_info.memoryTypeIndex = find_memory_type(requirements.memoryTypeBits, properties);
+    if (alloc_info.memoryTypeIndex == UINT32_MAX ||
+        vkAllocateMemory(logical_device, &alloc_info, NULL, memory) != VK_SUCCESS) {
+        ERROR("Failed to allocate %llu bytes of buffer memory", (unsigned long long) requirements.size);
+        vkDestroyBuffer(logical_device, *buffer, NULL);
+        *buffer = VK_NULL_HANDLE;
+        return false;
+    }
+    vkBindBufferMemory(logical_device, *buffer, *memory, 0);
+    return true;
+}
+
+VkCommandBuffer begin_single_time_commands() {
+    VkCommandBufferAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandPool = command_pool;
+    alloc_info.commandBufferCount = 1;
+
+    VkCommandBuffer cmd_buffer;
+    vkAllocateCommandBuffers(logical_device, &alloc_info, &cmd_buffer);
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(cmd_buffer, &begin_info);
+    return cmd_buffer;
+}
+
+void end_single_time_commands(VkCommandBuffer cmd_buffer) {
+    vkEndCommandBuffer(cmd_buffer);
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &cmd_buffer;
+    vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
+    vkQueueWaitIdle(graphics_queue);
+
+    vkFreeCommandBuffers(logical_device, command_pool, 1, &cmd_buffer);
+}
+
+// optional, the workers generate the terrain when the graphics queue can not compute
+static void create_density() {
+    uint32_t queue_family_count;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, NULL);
+    VkQueueFamilyProperties queue_family[queue_family_count];
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_family);
+    if (!(queue_family[queue_indices.graphics_family].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+        WARNING("The graphics queue has no compute, the terrain density stays on the workers");
+        return;
+    }
+    density_gpu_create(graphics_queue, queue_indices.graphics_family, streamer_generator(game.streamer));
+}
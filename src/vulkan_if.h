@@ -1,6 +1,7 @@
 #pragma once
 
 #include "defines.h"
+#include "pacing.h"
 #define GLFW_INCLUDE_VULKAN
 #include "GLFW/glfw3.h"
 #include <vulkan/vulkan.h>
@@ -13,14 +14,45 @@ typedef struct swap_chain {
     VkImageView *image_views;   // the view into the image
     VkFormat image_format;  
     VkExtent2D extent;      
+    VkImageUsageFlags usage;    // transfer source too when the surface allows it, for the readbacks
+    VkPresentModeKHR present_mode;
 } swap_chain_t;
 
 
 extern VkDevice logical_device;
 extern swap_chain_t swap_chain;
+extern VkPhysicalDeviceFeatures enabled_device_features; // optional features turned on at device creation
+extern struct FrameArena *frame_arena;  // per frame scratch of the render thread, see memory.h
+extern VkFormat depth_format;           // a float format when there is one, depth is reversed (near is 1)
+
+// what the renderer did during the last frame, the overlay shows it
+struct RenderStats {
+    uint32_t draw_calls;
+    uint64_t upload_bytes;      // written to GPU memory during the frame
+    uint32_t chunks_meshed;     // chunk meshes on the GPU
+    uint32_t chunks_visible;    // drawn during the frame
+    double wait_ms;             // blocked on the fence and the swap chain
+    double gpu_done;            // timer_now() when the previous frame was done on the GPU, estimated
+    double gpu_ms;              // between the timestamps of the previous frame, -1 without timestamps
+    int64_t fragments;          // fragment shader invocations of the previous frame, -1 without pipeline statistics
+    uint32_t sorts;             // translucent sections sorted on the workers, applied this frame
+    double sort_ms;             // worker time of those sorts
+};
+extern struct RenderStats render_stats;
 
 
 
 bool init_vulkan(GLFWwindow *window);
 void destroy_vulkan();
 void draw_frame();
+// before init_vulkan(), or later and the swap chain is made again. FIFO when the
+// surface does not have the mode, swap_chain.present_mode is the one in use
+void set_present_mode(enum present_mode mode);
+
+// index of a memory type in type_bits with all the properties, UINT32_MAX when there is none
+uint32_t find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags properties);
+bool create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+                   VkBuffer *buffer, VkDeviceMemory *memory);
+// one shot commands for the uploads at load time, end_ submits them and waits
+VkCommandBuffer begin_single_time_commands();
+void end_single_time_commands(VkCommandBuffer cmd_buffer);
@@ -1,8 +1,17 @@
 #include "window.h"
 #include "defines.h"
+#include "capture.h"
 #include "log.h"
+#include "overlay.h"
+#include "simulation.h"
+#include "streamer.h"
+#include "terrain.h"
+#include "timer.h"
 #include "vulkan_if.h"
 
+// ticks run in one frame at most, a slower frame rate slows the game down
+#define MAX_TICKS_PER_FRAME 5
+
 
 // the global window
 struct Window window;
@@ -13,6 +22,8 @@ static void error_callback(int error, const char *description) {
 }
 
 static void key_callback(GLFWwindow *_window, int key, int scancode, int action, int mods){
+    if (key < 0) return;    // GLFW_KEY_UNKNOWN
+    input_push(game.input, &(struct InputEvent) {.type = INPUT_EVENT_KEY, .code = key, .action = action});
     // if (key >0 && action == GLFW_PRESS) {
     //     window.keyboard.key[key].pressed = true;
     // } else {
@@ -25,6 +36,7 @@ static void key_callback(GLFWwindow *_window, int key, int scancode, int action,
 
 static void mouse_button_callback(GLFWwindow* _window, int button, int action, int mods)
 {
+    input_push(game.input, &(struct InputEvent) {.type = INPUT_EVENT_MOUSE_BUTTON, .code = button, .action = action});
     // if (button > 0 && action == GLFW_PRESS) {
     //     window.mouse.button[button].pressed = true;
     // } else {
@@ -34,17 +46,20 @@ static void mouse_button_callback(GLFWwindow* _window, int button, int action, i
 }
 
 static void cursor_position_callback(GLFWwindow* _window, double xpos, double ypos) {
+    input_push(game.input, &(struct InputEvent) {.type = INPUT_EVENT_CURSOR, .x = xpos, .y = ypos});
     window.mouse.position.x = xpos;
     window.mouse.position.y = ypos;
 }
 
 static void scroll_callback(GLFWwindow* _window, double xoffset, double yoffset)
 {
+    input_push(game.input, &(struct InputEvent) {.type = INPUT_EVENT_SCROLL, .x = xoffset, .y = yoffset});
     window.mouse.scroll.x = xoffset;
     window.mouse.scroll.y = yoffset;
 }
 
 static void cursor_enter_callback(GLFWwindow* _window, int entered) {
+    input_push(game.input, &(struct InputEvent) {.type = INPUT_EVENT_CURSOR_ENTER, .action = entered});
     window.mouse.is_inside = entered;
 }
 
@@ -82,13 +97,71 @@ bool window_create(int width, int height, const char *title) {
     return true;
 }
 
+// the simulation only sees the input through the ticks, so a replay is deterministic
+static void game_tick() {
+    input_tick(game.input, (uint32_t) game.simulation->tick, &game.input_state);
+    player_update(&game.player, &game.input_state, TICK_DT);
+    simulation_tick(game.simulation);
+}
+
 void window_loop() {
+    double next_tick = timer_now();
+    bool overlay_key = false;
+    bool depth_key = false;
+    bool present_key = false;
+    bool latency_key = false;
+    // what was asked for, an unsupported mode falls back to fifo and F5 goes on from here
+    enum present_mode present_mode = (enum present_mode) swap_chain.present_mode;
+    game.pacer.present_mode = present_mode;
+    uint64_t frames = 0;
  
     while (!glfwWindowShouldClose(window.handle))
     {
+        pacer_begin_frame(&game.pacer);
+        double frame_start = timer_now();
         glfwPollEvents();
+
+        if (capture_enabled()) {
+            // a tick per frame, what a tick shows does not depend on the frame rate
+            game_tick();
+            capture_tick(game.simulation->tick);
+        } else {
+            int ticks = 0;
+            while (frame_start >= next_tick && ticks < MAX_TICKS_PER_FRAME) {
+                game_tick();
+                next_tick += TICK_DT;
+                ticks++;
+            }
+            if (frame_start >= next_tick) next_tick = frame_start;
+        }
+
+        // on the press only, holding F3 does not flicker
+        if (window.keyboard.key[GLFW_KEY_F3].pressed && !overlay_key) overlay_toggle();
+        overlay_key = window.keyboard.key[GLFW_KEY_F3].pressed;
+        if (window.keyboard.key[GLFW_KEY_F4].pressed && !depth_key) {
+            terrain_set_depth_mode((terrain_depth_mode() + 1) % DEPTH_MODE_COUNT);
+        }
+        depth_key = window.keyboard.key[GLFW_KEY_F4].pressed;
+        if (window.keyboard.key[GLFW_KEY_F5].pressed && !present_key) {
+            present_mode = (present_mode + 1) % PRESENT_MODE_COUNT;
+            set_present_mode(present_mode);
+            game.pacer.present_mode = (enum present_mode) swap_chain.present_mode;
+        }
+        present_key = window.keyboard.key[GLFW_KEY_F5].pressed;
+        if (window.keyboard.key[GLFW_KEY_F6].pressed && !latency_key) {
+            pacer_set_latency_mode(&game.pacer, (game.pacer.latency_mode + 1) % LATENCY_MODE_COUNT);
+        }
+        latency_key = window.keyboard.key[GLFW_KEY_F6].pressed;
+
+        streamer_update(game.streamer, game.player.x, game.player.z);
+
         draw_frame();
-        glfwSetWindowShouldClose(window.handle, window.keyboard.key[GLFW_KEY_Q].pressed);
+        pacer_end_frame(&game.pacer, render_stats.wait_ms / 1000.0, render_stats.gpu_done);
+        double frame_time = timer_now() - frame_start;
+        if (frames++ == 0) INFO("STARTUP first frame %.1f ms after launch", (timer_now() - game.start) * 1000.0);
+        frame_log_add(&game.frames, game.simulation->tick, frame_time);
+        overlay_add_frame(frame_time);
+        glfwSetWindowShouldClose(window.handle, window.keyboard.key[GLFW_KEY_Q].pressed || input_replay_done(game.input));
 
         if (window.keyboard.key[GLFW_KEY_ESCAPE].pressed && glfwGetInputMode(window.handle, GLFW_CURSOR) == GLFW_CURSOR_DISABLED) {
             glfwSetInputMode(window.handle, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
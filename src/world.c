@@ -0,0 +1,295 @@
+#include "world.h"
+#include "log.h"
+#include "memory.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// a block array with its reference count in front
+struct BlockArray {
+    int refs;
+    block_t blocks[SECTION_VOLUME];
+};
+
+static struct BlockArray *block_array(block_t *blocks) {
+    return (struct BlockArray *) ((char *) blocks - offsetof(struct BlockArray, blocks));
+}
+
+static block_t *blocks_alloc() {
+    struct BlockArray *array = memory_alloc(sizeof(*array), MEMORY_TAG_WORLD);
+    if (array == NULL) {
+        FATAL("WORLD out of memory allocating a section");
+        return NULL;
+    }
+    array->refs = 1;
+    return array->blocks;
+}
+
+void section_blocks_retain(block_t *blocks) {
+    if (blocks != NULL) __atomic_add_fetch(&block_array(blocks)->refs, 1, __ATOMIC_RELAXED);
+}
+
+void section_blocks_release(block_t *blocks) {
+    if (blocks == NULL) return;
+    struct BlockArray *array = block_array(blocks);
+    if (__atomic_sub_fetch(&array->refs, 1, __ATOMIC_ACQ_REL) == 0) memory_free(array);
+}
+
+// open addressing table of chunk pointers, linear probing.
+// Grows when it is more than half full
+struct World {
+    struct Chunk **slots;
+    uint32_t capacity;      // power of two
+    uint32_t count;
+};
+
+static uint32_t hash_chunk(int32_t x, int32_t z) {
+    uint32_t h = (uint32_t) x * 0x9E3779B1u ^ (uint32_t) z * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+struct World *world_create() {
+    struct World *world = memory_calloc(1, sizeof(*world), MEMORY_TAG_WORLD);
+    if (world == NULL) {
+        FATAL("WORLD failed to allocate the world");
+        return NULL;
+    }
+    world->capacity = 1024;
+    world->slots = memory_calloc(world->capacity, sizeof(*world->slots), MEMORY_TAG_WORLD);
+    if (world->slots == NULL) {
+        FATAL("WORLD failed to allocate the chunk table");
+        memory_free(world);
+        return NULL;
+    }
+    return world;
+}
+
+void chunk_free(struct Chunk *chunk) {
+    if (chunk == NULL) return;
+    for (int i=0; i<CHUNK_SECTIONS; i++) {
+        section_blocks_release(chunk->sections[i].blocks);
+    }
+    memory_free(chunk);
+}
+
+void world_destroy(struct World *world) {
+    if (world == NULL) return;
+    for (uint32_t i=0; i<world->capacity; i++) {
+        chunk_free(world->slots[i]);
+    }
+    memory_free(world->slots);
+    memory_free(world);
+}
+
+static uint32_t find_slot(struct World *world, int32_t x, int32_t z) {
+    uint32_t mask = world->capacity - 1;
+    uint32_t slot = hash_chunk(x, z) & mask;
+    while (world->slots[slot] != NULL) {
+        if (world->slots[slot]->x == x && world->slots[slot]->z == z) break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static bool grow(struct World *world) {
+    uint32_t old_capacity = world->capacity;
+    struct Chunk **old_slots = world->slots;
+
+    struct Chunk **slots = memory_calloc(old_capacity * 2, sizeof(*slots), MEMORY_TAG_WORLD);
+    if (slots == NULL) return false;
+    world->slots = slots;
+    world->capacity = old_capacity * 2;
+
+    for (uint32_t i=0; i<old_capacity; i++) {
+        if (old_slots[i] != NULL) {
+            world->slots[find_slot(world, old_slots[i]->x, old_slots[i]->z)] = old_slots[i];
+        }
+    }
+    memory_free(old_slots);
+    return true;
+}
+
+struct Chunk *world_get_chunk(struct World *world, int32_t chunk_x, int32_t chunk_z) {
+    return world->slots[find_slot(world, chunk_x, chunk_z)];
+}
+
+struct Chunk *chunk_create(int32_t chunk_x, int32_t chunk_z) {
+    struct Chunk *chunk = memory_calloc(1, sizeof(*chunk), MEMORY_TAG_WORLD);
+    if (chunk == NULL) {
+        FATAL("WORLD out of memory allocating chunk %d,%d", chunk_x, chunk_z);
+        return NULL;
+    }
+    chunk->x = chunk_x;
+    chunk->z = chunk_z;
+    chunk->recount = (1u << CHUNK_SECTIONS) - 1;
+    return chunk;
+}
+
+bool world_insert_chunk(struct World *world, struct Chunk *chunk) {
+    uint32_t slot = find_slot(world, chunk->x, chunk->z);
+    if (world->slots[slot] != NULL) return false;
+
+    if ((world->count + 1) * 2 > world->capacity) {
+        if (!grow(world)) {
+            FATAL("WORLD out of memory growing the chunk table");
+            return false;
+        }
+        slot = find_slot(world, chunk->x, chunk->z);
+    }
+    world->slots[slot] = chunk;
+    world->count++;
+    return true;
+}
+
+struct Chunk *world_create_chunk(struct World *world, int32_t chunk_x, int32_t chunk_z) {
+    struct Chunk *chunk = world_get_chunk(world, chunk_x, chunk_z);
+    if (chunk != NULL) return chunk;
+
+    chunk = chunk_create(chunk_x, chunk_z);
+    if (chunk == NULL) return NULL;
+    if (!world_insert_chunk(world, chunk)) {
+        chunk_free(chunk);
+        return NULL;
+    }
+    return chunk;
+}
+
+void world_remove_chunk(struct World *world, int32_t chunk_x, int32_t chunk_z) {
+    uint32_t mask = world->capacity - 1;
+    uint32_t slot = find_slot(world, chunk_x, chunk_z);
+    if (world->slots[slot] == NULL) return;
+
+    chunk_free(world->slots[slot]);
+    world->slots[slot] = NULL;
+    world->count--;
+
+    // backward shift the entries after the hole so the probe chains stay intact
+    uint32_t hole = slot;
+    uint32_t next = (slot + 1) & mask;
+    while (world->slots[next] != NULL) {
+        uint32_t home = hash_chunk(world->slots[next]->x, world->slots[next]->z) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            world->slots[hole] = world->slots[next];
+            world->slots[next] = NULL;
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+uint32_t world_chunk_count(struct World *world) {
+    return world->count;
+}
+
+uint64_t world_memory_usage(struct World *world) {
+    uint64_t bytes = sizeof(*world) + (uint64_t) world->capacity * sizeof(*world->slots);
+    for (uint32_t i=0; i<world->capacity; i++) {
+        struct Chunk *chunk = world->slots[i];
+        if (chunk == NULL) continue;
+        bytes += sizeof(*chunk);
+        for (int s=0; s<CHUNK_SECTIONS; s++) {
+            if (chunk->sections[s].blocks != NULL) bytes += SECTION_VOLUME * sizeof(block_t);
+        }
+    }
+    return bytes;
+}
+
+struct Chunk *world_next_chunk(struct World *world, uint32_t *cursor) {
+    while (*cursor < world->capacity) {
+        struct Chunk *chunk = world->slots[(*cursor)++];
+        if (chunk != NULL) return chunk;
+    }
+    return NULL;
+}
+
+block_t section_get(const struct Section *section, int x, int y, int z) {
+    if (section->blocks == NULL) return section->single;
+    return section->blocks[section_index(x, y, z)];
+}
+
+block_t *section_write_blocks(struct Section *section) {
+    if (section->blocks == NULL) {
+        // first different block, the section needs its own array
+        block_t *blocks = blocks_alloc();
+        if (blocks == NULL) return NULL;
+        for (int i=0; i<SECTION_VOLUME; i++) {
+            blocks[i] = section->single;
+        }
+        section->blocks = blocks;
+    } else if (__atomic_load_n(&block_array(section->blocks)->refs, __ATOMIC_ACQUIRE) > 1) {
+        // a snapshot still reads this one, leave it alone
+        block_t *blocks = blocks_alloc();
+        if (blocks == NULL) return NULL;
+        memcpy(blocks, section->blocks, SECTION_VOLUME * sizeof(block_t));
+        section_blocks_release(section->blocks);
+        section->blocks = blocks;
+    }
+    return section->blocks;
+}
+
+void section_set(struct Section *section, int x, int y, int z, block_t block) {
+    if (section->blocks == NULL && section->single == block) return;
+    block_t *blocks = section_write_blocks(section);
+    if (blocks == NULL) return;
+    blocks[section_index(x, y, z)] = block;
+}
+
+void section_fill(struct Section *section, block_t block) {
+    section_blocks_release(section->blocks);
+    section->blocks = NULL;
+    section->single = block;
+}
+
+void section_compact(struct Section *section) {
+    if (section->blocks == NULL) return;
+    block_t first = section->blocks[0];
+    for (int i=1; i<SECTION_VOLUME; i++) {
+        if (section->blocks[i] != first) return;
+    }
+    section_fill(section, first);
+}
+
+block_t world_get_block(struct World *world, int32_t x, int32_t y, int32_t z) {
+    if (y < 0 || y >= WORLD_HEIGHT) return BLOCK_AIR;
+    struct Chunk *chunk = world_get_chunk(world, block_to_chunk(x), block_to_chunk(z));
+    if (chunk == NULL) return BLOCK_AIR;
+    return section_get(&chunk->sections[y >> SECTION_SHIFT], x & SECTION_MASK, y & SECTION_MASK, z & SECTION_MASK);
+}
+
+void world_set_block(struct World *world, int32_t x, int32_t y, int32_t z, block_t block) {
+    if (y < 0 || y >= WORLD_HEIGHT) return;
+    struct Chunk *chunk = world_get_chunk(world, block_to_chunk(x), block_to_chunk(z));
+    if (chunk == NULL) return;
+
+    int section = y >> SECTION_SHIFT;
+    section_set(&chunk->sections[section], x & SECTION_MASK, y & SECTION_MASK, z & SECTION_MASK, block);
+    chunk->dirty |= 1u << section;
+    chunk->unsaved |= 1u << section;
+    chunk->recount |= 1u << section;
+    chunk->changed[section] = ++chunk->version;
+}
+
+void block_access_init(struct BlockAccess *access, struct World *world) {
+    access->world = world;
+    access->chunk = world_get_chunk(world, 0, 0);
+    access->chunk_x = 0;
+    access->chunk_z = 0;
+}
+
+block_t block_access_get(struct BlockAccess *access, int32_t x, int32_t y, int32_t z) {
+    if (y < 0 || y >= WORLD_HEIGHT) return BLOCK_AIR;
+
+    int32_t chunk_x = block_to_chunk(x);
+    int32_t chunk_z = block_to_chunk(z);
+    if (chunk_x != access->chunk_x || chunk_z != access->chunk_z) {
+        access->chunk = world_get_chunk(access->world, chunk_x, chunk_z);
+        access->chunk_x = chunk_x;
+        access->chunk_z = chunk_z;
+    }
+    if (access->chunk == NULL) return BLOCK_AIR;
+    return section_get(&access->chunk->sections[y >> SECTION_SHIFT], x & SECTION_MASK, y & SECTION_MASK, z & SECTION_MASK);
+}
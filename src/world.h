@@ -0,0 +1,96 @@
+// Block storage.
+// The world is a hash map of chunk columns, a column is a stack of 16x16x16 sections.
+// A section made of a single block type (air above ground, stone deep down)
+// does not allocate its block array.
+// Block arrays are reference counted so a save snapshot can share them with
+// the live world: writing to a shared array copies it first (copy on write).
+
+#pragma once
+
+#include "block.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SECTION_SIZE    16                      // blocks per side of a section
+#define SECTION_SHIFT   4
+#define SECTION_MASK    (SECTION_SIZE - 1)
+#define SECTION_VOLUME  (SECTION_SIZE * SECTION_SIZE * SECTION_SIZE)
+#define CHUNK_SECTIONS  16                      // sections stacked in a chunk column
+#define WORLD_HEIGHT    (SECTION_SIZE * CHUNK_SECTIONS)
+
+struct Section {
+    block_t *blocks;    // SECTION_VOLUME blocks, x fastest then z then y. NULL when uniform.
+                        // Read it directly, write through section_write_blocks()
+    block_t single;     // the block filling the whole section when blocks is NULL
+};
+
+struct Chunk {
+    int32_t x, z;                               // chunk coordinates (block >> SECTION_SHIFT)
+    struct Section sections[CHUNK_SECTIONS];
+    uint32_t dirty;                             // one bit per section changed since the last mesh
+    uint32_t unsaved;                           // one bit per section changed since the last save
+    uint32_t recount;                           // one bit per section changed since the random ticks looked at it
+    uint32_t ticking;                           // one bit per section holding random tick blocks, when last looked at
+    uint32_t version;                           // counts the blocks set, a client with an older copy gets it again
+    uint32_t changed[CHUNK_SECTIONS];           // version at the last block set in each section, those newer than
+                                                // the copy of a client are the ones it gets again
+};
+
+struct World;
+
+// Caches the last chunk looked up, so reading the blocks around a point
+// costs one hash lookup per chunk instead of one per block
+struct BlockAccess {
+    struct World *world;
+    struct Chunk *chunk;
+    int32_t chunk_x, chunk_z;
+};
+
+static inline uint32_t section_index(int x, int y, int z) {
+    return ((uint32_t) y << (2 * SECTION_SHIFT)) | ((uint32_t) z << SECTION_SHIFT) | (uint32_t) x;
+}
+
+// floor division for block -> chunk coordinates, works for negatives
+static inline int32_t block_to_chunk(int32_t v) {
+    return v >> SECTION_SHIFT;
+}
+
+struct World *world_create();
+void world_destroy(struct World *world);
+
+struct Chunk *world_get_chunk(struct World *world, int32_t chunk_x, int32_t chunk_z);
+// returns the existing chunk or a new all-air one
+struct Chunk *world_create_chunk(struct World *world, int32_t chunk_x, int32_t chunk_z);
+// a chunk from chunk_create(), owned by the world from now on. False when the world
+// already has a chunk there (this one stays the caller's) or out of memory
+bool world_insert_chunk(struct World *world, struct Chunk *chunk);
+void world_remove_chunk(struct World *world, int32_t chunk_x, int32_t chunk_z);
+uint32_t world_chunk_count(struct World *world);
+// bytes held by the chunk table, the chunks and their block arrays
+uint64_t world_memory_usage(struct World *world);
+// iterate the loaded chunks, *cursor starts at 0. NULL when done
+struct Chunk *world_next_chunk(struct World *world, uint32_t *cursor);
+
+// blocks outside the loaded chunks read as air, writes to them are dropped
+block_t world_get_block(struct World *world, int32_t x, int32_t y, int32_t z);
+void world_set_block(struct World *world, int32_t x, int32_t y, int32_t z, block_t block);
+
+block_t section_get(const struct Section *section, int x, int y, int z);
+void section_set(struct Section *section, int x, int y, int z, block_t block);
+void section_fill(struct Section *section, block_t block);
+// the section's array ready for writing: a uniform section gets one filled
+// with its block, an array shared with a snapshot is copied. NULL out of memory
+block_t *section_write_blocks(struct Section *section);
+// free the block array when every block is the same
+void section_compact(struct Section *section);
+// an all-air chunk outside any world
+struct Chunk *chunk_create(int32_t chunk_x, int32_t chunk_z);
+void chunk_free(struct Chunk *chunk);
+
+// reference counting of the block arrays, thread safe
+void section_blocks_retain(block_t *blocks);
+void section_blocks_release(block_t *blocks);
+
+void block_access_init(struct BlockAccess *access, struct World *world);
+block_t block_access_get(struct BlockAccess *access, int32_t x, int32_t y, int32_t z);
@@ -0,0 +1,280 @@
+#include "worldgen.h"
+#include "noise.h"
+#include "log.h"
+
+#include <stddef.h>
+
+#define DIRT_DEPTH      4
+#define CAVE_MIN_Y      5       // lava would go under here, for now just stone
+#define CAVE_ROOF       8       // ground kept over the caves, trees never stand over a hole
+#define CAVE_CELL       4       // the cave noise is sampled every 4 blocks and interpolated
+#define CAVE_THRESHOLD  0.28f
+#define TREE_TRIES      WORLDGEN_MAX_TREES
+
+int32_t worldgen_height(int32_t x, int32_t z, uint32_t seed) {
+    // broad hills plus some detail
+    float hills = fbm2(x / 256.0f, z / 256.0f, 4, seed);
+    float detail = fbm2(x / 32.0f, z / 32.0f, 2, seed + 101);
+    int32_t height = SEA_LEVEL + 2 + (int32_t) (hills * 40.0f + detail * 4.0f);
+    if (height < 1) height = 1;
+    if (height > WORLD_HEIGHT - 1) height = WORLD_HEIGHT - 1;
+    return height;
+}
+
+enum biome worldgen_biome(int32_t x, int32_t z, uint32_t seed) {
+    float temperature = fbm2(x / 512.0f, z / 512.0f, 2, seed + 202);
+    float humidity = fbm2(x / 512.0f, z / 512.0f, 2, seed + 303);
+    if (temperature > 0.15f && humidity < 0.0f) return BIOME_DESERT;
+    if (humidity > 0.1f) return BIOME_FOREST;
+    return BIOME_PLAINS;
+}
+
+static block_t column_block(int32_t y, int32_t height) {
+    if (y == 0) return BLOCK_BEDROCK;
+    if (y < height) return BLOCK_STONE;
+    if (y <= SEA_LEVEL) return BLOCK_WATER;
+    return BLOCK_AIR;
+}
+
+void worldgen_stage_noise(struct Chunk *chunk, int32_t chunk_x, int32_t chunk_z, struct WorldgenColumns *columns, uint32_t seed) {
+    columns->min_height = WORLD_HEIGHT;
+    columns->max_height = 0;
+    for (int z=0; z<SECTION_SIZE; z++) {
+        for (int x=0; x<SECTION_SIZE; x++) {
+            int32_t h = worldgen_height(chunk_x * SECTION_SIZE + x, chunk_z * SECTION_SIZE + z, seed);
+            columns->heights[z][x] = (int16_t) h;
+            if (h < columns->min_height) columns->min_height = h;
+            if (h > columns->max_height) columns->max_height = h;
+        }
+    }
+    if (chunk == NULL) return;
+    int32_t top = columns->max_height > SEA_LEVEL + 1 ? columns->max_height : SEA_LEVEL + 1;
+
+    for (int s=0; s<CHUNK_SECTIONS; s++) {
+        struct Section *section = &chunk->sections[s];
+        int32_t y0 = s * SECTION_SIZE;
+
+        // whole sections of stone or air do not need an array
+        if (y0 > 0 && y0 + SECTION_SIZE <= columns->min_height) {
+            section_fill(section, BLOCK_STONE);
+            continue;
+        }
+        if (y0 >= top) {
+            section_fill(section, BLOCK_AIR);
+            continue;
+        }
+
+        block_t *blocks = section_write_blocks(section);
+        if (blocks == NULL) return;
+        for (int y=0; y<SECTION_SIZE; y++) {
+            for (int z=0; z<SECTION_SIZE; z++) {
+                for (int x=0; x<SECTION_SIZE; x++) {
+                    blocks[section_index(x, y, z)] = column_block(y0 + y, columns->heights[z][x]);
+                }
+            }
+        }
+        section_compact(section);
+    }
+}
+
+void worldgen_stage_caves(struct Chunk *chunk, const struct WorldgenColumns *columns, uint32_t seed) {
+    enum { CELLS = SECTION_SIZE / CAVE_CELL + 1, LAYERS = WORLD_HEIGHT / CAVE_CELL + 1 };
+    int32_t cave_top = columns->max_height - CAVE_ROOF;
+    if (cave_top <= CAVE_MIN_Y) return;
+
+    // the noise on the corners of 4x4x4 cells, up to the highest cave
+    float lattice[LAYERS][CELLS][CELLS];
+    int layers = cave_top / CAVE_CELL + 2;
+    if (layers > LAYERS) layers = LAYERS;
+    for (int ly=0; ly<layers; ly++) {
+        for (int lz=0; lz<CELLS; lz++) {
+            for (int lx=0; lx<CELLS; lx++) {
+                float wx = (float) (chunk->x * SECTION_SIZE + lx * CAVE_CELL);
+                float wz = (float) (chunk->z * SECTION_SIZE + lz * CAVE_CELL);
+                lattice[ly][lz][lx] = fbm3(wx / 64.0f, (float) (ly * CAVE_CELL) / 32.0f, wz / 64.0f, 2, seed + 404);
+            }
+        }
+    }
+
+    for (int s=0; s<CHUNK_SECTIONS; s++) {
+        int32_t y0 = s * SECTION_SIZE;
+        if (y0 + SECTION_SIZE <= CAVE_MIN_Y) continue;
+        if (y0 >= cave_top) break;
+
+        // an interpolated value is never above the cell corners: most sections have no cave at all
+        float highest = -1.0f;
+        for (int ly=y0 / CAVE_CELL; ly<=(y0 + SECTION_SIZE) / CAVE_CELL && ly<layers; ly++) {
+            for (int lz=0; lz<CELLS; lz++) {
+                for (int lx=0; lx<CELLS; lx++) {
+                    if (lattice[ly][lz][lx] > highest) highest = lattice[ly][lz][lx];
+                }
+            }
+        }
+        if (highest <= CAVE_THRESHOLD) continue;
+
+        struct Section *section = &chunk->sections[s];
+        block_t *blocks = section_write_blocks(section);
+        if (blocks == NULL) return;
+        for (int y=0; y<SECTION_SIZE; y++) {
+            int32_t wy = y0 + y;
+            if (wy < CAVE_MIN_Y || wy >= cave_top) continue;
+            int ly = wy / CAVE_CELL;
+            float fy = (float) (wy % CAVE_CELL) * (1.0f / CAVE_CELL);
+            for (int z=0; z<SECTION_SIZE; z++) {
+                int lz = z / CAVE_CELL;
+                float fz = (float) (z % CAVE_CELL) * (1.0f / CAVE_CELL);
+                for (int x=0; x<SECTION_SIZE; x++) {
+                    if (wy >= columns->heights[z][x] - CAVE_ROOF) continue;
+                    int lx = x / CAVE_CELL;
+                    float fx = (float) (x % CAVE_CELL) * (1.0f / CAVE_CELL);
+
+                    float c00 = lattice[ly][lz][lx]         + (lattice[ly][lz][lx + 1]         - lattice[ly][lz][lx])         * fx;
+                    float c10 = lattice[ly][lz + 1][lx]     + (lattice[ly][lz + 1][lx + 1]     - lattice[ly][lz + 1][lx])     * fx;
+                    float c01 = lattice[ly + 1][lz][lx]     + (lattice[ly + 1][lz][lx + 1]     - lattice[ly + 1][lz][lx])     * fx;
+                    float c11 = lattice[ly + 1][lz + 1][lx] + (lattice[ly + 1][lz + 1][lx + 1] - lattice[ly + 1][lz + 1][lx]) * fx;
+                    float c0 = c00 + (c10 - c00) * fz;
+                    float c1 = c01 + (c11 - c01) * fz;
+                    if (c0 + (c1 - c0) * fy > CAVE_THRESHOLD) blocks[section_index(x, y, z)] = BLOCK_AIR;
+                }
+            }
+        }
+        section_compact(section);
+    }
+}
+
+void worldgen_stage_biomes(int32_t chunk_x, int32_t chunk_z, struct WorldgenColumns *columns, uint32_t seed) {
+    for (int z=0; z<SECTION_SIZE; z++) {
+        for (int x=0; x<SECTION_SIZE; x++) {
+            columns->biomes[z][x] = (uint8_t) worldgen_biome(chunk_x * SECTION_SIZE + x, chunk_z * SECTION_SIZE + z, seed);
+        }
+    }
+}
+
+void worldgen_stage_surface(struct Chunk *chunk, const struct WorldgenColumns *columns) {
+    int32_t bottom = columns->min_height - DIRT_DEPTH;
+    if (bottom < 1) bottom = 1;
+    for (int s=bottom / SECTION_SIZE; s<CHUNK_SECTIONS; s++) {
+        int32_t y0 = s * SECTION_SIZE;
+        if (y0 >= columns->max_height) break;
+
+        block_t *blocks = section_write_blocks(&chunk->sections[s]);
+        if (blocks == NULL) return;
+        for (int z=0; z<SECTION_SIZE; z++) {
+            for (int x=0; x<SECTION_SIZE; x++) {
+                int32_t height = columns->heights[z][x];
+                // beaches and deserts are sand all the way down
+                bool sand = height <= SEA_LEVEL + 1 || columns->biomes[z][x] == BIOME_DESERT;
+                for (int y=0; y<SECTION_SIZE; y++) {
+                    int32_t wy = y0 + y;
+                    if (wy < height - DIRT_DEPTH || wy < 1) continue;
+                    if (wy >= height) break;
+                    block_t block = sand ? BLOCK_SAND : wy == height - 1 ? BLOCK_GRASS : BLOCK_DIRT;
+                    blocks[section_index(x, y, z)] = block;
+                }
+            }
+        }
+        section_compact(&chunk->sections[s]);
+    }
+}
+
+static uint32_t hash_chunk(int32_t x, int32_t z, uint32_t seed) {
+    uint32_t h = (uint32_t) x * 0x9E3779B1u ^ (uint32_t) z * 0x85EBCA77u ^ seed * 0xC2B2AE3Du;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+uint32_t worldgen_stage_trees(int32_t chunk_x, int32_t chunk_z, const struct WorldgenColumns *columns, uint32_t seed,
+                              struct Tree trees[WORLDGEN_MAX_TREES]) {
+    // out of 256, per try
+    static const uint32_t chance[BIOME_COUNT] = {
+        [BIOME_PLAINS] = 24,
+        [BIOME_FOREST] = 256,
+        [BIOME_DESERT] = 0,
+    };
+    uint32_t count = 0;
+    uint32_t rng = hash_chunk(chunk_x, chunk_z, seed);
+    for (int i=0; i<TREE_TRIES; i++) {
+        rng = rng * 1664525u + 1013904223u;
+        uint32_t bits = rng ^ rng >> 16;
+        int x = bits & SECTION_MASK, z = (bits >> 4) & SECTION_MASK;
+        uint32_t height = 4 + (bits >> 8) % 3;
+        uint32_t roll = (bits >> 16) & 0xff;
+
+        int32_t wx = chunk_x * SECTION_SIZE + x, wz = chunk_z * SECTION_SIZE + z;
+        int32_t ground = columns != NULL ? columns->heights[z][x] : worldgen_height(wx, wz, seed);
+        // beaches and water
+        if (ground <= SEA_LEVEL + 1 || ground + (int32_t) height + 1 >= WORLD_HEIGHT) continue;
+        enum biome biome = columns != NULL ? columns->biomes[z][x] : worldgen_biome(wx, wz, seed);
+        if (roll >= chance[biome]) continue;
+
+        trees[count++] = (struct Tree) {.x = (uint8_t) x, .z = (uint8_t) z, .height = (uint8_t) height, .y = (int16_t) ground};
+    }
+    return count;
+}
+
+// leaves only fill air and logs go through leaves, so the order trees are placed in does not matter
+static void place(struct Chunk *chunk, int x, int y, int z, block_t block) {
+    if (x < 0 || x >= SECTION_SIZE || z < 0 || z >= SECTION_SIZE) return;
+    struct Section *section = &chunk->sections[y >> SECTION_SHIFT];
+    block_t old = section_get(section, x, y & SECTION_MASK, z);
+    if (old == BLOCK_AIR || (block == BLOCK_LOG && old == BLOCK_LEAVES)) {
+        section_set(section, x, y & SECTION_MASK, z, block);
+    }
+}
+
+static void place_tree(struct Chunk *chunk, const struct Tree *tree, int x, int z) {
+    int top = tree->y + tree->height - 1;
+    for (int y=top - 2; y<=top + 1; y++) {
+        int radius = y < top ? TREE_RADIUS : 1;
+        for (int dz=-radius; dz<=radius; dz++) {
+            for (int dx=-radius; dx<=radius; dx++) {
+                // round the corners, the top is a cross
+                bool corner = (dx == -radius || dx == radius) && (dz == -radius || dz == radius);
+                if (corner && (radius == TREE_RADIUS || y > top)) continue;
+                place(chunk, x + dx, y, z + dz, BLOCK_LEAVES);
+            }
+        }
+    }
+    for (int y=tree->y; y<=top; y++) place(chunk, x, y, z, BLOCK_LOG);
+}
+
+void worldgen_stage_decorate(struct Chunk *chunk, const struct Tree *const trees[9], const uint32_t counts[9]) {
+    for (int n=0; n<9; n++) {
+        int offset_x = (n % 3 - 1) * SECTION_SIZE, offset_z = (n / 3 - 1) * SECTION_SIZE;
+        for (uint32_t i=0; i<counts[n]; i++) {
+            int x = trees[n][i].x + offset_x, z = trees[n][i].z + offset_z;
+            if (x < -TREE_RADIUS || x >= SECTION_SIZE + TREE_RADIUS || z < -TREE_RADIUS || z >= SECTION_SIZE + TREE_RADIUS) continue;
+            place_tree(chunk, &trees[n][i], x, z);
+        }
+    }
+}
+
+void worldgen_fill_chunk(struct Chunk *chunk, uint32_t seed) {
+    struct WorldgenColumns columns;
+    worldgen_stage_noise(chunk, chunk->x, chunk->z, &columns, seed);
+    worldgen_stage_caves(chunk, &columns, seed);
+    worldgen_stage_biomes(chunk->x, chunk->z, &columns, seed);
+    worldgen_stage_surface(chunk, &columns);
+
+    // the neighbors' trees come from the noise, the generator keeps them from their own trees stage
+    struct Tree trees[9][WORLDGEN_MAX_TREES];
+    const struct Tree *lists[9];
+    uint32_t counts[9];
+    for (int n=0; n<9; n++) {
+        counts[n] = worldgen_stage_trees(chunk->x + n % 3 - 1, chunk->z + n / 3 - 1, n == 4 ? &columns : NULL, seed, trees[n]);
+        lists[n] = trees[n];
+    }
+    worldgen_stage_decorate(chunk, lists, counts);
+
+    chunk->dirty = (1u << CHUNK_SECTIONS) - 1;
+    chunk->unsaved = (1u << CHUNK_SECTIONS) - 1;
+}
+
+struct Chunk *worldgen_generate_chunk(struct World *world, int32_t chunk_x, int32_t chunk_z, uint32_t seed) {
+    struct Chunk *chunk = world_create_chunk(world, chunk_x, chunk_z);
+    if (chunk == NULL) return NULL;
+    worldgen_fill_chunk(chunk, seed);
+    return chunk;
+}
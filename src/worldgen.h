@@ -0,0 +1,61 @@
+// Terrain generator, in stages:
+//   noise      height map, stone up to it and water up to the sea
+//   caves      3D noise carved out of the stone, under the surface layers
+//   biomes     plains, forest or desert from two low frequency noises
+//   surface    grass, dirt and sand by biome
+//   trees      where the trees of the chunk stand
+//   decorate   places the trees of the chunk and of its 8 neighbors, leaves cross the borders
+// Only decorate reads other chunks (their trees). generator.h runs the stages
+// across chunks and keeps their results; worldgen_fill_chunk() runs them all on
+// one chunk and works the neighbors' trees out again from the noise. Both give
+// the same blocks. Noise and caves are the density stages, shaders/density.comp
+// runs the same operations on the GPU (density_gpu.h).
+
+#pragma once
+
+#include "world.h"
+
+#include <stdint.h>
+
+#define SEA_LEVEL           62
+#define WORLDGEN_MAX_TREES  6   // per chunk
+#define TREE_RADIUS         2   // leaves reach this far from the trunk
+
+enum biome {
+    BIOME_PLAINS = 0,
+    BIOME_FOREST,
+    BIOME_DESERT,
+    BIOME_COUNT
+};
+
+struct Tree {
+    uint8_t x, z;       // in the chunk
+    uint8_t height;     // of the trunk
+    int16_t y;          // first block of the trunk, on top of the ground
+};
+
+// what the stages know about each column of a chunk
+struct WorldgenColumns {
+    int16_t heights[SECTION_SIZE][SECTION_SIZE];    // first block above the ground, [z][x]
+    uint8_t biomes[SECTION_SIZE][SECTION_SIZE];
+    int32_t min_height, max_height;
+};
+
+int32_t worldgen_height(int32_t x, int32_t z, uint32_t seed);
+enum biome worldgen_biome(int32_t x, int32_t z, uint32_t seed);
+
+// the stages in order, chunk NULL only fills the columns
+void worldgen_stage_noise(struct Chunk *chunk, int32_t chunk_x, int32_t chunk_z, struct WorldgenColumns *columns, uint32_t seed);
+void worldgen_stage_caves(struct Chunk *chunk, const struct WorldgenColumns *columns, uint32_t seed);
+void worldgen_stage_biomes(int32_t chunk_x, int32_t chunk_z, struct WorldgenColumns *columns, uint32_t seed);
+void worldgen_stage_surface(struct Chunk *chunk, const struct WorldgenColumns *columns);
+// columns NULL works the heights and biomes it needs out from the noise. Returns the tree count
+uint32_t worldgen_stage_trees(int32_t chunk_x, int32_t chunk_z, const struct WorldgenColumns *columns, uint32_t seed,
+                              struct Tree trees[WORLDGEN_MAX_TREES]);
+// trees and counts of the 3x3 chunks around this one, row by row from -1,-1
+void worldgen_stage_decorate(struct Chunk *chunk, const struct Tree *const trees[9], const uint32_t counts[9]);
+
+// fills an existing chunk, only touches that chunk so chunks can be filled in parallel
+void worldgen_fill_chunk(struct Chunk *chunk, uint32_t seed);
+// creates (or overwrites) the chunk column and fills it
+struct Chunk *worldgen_generate_chunk(struct World *world, int32_t chunk_x, int32_t chunk_z, uint32_t seed);
@@ -0,0 +1,213 @@
+// Turns data/blocks.txt into block_table.c: the bitsets and arrays of block.h
+// for the built in blocks, checked against enum block_id when compiled.
+// With --glsl it writes the ids and colors of the blocks for the shaders instead.
+//
+//   blockgen blocks.txt block_table.c
+//   blockgen --glsl blocks.txt blocks.glsl
+
+#include "block.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NAME_LENGTH 32
+
+struct Block {
+    char name[NAME_LENGTH];
+    uint32_t flags;
+    unsigned light;
+    uint32_t color;         // RRGGBBAA
+    unsigned faces[FACE_COUNT];
+};
+
+static const char *FLAG_NAMES[BLOCK_FLAG_COUNT] = {
+    [BLOCK_FLAG_SOLID]       = "solid",
+    [BLOCK_FLAG_OPAQUE]      = "opaque",
+    [BLOCK_FLAG_CUTOUT]      = "cutout",
+    [BLOCK_FLAG_TRANSLUCENT] = "translucent",
+    [BLOCK_FLAG_LIQUID]      = "liquid",
+    [BLOCK_FLAG_FALLS]       = "falls",
+    [BLOCK_FLAG_RANDOM_TICK] = "ticks",
+};
+
+static const char *FLAG_ENUMS[BLOCK_FLAG_COUNT] = {
+    [BLOCK_FLAG_SOLID]       = "BLOCK_FLAG_SOLID",
+    [BLOCK_FLAG_OPAQUE]      = "BLOCK_FLAG_OPAQUE",
+    [BLOCK_FLAG_CUTOUT]      = "BLOCK_FLAG_CUTOUT",
+    [BLOCK_FLAG_TRANSLUCENT] = "BLOCK_FLAG_TRANSLUCENT",
+    [BLOCK_FLAG_LIQUID]      = "BLOCK_FLAG_LIQUID",
+    [BLOCK_FLAG_FALLS]       = "BLOCK_FLAG_FALLS",
+    [BLOCK_FLAG_RANDOM_TICK] = "BLOCK_FLAG_RANDOM_TICK",
+};
+
+static struct Block blocks[BLOCK_MAX];
+static int count;
+
+static bool parse_flags(char *text, uint32_t *flags) {
+    *flags = 0;
+    if (strcmp(text, "-") == 0) return true;
+    for (char *flag = strtok(text, ","); flag != NULL; flag = strtok(NULL, ",")) {
+        int f = 0;
+        while (f < BLOCK_FLAG_COUNT && strcmp(flag, FLAG_NAMES[f]) != 0) f++;
+        if (f == BLOCK_FLAG_COUNT) return false;
+        *flags |= 1u << f;
+    }
+    return true;
+}
+
+// name flags light color faces, false on a malformed line
+static bool parse_line(char *line, struct Block *block) {
+    char name[NAME_LENGTH], flags[128], color[16];
+    unsigned faces[FACE_COUNT];
+    int read = sscanf(line, "%31s %127s %u %15s %u %u %u %u %u %u", name, flags, &block->light, color,
+                      &faces[0], &faces[1], &faces[2], &faces[3], &faces[4], &faces[5]);
+    if (read != 5 && read != 10) return false;
+    if (block->light > BLOCK_MAX_LIGHT || !parse_flags(flags, &block->flags)) return false;
+    char *end;
+    block->color = (uint32_t) strtoul(color, &end, 16);
+    if (strlen(color) != 8 || *end != '\0') return false;
+    for (int f=0; f<FACE_COUNT; f++) {
+        block->faces[f] = read == 5 ? faces[0] : faces[f];
+        if (block->faces[f] > UINT8_MAX) return false;
+    }
+    strcpy(block->name, name);
+    return true;
+}
+
+static bool read_blocks(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "blockgen: can not open %s\n", path);
+        return false;
+    }
+    char line[256];
+    int number = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file) != NULL) {
+        number++;
+        char *start = line;
+        while (isspace((unsigned char) *start)) start++;
+        if (*start == '\0' || *start == '#') continue;
+        if (count == BLOCK_MAX || !parse_line(start, &blocks[count])) {
+            fprintf(stderr, "%s:%d: expected name flags light color faces\n", path, number);
+            ok = false;
+        } else if ((blocks[count].flags & BLOCK_LAYER_FLAGS) == BLOCK_LAYER_FLAGS) {
+            // the mesher puts a block in one layer
+            fprintf(stderr, "%s:%d: %s is either cutout or translucent\n", path, number, blocks[count].name);
+            ok = false;
+        }
+        count++;
+    }
+    fclose(file);
+    return ok;
+}
+
+static void enum_name(const char *name, char *out) {
+    strcpy(out, "BLOCK_");
+    out += strlen(out);
+    for (; *name; name++) *out++ = (char) toupper((unsigned char) *name);
+    *out = '\0';
+}
+
+static bool write_table(const char *path, const char *source) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "blockgen: can not write %s\n", path);
+        return false;
+    }
+    char id[NAME_LENGTH + 8];
+    const char *slash = strrchr(source, '/');
+    fprintf(file, "// Generated by tools/blockgen.c from data/%s, edit that file instead\n\n", slash ? slash + 1 : source);
+    fprintf(file, "#include \"block.h\"\n\n");
+
+    // a block missing from the enum or out of order fails the build
+    fprintf(file, "#define CHECK(name, value) typedef char check_##name[(name) == (value) ? 1 : -1];\n");
+    for (int i=0; i<count; i++) {
+        enum_name(blocks[i].name, id);
+        fprintf(file, "CHECK(%s, %d)\n", id, i);
+    }
+    fprintf(file, "CHECK(BLOCK_COUNT, %d)\n\n", count);
+
+    fprintf(file, "struct BlockTables block_tables = {\n");
+    fprintf(file, "    .flags = {\n");
+    for (int f=0; f<BLOCK_FLAG_COUNT; f++) {
+        uint64_t words[BLOCK_WORDS] = {0};
+        for (int i=0; i<count; i++) {
+            if (blocks[i].flags & (1u << f)) words[i >> 6] |= 1ull << (i & 63);
+        }
+        fprintf(file, "        [%s] = {", FLAG_ENUMS[f]);
+        for (int w=0; w<BLOCK_WORDS; w++) {
+            fprintf(file, "%s0x%016llxull", w ? ", " : "", (unsigned long long) words[w]);
+        }
+        fprintf(file, "},\n");
+    }
+    fprintf(file, "    },\n");
+
+    fprintf(file, "    .light = {\n");
+    for (int i=0; i<count; i++) {
+        enum_name(blocks[i].name, id);
+        fprintf(file, "        [%s] = %u,\n", id, blocks[i].light);
+    }
+    fprintf(file, "    },\n");
+
+    fprintf(file, "    .faces = {\n");
+    for (int i=0; i<count; i++) {
+        enum_name(blocks[i].name, id);
+        fprintf(file, "        [%s] = {", id);
+        for (int f=0; f<FACE_COUNT; f++) fprintf(file, "%s%u", f ? ", " : "", blocks[i].faces[f]);
+        fprintf(file, "},\n");
+    }
+    fprintf(file, "    },\n");
+
+    fprintf(file, "    .names = {\n");
+    for (int i=0; i<count; i++) {
+        enum_name(blocks[i].name, id);
+        fprintf(file, "        [%s] = \"%s\",\n", id, blocks[i].name);
+    }
+    fprintf(file, "    },\n");
+    fprintf(file, "    .count = BLOCK_COUNT,\n");
+    fprintf(file, "};\n");
+    return fclose(file) == 0;
+}
+
+// the same ids as enum block_id and the colors the block shaders draw with
+static bool write_glsl(const char *path, const char *source) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "blockgen: can not write %s\n", path);
+        return false;
+    }
+    char id[NAME_LENGTH + 8];
+    const char *slash = strrchr(source, '/');
+    fprintf(file, "// Generated by tools/blockgen.c from data/%s, edit that file instead\n\n", slash ? slash + 1 : source);
+    for (int i=0; i<count; i++) {
+        enum_name(blocks[i].name, id);
+        fprintf(file, "const uint %s = %du;\n", id, i);
+    }
+    fprintf(file, "const int BLOCK_COUNT = %d;\n\n", count);
+
+    // alpha is used by the translucent pass only
+    fprintf(file, "const vec4 BLOCK_COLORS[BLOCK_COUNT] = vec4[](\n");
+    for (int i=0; i<count; i++) {
+        uint32_t c = blocks[i].color;
+        fprintf(file, "    vec4(%.4f, %.4f, %.4f, %.4f)%s // %s\n", (c >> 24) / 255.0, (c >> 16 & 0xff) / 255.0,
+                (c >> 8 & 0xff) / 255.0, (c & 0xff) / 255.0, i + 1 < count ? ", " : "  ", blocks[i].name);
+    }
+    fprintf(file, ");\n");
+    return fclose(file) == 0;
+}
+
+int main(int argc, char **argv) {
+    bool glsl = argc == 4 && strcmp(argv[1], "--glsl") == 0;
+    if (argc != 3 && !glsl) {
+        fprintf(stderr, "usage: blockgen blocks.txt block_table.c\n"
+                        "       blockgen --glsl blocks.txt blocks.glsl\n");
+        return EXIT_FAILURE;
+    }
+    const char *source = argv[glsl ? 2 : 1], *output = argv[glsl ? 3 : 2];
+    if (!read_blocks(source)) return EXIT_FAILURE;
+    if (!(glsl ? write_glsl(output, source) : write_table(output, source))) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}